@@ -0,0 +1,794 @@
+/**
+ * SandboxBench.cpp -- Benchmarks for the sandbox library
+ *
+ * @file SandboxBench.cpp
+ * Run with --benchmark_out=<file> --benchmark_out_format=json (or build the SandboxBenchJson target) to
+ * keep a machine-readable record for comparing releases.
+ * This file is part of the SandboxRunner project.
+ */
+
+#include "../SandboxRunnerCore/Sandbox.h"
+#include "../SandboxRunnerCore/Logger.h"
+#include "../SandboxRunnerCore/Metrics.h"
+#include "../SandboxRunnerCore/Linux/SecurePolicy.h"
+#include "../SandboxRunnerCore/Linux/SpoolQueue.h"
+#include "../SandboxRunnerCore/Linux/SubmissionRing.h"
+#include "../SandboxRunnerCore/Policy/PolicyRegistry.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr long SYSCALLS_PER_RUN            = 200000;
+constexpr std::string_view COLD_PROBE_FLAG = "--cold-probe";
+
+std::filesystem::path gBenchDirectory;
+
+struct BenchPolicy
+{
+    std::string Label;
+    std::string Policy;
+};
+
+std::string GetLogFile()
+{
+    return (gBenchDirectory / "sandbox.log").string();
+}
+
+double ToSeconds(Clock::duration duration)
+{
+    return std::chrono::duration<double>(duration).count();
+}
+
+// Write CXX_PROGRAM.json with a different FilterLayout, so only the filter shape differs from the built-in one.
+std::string WriteLayoutVariant(const std::string &layout)
+{
+    std::ifstream input(std::filesystem::path(SANDBOX_BENCH_POLICY_DIR) / "CXX_PROGRAM.json");
+    auto root = nlohmann::json::parse(input);
+    root.at("Seccomp")["FilterLayout"] = layout;
+
+    const auto path = gBenchDirectory / ("CXX_PROGRAM_" + layout + ".json");
+    std::ofstream output(path);
+    output << root.dump(4);
+    return path.string();
+}
+
+// How the open variant of CXX_PROGRAM confines the files it opens.
+enum class OpenConfinement
+{
+    None,
+    PathRules,  // Landlock, see PathAccessRules
+    Supervisor, // Every open asks the seccomp supervisor, see SupervisorRules
+};
+
+// CXX_PROGRAM allowed to open files, optionally confined to the system directories.
+std::string WriteOpenVariant(OpenConfinement confinement)
+{
+    std::ifstream input(std::filesystem::path(SANDBOX_BENCH_POLICY_DIR) / "CXX_PROGRAM.json");
+    auto root = nlohmann::json::parse(input);
+    root.at("Seccomp").at("WhiteList").push_back("openat");
+    auto rules = nlohmann::json::array();
+    for (const auto *systemPath : {"/usr", "/lib", "/lib64", "/etc"})
+        rules.push_back({{"PathPrefix", systemPath}, {"Mode", "ReadOnly"}});
+
+    std::string name = "CXX_PROGRAM_Open.json";
+    if (confinement == OpenConfinement::PathRules)
+    {
+        root["PathAccessRules"] = rules;
+        name                    = "CXX_PROGRAM_PathRules.json";
+    }
+    else if (confinement == OpenConfinement::Supervisor)
+    {
+        root.at("Seccomp")["Supervisor"]["OpenPathRules"] = rules;
+        name                                            = "CXX_PROGRAM_Supervised.json";
+    }
+
+    const auto path = gBenchDirectory / name;
+    std::ofstream output(path);
+    output << root.dump(4);
+    return path.string();
+}
+
+/**
+ * @brief ExpectedAccepted from the test samples, configured the same way as in SandboxTest
+ */
+class AcceptedRun
+{
+public:
+    explicit AcceptedRun(const std::string &tag)
+        : _executable((std::filesystem::path(SANDBOX_BENCH_SAMPLES_DIR) / "Samples" / "ExpectedAccepted").string()),
+          _inputFile((std::filesystem::path(SANDBOX_BENCH_SAMPLES_DIR) / "TestData" / "test_data.in").string()),
+          _outputFile((gBenchDirectory / ("ExpectedAccepted_" + tag + ".out")).string()),
+          _logFile(GetLogFile())
+    {
+        _configuration.TaskName        = "SandboxBench";
+        _configuration.UserCommand     = _executable.c_str();
+        _configuration.InputFile       = _inputFile.c_str();
+        _configuration.OutputFile      = _outputFile.c_str();
+        _configuration.LogFile         = _logFile.c_str();
+        _configuration.MaxRealTime     = 3000;
+        _configuration.MaxMemory       = 128 * 1024 * 1024;
+        _configuration.MaxCpuTime      = 1000;
+        _configuration.MaxOutputSize   = 10 * 1024;
+        _configuration.MaxProcessCount = 0;
+        _configuration.Policy          = "CXX_PROGRAM";
+    }
+
+    bool Run() const
+    {
+        SandboxResult result{};
+        return StartSandbox(&_configuration, &result) == SANDBOX_STATUS_SUCCESS
+               && result.Status == SANDBOX_STATUS_SUCCESS;
+    }
+
+    bool Run(SandboxResultEx &result, const SandboxConfigurationEx *extension = nullptr) const
+    {
+        return StartSandboxEx(&_configuration, extension, &result) == SANDBOX_STATUS_SUCCESS
+               && result.Result.Status == SANDBOX_STATUS_SUCCESS;
+    }
+
+    // The same program started with plain fork/execve, no limits, no filter and no monitor.
+    bool RunUnsandboxed() const
+    {
+        const pid_t pid = fork();
+        if (pid < 0)
+            return false;
+
+        if (pid == 0)
+        {
+            const int input  = open(_inputFile.c_str(), O_RDONLY);
+            const int output = open(_outputFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (input < 0 || output < 0 || dup2(input, STDIN_FILENO) < 0 || dup2(output, STDOUT_FILENO) < 0)
+                _exit(127);
+
+            char *const argv[] = {const_cast<char *>(_executable.c_str()), nullptr};
+            execv(_executable.c_str(), argv);
+            _exit(127);
+        }
+
+        int status = 0;
+        return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+private:
+    std::string _executable;
+    std::string _inputFile;
+    std::string _outputFile;
+    std::string _logFile;
+    SandboxConfiguration _configuration{};
+};
+
+// Runs in a freshly executed SandboxBench: nothing is initialized or paged in yet.
+int RunColdProbe()
+{
+    const AcceptedRun run("cold");
+    const auto begin   = Clock::now();
+    const bool success = run.Run();
+    const auto elapsed = Clock::now() - begin;
+
+    std::printf("%.9f\n", ToSeconds(elapsed));
+    return success ? 0 : 1;
+}
+
+/**
+ * @brief Latency of the first StartSandbox call in a new process
+ * @remarks Each iteration executes a new SandboxBench process, so logger setup, policy lookup and the
+ * first-touch page faults of the library are included. The time is measured inside that process.
+ */
+void BM_StartSandboxCold(benchmark::State &state)
+{
+    const auto command = std::filesystem::read_symlink("/proc/self/exe").string() + " " + std::string(COLD_PROBE_FLAG)
+                         + " " + gBenchDirectory.string();
+
+    for (auto _ : state)
+    {
+        FILE *probe = popen(command.c_str(), "r");
+        double seconds = 0;
+        const bool parsed = probe != nullptr && std::fscanf(probe, "%lf", &seconds) == 1;
+        if (probe == nullptr || pclose(probe) != 0 || !parsed)
+        {
+            state.SkipWithError("cold probe failed");
+            break;
+        }
+        state.SetIterationTime(seconds);
+    }
+}
+BENCHMARK(BM_StartSandboxCold)->UseManualTime()->Unit(benchmark::kMicrosecond)->Iterations(10);
+
+void BM_StartSandboxWarm(benchmark::State &state)
+{
+    const AcceptedRun run("warm");
+    if (!run.Run())
+    {
+        state.SkipWithError("ExpectedAccepted did not succeed");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        if (!run.Run())
+        {
+            state.SkipWithError("ExpectedAccepted did not succeed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_StartSandboxWarm)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief A run answered by the result cache: key hashing, index lookup and output restore, compare with
+ * BM_StartSandboxWarm
+ */
+void BM_ResultCacheReplay(benchmark::State &state)
+{
+    const AcceptedRun run("cached");
+    const std::string cacheFile = (gBenchDirectory / "results.idx").string();
+    SandboxConfigurationEx extension{};
+    extension.StructSize      = sizeof(SandboxConfigurationEx);
+    extension.Version         = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.ResultCacheFile = cacheFile.c_str();
+
+    SandboxResultEx result{};
+    result.StructSize = sizeof(SandboxResultEx);
+    if (!run.Run(result, &extension))
+    {
+        state.SkipWithError("ExpectedAccepted did not succeed");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        if (!run.Run(result, &extension) || result.FromResultCache == 0)
+        {
+            state.SkipWithError("The run was not replayed from the result cache");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_ResultCacheReplay)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief BM_StartSandboxWarm with the program executed from its cached memfd copy instead of its path
+ */
+void BM_StartSandboxExecutableCache(benchmark::State &state)
+{
+    const AcceptedRun run("memfd");
+    SandboxConfigurationEx extension{};
+    extension.StructSize      = sizeof(SandboxConfigurationEx);
+    extension.Version         = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.CacheExecutable = 1;
+
+    SandboxResultEx result{};
+    result.StructSize = sizeof(SandboxResultEx);
+    for (auto _ : state)
+    {
+        if (!run.Run(result, &extension) || result.FromExecutableCache == 0)
+        {
+            state.SkipWithError("ExpectedAccepted did not run from the executable cache");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_StartSandboxExecutableCache)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief BM_StartSandboxWarm isolated in all namespaces, created at launch (pool size 0) or joined warm
+ * @remarks "pooled" is the share of runs that found a warm set; the pool refills in the background.
+ */
+void BM_StartSandboxNamespaces(benchmark::State &state)
+{
+    const AcceptedRun run("namespaces");
+    SetSandboxNamespacePoolSize(static_cast<uint32_t>(state.range(0)));
+    SandboxConfigurationEx extension{};
+    extension.StructSize = sizeof(SandboxConfigurationEx);
+    extension.Version    = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.Namespaces = SANDBOX_NAMESPACE_USER | SANDBOX_NAMESPACE_MOUNT | SANDBOX_NAMESPACE_PID
+                           | SANDBOX_NAMESPACE_NET | SANDBOX_NAMESPACE_IPC;
+
+    SandboxResultEx result{};
+    result.StructSize = sizeof(SandboxResultEx);
+    uint64_t pooled   = 0;
+    for (auto _ : state)
+    {
+        if (!run.Run(result, &extension))
+        {
+            state.SkipWithError("ExpectedAccepted did not succeed in namespaces");
+            break;
+        }
+        pooled += result.FromNamespacePool;
+    }
+    state.counters["pooled"] = benchmark::Counter(static_cast<double>(pooled), benchmark::Counter::kAvgIterations);
+    SetSandboxNamespacePoolSize(2); // The default
+}
+BENCHMARK(BM_StartSandboxNamespaces)->Arg(0)->Arg(2)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief BM_StartSandboxWarm in a 16 MiB tmpfs scratch directory, mounted and torn down by every run
+ */
+void BM_StartSandboxScratch(benchmark::State &state)
+{
+    const AcceptedRun run("scratch");
+    SandboxConfigurationEx extension{};
+    extension.StructSize  = sizeof(SandboxConfigurationEx);
+    extension.Version     = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.ScratchSize = 16 * 1024 * 1024;
+
+    SandboxResultEx result{};
+    result.StructSize = sizeof(SandboxResultEx);
+    for (auto _ : state)
+    {
+        if (!run.Run(result, &extension))
+        {
+            state.SkipWithError("ExpectedAccepted did not succeed in a scratch directory");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_StartSandboxScratch)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief Completed runs per second with several sandboxes started concurrently from one process
+ */
+void BM_Throughput(benchmark::State &state)
+{
+    const AcceptedRun run("thread" + std::to_string(state.thread_index()));
+
+    for (auto _ : state)
+    {
+        if (!run.Run())
+        {
+            state.SkipWithError("ExpectedAccepted did not succeed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Throughput)
+    ->ThreadRange(1, static_cast<int>(std::max(2U, std::thread::hardware_concurrency())))
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief BM_Throughput with every run queued through a spool directory shared by N runners
+ * @remarks Each thread is a runner with a queue of its own, as separate runner processes would have.
+ * It submits a job and processes whichever job it claims first. spool_overhead_us is the time of a
+ * processed job outside the sandboxed run: the claim, the lease renewal and writing the result.
+ */
+void BM_SpoolQueue(benchmark::State &state)
+{
+    const AcceptedRun run("spool" + std::to_string(state.thread_index()));
+    const SpoolQueue queue(gBenchDirectory / "spool", std::chrono::seconds(30));
+    const std::string prefix = "job-" + std::to_string(state.thread_index()) + "-";
+    uint64_t submitted = 0, processed = 0;
+    Clock::duration overhead{};
+
+    for (auto _ : state)
+    {
+        bool succeeded = true;
+        Clock::duration runTime{};
+        queue.Submit(prefix + std::to_string(submitted++) + ".json", "");
+        const auto begin = Clock::now();
+        const bool found = queue.Process([&](const std::string &) {
+            const auto runBegin = Clock::now();
+            succeeded           = run.Run();
+            runTime             = Clock::now() - runBegin;
+            return std::string("{}");
+        });
+        if (!succeeded)
+        {
+            state.SkipWithError("ExpectedAccepted did not succeed");
+            break;
+        }
+        if (found)
+        {
+            overhead += Clock::now() - begin - runTime;
+            ++processed;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(processed));
+    state.counters["spool_overhead_us"] =
+        benchmark::Counter(ToSeconds(overhead) * 1e6 / static_cast<double>(std::max<uint64_t>(processed, 1)));
+}
+BENCHMARK(BM_SpoolQueue)
+    ->ThreadRange(1, static_cast<int>(std::max(2U, std::thread::hardware_concurrency())))
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief A batch of N submissions through a shared-memory ring and back, with no run behind them
+ * @remarks The runner side is a thread that completes each submission as it takes it, so this is the cost
+ * the ring adds to every run: queueing both ways and waking a sleeping side. ring_ns is that cost per run.
+ */
+void BM_RingRoundTrip(benchmark::State &state)
+{
+    const std::string name = "bench-" + std::to_string(getpid());
+    const auto runner      = SubmissionRing::Create(name);
+    const auto client      = SubmissionRing::Open(name);
+    if (runner == nullptr || client == nullptr)
+    {
+        state.SkipWithError("Failed to create the ring");
+        return;
+    }
+    std::thread echo([&runner] {
+        SandboxRingSubmission submission{};
+        while (runner->Take(submission))
+        {
+            SandboxRingCompletion completion{};
+            completion.UserData = submission.UserData;
+            if (!runner->Complete(completion))
+                return;
+        }
+    });
+
+    const auto batch = static_cast<uint32_t>(state.range(0));
+    const SandboxRingSubmission submission{.UserData = 0, .ConfigId = 0, .InputId = SANDBOX_RING_NO_FILE,
+                                           .OutputId = SANDBOX_RING_NO_FILE, .Reserved = 0};
+    std::vector<SandboxRingSubmission> submissions(batch, submission);
+    std::vector<SandboxRingCompletion> completions(batch);
+    const auto begin = Clock::now();
+    for (auto _ : state)
+    {
+        uint32_t submitted = 0, reaped = 0;
+        while (reaped < batch)
+        {
+            submitted += client->Submit(submissions.data() + submitted, batch - submitted);
+            reaped += client->Reap(completions.data() + reaped, batch - reaped, std::chrono::milliseconds(1000));
+        }
+    }
+    const auto elapsed = Clock::now() - begin;
+    runner->Stop();
+    echo.join();
+
+    const auto runs = static_cast<uint64_t>(state.iterations()) * batch;
+    state.SetItemsProcessed(static_cast<int64_t>(runs));
+    state.counters["ring_ns"] =
+        benchmark::Counter(ToSeconds(elapsed) * 1e9 / static_cast<double>(std::max<uint64_t>(runs, 1)));
+}
+BENCHMARK(BM_RingRoundTrip)->RangeMultiplier(8)->Range(1, 512)->UseRealTime();
+
+/**
+ * @brief Where the time of a warm run goes, from the timeline reported by StartSandboxEx
+ * @remarks baseline_us is the same program started with plain fork/execve/wait, for comparison with
+ * the whole sandboxed run (the iteration time).
+ */
+void BM_LaunchBreakdown(benchmark::State &state)
+{
+    const AcceptedRun run("breakdown");
+    uint64_t prepare = 0, fork = 0, childSetup = 0, exec = 0, program = 0, reap = 0;
+    Clock::duration baseline{};
+
+    for (auto _ : state)
+    {
+        const auto begin       = Clock::now();
+        const bool unsandboxed = run.RunUnsandboxed();
+        baseline += Clock::now() - begin;
+
+        SandboxResultEx result{};
+        result.StructSize = sizeof(SandboxResultEx);
+        if (!unsandboxed || !run.Run(result))
+        {
+            state.SkipWithError("ExpectedAccepted did not succeed");
+            break;
+        }
+
+        const auto &timeline = result.Timeline;
+        prepare += timeline.ForkStart - timeline.PrepareStart;
+        fork += timeline.ForkDone - timeline.ForkStart;
+        childSetup += timeline.ExecStart - timeline.ChildSetupStart;
+        exec += timeline.ExecDone - timeline.ExecStart;
+        program += timeline.Exit - timeline.ExecDone;
+        reap += timeline.Reaped - timeline.Exit;
+        state.SetIterationTime(static_cast<double>(timeline.Reaped - timeline.PrepareStart) * 1e-9);
+    }
+
+    const auto toMicroseconds = [](double nanoseconds) {
+        return benchmark::Counter(nanoseconds / 1000.0, benchmark::Counter::kAvgIterations);
+    };
+    state.counters["prepare_us"]     = toMicroseconds(static_cast<double>(prepare));
+    state.counters["fork_us"]        = toMicroseconds(static_cast<double>(fork));
+    state.counters["child_setup_us"] = toMicroseconds(static_cast<double>(childSetup));
+    state.counters["exec_us"]        = toMicroseconds(static_cast<double>(exec));
+    state.counters["run_us"]         = toMicroseconds(static_cast<double>(program));
+    state.counters["reap_us"]        = toMicroseconds(static_cast<double>(reap));
+    state.counters["baseline_us"]    = toMicroseconds(ToSeconds(baseline) * 1e9);
+}
+BENCHMARK(BM_LaunchBreakdown)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief CPU time of this process while many sandboxes sleep, with and without live sampling
+ * @remarks Arguments: concurrent sandboxes, sample interval in ms (0 = off). The sandboxed programs
+ * only sleep, so cpu_pct is almost entirely supervisor and sampler work; the sampler's share is the
+ * difference between the two interval settings.
+ */
+void BM_SamplingOverhead(benchmark::State &state)
+{
+    const auto sandboxes  = static_cast<size_t>(state.range(0));
+    const auto intervalMs = static_cast<uint32_t>(state.range(1));
+    const std::string logFile = GetLogFile();
+    double cpuPercent = 0;
+
+    for (auto _ : state)
+    {
+        rusage before{}, after{};
+        getrusage(RUSAGE_SELF, &before);
+        const auto begin = Clock::now();
+
+        std::vector<std::thread> threads;
+        std::atomic<bool> failed{false};
+        for (size_t i = 0; i < sandboxes; ++i)
+        {
+            threads.emplace_back([&] {
+                SandboxConfiguration configuration{};
+                configuration.TaskName        = "SandboxBench";
+                configuration.UserCommand     = "/bin/sleep 0.5";
+                configuration.LogFile         = logFile.c_str();
+                configuration.MaxProcessCount = -1;
+                configuration.Policy          = "default";
+
+                std::vector<SandboxSample> samples(64);
+                SandboxConfigurationEx extension{};
+                extension.StructSize       = sizeof(SandboxConfigurationEx);
+                extension.Version          = SANDBOX_CONFIGURATION_EX_VERSION;
+                extension.SampleIntervalMs = intervalMs;
+                extension.SampleCapacity   = static_cast<uint32_t>(samples.size());
+                extension.Samples          = samples.data();
+
+                SandboxResultEx result{};
+                result.StructSize = sizeof(SandboxResultEx);
+                if (StartSandboxEx(&configuration, &extension, &result) != SANDBOX_STATUS_SUCCESS
+                    || result.Result.Status != SANDBOX_STATUS_SUCCESS)
+                    failed = true;
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+
+        const double wall = ToSeconds(Clock::now() - begin);
+        getrusage(RUSAGE_SELF, &after);
+        const auto cpu = [](const rusage &usage) {
+            return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+                   + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+        };
+        if (failed)
+        {
+            state.SkipWithError("/bin/sleep did not succeed");
+            break;
+        }
+        cpuPercent += 100.0 * (cpu(after) - cpu(before)) / wall;
+    }
+
+    state.counters["cpu_pct"] = benchmark::Counter(cpuPercent, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_SamplingOverhead)
+    ->Args({64, 0})
+    ->Args({64, 10})
+    ->Iterations(3)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+void BM_PolicyResolveBuiltin(benchmark::State &state)
+{
+    for (auto _ : state)
+    {
+        SandboxPolicyEngine::SandboxPolicy storage;
+        benchmark::DoNotOptimize(SandboxPolicyEngine::TryResolvePolicyNoCache("CXX_PROGRAM", storage));
+    }
+}
+BENCHMARK(BM_PolicyResolveBuiltin);
+
+void BM_PolicyResolveFile(benchmark::State &state)
+{
+    const auto policyFile = WriteLayoutVariant("Linear");
+    for (auto _ : state)
+    {
+        SandboxPolicyEngine::SandboxPolicy storage;
+        benchmark::DoNotOptimize(SandboxPolicyEngine::TryResolvePolicyNoCache(policyFile, storage));
+    }
+}
+BENCHMARK(BM_PolicyResolveFile);
+
+void BM_PolicyResolveCached(benchmark::State &state)
+{
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(SandboxPolicyEngine::TryResolvePolicy("CXX_PROGRAM"));
+    }
+}
+BENCHMARK(BM_PolicyResolveCached);
+
+/**
+ * @brief Time to turn a resolved policy into a BPF program, per filter layout
+ */
+void BM_PolicyCompile(benchmark::State &state)
+{
+    using SandboxPolicyEngine::FilterLayout;
+    constexpr FilterLayout kLayouts[] = {FilterLayout::Linear, FilterLayout::BinaryTree, FilterLayout::Frequency};
+    constexpr const char *kLayoutNames[] = {"Linear", "BinaryTree", "Frequency"};
+
+    auto policy   = SandboxPolicyEngine::ResolvePolicy("CXX_PROGRAM");
+    policy.Layout = kLayouts[state.range(0)];
+    state.SetLabel(kLayoutNames[state.range(0)]);
+
+    const int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    for (auto _ : state)
+    {
+        if (!ExportLinuxSecurePolicy("/bin/true", policy, devNull))
+        {
+            state.SkipWithError("failed to compile policy");
+            break;
+        }
+    }
+    close(devNull);
+}
+BENCHMARK(BM_PolicyCompile)->DenseRange(0, 2);
+
+/**
+ * @brief Cost of one timing calibration, paid by the first calibrated run and then once a minute
+ */
+void BM_TimingCalibration(benchmark::State &state)
+{
+    double speedFactor = 0;
+    double timingNoise = 0;
+    for (auto _ : state)
+        CalibrateSandboxTiming(&speedFactor, &timingNoise);
+    state.counters["speed_factor"] = speedFactor;
+    state.counters["noise_pct"]    = timingNoise * 100;
+}
+BENCHMARK(BM_TimingCalibration)->Unit(benchmark::kMillisecond)->Iterations(5);
+
+void BM_LoggerInfo(benchmark::State &state)
+{
+    int64_t sequence = 0;
+    for (auto _ : state)
+    {
+        Logger::Info("Benchmark message {0} from thread {1}", sequence++, state.thread_index());
+    }
+}
+BENCHMARK(BM_LoggerInfo)->ThreadRange(1, 4)->UseRealTime();
+
+/**
+ * @brief Cost of recording one run's counter and duration, as every run does several times
+ */
+void BM_MetricsRecord(benchmark::State &state)
+{
+    uint64_t ns = 1000;
+    for (auto _ : state)
+    {
+        MetricsRegistry::Instance().Increment(MetricCounter::Launches);
+        MetricsRegistry::Instance().Observe(MetricHistogram::RunTime, ns);
+        ns = ns * 33 % 1'000'000'007;
+    }
+}
+BENCHMARK(BM_MetricsRecord)->ThreadRange(1, 4)->UseRealTime();
+
+/**
+ * @brief Average cost of one syscall made by a sandboxed program
+ * @remarks Each iteration is one sandbox run of SyscallLoop; the reported time is the per-call time
+ * measured inside the sandbox, so process creation and filter loading are excluded.
+ */
+void BM_SyscallOverhead(benchmark::State &state, const BenchPolicy &policy, const std::string &syscall)
+{
+    const auto outputFile = (gBenchDirectory / (policy.Label + "_" + syscall + ".out")).string();
+    const auto logFile    = GetLogFile();
+    const auto command    = std::string(SANDBOX_BENCH_SYSCALL_LOOP) + " " + syscall + " " + std::to_string(SYSCALLS_PER_RUN);
+
+    SandboxConfiguration configuration{};
+    configuration.TaskName        = "SandboxBench";
+    configuration.UserCommand     = command.c_str();
+    configuration.InputFile       = "/dev/null";
+    configuration.OutputFile      = outputFile.c_str();
+    configuration.LogFile         = logFile.c_str();
+    configuration.MaxMemory       = 256 * 1024 * 1024;
+    configuration.MaxCpuTime      = 10000;
+    configuration.MaxRealTime     = 20000;
+    configuration.MaxProcessCount = 0;
+    configuration.Policy          = policy.Policy.c_str();
+
+    for (auto _ : state)
+    {
+        SandboxResult result{};
+        if (StartSandbox(&configuration, &result) != SANDBOX_STATUS_SUCCESS || result.Status != SANDBOX_STATUS_SUCCESS)
+        {
+            state.SkipWithError("sandboxed SyscallLoop did not succeed");
+            break;
+        }
+
+        double nanosecondsPerCall = 0;
+        std::ifstream(outputFile) >> nanosecondsPerCall;
+        state.SetIterationTime(nanosecondsPerCall * 1e-9);
+    }
+}
+
+void RegisterSyscallOverheadBenchmarks()
+{
+    const std::vector<BenchPolicy> policies = {
+        {"default", "default"},
+        {"CXX_PROGRAM", "CXX_PROGRAM"},
+        {"CXX_PROGRAM_Linear", WriteLayoutVariant("Linear")},
+        {"CXX_PROGRAM_BinaryTree", WriteLayoutVariant("BinaryTree")},
+    };
+
+    for (const auto &policy : policies)
+    {
+        for (const std::string syscall : {"read", "write", "brk", "getpid", "getrandom"})
+        {
+            benchmark::RegisterBenchmark(("SyscallOverhead/" + policy.Label + "/" + syscall).c_str(), BM_SyscallOverhead,
+                                         policy, syscall)
+                ->UseManualTime()
+                ->Unit(benchmark::kNanosecond)
+                ->Iterations(5);
+        }
+    }
+
+    // Landlock checks every path walk of a confined process, other syscalls are not affected. Under the
+    // supervisor each open is a round trip to the supervisor thread instead.
+    const std::vector<BenchPolicy> openPolicies = {
+        {"CXX_PROGRAM_Open", WriteOpenVariant(OpenConfinement::None)},
+        {"CXX_PROGRAM_PathRules", WriteOpenVariant(OpenConfinement::PathRules)},
+        {"CXX_PROGRAM_Supervised", WriteOpenVariant(OpenConfinement::Supervisor)},
+    };
+    for (const auto &policy : openPolicies)
+    {
+        for (const std::string syscall : {"read", "openat"})
+        {
+            benchmark::RegisterBenchmark(("SyscallOverhead/" + policy.Label + "/" + syscall).c_str(), BM_SyscallOverhead,
+                                         policy, syscall)
+                ->UseManualTime()
+                ->Unit(benchmark::kNanosecond)
+                ->Iterations(5);
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && argv[1] == COLD_PROBE_FLAG)
+    {
+        gBenchDirectory = argv[2];
+        return RunColdProbe();
+    }
+
+    gBenchDirectory = std::filesystem::temp_directory_path() / ("sandbox-bench-" + std::to_string(getpid()));
+    std::filesystem::create_directories(gBenchDirectory);
+
+    // The first initialization wins, so every run below logs to the same file as BM_LoggerInfo.
+    Logger::Initialize("SandboxBench", GetLogFile().c_str(), Logger::LoggerLevel::Debug);
+    RegisterSyscallOverheadBenchmarks();
+
+    benchmark::AddCustomContext("sandbox_version", std::to_string(MAJOR_VERSION(Sandbox::GetVersion())) + "."
+                                                       + std::to_string(MINOR_VERSION(Sandbox::GetVersion())) + "."
+                                                       + std::to_string(PATCH_VERSION(Sandbox::GetVersion())));
+    benchmark::Initialize(&argc, argv);
+    const bool invalidArguments = benchmark::ReportUnrecognizedArguments(argc, argv);
+    if (!invalidArguments)
+    {
+        benchmark::RunSpecifiedBenchmarks();
+    }
+    benchmark::Shutdown();
+
+    std::error_code errorCode;
+    std::filesystem::remove_all(gBenchDirectory, errorCode);
+    return invalidArguments ? 1 : 0;
+}
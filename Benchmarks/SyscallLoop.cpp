@@ -0,0 +1,66 @@
+/**
+ * SyscallLoop.cpp -- Sandboxed workload for SandboxBench
+ *
+ * @file SyscallLoop.cpp
+ * Usage: SyscallLoop <read|write|brk|getpid|getrandom|openat> <count>
+ * Issues the syscall <count> times through syscall(2), bypassing libc caching and the vDSO, and
+ * prints the average wall time per call in nanoseconds to stdout. openat opens and closes /etc/passwd,
+ * so each call also walks a path.
+ * This file is part of the SandboxRunner project.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+
+long IssueSyscall(const char *name)
+{
+    char buffer[1];
+    if (std::strcmp(name, "read") == 0)
+        return syscall(SYS_read, STDIN_FILENO, buffer, 0);
+    if (std::strcmp(name, "write") == 0)
+        return syscall(SYS_write, STDOUT_FILENO, buffer, 0);
+    if (std::strcmp(name, "brk") == 0)
+        return syscall(SYS_brk, 0);
+    if (std::strcmp(name, "getpid") == 0)
+        return syscall(SYS_getpid);
+    if (std::strcmp(name, "getrandom") == 0)
+        return syscall(SYS_getrandom, buffer, 0, 0);
+    if (std::strcmp(name, "openat") == 0)
+    {
+        const long fd = syscall(SYS_openat, AT_FDCWD, "/etc/passwd", O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+            syscall(SYS_close, fd);
+        return fd;
+    }
+    return -1;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 3 || IssueSyscall(argv[1]) < 0)
+    {
+        std::fprintf(stderr, "Usage: SyscallLoop <read|write|brk|getpid|getrandom|openat> <count>\n");
+        return 1;
+    }
+
+    const long count = std::strtol(argv[2], nullptr, 10);
+    const auto begin = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; ++i)
+    {
+        IssueSyscall(argv[1]);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    std::printf("%.3f\n", std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(count));
+    return 0;
+}
@@ -1,23 +1,63 @@
 #include "SandboxRunner.h"
 #include "../SandboxRunnerCore/Sandbox.h"
+#include "../SandboxRunnerCore/Linux/SpoolQueue.h"
+#include "../SandboxRunnerCore/Linux/SubmissionRing.h"
 #include "cmdline.h"
 #include "stduuid/uuid.h"
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <iomanip>
+#include <mutex>
 #include <nlohmann/json.hpp>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 struct CliOptions
 {
     SandboxConfiguration Configuration;
+    SandboxConfigurationEx Extension;
     std::string Format;
+    uint32_t RepeatCount;
+    uint32_t ParallelRuns;
+    uint64_t MemoryBudget;
+    std::string SpoolDirectory; // Serve the jobs of this spool instead of running a command
+    uint64_t SpoolLeaseMs;
+    uint64_t SpoolPollMs;
+    std::string RingName; // Serve the submissions of this shared-memory ring instead of running a command
+    std::string MetricsFile;
+    uint64_t MetricsIntervalMs;
+    std::string ActivityName; // Publish the runs in progress under this name
+    std::string TopName;      // Show the runs another runner publishes under this name instead of running a command
+    uint64_t TopIntervalMs;
 };
 
 CliOptions GetCliOptions(int argc, char **argv);
 
+/**
+ * @brief Parse a command line, or the arguments of a spool job, without exiting on errors
+ * @param args The arguments, the program name first
+ * @param error Set to the message to print when false is returned
+ */
+bool ParseCliOptions(const std::vector<std::string> &args, CliOptions &options, std::string &error);
+
 namespace
 {
 
+// Enough for a long run: the library halves the resolution whenever the buffer fills.
+constexpr uint32_t CLI_SAMPLE_CAPACITY = 1024;
+
 const char *GetStatusName(int status)
 {
     switch (status)
@@ -51,27 +91,318 @@ std::string NormalizeFormat(std::string format)
     return format;
 }
 
-void PrintResultAsJson(const SandboxResult &result)
+struct PhaseDuration
+{
+    const char *Name;
+    uint64_t Microseconds;
+};
+
+// Durations of the phases in the timeline; a phase that was not reached is reported as 0.
+std::array<PhaseDuration, 6> GetPhaseDurations(const SandboxTimeline &timeline)
+{
+    const auto span = [](uint64_t begin, uint64_t end) -> uint64_t {
+        return (begin != 0 && end >= begin) ? (end - begin) / 1000 : 0;
+    };
+
+    return {{
+        {"Prepare", span(timeline.PrepareStart, timeline.ForkStart)},
+        {"Fork", span(timeline.ForkStart, timeline.ForkDone)},
+        {"ChildSetup", span(timeline.ChildSetupStart, timeline.ExecStart)},
+        {"Exec", span(timeline.ExecStart, timeline.ExecDone)},
+        {"Run", span(timeline.ExecDone, timeline.Exit)},
+        {"Reap", span(timeline.Exit, timeline.Reaped)},
+    }};
+}
+
+const char *GetTerminationReasonName(uint32_t reason)
+{
+    switch (reason)
+    {
+    case SANDBOX_TERMINATION_REAL_TIME_LIMIT:
+        return "REAL_TIME_LIMIT";
+    case SANDBOX_TERMINATION_MEMORY_LIMIT:
+        return "MEMORY_LIMIT";
+    case SANDBOX_TERMINATION_IDLE_LIMIT:
+        return "IDLE_LIMIT";
+    case SANDBOX_TERMINATION_PROCESS_LIMIT:
+        return "PROCESS_LIMIT";
+    case SANDBOX_TERMINATION_OUTPUT_LIMIT:
+        return "OUTPUT_LIMIT";
+    default:
+        return "NONE";
+    }
+}
+
+const char *GetTimingConfidenceName(uint32_t confidence)
+{
+    switch (confidence)
+    {
+    case SANDBOX_TIMING_CONFIDENCE_HIGH:
+        return "HIGH";
+    case SANDBOX_TIMING_CONFIDENCE_LOW:
+        return "LOW";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+uint32_t GetTimingCalibrationMode(const std::string &name)
+{
+    if (name == "report")
+        return SANDBOX_TIMING_CALIBRATION_REPORT;
+    if (name == "scale")
+        return SANDBOX_TIMING_CALIBRATION_SCALE_CPU_LIMIT;
+    return SANDBOX_TIMING_CALIBRATION_OFF;
+}
+
+// Parses a comma-separated list of namespace names such as "pid,net"; false on an unknown name.
+bool ParseNamespaceFlags(const std::string &list, uint32_t &flags)
+{
+    constexpr std::array<std::pair<const char *, uint32_t>, 5> names = {{
+        {"user", SANDBOX_NAMESPACE_USER},
+        {"mount", SANDBOX_NAMESPACE_MOUNT},
+        {"pid", SANDBOX_NAMESPACE_PID},
+        {"net", SANDBOX_NAMESPACE_NET},
+        {"ipc", SANDBOX_NAMESPACE_IPC},
+    }};
+
+    flags = 0;
+    if (list.empty())
+        return true;
+    for (size_t begin = 0; begin <= list.size();)
+    {
+        const size_t end       = std::min(list.find(',', begin), list.size());
+        const std::string name = list.substr(begin, end - begin);
+        const auto match       = std::find_if(names.begin(), names.end(), [&name](const auto &entry) {
+            return name == entry.first;
+        });
+        if (match == names.end())
+            return false;
+        flags |= match->second;
+        begin = end + 1;
+    }
+    return true;
+}
+
+uint32_t GetPriority(const std::string &name)
+{
+    if (name == "low")
+        return SANDBOX_PRIORITY_LOW;
+    if (name == "idle")
+        return SANDBOX_PRIORITY_IDLE;
+    return SANDBOX_PRIORITY_NORMAL;
+}
+
+const char *GetPeakMemorySourceName(uint32_t source)
+{
+    return source == SANDBOX_PEAK_MEMORY_SOURCE_RUSAGE ? "rusage" : "none";
+}
+
+nlohmann::json ResultToJson(const SandboxResultEx &resultEx, const SandboxConfigurationEx &extension)
 {
+    const SandboxResult &result = resultEx.Result;
     nlohmann::json j;
-    j["Status"]        = result.Status;
-    j["StatusName"]    = GetStatusName(result.Status);
-    j["ExitCode"]      = result.ExitCode;
-    j["Signal"]        = result.Signal;
-    j["CpuTimeUsage"]  = result.CpuTimeUsage;
-    j["RealTimeUsage"] = result.RealTimeUsage;
-    j["MemoryUsage"]   = result.MemoryUsage;
-    std::cout << j.dump() << std::endl;
+    j["Status"]            = result.Status;
+    j["StatusName"]        = GetStatusName(result.Status);
+    j["ExitCode"]          = result.ExitCode;
+    j["Signal"]            = result.Signal;
+    j["CpuTimeUsage"]      = result.CpuTimeUsage;
+    j["RealTimeUsage"]     = result.RealTimeUsage;
+    j["MemoryUsage"]       = result.MemoryUsage;
+    j["TerminationReason"] = GetTerminationReasonName(resultEx.TerminationReason);
+    if (extension.PinToCore != 0)
+        j["CpuCore"] = resultEx.CpuCore;
+    if (extension.ResultCacheFile != nullptr)
+        j["FromResultCache"] = resultEx.FromResultCache != 0;
+    if (extension.Namespaces != 0)
+        j["FromNamespacePool"] = resultEx.FromNamespacePool != 0;
+    if (extension.TimingCalibration != SANDBOX_TIMING_CALIBRATION_OFF)
+    {
+        auto &timing                  = j["Timing"];
+        timing["SpeedFactor"]         = resultEx.SpeedFactor;
+        timing["Noise"]               = resultEx.TimingNoise;
+        timing["NormalizedCpuTimeUs"] = resultEx.NormalizedCpuTimeUs;
+        timing["Confidence"]          = GetTimingConfidenceName(resultEx.TimingConfidence);
+        timing["RunCount"]            = resultEx.RunCount;
+    }
+    if (extension.ProfileOutputFile != nullptr)
+    {
+        j["ProfiledSyscallCount"]         = resultEx.ProfiledSyscallCount;
+        j["ProfiledDistinctSyscallCount"] = resultEx.ProfiledDistinctSyscallCount;
+    }
+    if (resultEx.SupervisedSyscallCount != 0)
+    {
+        auto &supervisor          = j["Supervisor"];
+        supervisor["Syscalls"]    = resultEx.SupervisedSyscallCount;
+        supervisor["Denials"]     = resultEx.SupervisedSyscallDenials;
+        supervisor["TotalTimeNs"] = resultEx.SupervisorTimeNs;
+        supervisor["MaxTimeNs"]   = resultEx.SupervisorMaxTimeNs;
+    }
+    if (resultEx.MemoryAdmissionWaitNs != 0 || resultEx.MemoryQueueDepth != 0)
+    {
+        auto &admission         = j["MemoryAdmission"];
+        admission["WaitNs"]     = resultEx.MemoryAdmissionWaitNs;
+        admission["QueueDepth"] = resultEx.MemoryQueueDepth;
+    }
+    for (const auto &[name, microseconds] : GetPhaseDurations(resultEx.Timeline))
+        j["PhaseTimeUsage"][name] = microseconds;
+
+    auto &counters                         = j["ResourceCounters"];
+    counters["UserTimeUs"]                 = resultEx.UserTimeUs;
+    counters["SystemTimeUs"]               = resultEx.SystemTimeUs;
+    counters["MinorPageFaults"]            = resultEx.MinorPageFaults;
+    counters["MajorPageFaults"]            = resultEx.MajorPageFaults;
+    counters["VoluntaryContextSwitches"]   = resultEx.VoluntaryContextSwitches;
+    counters["InvoluntaryContextSwitches"] = resultEx.InvoluntaryContextSwitches;
+    counters["BlockInputOperations"]       = resultEx.BlockInputOperations;
+    counters["BlockOutputOperations"]      = resultEx.BlockOutputOperations;
+    if (resultEx.HasIoCounters != 0)
+    {
+        counters["ReadBytes"]         = resultEx.ReadBytes;
+        counters["WriteBytes"]        = resultEx.WriteBytes;
+        counters["StorageReadBytes"]  = resultEx.StorageReadBytes;
+        counters["StorageWriteBytes"] = resultEx.StorageWriteBytes;
+    }
+    counters["PeakMemoryUsage"]  = resultEx.PeakMemoryUsage;
+    counters["PeakMemorySource"] = GetPeakMemorySourceName(resultEx.PeakMemorySource);
+
+    if (extension.SampleIntervalMs != 0)
+    {
+        // Columns instead of one object per sample keeps long series compact.
+        auto &samples         = j["Samples"];
+        samples["IntervalMs"] = static_cast<uint64_t>(extension.SampleIntervalMs) * resultEx.SampleStride;
+        samples["TimeUs"]         = nlohmann::json::array();
+        samples["ResidentMemory"] = nlohmann::json::array();
+        samples["CpuTimeUs"]      = nlohmann::json::array();
+        for (uint32_t i = 0; i < resultEx.SampleCount; ++i)
+        {
+            const SandboxSample &sample = extension.Samples[i];
+            samples["TimeUs"].push_back((sample.Time - resultEx.Timeline.ExecStart) / 1000);
+            samples["ResidentMemory"].push_back(sample.ResidentMemory);
+            samples["CpuTimeUs"].push_back(sample.CpuTimeUs);
+        }
+    }
+    return j;
+}
+
+void PrintResultAsJson(const SandboxResultEx &resultEx, const SandboxConfigurationEx &extension)
+{
+    std::cout << ResultToJson(resultEx, extension).dump() << std::endl;
 }
 
-void PrintResultAsText(const SandboxResult &result)
+void PrintResultAsText(const SandboxResultEx &resultEx, const SandboxConfigurationEx &extension)
 {
+    const SandboxResult &result = resultEx.Result;
     std::cout << "Status:       " << GetStatusName(result.Status) << std::endl;
     std::cout << "ExitCode:     " << result.ExitCode << std::endl;
     std::cout << "Signal:       " << result.Signal << std::endl;
     std::cout << "CpuTimeUsage: " << result.CpuTimeUsage << " ms" << std::endl;
     std::cout << "RealTimeUsage:" << result.RealTimeUsage << " ms" << std::endl;
     std::cout << "MemoryUsage:  " << result.MemoryUsage << " bytes" << std::endl;
+    if (resultEx.TerminationReason != SANDBOX_TERMINATION_NONE)
+        std::cout << "KilledFor:    " << GetTerminationReasonName(resultEx.TerminationReason) << std::endl;
+    if (extension.PinToCore != 0)
+        std::cout << "CpuCore:      " << resultEx.CpuCore << std::endl;
+    if (resultEx.FromResultCache != 0)
+        std::cout << "Replayed:     from the result cache " << extension.ResultCacheFile << std::endl;
+    if (extension.Namespaces != 0)
+        std::cout << "Namespaces:   " << (resultEx.FromNamespacePool != 0 ? "pooled" : "created at launch") << std::endl;
+    if (extension.TimingCalibration != SANDBOX_TIMING_CALIBRATION_OFF)
+    {
+        std::cout << "Timing:       speed " << resultEx.SpeedFactor << ", noise " << resultEx.TimingNoise * 100
+                  << "%, normalized CPU time " << resultEx.NormalizedCpuTimeUs << " us, confidence "
+                  << GetTimingConfidenceName(resultEx.TimingConfidence) << " after " << resultEx.RunCount
+                  << " run(s)" << std::endl;
+    }
+    if (extension.ProfileOutputFile != nullptr)
+    {
+        std::cout << "Syscalls:     " << resultEx.ProfiledSyscallCount << " ("
+                  << resultEx.ProfiledDistinctSyscallCount << " distinct), policy written to "
+                  << extension.ProfileOutputFile << std::endl;
+    }
+    if (resultEx.SupervisedSyscallCount != 0)
+    {
+        std::cout << "Supervised:   " << resultEx.SupervisedSyscallCount << " syscalls ("
+                  << resultEx.SupervisedSyscallDenials << " denied), " << resultEx.SupervisorTimeNs / 1000
+                  << " us total, " << resultEx.SupervisorMaxTimeNs / 1000 << " us max" << std::endl;
+    }
+    if (resultEx.MemoryAdmissionWaitNs != 0 || resultEx.MemoryQueueDepth != 0)
+    {
+        std::cout << "MemoryWait:   " << resultEx.MemoryAdmissionWaitNs / 1000 << " us behind "
+                  << resultEx.MemoryQueueDepth << " queued run(s)" << std::endl;
+    }
+    std::cout << "Phases:      ";
+    for (const auto &[name, microseconds] : GetPhaseDurations(resultEx.Timeline))
+        std::cout << " " << name << " " << microseconds << " us";
+    std::cout << std::endl;
+    std::cout << "CpuTime:      user " << resultEx.UserTimeUs << " us, sys " << resultEx.SystemTimeUs << " us"
+              << std::endl;
+    std::cout << "PageFaults:   minor " << resultEx.MinorPageFaults << ", major " << resultEx.MajorPageFaults
+              << std::endl;
+    std::cout << "CtxSwitches:  voluntary " << resultEx.VoluntaryContextSwitches << ", involuntary "
+              << resultEx.InvoluntaryContextSwitches << std::endl;
+    std::cout << "BlockIO:      in " << resultEx.BlockInputOperations << ", out " << resultEx.BlockOutputOperations
+              << std::endl;
+    if (resultEx.HasIoCounters != 0)
+    {
+        std::cout << "IO:           read " << resultEx.ReadBytes << " bytes (" << resultEx.StorageReadBytes
+                  << " from storage), write " << resultEx.WriteBytes << " bytes (" << resultEx.StorageWriteBytes
+                  << " to storage)" << std::endl;
+    }
+    std::cout << "PeakMemory:   " << resultEx.PeakMemoryUsage << " bytes ("
+              << GetPeakMemorySourceName(resultEx.PeakMemorySource) << ")" << std::endl;
+    if (extension.SampleIntervalMs != 0)
+    {
+        uint64_t peakResident = 0;
+        for (uint32_t i = 0; i < resultEx.SampleCount; ++i)
+            peakResident = std::max(peakResident, extension.Samples[i].ResidentMemory);
+        std::cout << "Samples:      " << resultEx.SampleCount << " every "
+                  << static_cast<uint64_t>(extension.SampleIntervalMs) * resultEx.SampleStride << " ms, peak RSS "
+                  << peakResident << " bytes" << std::endl;
+    }
+    if (extension.TraceFile != nullptr)
+        std::cout << "Trace:        " << extension.TraceFile << std::endl;
+}
+
+nlohmann::json StatisticsToJson(const SandboxRunStatistics &statistics)
+{
+    return {
+        {"Min", statistics.Min},   {"Median", statistics.Median}, {"P95", statistics.P95},
+        {"Max", statistics.Max},   {"Mean", statistics.Mean},     {"StdDev", statistics.StdDev},
+    };
+}
+
+nlohmann::json RepeatResultToJson(const SandboxRepeatResult &result)
+{
+    nlohmann::json j;
+    j["RunCount"]        = result.RunCount;
+    j["Status"]          = result.Status;
+    j["StatusName"]      = GetStatusName(result.Status);
+    j["StatusAgreement"] = result.StatusAgreement;
+    j["CpuTimeUs"]       = StatisticsToJson(result.CpuTimeUs);
+    j["RealTimeUs"]      = StatisticsToJson(result.RealTimeUs);
+    j["MemoryUsage"]     = StatisticsToJson(result.MemoryUsage);
+    return j;
+}
+
+void PrintRepeatResultAsJson(const SandboxRepeatResult &result)
+{
+    std::cout << RepeatResultToJson(result).dump() << std::endl;
+}
+
+void PrintStatisticsAsText(const char *label, const SandboxRunStatistics &statistics, const char *unit)
+{
+    std::cout << std::fixed << std::setprecision(1) << label << "min " << statistics.Min << ", median " << statistics.Median << ", p95 " << statistics.P95
+              << ", max " << statistics.Max << ", stddev " << statistics.StdDev << " " << unit << std::endl;
+}
+
+void PrintRepeatResultAsText(const SandboxRepeatResult &result)
+{
+    std::cout << "Status:       " << GetStatusName(result.Status) << " (" << result.StatusAgreement << " of "
+              << result.RunCount << " runs)" << std::endl;
+    PrintStatisticsAsText("CpuTime:      ", result.CpuTimeUs, "us");
+    PrintStatisticsAsText("RealTime:     ", result.RealTimeUs, "us");
+    PrintStatisticsAsText("Memory:       ", result.MemoryUsage, "bytes");
 }
 
 char *CopyString(const std::string &s)
@@ -82,30 +413,410 @@ char *CopyString(const std::string &s)
     return strdup(s.c_str());
 }
 
+void FreeCliOptions(CliOptions &options)
+{
+    SandboxConfiguration &configuration = options.Configuration;
+    for (const char *s : {configuration.TaskName, configuration.UserCommand, configuration.WorkingDirectory,
+                          configuration.InputFile, configuration.OutputFile, configuration.ErrorFile,
+                          configuration.LogFile, configuration.Policy, options.Extension.ProfileOutputFile,
+                          options.Extension.TraceFile, options.Extension.ResultCacheFile})
+        free(const_cast<char *>(s));
+    delete[] options.Extension.Samples;
+}
+
+// A job is a JSON array of the arguments of a run, such as ["--memory", "268435456", "./solution"].
+bool ParseJobArguments(const std::string &contents, CliOptions &options, std::string &error)
+{
+    const auto job = nlohmann::json::parse(contents, nullptr, false);
+    if (!job.is_array() || !std::all_of(job.begin(), job.end(), [](const auto &a) { return a.is_string(); }))
+    {
+        error = "A job must be a JSON array of SandboxRunner arguments";
+        return false;
+    }
+
+    std::vector<std::string> args = {"SandboxRunner"};
+    for (const auto &argument : job)
+        args.push_back(argument.get<std::string>());
+    return ParseCliOptions(args, options, error);
+}
+
+nlohmann::json RunSpoolJob(const std::string &contents)
+{
+    CliOptions options{};
+    std::string error;
+    if (!ParseJobArguments(contents, options, error))
+        return {{"Error", error}};
+
+    nlohmann::json result;
+    if (options.RepeatCount > 1)
+    {
+        SandboxRepeatResult repeatResult{};
+        repeatResult.StructSize = sizeof(SandboxRepeatResult);
+        StartSandboxRepeated(&options.Configuration, &options.Extension, options.RepeatCount, options.ParallelRuns,
+                             &repeatResult);
+        result = RepeatResultToJson(repeatResult);
+    }
+    else
+    {
+        SandboxResultEx resultEx{};
+        resultEx.StructSize   = sizeof(SandboxResultEx);
+        const int infraStatus = StartSandboxEx(&options.Configuration, &options.Extension, &resultEx);
+        if (infraStatus != SANDBOX_STATUS_SUCCESS && resultEx.Result.Status == 0)
+            resultEx.Result.Status = infraStatus;
+        result = ResultToJson(resultEx, options.Extension);
+    }
+    FreeCliOptions(options);
+    return result;
+}
+
+int ServeSpool(const CliOptions &options)
+{
+    const SpoolQueue queue(options.SpoolDirectory, std::chrono::milliseconds(options.SpoolLeaseMs));
+    const auto run = [](const std::string &contents) { return RunSpoolJob(contents).dump(); };
+    while (true)
+    {
+        queue.ReclaimExpired();
+        if (queue.Process(run))
+            continue;
+        if (options.SpoolPollMs == 0)
+            return 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(options.SpoolPollMs));
+    }
+}
+
+/**
+ * @brief A ring configuration parsed by a worker, kept until the client registers the slot again
+ */
+struct RingConfig
+{
+    uint32_t Generation;
+    CliOptions Options;
+};
+
+int RunRingSubmission(const SubmissionRing &ring, const SandboxRingSubmission &submission,
+                      std::unordered_map<uint32_t, RingConfig> &configs, SandboxResult &result)
+{
+    const auto registered = ring.ReadConfig(submission.ConfigId);
+    if (!registered.has_value())
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+
+    auto cached = configs.find(submission.ConfigId);
+    if (cached == configs.end() || cached->second.Generation != registered->first)
+    {
+        CliOptions options{};
+        std::string error;
+        if (!ParseJobArguments(registered->second, options, error))
+        {
+            fprintf(stderr, "Invalid ring configuration %u: %s\n", submission.ConfigId, error.c_str());
+            return SANDBOX_STATUS_INTERNAL_ERROR;
+        }
+        if (cached != configs.end())
+            FreeCliOptions(cached->second.Options);
+        cached = configs.insert_or_assign(submission.ConfigId, RingConfig{registered->first, options}).first;
+    }
+
+    // Copies, so the registered files of this submission do not stick to the cached configuration.
+    SandboxConfiguration configuration = cached->second.Options.Configuration;
+    SandboxConfigurationEx extension   = cached->second.Options.Extension;
+    std::optional<std::string> input;
+    std::optional<std::string> output;
+    if (submission.InputId != SANDBOX_RING_NO_FILE)
+    {
+        input = ring.ReadFile(submission.InputId);
+        if (!input.has_value())
+            return SANDBOX_STATUS_INTERNAL_ERROR;
+        configuration.InputFile = input->c_str();
+    }
+    if (submission.OutputId != SANDBOX_RING_NO_FILE)
+    {
+        output = ring.ReadFile(submission.OutputId);
+        if (!output.has_value())
+            return SANDBOX_STATUS_INTERNAL_ERROR;
+        configuration.OutputFile = output->c_str();
+    }
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize   = sizeof(SandboxResultEx);
+    const int infraStatus = StartSandboxEx(&configuration, &extension, &resultEx);
+    result                = resultEx.Result;
+    return infraStatus;
+}
+
+void ServeRingWorker(SubmissionRing &ring)
+{
+    std::unordered_map<uint32_t, RingConfig> configs;
+    SandboxRingSubmission submission{};
+    while (ring.Take(submission))
+    {
+        SandboxRingCompletion completion{};
+        completion.UserData    = submission.UserData;
+        completion.InfraStatus = RunRingSubmission(ring, submission, configs, completion.Result);
+        if (!ring.Complete(completion))
+            break;
+    }
+    for (auto &[id, config] : configs)
+        FreeCliOptions(config.Options);
+}
+
+std::atomic<SubmissionRing *> ServedRing = nullptr;
+
+void StopServedRing(int)
+{
+    if (SubmissionRing *ring = ServedRing.load())
+        ring->Stop();
+}
+
+// Handlers rather than a blocked signal set, which the sandboxed programs would inherit.
+int ServeRing(const CliOptions &options)
+{
+    const auto ring = SubmissionRing::Create(options.RingName);
+    if (ring == nullptr)
+    {
+        fprintf(stderr, "Failed to create ring %s\n", options.RingName.c_str());
+        return 1;
+    }
+    ServedRing = ring.get();
+    struct sigaction action{};
+    action.sa_handler = StopServedRing;
+    action.sa_flags   = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < options.ParallelRuns; ++i)
+        workers.emplace_back(ServeRingWorker, std::ref(*ring));
+    for (auto &worker : workers)
+        worker.join();
+
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    ServedRing = nullptr;
+    return 0;
+}
+
+const char *GetActivityPhaseName(uint32_t phase)
+{
+    switch (phase)
+    {
+    case SANDBOX_ACTIVITY_PREPARING:
+        return "PREPARING";
+    case SANDBOX_ACTIVITY_WAITING_FOR_MEMORY:
+        return "WAIT_MEMORY";
+    case SANDBOX_ACTIVITY_WAITING_FOR_CORE:
+        return "WAIT_CORE";
+    case SANDBOX_ACTIVITY_STARTING:
+        return "STARTING";
+    case SANDBOX_ACTIVITY_RUNNING:
+        return "RUNNING";
+    case SANDBOX_ACTIVITY_FINISHING:
+        return "FINISHING";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+nlohmann::json ActivityToJson(const SandboxActivity &activity)
+{
+    nlohmann::json j;
+    j["TaskName"]    = activity.TaskName;
+    j["Pid"]         = activity.Pid;
+    j["Policy"]      = activity.Policy;
+    j["Phase"]       = GetActivityPhaseName(activity.Phase);
+    j["Priority"]    = activity.Priority;
+    j["CpuCore"]     = activity.CpuCore;
+    j["ElapsedMs"]   = activity.ElapsedNs / 1000000;
+    j["CpuTimeMs"]   = activity.CpuTimeUs / 1000;
+    j["MemoryUsage"] = activity.MemoryUsage;
+    j["MaxCpuTime"]  = activity.MaxCpuTime;
+    j["MaxRealTime"] = activity.MaxRealTime;
+    j["MaxMemory"]   = activity.MaxMemory;
+    return j;
+}
+
+// "used/limit", or "used/-" for no limit.
+std::string FormatUsage(double used, uint64_t limit, double scale, int precision)
+{
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(precision) << used / scale << "/";
+    if (limit == 0)
+        text << "-";
+    else
+        text << static_cast<double>(limit) / scale;
+    return text.str();
+}
+
+void PrintActivityAsText(const std::string &name, const SandboxActivity *activities, uint32_t count)
+{
+    constexpr double MIB = 1024.0 * 1024.0;
+    std::cout << count << " run(s) in progress on " << name << std::endl;
+    std::cout << std::left << std::setw(24) << "TASK" << std::right << std::setw(8) << "PID" << "  " << std::left
+              << std::setw(16) << "POLICY" << std::setw(12) << "PHASE" << std::right << std::setw(10) << "ELAPSED s"
+              << std::setw(16) << "CPU s" << std::setw(20) << "RSS MiB" << std::setw(6) << "CORE" << std::endl;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const SandboxActivity &activity = activities[i];
+        std::cout << std::left << std::setw(24) << std::string(activity.TaskName).substr(0, 23) << std::right
+                  << std::setw(8) << activity.Pid << "  " << std::left << std::setw(16)
+                  << std::string(activity.Policy).substr(0, 15) << std::setw(12) << GetActivityPhaseName(activity.Phase)
+                  << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+                  << static_cast<double>(activity.ElapsedNs) / 1e9 << std::setw(16)
+                  << FormatUsage(static_cast<double>(activity.CpuTimeUs) / 1000, activity.MaxCpuTime, 1000, 2)
+                  << std::setw(20)
+                  << FormatUsage(static_cast<double>(activity.MemoryUsage), activity.MaxMemory, MIB, 1)
+                  << std::setw(6) << (activity.CpuCore < 0 ? "-" : std::to_string(activity.CpuCore)) << std::endl;
+    }
+}
+
+// Reads shared memory only, so watching a runner costs it nothing.
+int ShowTop(const CliOptions &options)
+{
+    std::vector<SandboxActivity> activities(SANDBOX_ACTIVITY_SLOTS);
+    const bool redraw = options.TopIntervalMs != 0 && options.Format == "text" && isatty(STDOUT_FILENO);
+    while (true)
+    {
+        uint32_t count = 0;
+        if (ReadSandboxActivity(options.TopName.c_str(), activities.data(), SANDBOX_ACTIVITY_SLOTS, &count)
+            != SANDBOX_STATUS_SUCCESS)
+        {
+            fprintf(stderr, "No runner publishes its activity as %s\n", options.TopName.c_str());
+            return 1;
+        }
+
+        if (options.Format == "json")
+        {
+            nlohmann::json runs = nlohmann::json::array();
+            for (uint32_t i = 0; i < count; ++i)
+                runs.push_back(ActivityToJson(activities[i]));
+            std::cout << runs.dump() << std::endl;
+        }
+        else
+        {
+            if (redraw)
+                std::cout << "\x1b[H\x1b[2J";
+            PrintActivityAsText(options.TopName, activities.data(), count);
+        }
+        if (options.TopIntervalMs == 0)
+            return 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(options.TopIntervalMs));
+    }
+}
+
+/**
+ * @brief Writes the metrics to a file every interval while it lives, and once more when it is destroyed
+ * @remarks Does nothing without a path.
+ */
+class MetricsFileWriter
+{
+public:
+    MetricsFileWriter(std::string path, std::chrono::milliseconds interval) : _path(std::move(path))
+    {
+        if (_path.empty())
+            return;
+        _thread = std::thread([this, interval] {
+            std::unique_lock lock(_mutex);
+            while (!_stopped.wait_for(lock, interval, [this] { return _stopping; }))
+                Write();
+        });
+    }
+
+    ~MetricsFileWriter()
+    {
+        if (_path.empty())
+            return;
+        {
+            std::lock_guard lock(_mutex);
+            _stopping = true;
+        }
+        _stopped.notify_all();
+        _thread.join();
+        Write();
+    }
+
+    MetricsFileWriter(const MetricsFileWriter &)            = delete;
+    MetricsFileWriter &operator=(const MetricsFileWriter &) = delete;
+
+private:
+    void Write() const
+    {
+        if (WriteSandboxMetrics(_path.c_str()) != SANDBOX_STATUS_SUCCESS)
+            fprintf(stderr, "Failed to write metrics to %s\n", _path.c_str());
+    }
+
+    std::string _path;
+    std::mutex _mutex;
+    std::condition_variable _stopped;
+    bool _stopping = false;
+    std::thread _thread;
+};
+
 } // namespace
 
 int main(int argc, char *argv[])
 {
-    auto [configuration, format] = GetCliOptions(argc, argv);
-    SandboxResult result{};
+    CliOptions options = GetCliOptions(argc, argv);
+    SetSandboxMemoryBudget(options.MemoryBudget);
+    if (!options.TopName.empty())
+        return ShowTop(options);
+    if (!options.ActivityName.empty() && PublishSandboxActivity(options.ActivityName.c_str()) != SANDBOX_STATUS_SUCCESS)
+        fprintf(stderr, "Failed to publish activity as %s\n", options.ActivityName.c_str());
+    const MetricsFileWriter metricsWriter(options.MetricsFile, std::chrono::milliseconds(options.MetricsIntervalMs));
+    if (!options.SpoolDirectory.empty())
+        return ServeSpool(options);
+    if (!options.RingName.empty())
+        return ServeRing(options);
 
-    int infraStatus = StartSandbox(&configuration, &result);
+    auto [configuration, extension, format, repeatCount, parallelRuns] =
+        std::tie(options.Configuration, options.Extension, options.Format, options.RepeatCount, options.ParallelRuns);
+    if (repeatCount > 1)
+    {
+        SandboxRepeatResult repeatResult{};
+        repeatResult.StructSize = sizeof(SandboxRepeatResult);
+        const int infraStatus =
+            StartSandboxRepeated(&configuration, &extension, repeatCount, parallelRuns, &repeatResult);
+        if (infraStatus != SANDBOX_STATUS_SUCCESS)
+            fprintf(stderr, "Failed to start sandbox\n");
+
+        if (format == "json")
+            PrintRepeatResultAsJson(repeatResult);
+        else
+            PrintRepeatResultAsText(repeatResult);
+        return (infraStatus == SANDBOX_STATUS_SUCCESS) ? 0 : infraStatus;
+    }
 
-    if (infraStatus != SANDBOX_STATUS_SUCCESS && result.Status == 0)
+    SandboxResultEx result{};
+    result.StructSize = sizeof(SandboxResultEx);
+
+    int infraStatus = StartSandboxEx(&configuration, &extension, &result);
+
+    if (infraStatus != SANDBOX_STATUS_SUCCESS && result.Result.Status == 0)
     {
-        result.Status = infraStatus;
+        result.Result.Status = infraStatus;
         fprintf(stderr, "Failed to start sandbox\n");
     }
 
     if (format == "json")
-        PrintResultAsJson(result);
+        PrintResultAsJson(result, extension);
     else
-        PrintResultAsText(result);
+        PrintResultAsText(result, extension);
 
     return (infraStatus == SANDBOX_STATUS_SUCCESS) ? 0 : infraStatus;
 }
 
 CliOptions GetCliOptions(int argc, char **argv)
+{
+    CliOptions options{};
+    std::string error;
+    if (!ParseCliOptions(std::vector<std::string>(argv, argv + argc), options, error))
+    {
+        fprintf(stderr, "%s", error.c_str());
+        exit(1);
+    }
+    return options;
+}
+
+bool ParseCliOptions(const std::vector<std::string> &args, CliOptions &options, std::string &error)
 {
     cmdline::parser parser;
     parser.add<std::string>("name", 'n', "The name of the task", false);
@@ -118,17 +829,83 @@ CliOptions GetCliOptions(int argc, char **argv)
     parser.add<uint64_t>("stack", 0, "Stack limit of the task", false, 0);
     parser.add<uint64_t>("cpu", 0, "CPU time limit of the task", false, 0);
     parser.add<uint64_t>("real", 0, "Real time limit of the task", false, 0);
+    parser.add<uint64_t>("idle", 0, "Kill the task after this long without using CPU time, ms (0 = off)", false, 0);
     parser.add<int>("process", 0, "Process count limit of the task (-1 means unlimited)", false, -1);
     parser.add<uint64_t>("output-size", 0, "Output size limit of the task", false, 0);
     parser.add<std::string>("policy", 'p', "The policy name of the task", false, "default");
     parser.add<std::string>("format", 'f', "Output format (json or text)", false, "json");
+    parser.add<std::string>("profile", 0, "Profile the syscalls of the task and write a policy JSON to this file", false);
+    parser.add<std::string>("trace", 0, "Write the phase timeline as a Chrome trace-event JSON file", false);
+    parser.add<uint32_t>("sample-interval", 0, "Sample memory and CPU time every N ms while the task runs (0 = off)",
+                         false, 0);
+    parser.add("pin-core", 0, "Run the task on a physical CPU core of its own");
+    parser.add("cache-executable", 0, "Execute the task from an in-memory copy of its binary");
+    parser.add<std::string>("namespaces", 0, "Isolate the task in these namespaces (comma list of user, mount, "
+                            "pid, net, ipc)", false);
+    parser.add<uint64_t>("scratch", 0, "Cover the working directory with a tmpfs of this many bytes (0 = off)", false,
+                         0);
+    parser.add<std::string>("priority", 0, "Scheduling class of the task (normal, low or idle)", false, "normal",
+                            cmdline::oneof<std::string>("normal", "low", "idle"));
+    parser.add<std::string>("calibration", 0, "Calibrate timing against the reference workload (off, report or scale)",
+                            false, "off", cmdline::oneof<std::string>("off", "report", "scale"));
+    parser.add<uint32_t>("reruns", 0, "Re-run up to N times while a calibrated verdict is too close to call", false,
+                         0);
+    parser.add<std::string>("result-cache", 0, "Replay identical runs from the result cache indexed by this file",
+                            false);
+    parser.add("rerun", 0, "With --result-cache, run the task even if it is cached and overwrite the entry");
+    parser.add<uint32_t>("repeat", 0, "Run the task N times and report timing statistics", false, 1);
+    parser.add<uint32_t>("parallel", 0, "With --repeat, make up to N runs at once, each on a core of its own; with "
+                         "--ring, serve N submissions at once", false, 1);
+    parser.add<uint64_t>("memory-budget", 0, "With --parallel, only run at once what fits in this many bytes (0 = off)",
+                         false, 0);
+    parser.add<std::string>("spool", 0, "Run the jobs queued in this spool directory, see the readme", false);
+    parser.add<uint64_t>("lease", 0, "With --spool, hand a job to another runner after N ms without renewal", false,
+                         30000);
+    parser.add<uint64_t>("poll", 0, "With --spool, look for new jobs every N ms instead of exiting when idle", false,
+                         0);
+    parser.add<std::string>("ring", 0, "Serve runs submitted through the shared-memory ring of this name", false);
+    parser.add<std::string>("metrics", 0, "Write Prometheus metrics to this file periodically and on exit", false);
+    parser.add<uint64_t>("metrics-interval", 0, "With --metrics, write the file every N ms", false, 5000);
+    parser.add<std::string>("activity", 0, "Publish the runs in progress under this name for --top", false);
+    parser.add<std::string>("top", 0, "Show the runs in progress another runner publishes under this name", false);
+    parser.add<uint64_t>("top-interval", 0, "With --top, refresh every N ms (0 = show once and exit)", false, 1000);
     parser.footer("program [args...]");
 
-    parser.parse(argc, argv);
+    parser.parse(args);
+
+    // Checked before anything is allocated, so a rejected spool job leaks nothing.
+    uint32_t namespaces = 0;
+    if (!ParseNamespaceFlags(parser.get<std::string>("namespaces"), namespaces))
+    {
+        error = "Invalid namespaces: " + parser.get<std::string>("namespaces") + "\n"
+                + "Supported namespaces: user, mount, pid, net, ipc\n";
+        return false;
+    }
+
+    options.SpoolDirectory = parser.get<std::string>("spool");
+    options.RingName       = parser.get<std::string>("ring");
+    options.TopName        = parser.get<std::string>("top");
+    if (parser.rest().empty() && options.SpoolDirectory.empty() && options.RingName.empty() && options.TopName.empty())
+    {
+        error = "No command specified\n" + parser.usage();
+        return false;
+    }
+
+    std::string format = NormalizeFormat(parser.get<std::string>("format"));
+    constexpr std::array<const char *, 2> kSupportedFormats = {"json", "text"};
+    const bool isSupportedFormat = std::any_of(kSupportedFormats.begin(), kSupportedFormats.end(),
+                                               [&format](const char *supportedFormat) {
+                                                   return format == supportedFormat;
+                                               });
+    if (!isSupportedFormat)
+    {
+        error = "Invalid output format: " + format + "\nSupported formats: json, text\n";
+        return false;
+    }
 
     SandboxConfiguration configuration{};
 
-    // do not worry about memory leak --- always runs once and exit.
+    // Freed by FreeCliOptions in spool mode, which parses one job after another; a single run just exits.
 
     configuration.TaskName = CopyString(parser.get<std::string>("name"));
     if (configuration.TaskName == nullptr)
@@ -155,29 +932,44 @@ CliOptions GetCliOptions(int argc, char **argv)
     configuration.MaxOutputSize    = parser.get<uint64_t>("output-size");
     configuration.Policy           = CopyString(parser.get<std::string>("policy"));
 
-    if (parser.rest().empty())
+    SandboxConfigurationEx extension{};
+    extension.StructSize        = sizeof(SandboxConfigurationEx);
+    extension.Version           = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.ProfileOutputFile = CopyString(parser.get<std::string>("profile"));
+    extension.TraceFile         = CopyString(parser.get<std::string>("trace"));
+    extension.SampleIntervalMs  = parser.get<uint32_t>("sample-interval");
+    extension.MaxIdleTime       = parser.get<uint64_t>("idle");
+    extension.PinToCore         = parser.exist("pin-core") ? 1 : 0;
+    extension.CacheExecutable   = parser.exist("cache-executable") ? 1 : 0;
+    extension.ScratchSize       = parser.get<uint64_t>("scratch");
+    extension.Priority          = GetPriority(parser.get<std::string>("priority"));
+    extension.TimingCalibration  = GetTimingCalibrationMode(parser.get<std::string>("calibration"));
+    extension.MaxNearLimitReruns = parser.get<uint32_t>("reruns");
+    extension.ResultCacheFile    = CopyString(parser.get<std::string>("result-cache"));
+    extension.ResultCacheMode    = parser.exist("rerun") ? SANDBOX_RESULT_CACHE_REFRESH : SANDBOX_RESULT_CACHE_USE;
+    extension.Namespaces         = namespaces;
+    if (extension.SampleIntervalMs != 0)
     {
-        fprintf(stderr, "No command specified\n");
-        fprintf(stderr, "%s", parser.usage().c_str());
-        exit(1);
+        extension.SampleCapacity = CLI_SAMPLE_CAPACITY;
+        extension.Samples        = new SandboxSample[CLI_SAMPLE_CAPACITY];
     }
-    else
-    {
+    if (!parser.rest().empty())
         configuration.UserCommand = CopyString(parser.rest()[0]);
-    }
-
-    std::string format = NormalizeFormat(parser.get<std::string>("format"));
-    constexpr std::array<const char *, 2> kSupportedFormats = {"json", "text"};
-    const bool isSupportedFormat = std::any_of(kSupportedFormats.begin(), kSupportedFormats.end(),
-                                               [&format](const char *supportedFormat) {
-                                                   return format == supportedFormat;
-                                               });
-    if (!isSupportedFormat)
-    {
-        fprintf(stderr, "Invalid output format: %s\n", format.c_str());
-        fprintf(stderr, "Supported formats: json, text\n");
-        exit(1);
-    }
 
-    return {configuration, format};
+    options.Configuration     = configuration;
+    options.Extension         = extension;
+    options.Format            = format;
+    options.RepeatCount       = std::max(parser.get<uint32_t>("repeat"), 1U);
+    options.ParallelRuns      = std::max(parser.get<uint32_t>("parallel"), 1U);
+    options.MemoryBudget      = parser.get<uint64_t>("memory-budget");
+    options.SpoolLeaseMs      = std::max<uint64_t>(parser.get<uint64_t>("lease"), 1);
+    options.SpoolPollMs       = parser.get<uint64_t>("poll");
+    options.MetricsFile       = parser.get<std::string>("metrics");
+    options.MetricsIntervalMs = std::max<uint64_t>(parser.get<uint64_t>("metrics-interval"), 1);
+    options.ActivityName      = parser.get<std::string>("activity");
+    options.TopIntervalMs     = parser.get<uint64_t>("top-interval");
+    // A live view reads best as a table, so --top only prints JSON when asked to.
+    if (!options.TopName.empty() && !parser.exist("format"))
+        options.Format = "text";
+    return true;
 }
@@ -0,0 +1,213 @@
+#include "ContentHash.h"
+
+#include "InternalHelpers.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+#include <ctime>
+#include <tuple>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr std::array<uint32_t, 64> SHA256_ROUND_CONSTANTS = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// Remembered digests are dropped all at once past this many files.
+constexpr size_t MAX_REMEMBERED_FILES = 4096;
+// File timestamps advance in clock ticks, a file modified this recently could change again unnoticed.
+constexpr int64_t RACY_MODIFICATION_SECONDS = 2;
+constexpr size_t READ_CHUNK_SIZE      = 64 * 1024;
+
+uint32_t RotateRight(uint32_t value, int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+// The change time too, since utimensat can set the modification time back.
+using FileIdentity = std::tuple<dev_t, ino_t, off_t, int64_t, int64_t, int64_t, int64_t>;
+
+FileIdentity GetFileIdentity(const struct stat &info)
+{
+    return {info.st_dev,         info.st_ino,          info.st_size,        info.st_mtim.tv_sec,
+            info.st_mtim.tv_nsec, info.st_ctim.tv_sec, info.st_ctim.tv_nsec};
+}
+
+} // namespace
+
+Sha256::Sha256()
+    : _state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}
+{
+}
+
+void Sha256::Update(const void *data, size_t size)
+{
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    _totalBytes += size;
+
+    if (_buffered > 0)
+    {
+        const size_t taken = std::min(size, _buffer.size() - _buffered);
+        memcpy(_buffer.data() + _buffered, bytes, taken);
+        _buffered += taken;
+        bytes += taken;
+        size -= taken;
+        if (_buffered < _buffer.size())
+            return;
+        Compress(_buffer.data());
+        _buffered = 0;
+    }
+
+    for (; size >= _buffer.size(); bytes += _buffer.size(), size -= _buffer.size())
+        Compress(bytes);
+
+    memcpy(_buffer.data(), bytes, size);
+    _buffered = size;
+}
+
+ContentDigest Sha256::Finish()
+{
+    const uint64_t totalBits = _totalBytes * 8;
+    const uint8_t padding    = 0x80;
+    Update(&padding, 1);
+    const uint8_t zero = 0;
+    while (_buffered != 56)
+        Update(&zero, 1);
+
+    std::array<uint8_t, 8> length{};
+    for (size_t i = 0; i < length.size(); ++i)
+        length[i] = static_cast<uint8_t>(totalBits >> (56 - 8 * i));
+    Update(length.data(), length.size());
+
+    ContentDigest digest{};
+    for (size_t i = 0; i < _state.size(); ++i)
+    {
+        for (size_t j = 0; j < 4; ++j)
+            digest[4 * i + j] = static_cast<uint8_t>(_state[i] >> (24 - 8 * j));
+    }
+    return digest;
+}
+
+void Sha256::Compress(const uint8_t *block)
+{
+    std::array<uint32_t, 64> schedule{};
+    for (size_t i = 0; i < 16; ++i)
+    {
+        schedule[i] = static_cast<uint32_t>(block[4 * i]) << 24 | static_cast<uint32_t>(block[4 * i + 1]) << 16
+                      | static_cast<uint32_t>(block[4 * i + 2]) << 8 | static_cast<uint32_t>(block[4 * i + 3]);
+    }
+    for (size_t i = 16; i < 64; ++i)
+    {
+        const uint32_t s0 = RotateRight(schedule[i - 15], 7) ^ RotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+        const uint32_t s1 = RotateRight(schedule[i - 2], 17) ^ RotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+        schedule[i]       = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+    }
+
+    auto [a, b, c, d, e, f, g, h] = _state;
+    for (size_t i = 0; i < 64; ++i)
+    {
+        const uint32_t s1     = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+        const uint32_t choice = (e & f) ^ (~e & g);
+        const uint32_t t1     = h + s1 + choice + SHA256_ROUND_CONSTANTS[i] + schedule[i];
+        const uint32_t s0     = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+        const uint32_t major  = (a & b) ^ (a & c) ^ (b & c);
+        const uint32_t t2     = s0 + major;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    _state[0] += a;
+    _state[1] += b;
+    _state[2] += c;
+    _state[3] += d;
+    _state[4] += e;
+    _state[5] += f;
+    _state[6] += g;
+    _state[7] += h;
+}
+
+std::optional<ContentDigest> HashFileDescriptor(int fd)
+{
+    Sha256 hash;
+    std::array<uint8_t, READ_CHUNK_SIZE> chunk{};
+    off_t offset = 0;
+    ssize_t bytesRead;
+    while ((bytesRead = pread(fd, chunk.data(), chunk.size(), offset)) != 0)
+    {
+        if (bytesRead < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return std::nullopt;
+        }
+        hash.Update(chunk.data(), static_cast<size_t>(bytesRead));
+        offset += bytesRead;
+    }
+    return hash.Finish();
+}
+
+std::optional<ContentDigest> HashFileContent(const std::string &path)
+{
+    static std::mutex rememberedMutex;
+    static std::map<FileIdentity, ContentDigest> remembered;
+
+    // A remembered file costs one stat, not an open.
+    struct stat info{};
+    if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+        return std::nullopt;
+    {
+        std::lock_guard lock(rememberedMutex);
+        if (const auto found = remembered.find(GetFileIdentity(info)); found != remembered.end())
+            return found->second;
+    }
+
+    const SandboxInternal::UniqueFd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid() || fstat(fd.get(), &info) != 0 || !S_ISREG(info.st_mode))
+        return std::nullopt;
+    const auto digest = HashFileDescriptor(fd.get());
+    if (!digest.has_value())
+        return std::nullopt;
+
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (std::max(info.st_mtim.tv_sec, info.st_ctim.tv_sec) + RACY_MODIFICATION_SECONDS > now.tv_sec)
+        return digest;
+
+    std::lock_guard lock(rememberedMutex);
+    if (remembered.size() >= MAX_REMEMBERED_FILES)
+        remembered.clear();
+    remembered.emplace(GetFileIdentity(info), *digest);
+    return digest;
+}
+
+std::string DigestToHex(const ContentDigest &digest)
+{
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(digest.size() * 2);
+    for (const uint8_t byte : digest)
+    {
+        hex.push_back(HEX_DIGITS[byte >> 4]);
+        hex.push_back(HEX_DIGITS[byte & 0xF]);
+    }
+    return hex;
+}
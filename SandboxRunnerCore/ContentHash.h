@@ -0,0 +1,56 @@
+#ifndef SANDBOX_CONTENT_HASH_H
+#define SANDBOX_CONTENT_HASH_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+using ContentDigest = std::array<uint8_t, 32>;
+
+/**
+ * @brief SHA-256, so content keys cannot be forged by crafting a colliding binary or input
+ */
+class Sha256
+{
+public:
+    Sha256();
+
+    void Update(const void *data, size_t size);
+    void Update(std::string_view text) { Update(text.data(), text.size()); }
+
+    template <typename T> void UpdateValue(const T &value) { Update(&value, sizeof(value)); }
+
+    /**
+     * @brief Finish the hash, the object cannot be updated afterwards
+     */
+    ContentDigest Finish();
+
+private:
+    void Compress(const uint8_t *block);
+
+    std::array<uint32_t, 8> _state;
+    std::array<uint8_t, 64> _buffer{};
+    size_t _buffered     = 0;
+    uint64_t _totalBytes = 0;
+};
+
+/**
+ * @brief Hash the content of a file
+ * @remarks Digests are remembered by device, inode, size and modification time, so a binary or input
+ * used by many runs is read once. Files modified in the last two seconds are always read, since a
+ * rewrite within the same timestamp tick would look unchanged.
+ * @return std::nullopt if the file cannot be read
+ */
+std::optional<ContentDigest> HashFileContent(const std::string &path);
+
+/**
+ * @brief Hash everything readable from fd, from offset 0 without moving the file offset
+ */
+std::optional<ContentDigest> HashFileDescriptor(int fd);
+
+std::string DigestToHex(const ContentDigest &digest);
+
+#endif //! SANDBOX_CONTENT_HASH_H
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <csignal>
+#include <cstdint>
 #include <cstdio>
+#include <ctime>
 #include <memory>
 #include <string>
 #include <vector>
 #include <pthread.h>
+#include <unistd.h>
 
 #ifdef __linux__
 #include <seccomp.h>
@@ -16,6 +21,40 @@ struct SandboxConfiguration;
 namespace SandboxInternal
 {
 
+/**
+ * @brief CLOCK_MONOTONIC in nanoseconds
+ * @remarks Served by the vDSO, so it is safe to call in the child after the seccomp filter is loaded.
+ */
+inline uint64_t MonotonicNowNs()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+/**
+ * @brief Kill the program on behalf of a supervisor check and record why
+ * @remarks Only the first reason is kept, so a program hit by two checks at once gets one verdict.
+ * The caller must make sure the pid is not reaped yet.
+ */
+inline void KillWithReason(pid_t pid, std::atomic<uint32_t> *terminationReason, uint32_t reason)
+{
+    uint32_t expected = 0;
+    if (terminationReason != nullptr)
+        terminationReason->compare_exchange_strong(expected, reason);
+    kill(pid, SIGKILL);
+}
+
+/**
+ * @brief A path as the sandboxed program sees it: relative paths are resolved after changing to workingDirectory
+ */
+inline std::string ResolveSandboxPath(const char *workingDirectory, const std::string &path)
+{
+    if (path.empty() || path.front() == '/' || workingDirectory == nullptr || *workingDirectory == '\0')
+        return path;
+    return std::string(workingDirectory) + "/" + path;
+}
+
 // RAII wrapper for FILE*
 struct FileDeleter
 {
@@ -30,6 +69,55 @@ struct FileDeleter
 
 using UniqueFile = std::unique_ptr<FILE, FileDeleter>;
 
+// RAII wrapper for file descriptors
+class UniqueFd
+{
+    int _fd;
+
+public:
+    UniqueFd() : _fd(-1) {}
+
+    explicit UniqueFd(int fd) : _fd(fd) {}
+
+    ~UniqueFd()
+    {
+        reset();
+    }
+
+    UniqueFd(const UniqueFd &) = delete;
+    UniqueFd &operator=(const UniqueFd &) = delete;
+
+    UniqueFd(UniqueFd &&other) noexcept : _fd(other.release()) {}
+
+    UniqueFd &operator=(UniqueFd &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset(other.release());
+        }
+        return *this;
+    }
+
+    int get() const { return _fd; }
+    bool valid() const { return _fd >= 0; }
+
+    void reset(int fd = -1)
+    {
+        if (_fd >= 0)
+        {
+            close(_fd);
+        }
+        _fd = fd;
+    }
+
+    int release()
+    {
+        const int fd = _fd;
+        _fd = -1;
+        return fd;
+    }
+};
+
 #ifdef __linux__
 // RAII wrapper for seccomp context
 class SeccompContext
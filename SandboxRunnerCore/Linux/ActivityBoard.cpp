@@ -0,0 +1,271 @@
+#include "ActivityBoard.h"
+
+#include "../InternalHelpers.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint32_t BOARD_MAGIC          = 0x53424142; // "SBAB"
+constexpr uint32_t BOARD_LAYOUT_VERSION = 1;
+// A reader gives up on a slot that changed under it this many times in a row, it is listed again next time.
+constexpr int BOARD_READ_ATTEMPTS = 3;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "The board is shared between processes, its atomics must not need a lock");
+
+std::string GetSharedMemoryName(const std::string &name)
+{
+    return "/sandbox-top-" + name;
+}
+
+template <size_t N> void CopyName(char (&destination)[N], const char *source)
+{
+    snprintf(destination, N, "%s", source);
+}
+
+struct Publication
+{
+    std::mutex Mutex;
+    std::shared_ptr<ActivityBoard> Board;
+};
+
+Publication &GetPublication()
+{
+    static Publication publication;
+    return publication;
+}
+
+} // namespace
+
+/**
+ * @brief The slot of one run
+ */
+struct BoardSlot
+{
+    std::atomic<uint32_t> Claimed;  // Taken by a run of the publishing process
+    std::atomic<uint32_t> Sequence; // Odd while the fixed fields are written
+    uint32_t Listed;                // Fixed: the slot belongs to a run
+    uint64_t StartNs;               // Fixed: CLOCK_MONOTONIC ns the run started at
+    SandboxActivity Fixed;          // Fixed: names, priority and limits; the fields that change are below
+
+    std::atomic<int32_t> Pid;
+    std::atomic<int32_t> CpuCore;
+    std::atomic<uint32_t> Phase;
+    std::atomic<uint64_t> CpuTimeUs;
+    std::atomic<uint64_t> MemoryUsage;
+};
+
+/**
+ * @brief The shared memory of a board
+ */
+struct BoardLayout
+{
+    std::atomic<uint32_t> Magic; // Set last by the publisher, a reader only uses a board once it is set
+    uint32_t Version;
+    pid_t OwnerPid;
+    BoardSlot Slots[SANDBOX_ACTIVITY_SLOTS];
+};
+
+bool ActivityBoard::Publish(const std::string &name)
+{
+    auto &publication = GetPublication();
+    std::lock_guard lock(publication.Mutex);
+    if (name.empty())
+    {
+        publication.Board.reset();
+        return true;
+    }
+    if (publication.Board != nullptr && publication.Board->GetName() == name)
+        return true;
+
+    const std::string path = GetSharedMemoryName(name);
+    shm_unlink(path.c_str());
+    SandboxInternal::UniqueFd fd(shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600));
+    if (!fd.valid())
+        return false;
+
+    // The new pages read as zero, every slot starts free and unlisted.
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd.get(), sizeof(BoardLayout)) == 0)
+        memory = mmap(nullptr, sizeof(BoardLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (memory == MAP_FAILED)
+    {
+        shm_unlink(path.c_str());
+        return false;
+    }
+
+    auto *layout     = static_cast<BoardLayout *>(memory);
+    layout->Version  = BOARD_LAYOUT_VERSION;
+    layout->OwnerPid = getpid();
+    layout->Magic.store(BOARD_MAGIC, std::memory_order_release);
+    publication.Board.reset(new ActivityBoard(name, layout));
+    return true;
+}
+
+std::shared_ptr<ActivityBoard> ActivityBoard::GetPublished()
+{
+    auto &publication = GetPublication();
+    std::lock_guard lock(publication.Mutex);
+    return publication.Board;
+}
+
+std::optional<std::vector<SandboxActivity>> ActivityBoard::Read(const std::string &name)
+{
+    SandboxInternal::UniqueFd fd(shm_open(GetSharedMemoryName(name).c_str(), O_RDONLY | O_CLOEXEC, 0));
+    struct stat info{};
+    if (!fd.valid() || fstat(fd.get(), &info) != 0 || static_cast<size_t>(info.st_size) != sizeof(BoardLayout))
+        return std::nullopt;
+
+    void *memory = mmap(nullptr, sizeof(BoardLayout), PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (memory == MAP_FAILED)
+        return std::nullopt;
+    const auto *layout = static_cast<const BoardLayout *>(memory);
+    // A publisher that was killed leaves its board, and the runs on it, behind.
+    if (layout->Magic.load(std::memory_order_acquire) != BOARD_MAGIC || layout->Version != BOARD_LAYOUT_VERSION
+        || (kill(layout->OwnerPid, 0) != 0 && errno == ESRCH))
+    {
+        munmap(memory, sizeof(BoardLayout));
+        return std::nullopt;
+    }
+
+    const uint64_t now = SandboxInternal::MonotonicNowNs();
+    std::vector<SandboxActivity> activities;
+    for (const BoardSlot &slot : layout->Slots)
+    {
+        if (slot.Claimed.load(std::memory_order_relaxed) == 0)
+            continue;
+        for (int attempt = 0; attempt < BOARD_READ_ATTEMPTS; ++attempt)
+        {
+            const uint32_t sequence = slot.Sequence.load(std::memory_order_acquire);
+            if ((sequence & 1) != 0)
+                continue;
+            const uint32_t listed    = slot.Listed;
+            const uint64_t startNs   = slot.StartNs;
+            SandboxActivity activity = slot.Fixed;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.Sequence.load(std::memory_order_relaxed) != sequence)
+                continue;
+            if (listed == 0)
+                break;
+
+            activity.TaskName[SANDBOX_ACTIVITY_NAME_LENGTH - 1] = '\0';
+            activity.Policy[SANDBOX_ACTIVITY_NAME_LENGTH - 1]   = '\0';
+            activity.Pid         = slot.Pid.load(std::memory_order_relaxed);
+            activity.CpuCore     = slot.CpuCore.load(std::memory_order_relaxed);
+            activity.Phase       = slot.Phase.load(std::memory_order_relaxed);
+            activity.CpuTimeUs   = slot.CpuTimeUs.load(std::memory_order_relaxed);
+            activity.MemoryUsage = slot.MemoryUsage.load(std::memory_order_relaxed);
+            activity.ElapsedNs   = now > startNs ? now - startNs : 0;
+            activities.push_back(activity);
+            break;
+        }
+    }
+    munmap(memory, sizeof(BoardLayout));
+    return activities;
+}
+
+ActivityBoard::ActivityBoard(std::string name, BoardLayout *layout) : _name(std::move(name)), _layout(layout)
+{
+}
+
+ActivityBoard::~ActivityBoard()
+{
+    shm_unlink(GetSharedMemoryName(_name).c_str());
+    munmap(_layout, sizeof(BoardLayout));
+}
+
+BoardSlot *ActivityBoard::Claim(const SandboxActivity &activity, uint64_t startNs)
+{
+    for (BoardSlot &slot : _layout->Slots)
+    {
+        uint32_t free = 0;
+        if (!slot.Claimed.compare_exchange_strong(free, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            continue;
+
+        slot.Pid.store(0, std::memory_order_relaxed);
+        slot.CpuCore.store(-1, std::memory_order_relaxed);
+        slot.Phase.store(SANDBOX_ACTIVITY_PREPARING, std::memory_order_relaxed);
+        slot.CpuTimeUs.store(0, std::memory_order_relaxed);
+        slot.MemoryUsage.store(0, std::memory_order_relaxed);
+
+        const uint32_t sequence = slot.Sequence.load(std::memory_order_relaxed);
+        slot.Sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.Fixed   = activity;
+        slot.StartNs = startNs;
+        slot.Listed  = 1;
+        slot.Sequence.store(sequence + 2, std::memory_order_release);
+        return &slot;
+    }
+    return nullptr;
+}
+
+void ActivityBoard::Release(BoardSlot *slot)
+{
+    const uint32_t sequence = slot->Sequence.load(std::memory_order_relaxed);
+    slot->Sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->Listed = 0;
+    slot->Sequence.store(sequence + 2, std::memory_order_release);
+    slot->Claimed.store(0, std::memory_order_release);
+}
+
+ActivityEntry::ActivityEntry(const SandboxConfiguration &config, uint32_t priority, uint64_t startNs)
+    : _board(ActivityBoard::GetPublished())
+{
+    if (_board == nullptr)
+        return;
+
+    SandboxActivity activity{};
+    CopyName(activity.TaskName, config.TaskName != nullptr ? config.TaskName : "");
+    CopyName(activity.Policy, config.Policy != nullptr ? config.Policy : "default");
+    activity.Priority    = priority;
+    activity.MaxCpuTime  = config.MaxCpuTime;
+    activity.MaxRealTime = config.MaxRealTime;
+    activity.MaxMemory   = config.MaxMemory;
+    _slot                = _board->Claim(activity, startNs);
+    if (_slot == nullptr)
+        _board.reset();
+}
+
+ActivityEntry::~ActivityEntry()
+{
+    if (_slot != nullptr)
+        _board->Release(_slot);
+}
+
+void ActivityEntry::SetPhase(uint32_t phase)
+{
+    if (_slot != nullptr)
+        _slot->Phase.store(phase, std::memory_order_relaxed);
+}
+
+void ActivityEntry::SetPid(pid_t pid)
+{
+    if (_slot != nullptr)
+        _slot->Pid.store(pid, std::memory_order_relaxed);
+}
+
+void ActivityEntry::SetCpuCore(int cpu)
+{
+    if (_slot != nullptr)
+        _slot->CpuCore.store(cpu, std::memory_order_relaxed);
+}
+
+void ActivityEntry::SetUsage(uint64_t cpuTimeUs, uint64_t memoryUsage)
+{
+    if (_slot == nullptr)
+        return;
+    _slot->CpuTimeUs.store(cpuTimeUs, std::memory_order_relaxed);
+    _slot->MemoryUsage.store(memoryUsage, std::memory_order_relaxed);
+}
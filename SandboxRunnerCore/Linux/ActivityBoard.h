@@ -0,0 +1,92 @@
+#ifndef SANDBOX_ACTIVITY_BOARD_H
+#define SANDBOX_ACTIVITY_BOARD_H
+
+#include "../Sandbox.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+struct BoardLayout;
+struct BoardSlot;
+
+/**
+ * @brief Shared memory that lists the runs in progress of one process, for a viewer in another
+ * @remarks The process publishes at most one board. Every run claims a slot for its lifetime and writes
+ * what changes with plain atomic stores, so a viewer costs the runs nothing. The fixed fields of a slot
+ * are written under a sequence lock when it is claimed.
+ */
+class ActivityBoard
+{
+public:
+    /**
+     * @brief Publish a board under name, or stop publishing with an empty name
+     * @remarks Runs that hold a slot of a replaced board keep it until they finish; it is unlinked when
+     * the last of them does.
+     */
+    static bool Publish(const std::string &name);
+
+    /**
+     * @brief The board runs claim their slot from, nullptr while none is published
+     */
+    static std::shared_ptr<ActivityBoard> GetPublished();
+
+    /**
+     * @brief The runs on the board a process on this machine published under name
+     * @return std::nullopt if there is no such board or the process that published it is gone
+     */
+    static std::optional<std::vector<SandboxActivity>> Read(const std::string &name);
+
+    ~ActivityBoard();
+
+    ActivityBoard(const ActivityBoard &)            = delete;
+    ActivityBoard &operator=(const ActivityBoard &) = delete;
+
+    /**
+     * @return nullptr if every slot is taken
+     */
+    BoardSlot *Claim(const SandboxActivity &activity, uint64_t startNs);
+    void Release(BoardSlot *slot);
+
+    const std::string &GetName() const { return _name; }
+
+private:
+    ActivityBoard(std::string name, BoardLayout *layout);
+
+    std::string _name;
+    BoardLayout *_layout;
+};
+
+/**
+ * @brief The slot of one run on the published board, if any, released when the run finishes
+ * @remarks Every setter does nothing when the run is not listed, because no board is published or it is full.
+ */
+class ActivityEntry
+{
+public:
+    ActivityEntry(const SandboxConfiguration &config, uint32_t priority, uint64_t startNs);
+    ~ActivityEntry();
+
+    ActivityEntry(const ActivityEntry &)            = delete;
+    ActivityEntry &operator=(const ActivityEntry &) = delete;
+
+    bool IsListed() const { return _slot != nullptr; }
+
+    void SetPhase(uint32_t phase);
+    void SetPid(pid_t pid);
+    void SetCpuCore(int cpu);
+
+    /**
+     * @brief Called by the sampler thread with every sample of the program
+     */
+    void SetUsage(uint64_t cpuTimeUs, uint64_t memoryUsage);
+
+private:
+    std::shared_ptr<ActivityBoard> _board;
+    BoardSlot *_slot = nullptr;
+};
+
+#endif //! SANDBOX_ACTIVITY_BOARD_H
@@ -0,0 +1,125 @@
+#include "CoreAllocator.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <sched.h>
+#include <string>
+
+std::vector<int> ParseCpuList(std::string_view list)
+{
+    std::vector<int> cpus;
+    while (!list.empty() && (list.back() == '\n' || list.back() == ' '))
+        list.remove_suffix(1);
+
+    while (!list.empty())
+    {
+        const size_t comma = list.find(',');
+        const std::string_view range = list.substr(0, comma);
+        list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+
+        const size_t dash = range.find('-');
+        int first = 0;
+        int last  = 0;
+        const char *end = range.data() + range.size();
+        if (std::from_chars(range.data(), range.data() + std::min(dash, range.size()), first).ec != std::errc())
+            return {};
+        if (dash == std::string_view::npos)
+            last = first;
+        else if (std::from_chars(range.data() + dash + 1, end, last).ec != std::errc() || last < first)
+            return {};
+
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+std::vector<PhysicalCore> ReadCoreTopology(const std::filesystem::path &cpuRoot, const std::vector<int> &cpus)
+{
+    std::vector<PhysicalCore> cores;
+    std::vector<int> assigned;
+    for (const int cpu : cpus)
+    {
+        if (std::find(assigned.begin(), assigned.end(), cpu) != assigned.end())
+            continue;
+
+        std::vector<int> siblings;
+        std::ifstream file(cpuRoot / ("cpu" + std::to_string(cpu)) / "topology" / "thread_siblings_list");
+        std::string line;
+        if (file && std::getline(file, line))
+            siblings = ParseCpuList(line);
+
+        // Only the usable siblings matter, the others can neither be taken nor disturbed by a sandbox.
+        std::erase_if(siblings, [&cpus](int sibling) {
+            return std::find(cpus.begin(), cpus.end(), sibling) == cpus.end();
+        });
+        if (std::find(siblings.begin(), siblings.end(), cpu) == siblings.end())
+            siblings = {cpu};
+
+        assigned.insert(assigned.end(), siblings.begin(), siblings.end());
+        cores.push_back(PhysicalCore{.Cpu = siblings.front(), .Siblings = std::move(siblings)});
+    }
+    return cores;
+}
+
+CoreAllocator &CoreAllocator::Instance()
+{
+    static CoreAllocator instance([] {
+        std::vector<int> cpus;
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+            }
+        }
+        return ReadCoreTopology("/sys/devices/system/cpu", cpus);
+    }());
+    return instance;
+}
+
+CoreAllocator::CoreAllocator(std::vector<PhysicalCore> cores) : _cores(std::move(cores)), _busy(_cores.size(), false)
+{
+}
+
+int CoreAllocator::Acquire(uint32_t priority)
+{
+    if (_cores.empty())
+        return -1;
+
+    std::unique_lock lock(_mutex);
+    const auto place = _waiting.emplace(priority, _nextTicket++).first;
+    size_t core      = 0;
+    _released.wait(lock, [&] {
+        if (place != _waiting.begin())
+            return false;
+        const auto free = std::find(_busy.begin(), _busy.end(), false);
+        core            = static_cast<size_t>(free - _busy.begin());
+        return free != _busy.end();
+    });
+
+    _busy[core] = true;
+    _waiting.erase(place);
+    // The next waiter may find another free core right away.
+    _released.notify_all();
+    return _cores[core].Cpu;
+}
+
+void CoreAllocator::Release(int cpu)
+{
+    {
+        std::lock_guard lock(_mutex);
+        const auto core = std::find_if(_cores.begin(), _cores.end(), [cpu](const PhysicalCore &c) { return c.Cpu == cpu; });
+        if (core == _cores.end())
+            return;
+        _busy[static_cast<size_t>(core - _cores.begin())] = false;
+    }
+    _released.notify_all();
+}
@@ -0,0 +1,104 @@
+#ifndef SANDBOX_CORE_ALLOCATOR_H
+#define SANDBOX_CORE_ALLOCATOR_H
+
+#include "../Metrics.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A physical core: the logical CPUs that share its execution units (SMT siblings)
+ */
+struct PhysicalCore
+{
+    int Cpu = -1;              // The sibling sandboxes are pinned to, the lowest usable one
+    std::vector<int> Siblings; // Every usable logical CPU of the core, Cpu included
+};
+
+/**
+ * @brief Parse a kernel CPU list such as "0-3,8,10-11"
+ * @return The CPUs in ascending order, empty if the list is malformed
+ */
+std::vector<int> ParseCpuList(std::string_view list);
+
+/**
+ * @brief Group the given logical CPUs into physical cores
+ * @param cpuRoot A sysfs CPU directory, normally /sys/devices/system/cpu
+ * @remarks Reads cpu<N>/topology/thread_siblings_list. A CPU without topology information is a core of its own.
+ */
+std::vector<PhysicalCore> ReadCoreTopology(const std::filesystem::path &cpuRoot, const std::vector<int> &cpus);
+
+/**
+ * @brief Hands out whole physical cores to concurrent sandboxes
+ * @remarks A sandbox holding a core has it to itself: no other sandbox gets the same CPU or one of its
+ * SMT siblings. When every core is taken, Acquire queues the caller; cores are handed out by priority,
+ * then first come, first served.
+ */
+class CoreAllocator
+{
+public:
+    /**
+     * @brief The allocator over the cores the supervisor may run on, read once on first use
+     */
+    static CoreAllocator &Instance();
+
+    explicit CoreAllocator(std::vector<PhysicalCore> cores);
+
+    /**
+     * @brief Block until a core is free and no caller of a higher priority is waiting, and take it
+     * @param priority A SandboxPriority, lower values are served first
+     * @return The CPU to pin to, -1 if there are no cores at all
+     */
+    int Acquire(uint32_t priority = 0);
+
+    /**
+     * @brief Give back a core taken by Acquire
+     */
+    void Release(int cpu);
+
+    [[nodiscard]] size_t GetCoreCount() const { return _cores.size(); }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _released;
+    std::vector<PhysicalCore> _cores;
+    std::vector<bool> _busy;
+    std::set<std::pair<uint32_t, uint64_t>> _waiting; // Priority and ticket of each caller of Acquire, in serving order
+    uint64_t _nextTicket = 0;                         // Handed to the next caller of Acquire
+};
+
+/**
+ * @brief Holds a core of CoreAllocator::Instance() for the lifetime of the object
+ */
+class CoreLease
+{
+public:
+    CoreLease() = default;
+    explicit CoreLease(CoreAllocator &allocator, uint32_t priority = 0) : _allocator(&allocator)
+    {
+        const ScopedGauge waiting(MetricGauge::CoreQueueDepth);
+        _cpu = allocator.Acquire(priority);
+    }
+    ~CoreLease()
+    {
+        if (_cpu >= 0)
+            _allocator->Release(_cpu);
+    }
+
+    CoreLease(const CoreLease &)            = delete;
+    CoreLease &operator=(const CoreLease &) = delete;
+
+    [[nodiscard]] int GetCpu() const { return _cpu; }
+
+private:
+    CoreAllocator *_allocator = nullptr;
+    int _cpu                  = -1;
+};
+
+#endif //! SANDBOX_CORE_ALLOCATOR_H
@@ -29,12 +29,22 @@ int HandleParentError(const ErrorContext &ctx)
             return "Fork failed";
         case InternalError::ExecFailed:
             return "Exec failed";
+        case InternalError::ExecHandshakeFailed:
+            return "Exec handshake failed";
         case InternalError::WaitFailed:
             return "Wait failed";
         case InternalError::PolicyApplicationFailed:
             return "Policy application failed";
+        case InternalError::PathAccessRulesFailed:
+            return "Path access rules failed";
         case InternalError::MonitorThreadStartFailed:
             return "Monitor thread start failed";
+        case InternalError::NotifyChannelFailed:
+            return "Notify channel failed";
+        case InternalError::NamespaceSetupFailed:
+            return "Namespace setup failed";
+        case InternalError::ScratchDirectoryFailed:
+            return "Scratch directory setup failed";
         default:
             return "Unknown error";
         }
@@ -74,6 +84,12 @@ int HandleParentError(const ErrorContext &ctx)
             return "Exec failed";
         case InternalError::PolicyApplicationFailed:
             return "Policy application failed";
+        case InternalError::PathAccessRulesFailed:
+            return "Path access rules failed";
+        case InternalError::NamespaceSetupFailed:
+            return "Namespace setup failed";
+        case InternalError::ScratchDirectoryFailed:
+            return "Scratch directory setup failed";
         default:
             return "Unknown error";
         }
@@ -29,14 +29,23 @@ enum class InternalError
     // Process management errors
     ForkFailed,
     ExecFailed,
+    ExecHandshakeFailed,
     WaitFailed,
 
     // Security policy errors
     PolicyApplicationFailed,
+    PathAccessRulesFailed,
 
     // Monitor thread errors
     MonitorThreadStartFailed,
 
+    // Seccomp user-notification channel errors
+    NotifyChannelFailed,
+
+    // Namespace isolation errors
+    NamespaceSetupFailed,
+    ScratchDirectoryFailed,
+
     // Generic internal error
     Unknown
 };
@@ -0,0 +1,164 @@
+#include "ExecutableCache.h"
+
+#include "../Logger.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MFD_EXEC
+#define MFD_EXEC 0x0010U
+#endif
+
+namespace
+{
+
+constexpr unsigned int EXECUTABLE_SEALS = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+constexpr size_t MAX_REMEMBERED_SCRIPTS = 1024;
+
+SandboxInternal::UniqueFd CreateExecutableMemfd()
+{
+    // Since Linux 6.3 a memfd is only executable when asked for, older kernels reject the flag.
+    int fd = memfd_create("sandbox-executable", MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_EXEC);
+    if (fd < 0 && errno == EINVAL)
+        fd = memfd_create("sandbox-executable", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    return SandboxInternal::UniqueFd(fd);
+}
+
+bool CopyFileContent(int source, int destination, uint64_t size)
+{
+    off_t offset = 0;
+    while (static_cast<uint64_t>(offset) < size)
+    {
+        const ssize_t copied = sendfile(destination, source, &offset, size - static_cast<uint64_t>(offset));
+        if (copied < 0 && errno == EINTR)
+            continue;
+        // The file shrank while it was copied.
+        if (copied <= 0)
+            return false;
+    }
+    return true;
+}
+
+bool IsScript(int fd)
+{
+    char magic[2]{};
+    return pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && magic[0] == '#' && magic[1] == '!';
+}
+
+} // namespace
+
+ExecutableCache &ExecutableCache::Instance()
+{
+    static ExecutableCache instance;
+    return instance;
+}
+
+std::shared_ptr<const CachedExecutable> ExecutableCache::Acquire(const std::string &path)
+{
+    {
+        std::lock_guard lock(_mutex);
+        if (_budget == 0)
+            return nullptr;
+    }
+
+    const auto digest = HashFileContent(path);
+    if (!digest.has_value())
+        return nullptr;
+    {
+        std::lock_guard lock(_mutex);
+        if (const auto found = _entries.find(*digest); found != _entries.end())
+        {
+            _recency.splice(_recency.begin(), _recency, found->second.Recency);
+            return found->second.Executable;
+        }
+        if (_scripts.contains(*digest))
+            return nullptr;
+    }
+
+    // Keyed by what was actually copied, in case the file changed since it was hashed.
+    ContentDigest loadedDigest{};
+    bool isScript   = false;
+    auto executable = Load(path, loadedDigest, isScript);
+    if (executable == nullptr)
+    {
+        if (!isScript)
+            return nullptr;
+        std::lock_guard lock(_mutex);
+        if (_scripts.size() >= MAX_REMEMBERED_SCRIPTS)
+            _scripts.clear();
+        _scripts.insert(*digest);
+        return nullptr;
+    }
+
+    std::lock_guard lock(_mutex);
+    if (const auto found = _entries.find(loadedDigest); found != _entries.end())
+        return found->second.Executable;
+    if (executable->GetSize() > _budget)
+        return nullptr;
+
+    _recency.push_front(loadedDigest);
+    _entries.emplace(loadedDigest, Entry{executable, _recency.begin()});
+    _size += executable->GetSize();
+    EvictLocked();
+    Logger::Debug("Cached executable {0}, {1} bytes in {2} executables", path, _size, _entries.size());
+    return executable;
+}
+
+void ExecutableCache::SetBudget(uint64_t budget)
+{
+    std::lock_guard lock(_mutex);
+    _budget = budget;
+    EvictLocked();
+}
+
+uint64_t ExecutableCache::GetSize() const
+{
+    std::lock_guard lock(_mutex);
+    return _size;
+}
+
+size_t ExecutableCache::GetCount() const
+{
+    std::lock_guard lock(_mutex);
+    return _entries.size();
+}
+
+std::shared_ptr<const CachedExecutable> ExecutableCache::Load(const std::string &path,
+                                                              ContentDigest &digest,
+                                                              bool &isScript) const
+{
+    const SandboxInternal::UniqueFd source(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat info{};
+    if (!source.valid() || fstat(source.get(), &info) != 0 || !S_ISREG(info.st_mode))
+        return nullptr;
+    isScript = IsScript(source.get());
+    if (isScript)
+        return nullptr;
+
+    auto memfd = CreateExecutableMemfd();
+    const auto size = static_cast<uint64_t>(info.st_size);
+    if (!memfd.valid() || !CopyFileContent(source.get(), memfd.get(), size)
+        || fcntl(memfd.get(), F_ADD_SEALS, EXECUTABLE_SEALS) != 0)
+        return nullptr;
+
+    const auto loaded = HashFileDescriptor(memfd.get());
+    if (!loaded.has_value())
+        return nullptr;
+    digest = *loaded;
+    return std::make_shared<const CachedExecutable>(std::move(memfd), size);
+}
+
+void ExecutableCache::EvictLocked()
+{
+    while (_size > _budget && !_recency.empty())
+    {
+        const auto evicted = _entries.find(_recency.back());
+        _size -= evicted->second.Executable->GetSize();
+        _entries.erase(evicted);
+        _recency.pop_back();
+    }
+}
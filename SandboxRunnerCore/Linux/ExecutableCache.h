@@ -0,0 +1,82 @@
+#ifndef SANDBOX_EXECUTABLE_CACHE_H
+#define SANDBOX_EXECUTABLE_CACHE_H
+
+#include "../ContentHash.h"
+#include "../InternalHelpers.h"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+// Memory the cached executables may take by default, byte.
+constexpr uint64_t DEFAULT_EXECUTABLE_CACHE_BUDGET = 256ULL * 1024 * 1024;
+
+/**
+ * @brief An executable copied into a sealed memfd
+ * @remarks The descriptor is close-on-exec: the child executes it with fexecve() and the program does not
+ * inherit it.
+ */
+class CachedExecutable
+{
+public:
+    CachedExecutable(SandboxInternal::UniqueFd fd, uint64_t size) : _fd(std::move(fd)), _size(size) {}
+
+    int GetFd() const { return _fd.get(); }
+    uint64_t GetSize() const { return _size; }
+
+private:
+    SandboxInternal::UniqueFd _fd;
+    uint64_t _size;
+};
+
+/**
+ * @brief Sealed in-memory copies of the executables run by this process, keyed by content
+ * @remarks Each binary is read from its path once; later runs of the same content only stat the path.
+ * The least recently used copies are dropped once the total size passes the budget. A copy stays valid
+ * for the runs still holding it. Scripts are not cached, since the interpreter would reopen a
+ * close-on-exec descriptor that execve already closed.
+ */
+class ExecutableCache
+{
+public:
+    static ExecutableCache &Instance();
+
+    explicit ExecutableCache(uint64_t budget = DEFAULT_EXECUTABLE_CACHE_BUDGET) : _budget(budget) {}
+
+    /**
+     * @brief The cached copy of the executable at path, loading it on a miss
+     * @return nullptr if the file cannot be read, is a script or does not fit in the budget
+     */
+    std::shared_ptr<const CachedExecutable> Acquire(const std::string &path);
+
+    /**
+     * @brief Change the budget, evicting at once if the cache is over it. 0 disables the cache.
+     */
+    void SetBudget(uint64_t budget);
+
+    uint64_t GetSize() const;
+    size_t GetCount() const;
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const CachedExecutable> Executable;
+        std::list<ContentDigest>::iterator Recency;
+    };
+
+    std::shared_ptr<const CachedExecutable> Load(const std::string &path, ContentDigest &digest, bool &isScript) const;
+    void EvictLocked();
+
+    mutable std::mutex _mutex;
+    uint64_t _budget;
+    uint64_t _size = 0;
+    std::map<ContentDigest, Entry> _entries;
+    std::list<ContentDigest> _recency; // Most recently used first
+    std::set<ContentDigest> _scripts;  // Not cached, remembered so they are not read again
+};
+
+#endif //! SANDBOX_EXECUTABLE_CACHE_H
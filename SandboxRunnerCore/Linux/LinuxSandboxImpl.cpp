@@ -1,4 +1,3 @@
-#include <chrono>
 #include "SandboxImpl.h"
 #include "fmt/core.h"
 #include "../Logger.h"
@@ -6,28 +5,253 @@
 
 #include "../SandboxUtils.h" // IWYU pragma: keep
 #include "../InternalHelpers.h"
+#include "../Metrics.h"
 #include "SandboxChildProcess.h"
 #include "SandboxMonitor.h"
+#include "ActivityBoard.h"
+#include "SyscallProfiler.h"
+#include "SeccompNotify.h"
+#include "PhaseTrace.h"
+#include "CoreAllocator.h"
+#include "MemoryAdmission.h"
+#include "TimingCalibration.h"
+#include "SeccompSupervisor.h"
+#include "OutputRelay.h"
+#include "ProcessStats.h"
+#include "ResourceSampler.h"
+#include "ResultCache.h"
+#include "ExecutableCache.h"
+#include "PathAccessRuleset.h"
+#include "NamespacePool.h"
+#include "../Policy/PolicyRegistry.h"
+#include "../Policy/ResourceConfig.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <optional>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
 
 constexpr int MAX_ARGUMENTS       = 128;
+// How often MaxMemory and MaxIdleTime are checked when live sampling is off.
+constexpr uint32_t LIMIT_WATCH_INTERVAL_MS = 10;
+// How often a run listed on an activity board is sampled when nothing else samples it.
+constexpr uint32_t ACTIVITY_SAMPLE_INTERVAL_MS = 500;
 [[maybe_unused]] constexpr int USER_COMMAND_LENGTH = 1024;
 
-SandboxImpl::SandboxImpl(const SandboxConfiguration *config, SandboxResult &result) : _config(config), _result(result)
+namespace
 {
-    memset(&result, 0, sizeof(SandboxResult));
+
+struct SharedTimestampsDeleter
+{
+    void operator()(SandboxChildTimestamps *timestamps) const
+    {
+        timestamps->~SandboxChildTimestamps();
+        munmap(timestamps, sizeof(SandboxChildTimestamps));
+    }
+};
+
+using SharedTimestamps = std::unique_ptr<SandboxChildTimestamps, SharedTimestampsDeleter>;
+
+// Ordinary memory is copied on fork, the child's timestamps are only visible through a shared mapping.
+SharedTimestamps MapSharedTimestamps()
+{
+    void *memory = mmap(nullptr, sizeof(SandboxChildTimestamps), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return nullptr;
+    return SharedTimestamps(new (memory) SandboxChildTimestamps());
+}
+
+/**
+ * @brief Block until the child's execve succeeded or the child is gone
+ * @remarks Another thread forking concurrently may hold a copy of the write end until its own child
+ * executes, which only delays the handshake.
+ * @return true if execve succeeded
+ */
+bool WaitForExecHandshake(int handshakeFd)
+{
+    int childErrno = 0;
+    ssize_t bytesRead;
+    do
+    {
+        bytesRead = read(handshakeFd, &childErrno, sizeof(childErrno));
+    } while (bytesRead < 0 && errno == EINTR);
+    return bytesRead == 0;
+}
+
+uint64_t NanosecondsToMilliseconds(uint64_t nanoseconds)
+{
+    return nanoseconds / 1000000ULL;
+}
+
+uint64_t TimevalToMicroseconds(const timeval &time)
+{
+    return static_cast<uint64_t>(time.tv_sec) * 1000000ULL + static_cast<uint64_t>(time.tv_usec);
+}
+
+// RLIMIT_FSIZE only limits regular files; a pipe, socket or device needs the OutputRelay.
+bool IsOutputSizeUnenforced(const char *workingDirectory, const char *outputFile)
+{
+    struct stat info{};
+    // The child opens a relative OutputFile after changing to the working directory.
+    const int result = outputFile != nullptr
+                           ? stat(SandboxInternal::ResolveSandboxPath(workingDirectory, outputFile).c_str(), &info)
+                           : fstat(STDOUT_FILENO, &info);
+    // A missing file is created by the child as a regular file.
+    return result == 0 && !S_ISREG(info.st_mode);
+}
+
+void FillResourceCounters(const rusage &usage, const std::optional<ProcessIoCounters> &io, SandboxResultEx &resultEx)
+{
+    resultEx.UserTimeUs                 = TimevalToMicroseconds(usage.ru_utime);
+    resultEx.SystemTimeUs               = TimevalToMicroseconds(usage.ru_stime);
+    resultEx.MinorPageFaults            = static_cast<uint64_t>(usage.ru_minflt);
+    resultEx.MajorPageFaults            = static_cast<uint64_t>(usage.ru_majflt);
+    resultEx.VoluntaryContextSwitches   = static_cast<uint64_t>(usage.ru_nvcsw);
+    resultEx.InvoluntaryContextSwitches = static_cast<uint64_t>(usage.ru_nivcsw);
+    resultEx.BlockInputOperations       = static_cast<uint64_t>(usage.ru_inblock);
+    resultEx.BlockOutputOperations      = static_cast<uint64_t>(usage.ru_oublock);
+    resultEx.PeakMemoryUsage            = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+    resultEx.PeakMemorySource           = SANDBOX_PEAK_MEMORY_SOURCE_RUSAGE;
+
+    if (io.has_value())
+    {
+        resultEx.ReadBytes         = io->ReadChars;
+        resultEx.WriteBytes        = io->WriteChars;
+        resultEx.StorageReadBytes  = io->ReadBytes;
+        resultEx.StorageWriteBytes = io->WriteBytes;
+        resultEx.HasIoCounters     = 1;
+    }
+}
+
+} // namespace
+
+SandboxImpl::SandboxImpl(const SandboxConfiguration *config,
+                         const SandboxConfigurationEx *extension,
+                         SandboxResult *result,
+                         SandboxResultEx *resultEx)
+    : _config(config), _extension(), _resultEx(), _result(_resultEx.Result), _resultOut(result), _resultExOut(resultEx)
+{
+    if (extension != nullptr)
+        memcpy(&_extension, extension, std::min<size_t>(extension->StructSize, sizeof(SandboxConfigurationEx)));
+    _extension.StructSize = sizeof(SandboxConfigurationEx);
+
+    _resultEx.StructSize = sizeof(SandboxResultEx);
+    _resultEx.Version    = SANDBOX_RESULT_EX_VERSION;
+    _resultEx.CpuCore    = -1;
 }
 
 int SandboxImpl::Run()
+{
+    Logger::Initialize(_config->TaskName, _config->LogFile, Logger::LoggerLevel::Debug);
+
+    // Profiling observes the program itself, a replayed result would not write the profile.
+    std::optional<ResultCache> resultCache;
+    std::optional<ContentDigest> cacheKey;
+    if (_extension.ResultCacheFile != nullptr && _extension.ProfileOutputFile == nullptr)
+    {
+        resultCache.emplace(_extension.ResultCacheFile);
+        cacheKey = ComputeResultCacheKey(*_config, _extension);
+        if (!cacheKey.has_value())
+            Logger::Warning("Cannot read the program or the input file, the result cache is bypassed");
+    }
+
+    int status;
+    if (cacheKey.has_value() && _extension.ResultCacheMode != SANDBOX_RESULT_CACHE_REFRESH
+        && resultCache->Replay(*cacheKey, *_config, _resultEx))
+    {
+        Logger::Info("Replayed the result from the result cache");
+        MetricsRegistry::Instance().Increment(MetricCounter::ResultCacheHits);
+        status = SANDBOX_STATUS_SUCCESS;
+    }
+    else
+    {
+        status = _extension.TimingCalibration != SANDBOX_TIMING_CALIBRATION_OFF ? RunCalibrated() : RunSandbox();
+        if (status == SANDBOX_STATUS_SUCCESS && cacheKey.has_value())
+            resultCache->Record(*cacheKey, *_config, _resultEx);
+    }
+
+    MetricsRegistry::Instance().RecordVerdict(status == SANDBOX_STATUS_SUCCESS ? _result.Status : status);
+    if (_resultOut != nullptr)
+        *_resultOut = _result;
+    if (_resultExOut != nullptr)
+        *_resultExOut = _resultEx;
+    return status;
+}
+
+int SandboxImpl::RunCalibrated()
+{
+    const auto calibration = TimingCalibrator::Instance().Get();
+    if (_extension.TimingCalibration == SANDBOX_TIMING_CALIBRATION_SCALE_CPU_LIMIT && _config->MaxCpuTime != UNLIMITED)
+    {
+        _scaledConfig            = *_config;
+        _scaledConfig.MaxCpuTime = static_cast<uint64_t>(
+            std::ceil(static_cast<double>(_config->MaxCpuTime) / calibration.SpeedFactor));
+        _config = &_scaledConfig;
+    }
+
+    const SandboxResultEx blankResult = _resultEx;
+    int status = RunSandbox();
+    if (status != SANDBOX_STATUS_SUCCESS)
+        return status;
+    ApplyCalibration(calibration);
+
+    // Of several runs the fastest is the least disturbed one.
+    SandboxResultEx fastest    = _resultEx;
+    const int firstStatus      = _result.Status;
+    bool verdictsAgree         = true;
+    uint32_t runCount          = 1;
+    while (_resultEx.TimingConfidence == SANDBOX_TIMING_CONFIDENCE_LOW && runCount <= _extension.MaxNearLimitReruns)
+    {
+        Logger::Info("CPU time {0} ms is within the timing noise of the {1} ms limit, re-running",
+                     _result.CpuTimeUsage, _config->MaxCpuTime);
+        _resultEx = blankResult;
+        if (RunSandbox() != SANDBOX_STATUS_SUCCESS)
+            break;
+        ++runCount;
+        ApplyCalibration(calibration);
+        verdictsAgree = verdictsAgree && _result.Status == firstStatus;
+        if (_resultEx.UserTimeUs < fastest.UserTimeUs)
+            fastest = _resultEx;
+    }
+
+    _resultEx          = fastest;
+    _resultEx.RunCount = runCount;
+    if (runCount > 1)
+        _resultEx.TimingConfidence = verdictsAgree ? SANDBOX_TIMING_CONFIDENCE_HIGH : SANDBOX_TIMING_CONFIDENCE_LOW;
+    return status;
+}
+
+void SandboxImpl::ApplyCalibration(const TimingCalibrationSnapshot &calibration)
+{
+    _resultEx.SpeedFactor         = calibration.SpeedFactor;
+    _resultEx.TimingNoise         = calibration.Noise;
+    _resultEx.NormalizedCpuTimeUs = static_cast<uint64_t>(
+        std::llround(static_cast<double>(_resultEx.UserTimeUs) * calibration.SpeedFactor));
+    _resultEx.TimingConfidence = AssessTimingConfidence(_result.CpuTimeUsage, _config->MaxCpuTime, calibration.Noise);
+    _resultEx.RunCount         = 1;
+}
+
+int SandboxImpl::RunSandbox()
 {
     using SandboxInternal::ErrorContext;
     using SandboxInternal::InternalError;
     using SandboxInternal::HandleParentError;
 
-    Logger::Initialize(_config->TaskName, _config->LogFile, Logger::LoggerLevel::Debug);
+    auto &timeline        = _resultEx.Timeline;
+    timeline.PrepareStart = SandboxInternal::MonotonicNowNs();
+
     Logger::Info("Start running sandboxed process");
+    ActivityEntry activity(*_config, std::min<uint32_t>(_extension.Priority, SANDBOX_PRIORITY_IDLE),
+                           timeline.PrepareStart);
 
     /* No permission */
     /*if (getuid() != 0)
@@ -55,25 +279,183 @@ int SandboxImpl::Run()
     }
     args.push_back(nullptr);
 
+    // The profiling filter notifies on every syscall already and keeps RLIMIT_NPROC instead.
+    const bool profiling   = _extension.ProfileOutputFile != nullptr;
+    const bool processGate = !profiling && _config->MaxProcessCount >= 0;
+
+    SandboxChildContext childContext;
+    // An unknown policy is reported by the child, like the seccomp filter it fails to build.
+    SandboxInternal::UniqueFd pathRuleset;
+    SandboxPolicyEngine::SandboxPolicy resolvedPolicy;
+    const auto *policy =
+        profiling ? nullptr : SandboxPolicyEngine::TryResolvePolicyNoCache(_config->Policy, resolvedPolicy);
+    if (policy != nullptr && !policy->PathAccessRules.empty())
+    {
+        auto ruleset = CreatePathAccessRuleset(
+            *policy, SandboxInternal::ResolveSandboxPath(_config->WorkingDirectory, cmdArgs.front()));
+        if (!ruleset.has_value())
+        {
+            return HandleParentError(
+                ErrorContext(InternalError::PathAccessRulesFailed, "Failed to build path access rules"));
+        }
+        pathRuleset                = std::move(*ruleset);
+        childContext.PathRulesetFd = pathRuleset.get();
+    }
+
+    // Only the rare syscalls the BPF filter cannot decide are sent to the supervisor.
+    const bool supervised = policy != nullptr && !policy->Supervisor.IsEmpty();
+
+    // Declared before the relay, whose thread may set it until the relay is destroyed.
+    std::atomic<uint32_t> terminationReason{SANDBOX_TERMINATION_NONE};
+    OutputRelay outputRelay;
+    const bool relayOutput = _config->MaxOutputSize != UNLIMITED
+                             && IsOutputSizeUnenforced(_config->WorkingDirectory, _config->OutputFile);
+    if (relayOutput)
+    {
+        const auto outputPath = _config->OutputFile != nullptr
+                                    ? SandboxInternal::ResolveSandboxPath(_config->WorkingDirectory, _config->OutputFile)
+                                    : std::string();
+        if (!outputRelay.Open(outputPath, _config->MaxOutputSize))
+        {
+            return HandleParentError(ErrorContext(InternalError::OutputFileOpenFailed, "Failed to open output file"));
+        }
+        childContext.OutputPipeFd = outputRelay.GetWriteFd();
+    }
+
+    SandboxInternal::UniqueFd notifySocket;
+    if (profiling || processGate || supervised)
+    {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+        {
+            return HandleParentError(ErrorContext(InternalError::NotifyChannelFailed, "Failed to create notify socket"));
+        }
+        notifySocket.reset(sockets[0]);
+        childContext.Profiling    = profiling;
+        childContext.ProcessGate  = processGate;
+        childContext.Supervised   = supervised;
+        childContext.NotifySocket = sockets[1];
+    }
+
+    // Closed by a successful execve in the child; see WaitForExecHandshake.
+    int handshakePipe[2];
+    if (pipe2(handshakePipe, O_CLOEXEC) != 0)
+    {
+        if (childContext.NotifySocket >= 0)
+            close(childContext.NotifySocket);
+        return HandleParentError(ErrorContext(InternalError::ExecHandshakeFailed, "Failed to create exec handshake pipe"));
+    }
+    SandboxInternal::UniqueFd execHandshake(handshakePipe[0]);
+    childContext.ExecHandshakeFd = handshakePipe[1];
+
+    // Without it the run still works, only ChildSetupStart and ExecStart stay 0.
+    const auto childTimestamps = MapSharedTimestamps();
+    childContext.Timestamps    = childTimestamps.get();
+
+    childContext.Priority = std::min<uint32_t>(_extension.Priority, SANDBOX_PRIORITY_IDLE);
+
+    // Held until the program is reaped, like the core. A run waits for memory first, so it does not keep a
+    // core idle while it is queued; a scratch directory is memory too.
+    const uint64_t memoryLimit =
+        SandboxPolicyEngine::ResourceConfig::FromCConfig(*_config).GetEffectiveMaxMemoryToCrash();
+    activity.SetPhase(SANDBOX_ACTIVITY_WAITING_FOR_MEMORY);
+    const MemoryAdmissionLease memoryLease(
+        MemoryAdmission::Instance(), memoryLimit == 0 ? 0 : memoryLimit + _extension.ScratchSize, childContext.Priority);
+    _resultEx.MemoryAdmissionWaitNs = memoryLease.GetWaitNs();
+    _resultEx.MemoryQueueDepth      = memoryLease.GetQueueDepth();
+
+    // Held until the program is reaped. Waiting for a free core happens before ForkStart.
+    std::optional<CoreLease> coreLease;
+    if (_extension.PinToCore != 0)
+    {
+        activity.SetPhase(SANDBOX_ACTIVITY_WAITING_FOR_CORE);
+        coreLease.emplace(CoreAllocator::Instance(), childContext.Priority);
+        childContext.PinnedCpu = coreLease->GetCpu();
+        _resultEx.CpuCore      = childContext.PinnedCpu;
+        activity.SetCpuCore(childContext.PinnedCpu);
+        if (childContext.PinnedCpu < 0)
+            Logger::Warning("No CPU core to pin to, running unpinned");
+    }
+
+    // The child inherits the descriptor, so the copy may be evicted as soon as fork returns.
+    std::shared_ptr<const CachedExecutable> cachedExecutable;
+    if (_extension.CacheExecutable != 0)
+    {
+        cachedExecutable = ExecutableCache::Instance().Acquire(
+            SandboxInternal::ResolveSandboxPath(_config->WorkingDirectory, cmdArgs.front()));
+        if (cachedExecutable != nullptr)
+        {
+            childContext.ProgramFd        = cachedExecutable->GetFd();
+            _resultEx.FromExecutableCache = 1;
+            MetricsRegistry::Instance().Increment(MetricCounter::ExecutableCacheHits);
+        }
+    }
+
+    childContext.ScratchSize = _extension.ScratchSize;
+
+    // Handed back to the pool after the reap; an early return destroys the set with whatever runs in it.
+    std::unique_ptr<NamespaceSet> namespaces;
+    if (_extension.Namespaces != 0)
+    {
+        bool fromPool = false;
+        namespaces    = NamespacePool::Instance().Acquire(_extension.Namespaces, fromPool);
+        if (namespaces == nullptr)
+        {
+            if (childContext.NotifySocket >= 0)
+                close(childContext.NotifySocket);
+            close(childContext.ExecHandshakeFd);
+            return HandleParentError(ErrorContext(InternalError::NamespaceSetupFailed, "Failed to create namespaces"));
+        }
+        childContext.Namespaces     = namespaces.get();
+        _resultEx.FromNamespacePool = fromPool ? 1 : 0;
+        if (fromPool)
+            MetricsRegistry::Instance().Increment(MetricCounter::NamespacePoolHits);
+    }
+
     Logger::Info("Starting sandboxed process: \"{0}\"", _config->UserCommand);
-    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    timeline.ForkStart = SandboxInternal::MonotonicNowNs();
+    activity.SetPhase(SANDBOX_ACTIVITY_STARTING);
+    MetricsRegistry::Instance().Increment(MetricCounter::Launches);
 
-    pid_t sandboxPid = fork();
+    pid_t sandboxPid = namespaces != nullptr
+                           ? namespaces->Fork([&] { RunSandboxProcess(args[0], args.data(), _config, childContext); })
+                           : fork();
     if (sandboxPid < 0)
     {
+        if (childContext.NotifySocket >= 0)
+            close(childContext.NotifySocket);
+        close(childContext.ExecHandshakeFd);
+        MetricsRegistry::Instance().Increment(MetricCounter::ForkFailures);
         return HandleParentError(ErrorContext(InternalError::ForkFailed, "Failed to fork process"));
     }
 
     if (sandboxPid == 0) /* Child Process */
     {
-        RunSandboxProcess(args[0], args.data(), _config);
+        RunSandboxProcess(args[0], args.data(), _config, childContext);
     }
     else
     {
         /* Parent Process */
+        timeline.ForkDone = SandboxInternal::MonotonicNowNs();
+        close(childContext.ExecHandshakeFd);
+        const ScopedGauge activeRun(MetricGauge::ActiveRuns);
+        activity.SetPid(sandboxPid);
+
+        if (relayOutput && !outputRelay.Start(sandboxPid, &terminationReason))
+        {
+            kill(sandboxPid, SIGKILL);
+            waitpid(sandboxPid, nullptr, 0);
+            return HandleParentError(ErrorContext(InternalError::MonitorThreadStartFailed, "Failed to start output relay"));
+        }
 
         SandboxInternal::ScopedThread monitorThread;
-        SandboxMonitorConfiguration monitorConfig{.Timeout = _config->MaxRealTime, .Pid = sandboxPid};
+        SandboxMonitorConfiguration monitorConfig{
+            .Timeout           = _config->MaxRealTime,
+            .Pid               = sandboxPid,
+            .StartTime         = timeline.ForkDone,
+            .ExecStart         = childTimestamps != nullptr ? &childTimestamps->ExecStart : nullptr,
+            .TerminationReason = &terminationReason,
+        };
 
         if (_config->MaxRealTime != UNLIMITED)
         {
@@ -85,16 +467,158 @@ int SandboxImpl::Run()
             monitorThread.reset(threadId);
         }
 
+        SyscallProfiler profiler;
+        SeccompSupervisorSession supervisorSession;
+        bool supervisorAttached = false;
+        if (childContext.NotifySocket >= 0)
+        {
+            close(childContext.NotifySocket);
+            // -1 means the child failed before installing the filter, wait4 below reports it.
+            const int notifyFd = ReceiveSeccompNotifyFd(notifySocket.get());
+            bool started = notifyFd < 0;
+            if (!started && profiling)
+            {
+                started = profiler.Start(notifyFd, sandboxPid);
+            }
+            else if (!started)
+            {
+                supervisorSession.Pid               = sandboxPid;
+                supervisorSession.MaxProcessCount   = processGate ? _config->MaxProcessCount : -1;
+                supervisorSession.Rules             = supervised ? &policy->Supervisor : nullptr;
+                supervisorSession.ProgramPath       = SandboxInternal::ResolveSandboxPath(_config->WorkingDirectory,
+                                                                                          cmdArgs.front());
+                supervisorSession.TerminationReason = &terminationReason;
+                started = supervisorAttached = SeccompSupervisor::Instance().Attach(&supervisorSession, notifyFd);
+            }
+            if (!started)
+            {
+                kill(sandboxPid, SIGKILL);
+                waitpid(sandboxPid, nullptr, 0);
+                return HandleParentError(ErrorContext(InternalError::NotifyChannelFailed,
+                                                      profiling ? "Failed to start profiler"
+                                                                : "Failed to attach seccomp supervisor"));
+            }
+        }
+
+        if (WaitForExecHandshake(execHandshake.get()))
+        {
+            timeline.ExecDone = SandboxInternal::MonotonicNowNs();
+            MetricsRegistry::Instance().Observe(MetricHistogram::LaunchLatency,
+                                                timeline.ExecDone - timeline.PrepareStart);
+            activity.SetPhase(SANDBOX_ACTIVITY_RUNNING);
+        }
+
+        // Sample the program only, before execve the child still shares the supervisor's memory.
+        // The same session kills the program as soon as it passes MaxMemory or MaxIdleTime. A run listed on an
+        // activity board is sampled for it.
+        const bool sampling    = _extension.SampleIntervalMs != 0;
+        const bool watchMemory = _config->MaxMemory != UNLIMITED;
+        const bool watchIdle   = _extension.MaxIdleTime != 0;
+        ResourceSamplerSession samplerSession;
+        bool samplerAttached = false;
+        const bool watchLimits = watchMemory || watchIdle;
+        if ((sampling || watchLimits || activity.IsListed()) && timeline.ExecDone != 0)
+        {
+            const uint32_t intervalMs = sampling      ? _extension.SampleIntervalMs
+                                        : watchLimits ? LIMIT_WATCH_INTERVAL_MS
+                                                      : ACTIVITY_SAMPLE_INTERVAL_MS;
+            samplerSession.Pid        = sandboxPid;
+            samplerSession.IntervalNs = static_cast<uint64_t>(intervalMs) * 1000000ULL;
+            if (sampling)
+            {
+                samplerSession.Buffer   = _extension.Samples;
+                samplerSession.Capacity = _extension.SampleCapacity;
+                samplerSession.Callback = _extension.SampleCallback;
+                samplerSession.UserData = _extension.SampleUserData;
+            }
+            samplerSession.MemoryLimit            = watchMemory ? _config->MaxMemory : 0;
+            samplerSession.IdleLimitNs            = _extension.MaxIdleTime * 1000000ULL;
+            samplerSession.IdleWatchesDescendants = _config->MaxProcessCount != 0;
+            samplerSession.TerminationReason      = &terminationReason;
+            samplerSession.Activity               = activity.IsListed() ? &activity : nullptr;
+            samplerAttached                       = ResourceSampler::Instance().Attach(&samplerSession);
+            if (!samplerAttached)
+                Logger::Warning("Failed to sample program (pid @{0}), sampling and the live limits are disabled",
+                                sandboxPid);
+        }
+
+        // Observe the exit without reaping, so the pid cannot be reused while the monitor may still kill it.
+        siginfo_t exitInfo{};
+        int waitResult;
+        do
+        {
+            waitResult = waitid(P_PID, static_cast<id_t>(sandboxPid), &exitInfo, WEXITED | WNOWAIT);
+        } while (waitResult != 0 && errno == EINTR);
+        timeline.Exit = SandboxInternal::MonotonicNowNs();
+        activity.SetPhase(SANDBOX_ACTIVITY_FINISHING);
+        monitorThread.reset();
+        // Before the termination reason is read, passing the limit with the last output still kills.
+        const bool outputExceeded = outputRelay.Stop();
+        if (samplerAttached)
+        {
+            ResourceSampler::Instance().Detach(&samplerSession);
+            if (sampling)
+            {
+                _resultEx.SampleCount  = samplerSession.Count;
+                _resultEx.SampleStride = samplerSession.Stride;
+            }
+        }
+        _resultEx.TerminationReason = terminationReason.load();
+
+        // /proc/<pid>/io disappears with the reap, read it while the child is still a zombie.
+        std::optional<ProcessIoCounters> ioCounters;
+        if (waitResult == 0)
+            ioCounters = ReadProcessIoCounters(sandboxPid);
+
         int childStatus;
         rusage usage = {};
-        if (wait4(sandboxPid, &childStatus, 0, &usage) == -1)
+        if (waitResult != 0 || wait4(sandboxPid, &childStatus, 0, &usage) == -1)
         {
             kill(sandboxPid, SIGKILL);
+            if (supervisorAttached)
+                SeccompSupervisor::Instance().Detach(&supervisorSession);
             return HandleParentError(ErrorContext(InternalError::WaitFailed, "Failed to wait for child process"));
         }
+        timeline.Reaped = SandboxInternal::MonotonicNowNs();
+        MetricsRegistry::Instance().Observe(MetricHistogram::RunTime, timeline.Reaped - timeline.PrepareStart);
+        if (namespaces != nullptr)
+            NamespacePool::Instance().Release(std::move(namespaces), CanReuseNamespaces(policy));
+        // Processes the program left behind share the filter, so keep answering them until the reap.
+        if (supervisorAttached)
+        {
+            SeccompSupervisor::Instance().Detach(&supervisorSession);
+            _resultEx.SupervisedSyscallCount   = supervisorSession.NotificationCount;
+            _resultEx.SupervisedSyscallDenials = static_cast<uint32_t>(supervisorSession.DeniedCount);
+            _resultEx.SupervisorTimeNs         = supervisorSession.TotalLatencyNs;
+            _resultEx.SupervisorMaxTimeNs      = supervisorSession.MaxLatencyNs;
+        }
 
-        std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
-        _result.RealTimeUsage = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        if (childTimestamps != nullptr)
+        {
+            timeline.ChildSetupStart = childTimestamps->SetupStart.load(std::memory_order_relaxed);
+            timeline.ExecStart       = childTimestamps->ExecStart.load(std::memory_order_relaxed);
+        }
+
+        // Only the program's own time counts; fall back to the fork if the child never reached execve.
+        const uint64_t runStart = timeline.ExecStart != 0 ? timeline.ExecStart : timeline.ForkDone;
+        _result.RealTimeUsage   = NanosecondsToMilliseconds(timeline.Exit - runStart);
+
+        if (_extension.TraceFile != nullptr && !WriteChromeTrace(_extension.TraceFile, _config->TaskName, timeline,
+                                                                 getpid(), sandboxPid))
+        {
+            Logger::Error("Failed to write phase trace to {0}", _extension.TraceFile);
+        }
+
+        if (profiling)
+        {
+            profiler.Stop();
+            _resultEx.ProfiledSyscallCount         = profiler.GetTotalCount();
+            _resultEx.ProfiledDistinctSyscallCount = static_cast<uint32_t>(profiler.GetRecords().size());
+            if (profiler.WritePolicy(_extension.ProfileOutputFile))
+                Logger::Info("Profiled policy written to {0}", _extension.ProfileOutputFile);
+            else
+                Logger::Error("Failed to write profiled policy to {0}", _extension.ProfileOutputFile);
+        }
 
         // ScopedThread destructor will automatically clean up the monitor thread
 
@@ -102,6 +626,12 @@ int SandboxImpl::Run()
         if (WIFSIGNALED(childStatus))
             _result.Signal = WTERMSIG(childStatus);
 
+        // A check may fire just as the program exits on its own; then the kill did nothing.
+        if (_result.Signal != SIGKILL)
+            _resultEx.TerminationReason = SANDBOX_TERMINATION_NONE;
+        if (_resultEx.TerminationReason != SANDBOX_TERMINATION_NONE)
+            MetricsRegistry::Instance().RecordMonitorKill(_resultEx.TerminationReason);
+
         if (_result.Signal == SIGUSR1)
         {
             Logger::Error("An internal error occurred in the sandboxed process, terminated!");
@@ -112,6 +642,7 @@ int SandboxImpl::Run()
         _result.ExitCode     = WEXITSTATUS(childStatus);
         _result.MemoryUsage  = usage.ru_maxrss * 1024;
         _result.CpuTimeUsage = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000;
+        FillResourceCounters(usage, ioCounters, _resultEx);
 
         if (_result.ExitCode != 0 || _result.Signal != 0)
         {
@@ -121,14 +652,26 @@ int SandboxImpl::Run()
             else if (_result.Signal == SIGKILL && _config->MaxRealTime != UNLIMITED
                      && _result.RealTimeUsage >= _config->MaxRealTime)
                 _result.Status = SANDBOX_STATUS_REAL_TIME_LIMIT_EXCEEDED;
+            // A hang cut short by MaxIdleTime would have run into the real time limit.
+            else if (_resultEx.TerminationReason == SANDBOX_TERMINATION_IDLE_LIMIT)
+                _result.Status = SANDBOX_STATUS_REAL_TIME_LIMIT_EXCEEDED;
+            else if (_resultEx.TerminationReason == SANDBOX_TERMINATION_PROCESS_LIMIT)
+                _result.Status = SANDBOX_STATUS_PROCESS_LIMIT_EXCEEDED;
+            else if (_result.Signal == SIGXFSZ || _resultEx.TerminationReason == SANDBOX_TERMINATION_OUTPUT_LIMIT)
+                _result.Status = SANDBOX_STATUS_OUTPUT_LIMIT_EXCEEDED;
             else
                 _result.Status = (_result.Signal == SIGSYS) ? SANDBOX_STATUS_ILLEGAL_OPERATION : SANDBOX_STATUS_RUNTIME_ERROR;
         }
 
-        if (_config->MaxMemory != UNLIMITED && _result.MemoryUsage >= _config->MaxMemory)
+        if (_resultEx.TerminationReason == SANDBOX_TERMINATION_MEMORY_LIMIT)
+            _result.Status = SANDBOX_STATUS_MEMORY_LIMIT_EXCEEDED;
+        else if (_config->MaxMemory != UNLIMITED && _result.MemoryUsage >= _config->MaxMemory)
             _result.Status = SANDBOX_STATUS_MEMORY_LIMIT_EXCEEDED;
         else if (_config->MaxCpuTime != UNLIMITED && _result.CpuTimeUsage >= _config->MaxCpuTime)
             _result.Status = SANDBOX_STATUS_CPU_TIME_LIMIT_EXCEEDED;
+        // The program may exit before the relay gets to its last output.
+        else if (outputExceeded)
+            _result.Status = SANDBOX_STATUS_OUTPUT_LIMIT_EXCEEDED;
     }
     return 0;
 }
@@ -0,0 +1,83 @@
+#include "MemoryAdmission.h"
+
+#include "../InternalHelpers.h"
+#include "../Metrics.h"
+
+#include <algorithm>
+
+MemoryAdmission &MemoryAdmission::Instance()
+{
+    static MemoryAdmission instance;
+    return instance;
+}
+
+MemoryAdmission::MemoryAdmission(uint64_t budget) : _budget(budget)
+{
+}
+
+void MemoryAdmission::SetBudget(uint64_t budget)
+{
+    {
+        std::lock_guard lock(_mutex);
+        _budget = budget;
+    }
+    _released.notify_all();
+}
+
+uint64_t MemoryAdmission::Admit(uint64_t bytes, uint32_t priority, uint32_t &queueDepth)
+{
+    std::unique_lock lock(_mutex);
+    queueDepth = static_cast<uint32_t>(_waiting.size());
+    if (_budget == 0 && _waiting.empty())
+        return 0;
+
+    const auto place   = _waiting.emplace(priority, _nextTicket++).first;
+    uint64_t committed = 0;
+    _released.wait(lock, [&] {
+        if (place != _waiting.begin())
+            return false;
+        if (_budget == 0)
+            return true;
+        committed = bytes == 0 || bytes > _budget ? _budget : bytes;
+        return committed <= _budget - std::min(_committed, _budget);
+    });
+
+    if (_budget == 0)
+        committed = 0;
+    _committed += committed;
+    _waiting.erase(place);
+    // The next waiter may fit in what is left.
+    _released.notify_all();
+    return committed;
+}
+
+void MemoryAdmission::Release(uint64_t committed)
+{
+    if (committed == 0)
+        return;
+    {
+        std::lock_guard lock(_mutex);
+        _committed -= committed;
+    }
+    _released.notify_all();
+}
+
+uint64_t MemoryAdmission::GetCommitted()
+{
+    std::lock_guard lock(_mutex);
+    return _committed;
+}
+
+MemoryAdmissionLease::MemoryAdmissionLease(MemoryAdmission &admission, uint64_t bytes, uint32_t priority)
+    : _admission(&admission)
+{
+    const uint64_t start = SandboxInternal::MonotonicNowNs();
+    {
+        const ScopedGauge waiting(MetricGauge::MemoryQueueDepth);
+        _committed = admission.Admit(bytes, priority, _queueDepth);
+    }
+    // Nothing is committed without a budget, the run was not held back then.
+    _waitNs = _committed != 0 ? SandboxInternal::MonotonicNowNs() - start : 0;
+    if (_committed != 0)
+        MetricsRegistry::Instance().Observe(MetricHistogram::MemoryWait, _waitNs);
+}
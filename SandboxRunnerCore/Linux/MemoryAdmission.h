@@ -0,0 +1,80 @@
+#ifndef SANDBOX_MEMORY_ADMISSION_H
+#define SANDBOX_MEMORY_ADMISSION_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <utility>
+
+/**
+ * @brief Admits concurrent sandboxes only while the memory they may use fits a node budget
+ * @remarks Each run commits its memory limit for its whole duration. A run that does not fit waits before
+ * forking, and waiting runs are admitted by priority, then first come, first served: a small run never
+ * overtakes a large one of the same priority, which would otherwise wait forever. A run larger than the
+ * budget, or without a memory limit, commits the whole budget and so runs alone.
+ */
+class MemoryAdmission
+{
+public:
+    /**
+     * @brief The admission of this process, without a budget until SetBudget is called
+     */
+    static MemoryAdmission &Instance();
+
+    explicit MemoryAdmission(uint64_t budget = 0);
+
+    /**
+     * @brief Change the budget in bytes, 0 admits every run at once
+     * @remarks Runs already admitted keep what they committed.
+     */
+    void SetBudget(uint64_t budget);
+
+    /**
+     * @brief Block until the run fits the budget and commit its memory
+     * @param bytes The memory limit of the run, 0 if it has none
+     * @param priority A SandboxPriority, lower values are admitted first
+     * @param queueDepth Set to how many runs were already waiting
+     * @return The bytes committed, to be given to Release
+     */
+    uint64_t Admit(uint64_t bytes, uint32_t priority, uint32_t &queueDepth);
+
+    /**
+     * @brief Give back the memory committed by Admit
+     */
+    void Release(uint64_t committed);
+
+    [[nodiscard]] uint64_t GetCommitted();
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _released;
+    uint64_t _budget    = 0;
+    uint64_t _committed = 0;
+    std::set<std::pair<uint32_t, uint64_t>> _waiting; // Priority and ticket of each caller of Admit, in admission order
+    uint64_t _nextTicket = 0;                         // Handed to the next caller of Admit
+};
+
+/**
+ * @brief Holds the memory a run committed to MemoryAdmission::Instance() for the lifetime of the object
+ */
+class MemoryAdmissionLease
+{
+public:
+    MemoryAdmissionLease(MemoryAdmission &admission, uint64_t bytes, uint32_t priority);
+    ~MemoryAdmissionLease() { _admission->Release(_committed); }
+
+    MemoryAdmissionLease(const MemoryAdmissionLease &)            = delete;
+    MemoryAdmissionLease &operator=(const MemoryAdmissionLease &) = delete;
+
+    [[nodiscard]] uint64_t GetWaitNs() const { return _waitNs; }
+    [[nodiscard]] uint32_t GetQueueDepth() const { return _queueDepth; }
+
+private:
+    MemoryAdmission *_admission;
+    uint32_t _queueDepth = 0;
+    uint64_t _committed  = 0;
+    uint64_t _waitNs     = 0;
+};
+
+#endif //! SANDBOX_MEMORY_ADMISSION_H
@@ -0,0 +1,463 @@
+#include "NamespacePool.h"
+
+#include "../Logger.h"
+#include "../Sandbox.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sched.h>
+#include <seccomp.h>
+#include <string>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+
+struct NamespaceKind
+{
+    uint32_t Flag;
+    int CloneFlag;
+    const char *Name; // Under /proc/<pid>/ns
+};
+
+// The user namespace comes first: joining it grants the capabilities the others need.
+constexpr NamespaceKind NAMESPACE_KINDS[] = {
+    {SANDBOX_NAMESPACE_USER, CLONE_NEWUSER, "user"}, {SANDBOX_NAMESPACE_MOUNT, CLONE_NEWNS, "mnt"},
+    {SANDBOX_NAMESPACE_PID, CLONE_NEWPID, "pid"},    {SANDBOX_NAMESPACE_NET, CLONE_NEWNET, "net"},
+    {SANDBOX_NAMESPACE_IPC, CLONE_NEWIPC, "ipc"},
+};
+constexpr size_t PID_NAMESPACE_INDEX = 2;
+constexpr uint32_t KNOWN_NAMESPACE_FLAGS = SANDBOX_NAMESPACE_USER | SANDBOX_NAMESPACE_MOUNT | SANDBOX_NAMESPACE_PID
+                                         | SANDBOX_NAMESPACE_NET | SANDBOX_NAMESPACE_IPC;
+
+// Syscalls whose effects outlive the process inside the namespaces, see CanReuseNamespaces.
+constexpr std::string_view PERSISTENT_SYSCALLS[] = {
+    "mount",   "umount2", "pivot_root",    "move_mount", "fsmount", "open_tree", "mount_setattr",
+    "unshare", "setns",   "sethostname",   "setdomainname", "shmget", "msgget", "semget",
+    "mq_open", "socket",  "add_key",       "keyctl",
+};
+
+// Messages on the control socket. The keeper answers each with the same byte.
+constexpr char KEEPER_GO    = 'g'; // The id maps are written, set up the namespaces
+constexpr char KEEPER_RESET = 'r'; // Kill every other process in the PID namespace
+
+constexpr int KEEPER_TIMEOUT_MS = 1000;
+
+void CloseOtherDescriptors(int keep)
+{
+    if (keep > 0)
+        syscall(SYS_close_range, 0U, static_cast<unsigned>(keep - 1), 0U);
+    syscall(SYS_close_range, static_cast<unsigned>(keep + 1), ~0U, 0U);
+}
+
+void BringUpLoopback()
+{
+    const int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return;
+    ifreq request{};
+    strncpy(request.ifr_name, "lo", IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFFLAGS, &request) == 0)
+    {
+        request.ifr_flags |= IFF_UP | IFF_RUNNING;
+        ioctl(sock, SIOCSIFFLAGS, &request);
+    }
+    close(sock);
+}
+
+void ReapAll()
+{
+    while (waitpid(-1, nullptr, 0) > 0 || errno == EINTR)
+        errno = 0;
+}
+
+/**
+ * @brief The keeper process, started by a raw clone() from a possibly multi-threaded supervisor
+ * @remarks Only async-signal-safe calls from here on. The keeper closes every inherited descriptor first,
+ * so it holds no pipe of another run open.
+ */
+[[noreturn]] void RunKeeper(uint32_t flags, int controlFd)
+{
+    CloseOtherDescriptors(controlFd);
+
+    char message = 0;
+    if (recv(controlFd, &message, 1, 0) != 1 || message != KEEPER_GO)
+        _exit(EXIT_FAILURE);
+    if ((flags & SANDBOX_NAMESPACE_MOUNT) != 0 && mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) != 0)
+        _exit(EXIT_FAILURE);
+    // The host's /proc would still list the host's processes.
+    constexpr uint32_t mountAndPid = SANDBOX_NAMESPACE_MOUNT | SANDBOX_NAMESPACE_PID;
+    if ((flags & mountAndPid) == mountAndPid
+        && mount("proc", "/proc", "proc", MS_NOSUID | MS_NODEV | MS_NOEXEC, nullptr) != 0)
+        _exit(EXIT_FAILURE);
+    if ((flags & SANDBOX_NAMESPACE_NET) != 0)
+        BringUpLoopback();
+
+    // Orphans of the runs are reparented to the keeper as init of the PID namespace.
+    sigset_t childSignal;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_SETMASK, &childSignal, nullptr);
+    const int signalFd = signalfd(-1, &childSignal, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (signalFd < 0 || send(controlFd, &message, 1, MSG_NOSIGNAL) != 1)
+        _exit(EXIT_FAILURE);
+
+    pollfd fds[2] = {{.fd = controlFd, .events = POLLIN, .revents = 0}, {.fd = signalFd, .events = POLLIN, .revents = 0}};
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+            continue;
+        signalfd_siginfo info;
+        while (read(signalFd, &info, sizeof(info)) > 0)
+        {
+        }
+        while (waitpid(-1, nullptr, WNOHANG) > 0)
+        {
+        }
+        if ((fds[0].revents & (POLLIN | POLLHUP)) == 0)
+            continue;
+
+        const ssize_t received = recv(controlFd, &message, 1, 0);
+        if (received == 0 || (received < 0 && errno != EINTR))
+            _exit(EXIT_SUCCESS); // The supervisor is gone
+        if (received == 1 && message == KEEPER_RESET)
+        {
+            if ((flags & SANDBOX_NAMESPACE_PID) != 0)
+            {
+                kill(-1, SIGKILL);
+                ReapAll();
+            }
+            send(controlFd, &message, 1, MSG_NOSIGNAL);
+        }
+    }
+}
+
+bool WriteProcFile(const std::string &path, std::string_view content)
+{
+    const SandboxInternal::UniqueFd fd(open(path.c_str(), O_WRONLY | O_CLOEXEC));
+    return fd.valid() && write(fd.get(), content.data(), content.size()) == static_cast<ssize_t>(content.size());
+}
+
+/**
+ * @brief Map the caller's ids to root in the keeper's user namespace, or every id for a root caller
+ */
+bool WriteIdMaps(pid_t keeperPid)
+{
+    const std::string procDirectory = "/proc/" + std::to_string(keeperPid);
+    const uid_t uid = geteuid();
+    const gid_t gid = getegid();
+    if (uid == 0)
+    {
+        return WriteProcFile(procDirectory + "/uid_map", "0 0 4294967295")
+               && WriteProcFile(procDirectory + "/gid_map", "0 0 4294967295");
+    }
+    // An unprivileged process may only map its own group once setgroups is denied.
+    return WriteProcFile(procDirectory + "/uid_map", "0 " + std::to_string(uid) + " 1")
+           && WriteProcFile(procDirectory + "/setgroups", "deny")
+           && WriteProcFile(procDirectory + "/gid_map", "0 " + std::to_string(gid) + " 1");
+}
+
+bool ExchangeWithKeeper(int controlFd, char message)
+{
+    if (send(controlFd, &message, 1, MSG_NOSIGNAL) != 1)
+        return false;
+    pollfd pfd{.fd = controlFd, .events = POLLIN, .revents = 0};
+    char reply = 0;
+    return poll(&pfd, 1, KEEPER_TIMEOUT_MS) == 1 && recv(controlFd, &reply, 1, 0) == 1 && reply == message;
+}
+
+} // namespace
+
+NamespaceSet::NamespaceSet(uint32_t flags, pid_t keeperPid, SandboxInternal::UniqueFd controlFd)
+    : _flags(flags), _keeperPid(keeperPid), _controlFd(std::move(controlFd))
+{
+}
+
+NamespaceSet::~NamespaceSet()
+{
+    // init of a PID namespace takes every process in it along.
+    kill(_keeperPid, SIGKILL);
+    while (waitpid(_keeperPid, nullptr, 0) < 0 && errno == EINTR)
+    {
+    }
+}
+
+pid_t NamespaceSet::Fork(const std::function<void()> &child) const
+{
+    const auto forkChild = [&child] {
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            child();
+            _exit(EXIT_FAILURE);
+        }
+        return pid;
+    };
+
+    const int pidNamespace = _namespaceFds[PID_NAMESPACE_INDEX].get();
+    if (pidNamespace < 0)
+        return forkChild();
+
+    pid_t pid = -1;
+    try
+    {
+        std::thread([&] {
+            if (setns(pidNamespace, CLONE_NEWPID) == 0)
+                pid = forkChild();
+            else
+                Logger::Error("Failed to join PID namespace: {0}", strerror(errno));
+        }).join();
+    }
+    catch (const std::system_error &)
+    {
+        return -1;
+    }
+    return pid;
+}
+
+bool NamespaceSet::Enter() const
+{
+    // Joining the mount namespace moves the working directory to its root, the same path is entered again.
+    char workingDirectory[PATH_MAX];
+    if (getcwd(workingDirectory, sizeof(workingDirectory)) == nullptr)
+        return false;
+
+    for (size_t i = 0; i < std::size(NAMESPACE_KINDS); ++i)
+    {
+        if (i != PID_NAMESPACE_INDEX && _namespaceFds[i].valid()
+            && setns(_namespaceFds[i].get(), NAMESPACE_KINDS[i].CloneFlag) != 0)
+        {
+            return false;
+        }
+    }
+    return chdir(workingDirectory) == 0;
+}
+
+bool NamespaceSet::Reset() const
+{
+    return ExchangeWithKeeper(_controlFd.get(), KEEPER_RESET);
+}
+
+std::unique_ptr<NamespaceSet> CreateNamespaceSet(uint32_t flags)
+{
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+        return nullptr;
+    SandboxInternal::UniqueFd controlFd(sockets[0]);
+    SandboxInternal::UniqueFd keeperFd(sockets[1]);
+
+    long cloneFlags = SIGCHLD;
+    for (const auto &kind : NAMESPACE_KINDS)
+    {
+        if ((flags & kind.Flag) != 0)
+            cloneFlags |= kind.CloneFlag;
+    }
+
+    // Like fork(), but straight into the new namespaces: unshare() cannot take a multi-threaded
+    // caller into a user namespace, and a PID namespace only applies to the children of its caller.
+    const auto keeperPid = static_cast<pid_t>(syscall(SYS_clone, cloneFlags, nullptr, nullptr, nullptr, nullptr));
+    if (keeperPid < 0)
+    {
+        Logger::Warning("Failed to create namespaces {0:#x}: {1}", flags, strerror(errno));
+        return nullptr;
+    }
+    if (keeperPid == 0)
+        RunKeeper(flags, keeperFd.get());
+    keeperFd.reset();
+
+    auto set = std::make_unique<NamespaceSet>(flags, keeperPid, std::move(controlFd));
+    if (((flags & SANDBOX_NAMESPACE_USER) != 0 && !WriteIdMaps(keeperPid))
+        || !ExchangeWithKeeper(set->_controlFd.get(), KEEPER_GO))
+    {
+        Logger::Warning("Failed to set up namespaces {0:#x}", flags);
+        return nullptr;
+    }
+
+    for (size_t i = 0; i < std::size(NAMESPACE_KINDS); ++i)
+    {
+        if ((flags & NAMESPACE_KINDS[i].Flag) == 0)
+            continue;
+        const auto path = "/proc/" + std::to_string(keeperPid) + "/ns/" + NAMESPACE_KINDS[i].Name;
+        set->_namespaceFds[i].reset(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!set->_namespaceFds[i].valid())
+            return nullptr;
+    }
+    return set;
+}
+
+bool CanReuseNamespaces(const SandboxPolicyEngine::SandboxPolicy *policy)
+{
+    static const std::vector<int> persistentSyscalls = [] {
+        std::vector<int> syscalls;
+        for (const auto name : PERSISTENT_SYSCALLS)
+        {
+            const int syscall = seccomp_syscall_resolve_name(std::string(name).c_str());
+            if (syscall != __NR_SCMP_ERROR)
+                syscalls.push_back(syscall);
+        }
+        return syscalls;
+    }();
+
+    return policy != nullptr && std::ranges::none_of(policy->AllowedSyscalls, [](int syscall) {
+               return std::ranges::find(persistentSyscalls, syscall) != persistentSyscalls.end();
+           });
+}
+
+NamespacePool &NamespacePool::Instance()
+{
+    // Never destroyed: the detached thread may still be waiting when static destructors run.
+    static auto *instance = new NamespacePool();
+    return *instance;
+}
+
+void NamespacePool::StartLocked()
+{
+    if (_started)
+        return;
+    try
+    {
+        std::thread(&NamespacePool::Run, this).detach();
+        _started = true;
+    }
+    catch (const std::system_error &)
+    {
+        // Every set is created at launch then, the next Acquire tries again.
+    }
+}
+
+std::unique_ptr<NamespaceSet> NamespacePool::Acquire(uint32_t flags, bool &fromPool)
+{
+    fromPool = false;
+    if ((flags & ~KNOWN_NAMESPACE_FLAGS) != 0)
+    {
+        Logger::Error("Unknown namespace flags {0:#x}", flags & ~KNOWN_NAMESPACE_FLAGS);
+        return nullptr;
+    }
+
+    {
+        std::lock_guard lock(_mutex);
+        StartLocked();
+        // Registers the combination, so the thread keeps it topped up from now on.
+        auto &warm = _warm[flags];
+        _wakeUp.notify_one();
+        if (!warm.empty())
+        {
+            auto set = std::move(warm.front());
+            warm.pop_front();
+            fromPool = true;
+            return set;
+        }
+    }
+    return CreateNamespaceSet(flags);
+}
+
+void NamespacePool::Release(std::unique_ptr<NamespaceSet> set, bool reusable)
+{
+    // Without a PID namespace, whatever the run left behind cannot be found and killed.
+    reusable = reusable && (set->GetFlags() & SANDBOX_NAMESPACE_PID) != 0;
+    std::lock_guard lock(_mutex);
+    _released.emplace_back(std::move(set), reusable);
+    _wakeUp.notify_one();
+}
+
+void NamespacePool::SetSize(uint32_t size)
+{
+    std::vector<std::unique_ptr<NamespaceSet>> dropped;
+    {
+        std::lock_guard lock(_mutex);
+        _size = size;
+        for (auto &[flags, warm] : _warm)
+        {
+            while (warm.size() > size)
+            {
+                dropped.push_back(std::move(warm.back()));
+                warm.pop_back();
+            }
+        }
+        _wakeUp.notify_one();
+    }
+}
+
+bool NamespacePool::HasWorkLocked() const
+{
+    return !_released.empty()
+           || std::ranges::any_of(_warm, [this](const auto &entry) { return entry.second.size() < _size; });
+}
+
+void NamespacePool::Run()
+{
+    std::unique_lock lock(_mutex);
+    while (true)
+    {
+        _wakeUp.wait(lock, [this] { return HasWorkLocked(); });
+
+        // Sets are reset and destroyed outside the lock, both wait for the keeper.
+        if (!_released.empty())
+        {
+            auto [set, reusable] = std::move(_released.back());
+            _released.pop_back();
+            lock.unlock();
+            const bool reset = reusable && set->Reset();
+            lock.lock();
+
+            const auto found = _warm.find(set->GetFlags());
+            if (reset && found != _warm.end() && found->second.size() < _size)
+            {
+                found->second.push_back(std::move(set));
+                continue;
+            }
+            lock.unlock();
+            set.reset();
+            lock.lock();
+            continue;
+        }
+
+        const auto deficit =
+            std::ranges::find_if(_warm, [this](const auto &entry) { return entry.second.size() < _size; });
+        const uint32_t flags = deficit->first;
+        lock.unlock();
+        auto set = CreateNamespaceSet(flags);
+        lock.lock();
+
+        const auto found = _warm.find(flags);
+        if (set == nullptr)
+        {
+            // Forget the combination until it is asked for again, instead of retrying in a loop.
+            std::deque<std::unique_ptr<NamespaceSet>> failed;
+            if (found != _warm.end())
+            {
+                failed = std::move(found->second);
+                _warm.erase(found);
+            }
+            lock.unlock();
+            failed.clear();
+            lock.lock();
+        }
+        else if (found != _warm.end() && found->second.size() < _size)
+        {
+            found->second.push_back(std::move(set));
+        }
+        else
+        {
+            lock.unlock();
+            set.reset();
+            lock.lock();
+        }
+    }
+}
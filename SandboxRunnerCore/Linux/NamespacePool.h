@@ -0,0 +1,130 @@
+#ifndef SANDBOX_NAMESPACE_POOL_H
+#define SANDBOX_NAMESPACE_POOL_H
+
+#include "../InternalHelpers.h"
+#include "../Policy/SandboxPolicy.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+// Warm namespace sets kept for each combination of SandboxNamespaceFlags in use, by default.
+constexpr uint32_t DEFAULT_NAMESPACE_POOL_SIZE = 2;
+
+/**
+ * @brief Namespaces created together for a sandbox, held by their nsfs descriptors
+ * @remarks A keeper process creates them and stays in them. It is init of the PID namespace, which
+ * takes no new process once its init is gone, and clears it between runs. Destroying the set kills
+ * the keeper and with it every process still in the PID namespace.
+ */
+class NamespaceSet
+{
+public:
+    NamespaceSet(uint32_t flags, pid_t keeperPid, SandboxInternal::UniqueFd controlFd);
+    ~NamespaceSet();
+
+    NamespaceSet(const NamespaceSet &)            = delete;
+    NamespaceSet &operator=(const NamespaceSet &) = delete;
+
+    uint32_t GetFlags() const { return _flags; }
+
+    /**
+     * @brief fork() a process in the PID namespace of the set, or a plain fork() without one
+     * @param child Runs in the new process and must not return
+     * @remarks A PID namespace is entered by the children of the thread that joins it, so the fork
+     * happens on a helper thread that exits right after. That join needs CAP_SYS_ADMIN.
+     * @return The pid in the supervisor's PID namespace, -1 on failure
+     */
+    pid_t Fork(const std::function<void()> &child) const;
+
+    /**
+     * @brief Join the user, mount, network and IPC namespaces of the set, from the child before execve
+     * @remarks The working directory is kept by path, resolved again inside the mount namespace.
+     */
+    bool Enter() const;
+
+    /**
+     * @brief Kill whatever the last run left in the PID namespace, so the set can be handed out again
+     * @return false if the keeper did not answer, the set must not be used then
+     */
+    bool Reset() const;
+
+private:
+    friend std::unique_ptr<NamespaceSet> CreateNamespaceSet(uint32_t flags);
+
+    uint32_t _flags;
+    pid_t _keeperPid;
+    SandboxInternal::UniqueFd _controlFd; // Socket to the keeper, which exits once the supervisor closes it
+    std::array<SandboxInternal::UniqueFd, 5> _namespaceFds; // In the order of SandboxNamespaceFlags
+};
+
+/**
+ * @brief Create a set of the namespaces in flags (SandboxNamespaceFlags)
+ * @remarks With SANDBOX_NAMESPACE_USER the caller's user and group are root inside; a root caller keeps
+ * every id. The mount namespace is made private, so nothing mounted in it reaches the host, and gets a
+ * /proc of its own with a PID namespace. The loopback interface of the network namespace is brought up.
+ * @return nullptr if the kernel refuses the namespaces
+ */
+std::unique_ptr<NamespaceSet> CreateNamespaceSet(uint32_t flags);
+
+/**
+ * @brief Whether a run under the policy leaves its namespaces as it found them
+ * @param policy nullptr for an unfiltered run, which could have changed anything
+ * @remarks Mounts, System V and POSIX IPC objects, host names, sockets (which reach the network
+ * configuration) and keys outlive the processes that made them. A policy allowing none of them only
+ * leaves processes behind, which NamespaceSet::Reset kills.
+ */
+bool CanReuseNamespaces(const SandboxPolicyEngine::SandboxPolicy *policy);
+
+/**
+ * @brief Pre-created namespace sets, shared by all sandboxes of this process
+ * @remarks A background thread keeps the pool topped up for every combination of flags that was asked for.
+ * Sets with a PID namespace go back to the pool after a run if nothing of the run can outlive it there,
+ * see CanReuseNamespaces; the others are used once.
+ */
+class NamespacePool
+{
+public:
+    static NamespacePool &Instance();
+
+    /**
+     * @brief Take a set of the namespaces in flags, creating one if the pool has none ready
+     * @param fromPool Set to whether the set was taken warm from the pool
+     * @return nullptr if the namespaces cannot be created
+     */
+    std::unique_ptr<NamespaceSet> Acquire(uint32_t flags, bool &fromPool);
+
+    /**
+     * @brief Give back a set after the run, reset and pooled again in the background if reusable
+     */
+    void Release(std::unique_ptr<NamespaceSet> set, bool reusable);
+
+    /**
+     * @brief Change how many warm sets are kept per combination of flags, 0 creates them at launch
+     */
+    void SetSize(uint32_t size);
+
+private:
+    NamespacePool() = default;
+
+    void StartLocked();
+    void Run();
+    bool HasWorkLocked() const;
+
+    std::mutex _mutex;
+    std::condition_variable _wakeUp;
+    uint32_t _size = DEFAULT_NAMESPACE_POOL_SIZE;
+    std::map<uint32_t, std::deque<std::unique_ptr<NamespaceSet>>> _warm; // Every combination asked for
+    std::vector<std::pair<std::unique_ptr<NamespaceSet>, bool>> _released; // With whether it is reusable
+    bool _started = false;
+};
+
+#endif //! SANDBOX_NAMESPACE_POOL_H
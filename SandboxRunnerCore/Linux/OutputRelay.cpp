@@ -0,0 +1,143 @@
+#include "OutputRelay.h"
+
+#include "../Sandbox.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace
+{
+
+// Bytes moved from the pipe at once, its default capacity.
+constexpr size_t RELAY_CHUNK_SIZE = 64 * 1024;
+
+} // namespace
+
+OutputRelay::~OutputRelay()
+{
+    Stop();
+}
+
+bool OutputRelay::Open(const std::string &outputPath, uint64_t limit)
+{
+    if (outputPath.empty())
+    {
+        _outputFd.reset(fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0));
+    }
+    else
+    {
+        // As the child's fopen(OutputFile, "w"), but a FIFO without a reader would block until one comes.
+        _outputFd.reset(open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC, 0666));
+        if (!_outputFd.valid() && errno == ENXIO)
+            _outputFd.reset(open(outputPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC));
+    }
+
+    int fds[2];
+    if (!_outputFd.valid() || pipe2(fds, O_CLOEXEC) != 0)
+        return false;
+    _readFd.reset(fds[0]);
+    _writeFd.reset(fds[1]);
+    _stopFd.reset(eventfd(0, EFD_CLOEXEC));
+    _limit = limit;
+    return _stopFd.valid();
+}
+
+bool OutputRelay::Start(pid_t pid, std::atomic<uint32_t> *terminationReason)
+{
+    // Otherwise the pipe never reaches its end.
+    _writeFd.reset();
+    _pid               = pid;
+    _terminationReason = terminationReason;
+    try
+    {
+        _thread = std::thread(&OutputRelay::Run, this);
+    }
+    catch (const std::system_error &)
+    {
+        return false;
+    }
+    return true;
+}
+
+bool OutputRelay::Stop()
+{
+    if (_thread.joinable())
+    {
+        const uint64_t stop = 1;
+        [[maybe_unused]] const auto written = write(_stopFd.get(), &stop, sizeof(stop));
+        _thread.join();
+    }
+    return _exceeded.load();
+}
+
+void OutputRelay::Run()
+{
+    pollfd fds[2] = {{.fd = _readFd.get(), .events = POLLIN}, {.fd = _stopFd.get(), .events = POLLIN}};
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents != 0)
+            break;
+        // The end of the pipe: every process that had it has exited.
+        if (!Relay())
+            return;
+    }
+
+    // Pass on what the program wrote before it exited, not what its descendants may still write.
+    fcntl(_readFd.get(), F_SETFL, fcntl(_readFd.get(), F_GETFL) | O_NONBLOCK);
+    while (Relay())
+    {
+    }
+}
+
+bool OutputRelay::Relay()
+{
+    char buffer[RELAY_CHUNK_SIZE];
+    const ssize_t length = read(_readFd.get(), buffer, sizeof(buffer));
+    if (length <= 0)
+        return length < 0 && errno == EINTR;
+
+    // Past the limit the pipe is still emptied, so no writer blocks on it, but nothing is passed on.
+    const uint64_t room = _limit - std::min(_written, _limit);
+    _written += static_cast<uint64_t>(length);
+    WriteAll(buffer, static_cast<size_t>(std::min<uint64_t>(room, static_cast<uint64_t>(length))));
+    if (_written > _limit && !_exceeded.exchange(true))
+        SandboxInternal::KillWithReason(_pid, _terminationReason, SANDBOX_TERMINATION_OUTPUT_LIMIT);
+    return true;
+}
+
+bool OutputRelay::WriteAll(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t written = write(_outputFd.get(), data, size);
+        if (written > 0)
+        {
+            data += written;
+            size -= static_cast<size_t>(written);
+            continue;
+        }
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written == 0 || errno != EAGAIN)
+            return false;
+
+        // A full FIFO is waited for until Stop, then what it cannot take is dropped.
+        pollfd fds[2] = {{.fd = _outputFd.get(), .events = POLLOUT}, {.fd = _stopFd.get(), .events = POLLIN}};
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            return false;
+        if (fds[1].revents != 0)
+            return false;
+    }
+    return true;
+}
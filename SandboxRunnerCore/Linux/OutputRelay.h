@@ -0,0 +1,76 @@
+#ifndef SANDBOX_OUTPUT_RELAY_H
+#define SANDBOX_OUTPUT_RELAY_H
+
+#include "../InternalHelpers.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+
+/**
+ * @brief Copies the program's stdout to an OutputFile that RLIMIT_FSIZE does not cover, counting the bytes
+ * @remarks For a pipe, FIFO or device. The program and its descendants write to a pipe instead, so only
+ * what would have reached OutputFile counts, stderr and other files do not. At most MaxOutputSize bytes
+ * are passed on; the first byte past it kills the program with SANDBOX_TERMINATION_OUTPUT_LIMIT.
+ */
+class OutputRelay
+{
+public:
+    OutputRelay() = default;
+    ~OutputRelay();
+
+    OutputRelay(const OutputRelay &)            = delete;
+    OutputRelay &operator=(const OutputRelay &) = delete;
+
+    /**
+     * @brief Open OutputFile, or duplicate stdout if outputPath is empty, and the pipe
+     * @remarks A FIFO nobody reads yet is opened without waiting for a reader.
+     */
+    bool Open(const std::string &outputPath, uint64_t limit);
+
+    /**
+     * @brief The end of the pipe the child puts on its stdout, close-on-exec
+     */
+    int GetWriteFd() const { return _writeFd.get(); }
+
+    /**
+     * @brief Close the parent's write end and start copying, after fork
+     */
+    bool Start(pid_t pid, std::atomic<uint32_t> *terminationReason);
+
+    /**
+     * @brief Copy what is left in the pipe and stop, once the program has exited
+     * @remarks Descendants the program left behind may still hold the pipe; their later output is lost.
+     * @return Whether the program wrote more than the limit
+     */
+    bool Stop();
+
+private:
+    void Run();
+
+    /**
+     * @brief Move one read's worth from the pipe to the output
+     * @return false at the end of the pipe, or once it is empty after Stop
+     */
+    bool Relay();
+
+    /**
+     * @return false if the output failed, or was still full when Stop was called
+     */
+    bool WriteAll(const char *data, size_t size);
+
+    SandboxInternal::UniqueFd _outputFd;
+    SandboxInternal::UniqueFd _readFd;
+    SandboxInternal::UniqueFd _writeFd;
+    SandboxInternal::UniqueFd _stopFd; // eventfd, readable once Stop is called
+    uint64_t _limit   = 0;
+    uint64_t _written = 0; // Bytes read from the pipe, those past the limit included
+    pid_t _pid        = -1;
+    std::atomic<uint32_t> *_terminationReason = nullptr;
+    std::atomic<bool> _exceeded{false};
+    std::thread _thread;
+};
+
+#endif //! SANDBOX_OUTPUT_RELAY_H
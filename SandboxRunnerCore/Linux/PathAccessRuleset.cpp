@@ -0,0 +1,129 @@
+#include "PathAccessRuleset.h"
+
+#include "../Logger.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/landlock.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+#define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_IOCTL_DEV
+#define LANDLOCK_ACCESS_FS_IOCTL_DEV (1ULL << 15)
+#endif
+
+namespace
+{
+
+using SandboxPolicyEngine::PathAccessMode;
+
+// Rights of Landlock ABI 1, every later version adds one.
+constexpr uint64_t ACCESS_FS_ABI_1 = (LANDLOCK_ACCESS_FS_MAKE_SYM << 1) - 1;
+
+constexpr uint64_t ACCESS_FS_READ = LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_READ_FILE
+                                    | LANDLOCK_ACCESS_FS_READ_DIR;
+
+// The only rights a rule on a file, rather than a directory, may grant.
+constexpr uint64_t ACCESS_FS_FILE = LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_WRITE_FILE
+                                    | LANDLOCK_ACCESS_FS_READ_FILE | LANDLOCK_ACCESS_FS_TRUNCATE
+                                    | LANDLOCK_ACCESS_FS_IOCTL_DEV;
+
+uint64_t GetHandledAccessFs(int abiVersion)
+{
+    uint64_t access = ACCESS_FS_ABI_1;
+    if (abiVersion >= 2)
+        access |= LANDLOCK_ACCESS_FS_REFER;
+    if (abiVersion >= 3)
+        access |= LANDLOCK_ACCESS_FS_TRUNCATE;
+    if (abiVersion >= 5)
+        access |= LANDLOCK_ACCESS_FS_IOCTL_DEV;
+    return access;
+}
+
+/**
+ * @brief Allow access below path, masked to what the kernel handles and the kind of file allows
+ * @return false only if the rule could not be added; a missing path grants nothing and succeeds
+ */
+bool AddPathRule(int rulesetFd, const std::string &path, uint64_t access, uint64_t handledAccess)
+{
+    const SandboxInternal::UniqueFd parent(open(path.c_str(), O_PATH | O_CLOEXEC));
+    if (!parent.valid())
+    {
+        const int savedErrno = errno;
+        Logger::Debug("Skipping path access rule for {0}: {1}", path, strerror(savedErrno));
+        return savedErrno == ENOENT || savedErrno == ENOTDIR;
+    }
+
+    struct stat info{};
+    if (fstat(parent.get(), &info) != 0)
+        return false;
+    if (!S_ISDIR(info.st_mode))
+        access &= ACCESS_FS_FILE;
+
+    landlock_path_beneath_attr rule{
+        .allowed_access = access & handledAccess,
+        .parent_fd      = parent.get(),
+    };
+    return syscall(SYS_landlock_add_rule, rulesetFd, LANDLOCK_RULE_PATH_BENEATH, &rule, 0) == 0;
+}
+
+} // namespace
+
+int GetLandlockAbiVersion()
+{
+    static const int version = [] {
+        const auto abi = syscall(SYS_landlock_create_ruleset, nullptr, 0, LANDLOCK_CREATE_RULESET_VERSION);
+        return abi < 0 ? 0 : static_cast<int>(abi);
+    }();
+    return version;
+}
+
+std::optional<SandboxInternal::UniqueFd> CreatePathAccessRuleset(const SandboxPolicyEngine::SandboxPolicy &policy,
+                                                                 const std::string &programPath)
+{
+    if (policy.PathAccessRules.empty())
+        return SandboxInternal::UniqueFd();
+
+    const int abiVersion = GetLandlockAbiVersion();
+    if (abiVersion == 0)
+    {
+        Logger::Error("Policy {0} has path access rules, but the kernel does not support Landlock", policy.Name);
+        return std::nullopt;
+    }
+
+    const auto handledAccess = GetHandledAccessFs(abiVersion);
+    landlock_ruleset_attr attributes{};
+    attributes.handled_access_fs = handledAccess;
+    SandboxInternal::UniqueFd ruleset(
+        static_cast<int>(syscall(SYS_landlock_create_ruleset, &attributes, sizeof(attributes), 0)));
+    if (!ruleset.valid())
+        return std::nullopt;
+
+    // NoAccess prefixes are only ever outside the granted ones (see PolicyRegistry), where nothing is
+    // granted in the first place.
+    for (const auto &rule : policy.PathAccessRules)
+    {
+        if (rule.Mode == PathAccessMode::NoAccess)
+            continue;
+        const auto access = rule.Mode == PathAccessMode::ReadWrite ? handledAccess : ACCESS_FS_READ;
+        if (!AddPathRule(ruleset.get(), rule.PathPrefix, access, handledAccess))
+            return std::nullopt;
+    }
+
+    if (!AddPathRule(ruleset.get(), programPath, ACCESS_FS_READ, handledAccess))
+        return std::nullopt;
+
+    return ruleset;
+}
+
+bool RestrictToPathAccessRuleset(int rulesetFd)
+{
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 && syscall(SYS_landlock_restrict_self, rulesetFd, 0) == 0;
+}
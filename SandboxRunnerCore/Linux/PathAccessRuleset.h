@@ -0,0 +1,32 @@
+#ifndef SANDBOX_PATH_ACCESS_RULESET_H
+#define SANDBOX_PATH_ACCESS_RULESET_H
+
+#include "../InternalHelpers.h"
+#include "../Policy/SandboxPolicy.h"
+
+#include <optional>
+#include <string>
+
+/**
+ * @brief The Landlock ABI version of the running kernel, 0 if Landlock is unavailable
+ */
+int GetLandlockAbiVersion();
+
+/**
+ * @brief Build the Landlock ruleset enforcing the PathAccessRules of a policy, before fork
+ * @param programPath The program, which is always readable and executable so it can be started
+ * @remarks Every filesystem access right the kernel knows is handled, so whatever no rule grants is
+ * denied. Prefixes that do not exist are skipped. The ruleset descriptor is close-on-exec.
+ * @return An invalid descriptor if the policy has no rules, std::nullopt if the rules cannot be enforced
+ */
+std::optional<SandboxInternal::UniqueFd> CreatePathAccessRuleset(const SandboxPolicyEngine::SandboxPolicy &policy,
+                                                                 const std::string &programPath);
+
+/**
+ * @brief Confine the calling process and its future children to a ruleset from CreatePathAccessRuleset
+ * @remarks Called in the child after the redirections are opened and before the seccomp filter is
+ * loaded. Sets no_new_privs, which the seccomp filter requires as well.
+ */
+bool RestrictToPathAccessRuleset(int rulesetFd);
+
+#endif //! SANDBOX_PATH_ACCESS_RULESET_H
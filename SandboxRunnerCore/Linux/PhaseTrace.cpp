@@ -0,0 +1,81 @@
+#include "PhaseTrace.h"
+
+#include <fstream>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+namespace
+{
+
+using Json = nlohmann::ordered_json;
+
+// Trace-event timestamps are microseconds.
+double ToTraceTime(uint64_t nanoseconds)
+{
+    return static_cast<double>(nanoseconds) / 1000.0;
+}
+
+void AddPhase(Json &events, const char *name, uint64_t begin, uint64_t end, pid_t pid)
+{
+    if (begin == 0 || end == 0 || end < begin)
+        return;
+
+    events.push_back({
+        {"name", name},
+        {"cat", "sandbox"},
+        {"ph", "X"},
+        {"ts", ToTraceTime(begin)},
+        {"dur", ToTraceTime(end - begin)},
+        {"pid", pid},
+        {"tid", pid},
+    });
+}
+
+void AddProcessName(Json &events, pid_t pid, const std::string &name)
+{
+    events.push_back({
+        {"name", "process_name"},
+        {"ph", "M"},
+        {"pid", pid},
+        {"args", {{"name", name}}},
+    });
+}
+
+} // namespace
+
+bool WriteChromeTrace(const char *path,
+                      const char *taskName,
+                      const SandboxTimeline &timeline,
+                      pid_t supervisorPid,
+                      pid_t sandboxPid)
+{
+    const std::string name = taskName != nullptr ? taskName : "sandbox";
+
+    Json events = Json::array();
+    AddProcessName(events, supervisorPid, "Supervisor: " + name);
+    AddPhase(events, "Prepare", timeline.PrepareStart, timeline.ForkStart, supervisorPid);
+    AddPhase(events, "Fork", timeline.ForkStart, timeline.ForkDone, supervisorPid);
+    AddPhase(events, "Reap", timeline.Exit, timeline.Reaped, supervisorPid);
+
+    if (sandboxPid > 0)
+    {
+        AddProcessName(events, sandboxPid, "Sandbox: " + name);
+        AddPhase(events, "ChildSetup", timeline.ChildSetupStart, timeline.ExecStart, sandboxPid);
+        AddPhase(events, "Exec", timeline.ExecStart, timeline.ExecDone, sandboxPid);
+        AddPhase(events, "Run", timeline.ExecDone != 0 ? timeline.ExecDone : timeline.ExecStart, timeline.Exit,
+                 sandboxPid);
+    }
+
+    const Json root = {
+        {"traceEvents", std::move(events)},
+        {"displayTimeUnit", "ms"},
+    };
+
+    std::ofstream output(path);
+    if (!output.is_open())
+        return false;
+
+    output << root.dump(4) << std::endl;
+    return output.good();
+}
@@ -0,0 +1,19 @@
+#ifndef SANDBOX_PHASE_TRACE_H
+#define SANDBOX_PHASE_TRACE_H
+
+#include "../Sandbox.h"
+
+#include <sys/types.h>
+
+/**
+ * @brief Write the timeline of one run as a Chrome trace-event JSON file (chrome://tracing, Perfetto)
+ * @remarks Supervisor phases are reported under supervisorPid, the child's under sandboxPid.
+ * Phases that were not reached are left out.
+ */
+bool WriteChromeTrace(const char *path,
+                      const char *taskName,
+                      const SandboxTimeline &timeline,
+                      pid_t supervisorPid,
+                      pid_t sandboxPid);
+
+#endif //! SANDBOX_PHASE_TRACE_H
@@ -0,0 +1,98 @@
+#include "ProcessStats.h"
+
+#include "../InternalHelpers.h"
+
+#include <algorithm>
+#include <charconv>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+std::optional<ProcessIoCounters> ReadProcessIoCounters(pid_t pid)
+{
+    const std::string path = "/proc/" + std::to_string(pid) + "/io";
+    const SandboxInternal::UniqueFd ioFd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!ioFd.valid())
+        return std::nullopt;
+    return ReadProcessIoCountersFromFd(ioFd.get());
+}
+
+std::optional<ProcessIoCounters> ReadProcessIoCountersFromFd(int ioFd)
+{
+    char buffer[512];
+    const ssize_t length = pread(ioFd, buffer, sizeof(buffer), 0);
+    // The file is empty when access is denied.
+    if (length <= 0)
+        return std::nullopt;
+
+    ProcessIoCounters counters;
+    int found = 0;
+    // One "key: value" per line
+    std::string_view text(buffer, static_cast<size_t>(length));
+    while (!text.empty())
+    {
+        const size_t lineEnd = text.find('\n');
+        const std::string_view line = text.substr(0, lineEnd);
+        text.remove_prefix(lineEnd == std::string_view::npos ? text.size() : lineEnd + 1);
+
+        const size_t separator = line.find(": ");
+        if (separator == std::string_view::npos)
+            continue;
+
+        uint64_t value = 0;
+        if (std::from_chars(line.data() + separator + 2, line.data() + line.size(), value).ec != std::errc())
+            continue;
+
+        const std::string_view key = line.substr(0, separator);
+        if (key == "rchar")
+            counters.ReadChars = value, ++found;
+        else if (key == "wchar")
+            counters.WriteChars = value, ++found;
+        else if (key == "read_bytes")
+            counters.ReadBytes = value, ++found;
+        else if (key == "write_bytes")
+            counters.WriteBytes = value, ++found;
+    }
+
+    if (found != 4)
+        return std::nullopt;
+    return counters;
+}
+
+std::vector<pid_t> ListDescendants(pid_t root)
+{
+    std::vector<pid_t> descendants;
+    std::vector<pid_t> pending{root};
+    while (!pending.empty())
+    {
+        const std::string taskPath = "/proc/" + std::to_string(pending.back()) + "/task";
+        pending.pop_back();
+        DIR *tasks = opendir(taskPath.c_str());
+        if (tasks == nullptr)
+            continue; // Exited since its parent listed it
+        while (const dirent *task = readdir(tasks))
+        {
+            if (task->d_name[0] == '.')
+                continue;
+            const std::string childrenPath = taskPath + "/" + task->d_name + "/children";
+            SandboxInternal::UniqueFd childrenFd(open(childrenPath.c_str(), O_RDONLY | O_CLOEXEC));
+            char buffer[4096];
+            const ssize_t length = childrenFd.valid() ? read(childrenFd.get(), buffer, sizeof(buffer)) : -1;
+            // "pid pid ... ", a list that does not fit is cut at the last whole pid
+            for (const char *cursor = buffer, *end = buffer + std::max<ssize_t>(length, 0); cursor < end;)
+            {
+                pid_t child           = 0;
+                const auto [next, ec] = std::from_chars(cursor, end, child);
+                if (ec != std::errc() || next == end)
+                    break;
+                descendants.push_back(child);
+                pending.push_back(child);
+                cursor = next + 1;
+            }
+        }
+        closedir(tasks);
+    }
+    return descendants;
+}
@@ -0,0 +1,40 @@
+#ifndef SANDBOX_PROCESS_STATS_H
+#define SANDBOX_PROCESS_STATS_H
+
+#include <cstdint>
+#include <optional>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @brief The counters of /proc/<pid>/io
+ */
+struct ProcessIoCounters
+{
+    uint64_t ReadChars    = 0; // rchar
+    uint64_t WriteChars   = 0; // wchar
+    uint64_t ReadBytes    = 0; // read_bytes
+    uint64_t WriteBytes   = 0; // write_bytes
+};
+
+/**
+ * @brief Read /proc/<pid>/io
+ * @remarks Still readable while the process is a zombie, so call it between exit and reap to get
+ * the final values.
+ * @return std::nullopt if procfs is unavailable or the caller may not read the file
+ */
+std::optional<ProcessIoCounters> ReadProcessIoCounters(pid_t pid);
+
+/**
+ * @brief Read the counters through an open /proc/<pid>/io descriptor, for repeated reads
+ */
+std::optional<ProcessIoCounters> ReadProcessIoCountersFromFd(int ioFd);
+
+/**
+ * @brief Every live descendant of root, found through /proc/<pid>/task/<tid>/children
+ * @remarks Zombies not yet reaped are included. Descendants orphaned to init are not found, unless root
+ * is a child subreaper; a parent blocked in wait() still has its children.
+ */
+std::vector<pid_t> ListDescendants(pid_t root);
+
+#endif //! SANDBOX_PROCESS_STATS_H
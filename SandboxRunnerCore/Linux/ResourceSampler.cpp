@@ -0,0 +1,190 @@
+#include "ResourceSampler.h"
+#include "ActivityBoard.h"
+#include "ProcessStats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+uint64_t ReadResidentMemory(int statmFd)
+{
+    char buffer[128];
+    const ssize_t length = pread(statmFd, buffer, sizeof(buffer) - 1, 0);
+    if (length <= 0)
+        return 0;
+    buffer[length] = '\0';
+
+    // "size resident shared text lib data dt", in pages
+    const char *resident = static_cast<const char *>(memchr(buffer, ' ', static_cast<size_t>(length)));
+    uint64_t residentPages = 0;
+    if (resident == nullptr || std::from_chars(resident + 1, buffer + length, residentPages).ec != std::errc())
+        return 0;
+    static const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    return residentPages * pageSize;
+}
+
+uint64_t ReadCpuTimeUs(clockid_t cpuClock)
+{
+    timespec time{};
+    if (clock_gettime(cpuClock, &time) != 0)
+        return 0;
+    return static_cast<uint64_t>(time.tv_sec) * 1000000ULL + static_cast<uint64_t>(time.tv_nsec) / 1000ULL;
+}
+
+// The CPU time of every live descendant of root, see ListDescendants.
+uint64_t ReadDescendantsCpuTimeUs(pid_t root)
+{
+    uint64_t total = 0;
+    for (const pid_t descendant : ListDescendants(root))
+    {
+        clockid_t clock{};
+        if (clock_getcpuclockid(descendant, &clock) == 0)
+            total += ReadCpuTimeUs(clock);
+    }
+    return total;
+}
+
+// The next multiple of the interval after now.
+uint64_t NextTick(uint64_t now, uint64_t interval)
+{
+    return (now / interval + 1) * interval;
+}
+
+// Drop every other kept sample, so the buffer covers the whole run at half the resolution.
+void Decimate(ResourceSamplerSession *session)
+{
+    for (uint32_t i = 1; 2 * i < session->Count; ++i)
+        session->Buffer[i] = session->Buffer[2 * i];
+    session->Count = (session->Count + 1) / 2;
+    session->Stride *= 2;
+}
+
+} // namespace
+
+ResourceSampler &ResourceSampler::Instance()
+{
+    // Never destroyed: the detached thread may still be waiting when static destructors run.
+    static auto *instance = new ResourceSampler();
+    return *instance;
+}
+
+bool ResourceSampler::Attach(ResourceSamplerSession *session)
+{
+    if (session->IntervalNs == 0)
+        return false;
+
+    if (clock_getcpuclockid(session->Pid, &session->CpuClock) != 0)
+        return false;
+
+    const std::string statmPath = "/proc/" + std::to_string(session->Pid) + "/statm";
+    session->StatmFd.reset(open(statmPath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!session->StatmFd.valid())
+        return false;
+
+    session->Count         = 0;
+    session->Stride        = 1;
+    session->Ticks         = 0;
+    session->LastCpuTimeUs = 0;
+
+    std::lock_guard lock(_mutex);
+    // The first sample is taken right away, it marks where the series starts.
+    session->NextDue      = SandboxInternal::MonotonicNowNs();
+    session->LastProgress = session->NextDue;
+    _sessions.push_back(session);
+    if (!_started)
+    {
+        std::thread(&ResourceSampler::Run, this).detach();
+        _started = true;
+    }
+    _wakeUp.notify_one();
+    return true;
+}
+
+void ResourceSampler::Detach(ResourceSamplerSession *session)
+{
+    std::lock_guard lock(_mutex);
+    std::erase(_sessions, session);
+    session->StatmFd.reset();
+}
+
+void ResourceSampler::Sample(ResourceSamplerSession *session, uint64_t now)
+{
+    const SandboxSample sample{
+        .Time           = now,
+        .ResidentMemory = ReadResidentMemory(session->StatmFd.get()),
+        .CpuTimeUs      = ReadCpuTimeUs(session->CpuClock),
+    };
+
+    if (session->MemoryLimit != 0 && sample.ResidentMemory > session->MemoryLimit)
+    {
+        SandboxInternal::KillWithReason(session->Pid, session->TerminationReason, SANDBOX_TERMINATION_MEMORY_LIMIT);
+        session->MemoryLimit = 0; // Once is enough, the program is gone before the next tick
+    }
+
+    if (session->IdleLimitNs != 0)
+    {
+        // A descendant that is reaped takes its time out of the sum, that change counts as progress too.
+        const uint64_t cpuTimeUs =
+            sample.CpuTimeUs + (session->IdleWatchesDescendants ? ReadDescendantsCpuTimeUs(session->Pid) : 0);
+        if (cpuTimeUs != session->LastCpuTimeUs)
+        {
+            session->LastCpuTimeUs = cpuTimeUs;
+            session->LastProgress  = now;
+        }
+        else if (now - session->LastProgress >= session->IdleLimitNs)
+        {
+            SandboxInternal::KillWithReason(session->Pid, session->TerminationReason, SANDBOX_TERMINATION_IDLE_LIMIT);
+            session->IdleLimitNs = 0;
+        }
+    }
+
+    if (session->Activity != nullptr)
+        session->Activity->SetUsage(sample.CpuTimeUs, sample.ResidentMemory);
+
+    if (session->Callback != nullptr)
+        session->Callback(&sample, session->UserData);
+
+    if (session->Buffer != nullptr && session->Capacity > 0 && session->Ticks % session->Stride == 0)
+    {
+        if (session->Count == session->Capacity)
+            Decimate(session);
+        if (session->Ticks % session->Stride == 0)
+            session->Buffer[session->Count++] = sample;
+    }
+    ++session->Ticks;
+}
+
+void ResourceSampler::Run()
+{
+    std::unique_lock lock(_mutex);
+    while (true)
+    {
+        if (_sessions.empty())
+        {
+            _wakeUp.wait(lock);
+            continue;
+        }
+
+        const uint64_t now = SandboxInternal::MonotonicNowNs();
+        uint64_t nextDue   = UINT64_MAX;
+        for (auto *session : _sessions)
+        {
+            if (session->NextDue <= now)
+            {
+                Sample(session, now);
+                session->NextDue = NextTick(now, session->IntervalNs);
+            }
+            nextDue = std::min(nextDue, session->NextDue);
+        }
+
+        // steady_clock is CLOCK_MONOTONIC, the same clock as the due times.
+        _wakeUp.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::nanoseconds(nextDue)));
+    }
+}
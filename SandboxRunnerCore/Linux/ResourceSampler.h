@@ -0,0 +1,86 @@
+#ifndef SANDBOX_RESOURCE_SAMPLER_H
+#define SANDBOX_RESOURCE_SAMPLER_H
+
+#include "../Sandbox.h"
+#include "../InternalHelpers.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
+
+class ActivityEntry;
+
+/**
+ * @brief Sampling state of one sandboxed program
+ * @remarks The settings are filled by the caller. The rest is owned by the sampler thread while the
+ * session is attached, and may be read by the caller after Detach.
+ */
+struct ResourceSamplerSession
+{
+    pid_t Pid              = -1;
+    uint64_t IntervalNs    = 0;
+    SandboxSample *Buffer  = nullptr; // May be nullptr
+    uint32_t Capacity      = 0;
+    SandboxSampleCallback Callback = nullptr;
+    void *UserData         = nullptr;
+
+    uint64_t MemoryLimit = 0; // Kill the program once its resident memory passes this, 0 = no limit
+    uint64_t IdleLimitNs = 0; // Kill the program once its CPU time has not grown for this long, 0 = no limit
+    bool IdleWatchesDescendants = false; // The program may fork, CPU time of its descendants is progress too
+    std::atomic<uint32_t> *TerminationReason = nullptr;
+    ActivityEntry *Activity = nullptr; // Receives every sample when the run is listed on a board
+
+    uint32_t Count  = 0; // Samples kept in Buffer
+    uint32_t Stride = 1; // Buffer keeps every Stride-th tick
+    uint64_t Ticks  = 0; // Samples taken
+
+    uint64_t LastCpuTimeUs = 0; // CPU time, of the whole tree with IdleWatchesDescendants, when it last changed
+    uint64_t LastProgress  = 0; // When the CPU time last changed, CLOCK_MONOTONIC ns
+
+    uint64_t NextDue = 0;
+    clockid_t CpuClock{};
+    SandboxInternal::UniqueFd StatmFd;
+};
+
+/**
+ * @brief A single process-wide thread that samples every attached sandbox and enforces its live limits
+ * @remarks Due times are aligned to multiples of the interval, so sandboxes sampled at the same
+ * interval share one wake-up. A sample costs one pread of /proc/<pid>/statm and one clock_gettime
+ * on the program's CPU clock, both opened once in Attach. An idle limit on a program that may fork
+ * also walks its descendants.
+ */
+class ResourceSampler
+{
+public:
+    static ResourceSampler &Instance();
+
+    /**
+     * @brief Open the program's sources and start sampling it
+     * @return false if the program cannot be sampled; the session is not attached then
+     */
+    bool Attach(ResourceSamplerSession *session);
+
+    /**
+     * @brief Stop sampling the program
+     * @remarks Once this returns, the sampler no longer touches the session. Call it before the program
+     * is reaped, the sources refer to the pid.
+     */
+    void Detach(ResourceSamplerSession *session);
+
+private:
+    ResourceSampler() = default;
+
+    void Run();
+    static void Sample(ResourceSamplerSession *session, uint64_t now);
+
+    std::mutex _mutex;
+    std::condition_variable _wakeUp;
+    std::vector<ResourceSamplerSession *> _sessions;
+    bool _started = false;
+};
+
+#endif //! SANDBOX_RESOURCE_SAMPLER_H
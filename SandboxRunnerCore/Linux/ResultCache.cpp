@@ -0,0 +1,393 @@
+#include "ResultCache.h"
+
+#include "../InternalHelpers.h"
+#include "../Policy/BuiltinPolicies.h"
+#include "../Policy/PolicyRegistry.h"
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+extern char **environ;
+
+namespace
+{
+
+constexpr char RESULT_CACHE_MAGIC[8]          = {'S', 'B', 'X', 'R', 'C', 'A', 'C', 'H'};
+constexpr uint32_t RESULT_CACHE_FORMAT_VERSION = 1;
+// Slots tried after the home slot of a key before its home slot is overwritten.
+constexpr uint64_t MAX_PROBES = 16;
+
+constexpr uint32_t ENTRY_USED       = 1 << 0;
+constexpr uint32_t ENTRY_HAS_OUTPUT = 1 << 1;
+constexpr uint32_t ENTRY_HAS_ERROR  = 1 << 2;
+
+struct ResultCacheHeader
+{
+    char Magic[8];
+    uint32_t FormatVersion;
+    uint32_t EntrySize;
+    uint64_t Capacity;
+    uint64_t Reserved[5];
+};
+
+static_assert(sizeof(ResultCacheHeader) == 64);
+
+/**
+ * @brief The index file, locked and mapped for the lifetime of the object
+ */
+class MappedIndex
+{
+public:
+    /**
+     * @param writable Lock exclusively, and create or reset the index if it is missing or not compatible
+     */
+    static std::optional<MappedIndex> Open(const std::string &path, uint64_t capacity, bool writable)
+    {
+        SandboxInternal::UniqueFd fd(open(path.c_str(), writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644));
+        if (!fd.valid())
+            return std::nullopt;
+
+        int locked;
+        do
+        {
+            locked = flock(fd.get(), writable ? LOCK_EX : LOCK_SH);
+        } while (locked != 0 && errno == EINTR);
+        if (locked != 0)
+            return std::nullopt;
+
+        struct stat info{};
+        ResultCacheHeader header{};
+        if (fstat(fd.get(), &info) != 0)
+            return std::nullopt;
+        const bool hasHeader = pread(fd.get(), &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+        const bool compatible = hasHeader && memcmp(header.Magic, RESULT_CACHE_MAGIC, sizeof(RESULT_CACHE_MAGIC)) == 0
+                                && header.FormatVersion == RESULT_CACHE_FORMAT_VERSION
+                                && header.EntrySize == sizeof(ResultCacheEntry) && header.Capacity > 0
+                                && static_cast<uint64_t>(info.st_size) == FileSize(header.Capacity);
+
+        if (!compatible)
+        {
+            if (!writable)
+                return std::nullopt;
+
+            header = {};
+            memcpy(header.Magic, RESULT_CACHE_MAGIC, sizeof(RESULT_CACHE_MAGIC));
+            header.FormatVersion = RESULT_CACHE_FORMAT_VERSION;
+            header.EntrySize     = sizeof(ResultCacheEntry);
+            header.Capacity      = capacity;
+            if (ftruncate(fd.get(), 0) != 0 || ftruncate(fd.get(), static_cast<off_t>(FileSize(capacity))) != 0
+                || pwrite(fd.get(), &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))
+                return std::nullopt;
+        }
+
+        const size_t size = FileSize(header.Capacity);
+        void *memory = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd.get(), 0);
+        if (memory == MAP_FAILED)
+            return std::nullopt;
+        return MappedIndex(std::move(fd), memory, size, header.Capacity);
+    }
+
+    MappedIndex(MappedIndex &&other) noexcept
+        : _fd(std::move(other._fd)), _memory(std::exchange(other._memory, nullptr)), _size(other._size),
+          _capacity(other._capacity)
+    {
+    }
+
+    MappedIndex(const MappedIndex &)            = delete;
+    MappedIndex &operator=(const MappedIndex &) = delete;
+    MappedIndex &operator=(MappedIndex &&)      = delete;
+
+    // Closing the descriptor releases the lock.
+    ~MappedIndex()
+    {
+        if (_memory != nullptr)
+            munmap(_memory, _size);
+    }
+
+    uint64_t Capacity() const { return _capacity; }
+
+    ResultCacheEntry &Slot(uint64_t index) const
+    {
+        return reinterpret_cast<ResultCacheEntry *>(static_cast<char *>(_memory) + sizeof(ResultCacheHeader))[index];
+    }
+
+    uint64_t HomeSlot(const ContentDigest &key) const
+    {
+        uint64_t prefix;
+        memcpy(&prefix, key.data(), sizeof(prefix));
+        return prefix % _capacity;
+    }
+
+private:
+    MappedIndex(SandboxInternal::UniqueFd fd, void *memory, size_t size, uint64_t capacity)
+        : _fd(std::move(fd)), _memory(memory), _size(size), _capacity(capacity)
+    {
+    }
+
+    static uint64_t FileSize(uint64_t capacity)
+    {
+        return sizeof(ResultCacheHeader) + capacity * sizeof(ResultCacheEntry);
+    }
+
+    SandboxInternal::UniqueFd _fd;
+    void *_memory;
+    size_t _size;
+    uint64_t _capacity;
+};
+
+std::string ResolvePath(const SandboxConfiguration &config, const std::string &path)
+{
+    return SandboxInternal::ResolveSandboxPath(config.WorkingDirectory, path);
+}
+
+void UpdateString(Sha256 &hash, std::string_view text)
+{
+    hash.UpdateValue(static_cast<uint64_t>(text.size()));
+    hash.Update(text);
+}
+
+bool IsSameFile(const char *first, const char *second)
+{
+    return first != nullptr && second != nullptr && strcmp(first, second) == 0;
+}
+
+} // namespace
+
+std::optional<ContentDigest> ComputeResultCacheKey(const SandboxConfiguration &config,
+                                                   const SandboxConfigurationEx &extension)
+{
+    const auto internal = SandboxInternal::InternalConfig::FromCConfig(&config);
+    const auto args     = internal.ParseCommandArgs();
+    if (args.empty())
+        return std::nullopt;
+
+    Sha256 hash;
+    UpdateString(hash, "SandboxRunner result cache");
+    hash.UpdateValue(SANDBOX_VERSION);
+
+    const auto program = HashFileContent(ResolvePath(config, args.front()));
+    if (!program.has_value())
+        return std::nullopt;
+    hash.UpdateValue(*program);
+    UpdateString(hash, internal.UserCommand);
+    UpdateString(hash, internal.WorkingDirectory);
+
+    // Interpreted programs name their script as an argument.
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (const auto argument = HashFileContent(ResolvePath(config, args[i])))
+        {
+            hash.UpdateValue(static_cast<uint64_t>(i));
+            hash.UpdateValue(*argument);
+        }
+    }
+
+    if (config.InputFile != nullptr)
+    {
+        const auto input = HashFileContent(ResolvePath(config, config.InputFile));
+        if (!input.has_value())
+            return std::nullopt;
+        hash.UpdateValue(*input);
+    }
+
+    if (config.EnvironmentVariables != nullptr && config.EnvironmentVariablesCount != 0)
+    {
+        for (uint16_t i = 0; i < config.EnvironmentVariablesCount; ++i)
+            UpdateString(hash, config.EnvironmentVariables[i] != nullptr ? config.EnvironmentVariables[i] : "");
+    }
+    else
+    {
+        for (char **variable = environ; *variable != nullptr; ++variable)
+            UpdateString(hash, *variable);
+    }
+
+    const uint32_t redirections = (config.OutputFile != nullptr ? 1 : 0) | (config.ErrorFile != nullptr ? 2 : 0)
+                                  | (IsSameFile(config.OutputFile, config.ErrorFile) ? 4 : 0);
+    hash.UpdateValue(redirections);
+
+    hash.UpdateValue(config.MaxMemoryToCrash);
+    hash.UpdateValue(config.MaxMemory);
+    hash.UpdateValue(config.MaxStack);
+    hash.UpdateValue(config.MaxCpuTime);
+    hash.UpdateValue(config.MaxRealTime);
+    hash.UpdateValue(config.MaxOutputSize);
+    hash.UpdateValue(config.MaxProcessCount);
+    hash.UpdateValue(extension.MaxIdleTime);
+    hash.UpdateValue(extension.TimingCalibration);
+    hash.UpdateValue(extension.Namespaces); // The program may behave differently isolated
+    hash.UpdateValue(extension.ScratchSize);
+
+    // A name can mean a built-in policy or a file, resolve it as the run will.
+    UpdateString(hash, internal.Policy);
+    UpdateString(hash, SandboxPolicyEngine::GetBuiltinPoliciesDigest());
+    if (const auto policyPath = SandboxPolicyEngine::FindPolicyFile(internal.Policy))
+    {
+        if (const auto policyFile = HashFileContent(policyPath->string()))
+            hash.UpdateValue(*policyFile);
+    }
+
+    return hash.Finish();
+}
+
+bool IsResultCacheable(const SandboxResultEx &result)
+{
+    if (result.Result.Status == SANDBOX_STATUS_INTERNAL_ERROR
+        || result.Result.Status == SANDBOX_STATUS_REAL_TIME_LIMIT_EXCEEDED)
+        return false;
+    if (result.TerminationReason == SANDBOX_TERMINATION_REAL_TIME_LIMIT
+        || result.TerminationReason == SANDBOX_TERMINATION_IDLE_LIMIT)
+        return false;
+    return result.TimingConfidence != SANDBOX_TIMING_CONFIDENCE_LOW;
+}
+
+ResultCache::ResultCache(std::string indexPath, uint64_t capacity)
+    : _indexPath(std::move(indexPath)), _blobDirectory(_indexPath + ".blobs"), _capacity(std::max<uint64_t>(capacity, 1))
+{
+}
+
+std::optional<ResultCacheEntry> ResultCache::Lookup(const ContentDigest &key) const
+{
+    const auto index = MappedIndex::Open(_indexPath, _capacity, false);
+    if (!index.has_value())
+        return std::nullopt;
+
+    const uint64_t home   = index->HomeSlot(key);
+    const uint64_t probes = std::min(MAX_PROBES, index->Capacity());
+    for (uint64_t i = 0; i < probes; ++i)
+    {
+        const ResultCacheEntry &slot = index->Slot((home + i) % index->Capacity());
+        if ((slot.Flags & ENTRY_USED) == 0)
+            return std::nullopt;
+        if (slot.Key == key)
+            return slot;
+    }
+    return std::nullopt;
+}
+
+bool ResultCache::Store(const ResultCacheEntry &entry) const
+{
+    const auto index = MappedIndex::Open(_indexPath, _capacity, true);
+    if (!index.has_value())
+        return false;
+
+    const uint64_t home   = index->HomeSlot(entry.Key);
+    const uint64_t probes = std::min(MAX_PROBES, index->Capacity());
+    uint64_t target       = home;
+    for (uint64_t i = 0; i < probes; ++i)
+    {
+        const uint64_t candidate = (home + i) % index->Capacity();
+        const ResultCacheEntry &slot = index->Slot(candidate);
+        if ((slot.Flags & ENTRY_USED) == 0 || slot.Key == entry.Key)
+        {
+            target = candidate;
+            break;
+        }
+    }
+
+    index->Slot(target)       = entry;
+    index->Slot(target).Flags = entry.Flags | ENTRY_USED;
+    return true;
+}
+
+bool ResultCache::Replay(const ContentDigest &key, const SandboxConfiguration &config, SandboxResultEx &result) const
+{
+    const auto entry = Lookup(key);
+    if (!entry.has_value() || (entry->Flags & ENTRY_HAS_OUTPUT) == 0 || config.OutputFile == nullptr)
+        return false;
+    if (!RestoreBlob(entry->OutputDigest, ResolvePath(config, config.OutputFile).c_str()))
+        return false;
+    if ((entry->Flags & ENTRY_HAS_ERROR) != 0 && config.ErrorFile != nullptr
+        && !RestoreBlob(entry->ErrorDigest, ResolvePath(config, config.ErrorFile).c_str()))
+        return false;
+
+    result.Result                     = entry->Result;
+    result.TerminationReason          = entry->TerminationReason;
+    result.UserTimeUs                 = entry->UserTimeUs;
+    result.SystemTimeUs               = entry->SystemTimeUs;
+    result.MinorPageFaults            = entry->MinorPageFaults;
+    result.MajorPageFaults            = entry->MajorPageFaults;
+    result.VoluntaryContextSwitches   = entry->VoluntaryContextSwitches;
+    result.InvoluntaryContextSwitches = entry->InvoluntaryContextSwitches;
+    result.ReadBytes                  = entry->ReadBytes;
+    result.WriteBytes                 = entry->WriteBytes;
+    result.PeakMemoryUsage            = entry->PeakMemoryUsage;
+    result.PeakMemorySource           = SANDBOX_PEAK_MEMORY_SOURCE_RUSAGE;
+    result.FromResultCache            = 1;
+    return true;
+}
+
+bool ResultCache::Record(const ContentDigest &key, const SandboxConfiguration &config, const SandboxResultEx &result) const
+{
+    if (!IsResultCacheable(result) || config.OutputFile == nullptr)
+        return false;
+
+    ResultCacheEntry entry{};
+    entry.Key = key;
+
+    const auto output = StoreBlob(ResolvePath(config, config.OutputFile).c_str());
+    if (!output.has_value())
+        return false;
+    entry.OutputDigest = *output;
+    entry.Flags |= ENTRY_HAS_OUTPUT;
+
+    if (config.ErrorFile != nullptr && !IsSameFile(config.OutputFile, config.ErrorFile))
+    {
+        const auto error = StoreBlob(ResolvePath(config, config.ErrorFile).c_str());
+        if (!error.has_value())
+            return false;
+        entry.ErrorDigest = *error;
+        entry.Flags |= ENTRY_HAS_ERROR;
+    }
+
+    entry.TerminationReason          = result.TerminationReason;
+    entry.Result                     = result.Result;
+    entry.UserTimeUs                 = result.UserTimeUs;
+    entry.SystemTimeUs               = result.SystemTimeUs;
+    entry.MinorPageFaults            = result.MinorPageFaults;
+    entry.MajorPageFaults            = result.MajorPageFaults;
+    entry.VoluntaryContextSwitches   = result.VoluntaryContextSwitches;
+    entry.InvoluntaryContextSwitches = result.InvoluntaryContextSwitches;
+    entry.ReadBytes                  = result.ReadBytes;
+    entry.WriteBytes                 = result.WriteBytes;
+    entry.PeakMemoryUsage            = result.PeakMemoryUsage;
+    return Store(entry);
+}
+
+std::optional<ContentDigest> ResultCache::StoreBlob(const char *path) const
+{
+    const auto digest = HashFileContent(path);
+    if (!digest.has_value())
+        return std::nullopt;
+
+    const std::string blobPath = _blobDirectory + "/" + DigestToHex(*digest);
+    if (access(blobPath.c_str(), F_OK) == 0)
+        return digest;
+
+    // Written aside and renamed, so a concurrent Replay never sees a partial blob.
+    std::error_code error;
+    std::filesystem::create_directories(_blobDirectory, error);
+    const std::string temporaryPath = fmt::format("{0}.{1}.{2}.tmp", blobPath, getpid(), gettid());
+    if (!std::filesystem::copy_file(path, temporaryPath, std::filesystem::copy_options::overwrite_existing, error)
+        || rename(temporaryPath.c_str(), blobPath.c_str()) != 0)
+    {
+        unlink(temporaryPath.c_str());
+        return std::nullopt;
+    }
+    return digest;
+}
+
+bool ResultCache::RestoreBlob(const ContentDigest &digest, const char *path) const
+{
+    std::error_code error;
+    return std::filesystem::copy_file(_blobDirectory + "/" + DigestToHex(digest), path,
+                                      std::filesystem::copy_options::overwrite_existing, error);
+}
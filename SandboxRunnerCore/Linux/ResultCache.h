@@ -0,0 +1,85 @@
+#ifndef SANDBOX_RESULT_CACHE_H
+#define SANDBOX_RESULT_CACHE_H
+
+#include "../ContentHash.h"
+#include "../Sandbox.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Slots of a new index. The file is sparse, only slots that were written take disk space.
+constexpr uint64_t RESULT_CACHE_CAPACITY = 1 << 20;
+
+/**
+ * @brief One cached run, stored as is in the index file
+ */
+struct ResultCacheEntry
+{
+    ContentDigest Key;
+    ContentDigest OutputDigest; // Blob holding the OutputFile of the run
+    ContentDigest ErrorDigest;  // Blob holding the ErrorFile of the run, if it was a separate file
+    uint32_t Flags;
+    uint32_t TerminationReason;
+    SandboxResult Result;
+    uint64_t UserTimeUs;
+    uint64_t SystemTimeUs;
+    uint64_t MinorPageFaults;
+    uint64_t MajorPageFaults;
+    uint64_t VoluntaryContextSwitches;
+    uint64_t InvoluntaryContextSwitches;
+    uint64_t ReadBytes;
+    uint64_t WriteBytes;
+    uint64_t PeakMemoryUsage;
+};
+
+/**
+ * @brief Key a run by the content it depends on
+ * @remarks Hashes the program binary, every argument that names a file, the input file, the
+ * environment, the limits and the policy: the file a policy name loads from, or the built-in policies.
+ * @return std::nullopt if the program or the input file cannot be read
+ */
+std::optional<ContentDigest> ComputeResultCacheKey(const SandboxConfiguration &config,
+                                                   const SandboxConfigurationEx &extension);
+
+/**
+ * @brief Whether a result depends only on the key, not on the machine's load
+ */
+bool IsResultCacheable(const SandboxResultEx &result);
+
+/**
+ * @brief Memory-mapped, open-addressing index of cached runs, shared by processes through flock
+ * @remarks Output files are stored by content digest in "<index>.blobs", so identical outputs of
+ * different runs share one blob. A key probes at most a few slots; when they are all taken, the
+ * run in the key's home slot is overwritten.
+ */
+class ResultCache
+{
+public:
+    explicit ResultCache(std::string indexPath, uint64_t capacity = RESULT_CACHE_CAPACITY);
+
+    std::optional<ResultCacheEntry> Lookup(const ContentDigest &key) const;
+    bool Store(const ResultCacheEntry &entry) const;
+
+    /**
+     * @brief Restore the output files of a cached run and fill in its result
+     * @return false on a miss, or if a blob is missing
+     */
+    bool Replay(const ContentDigest &key, const SandboxConfiguration &config, SandboxResultEx &result) const;
+
+    /**
+     * @brief Store a finished run and its output files
+     * @return false if the run is not cacheable or could not be stored
+     */
+    bool Record(const ContentDigest &key, const SandboxConfiguration &config, const SandboxResultEx &result) const;
+
+private:
+    std::optional<ContentDigest> StoreBlob(const char *path) const;
+    bool RestoreBlob(const ContentDigest &digest, const char *path) const;
+
+    std::string _indexPath;
+    std::string _blobDirectory;
+    uint64_t _capacity;
+};
+
+#endif //! SANDBOX_RESULT_CACHE_H
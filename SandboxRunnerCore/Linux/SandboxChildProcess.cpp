@@ -5,14 +5,28 @@
 #include "../Policy/ResourceConfig.h"
 #include "../Policy/PolicyRegistry.h"
 #include "SecurePolicy.h"
+#include "NamespacePool.h"
+#include "ScratchDirectory.h"
 #include "ErrorHandler.h"
+#include <algorithm>
+#include <cerrno>
 #include <csignal>
+#include <fcntl.h>
+#include <initializer_list>
+#include <linux/capability.h>
 #include <sched.h>
+#include <sys/prctl.h>
 #include <sys/resource.h>
 #include <unistd.h>
+#include <vector>
 
 extern char **environ;
 
+// How many nice levels a SANDBOX_PRIORITY_LOW run is below the supervisor.
+constexpr int LOW_PRIORITY_NICE_INCREMENT = 10;
+// Highest number HideFds() moves a descriptor to, a larger one would grow the fd table for nothing.
+constexpr rlim_t MAX_HIDDEN_FD = 65535;
+
 bool SetResourceLimit(const int resource, rlim_t val)
 {
     if (resource != RLIMIT_NPROC && val == UNLIMITED)
@@ -21,6 +35,67 @@ bool SetResourceLimit(const int resource, rlim_t val)
     return setrlimit(resource, &limit) == 0;
 }
 
+bool ApplyPriority(uint32_t priority)
+{
+    if (priority == SANDBOX_PRIORITY_LOW)
+    {
+        // nice() may legitimately return -1, only errno tells a failure apart.
+        errno = 0;
+        return nice(LOW_PRIORITY_NICE_INCREMENT) != -1 || errno == 0;
+    }
+    if (priority == SANDBOX_PRIORITY_IDLE)
+    {
+        const sched_param parameters{.sched_priority = 0};
+        return sched_setscheduler(0, SCHED_IDLE, &parameters) == 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Move descriptors that the filter names by number out of the program's reach
+ * @remarks The policy allows execveat() on the cached program's descriptor and sendmsg() on the notify
+ * socket for the program's whole life. The lowest of the moved numbers becomes the hard RLIMIT_NOFILE, so
+ * once the descriptors are closed on exec, no open() or dup() of the program can be given those numbers
+ * again. Without CAP_SYS_RESOURCE, which root loses here, the limit stays.
+ * @param fds The descriptors to move, updated in place; negative ones are skipped
+ */
+bool HideFds(std::initializer_list<int *> fds)
+{
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == 0)
+        return false;
+
+    // The highest free numbers below the limit, the supervisor may have left others open.
+    int ceiling = static_cast<int>(std::min(limit.rlim_cur - 1, MAX_HIDDEN_FD));
+    int lowest  = -1;
+    for (int *fd : fds)
+    {
+        if (*fd < 0)
+            continue;
+
+        int hidden = ceiling;
+        while (hidden > *fd && fcntl(hidden, F_GETFD) != -1)
+            --hidden;
+        if (hidden != *fd)
+        {
+            if (dup3(*fd, hidden, O_CLOEXEC) == -1)
+                return false;
+            close(*fd);
+            *fd = hidden;
+        }
+        lowest  = lowest < 0 ? hidden : std::min(lowest, hidden);
+        ceiling = lowest - 1;
+    }
+    if (lowest < 0)
+        return true;
+
+    const rlimit lowered{.rlim_cur = static_cast<rlim_t>(lowest), .rlim_max = static_cast<rlim_t>(lowest)};
+    if (setrlimit(RLIMIT_NOFILE, &lowered) != 0)
+        return false;
+    // Dropping from the bounding set needs CAP_SETPCAP; without it, the program has no CAP_SYS_RESOURCE either.
+    return prctl(PR_CAPBSET_DROP, CAP_SYS_RESOURCE, 0, 0, 0) == 0 || errno == EPERM;
+}
+
 char *const *GetEnvironmentVariables(const SandboxConfiguration *configuration)
 {
     if (configuration->EnvironmentVariables == nullptr || configuration->EnvironmentVariablesCount == 0)
@@ -29,13 +104,23 @@ char *const *GetEnvironmentVariables(const SandboxConfiguration *configuration)
     return const_cast<char *const *>(configuration->EnvironmentVariables);
 }
 
-void RunSandboxProcess(const char *programPath, char *const *programArgs, const SandboxConfiguration *configuration)
+void RunSandboxProcess(const char *programPath,
+                       char *const *programArgs,
+                       const SandboxConfiguration *configuration,
+                       const SandboxChildContext &context)
 {
     using SandboxInternal::UniqueFile;
     using SandboxInternal::ErrorContext;
     using SandboxInternal::InternalError;
     using SandboxInternal::HandleChildError;
 
+    if (context.Timestamps != nullptr)
+        context.Timestamps->SetupStart.store(SandboxInternal::MonotonicNowNs(), std::memory_order_relaxed);
+
+    // First, so the working directory and the redirected files are resolved inside the namespaces.
+    if (context.Namespaces != nullptr && !context.Namespaces->Enter())
+        HandleChildError(ErrorContext(InternalError::NamespaceSetupFailed, "Failed to join namespaces"));
+
     UniqueFile inputStream;
     UniqueFile outputStream;
     UniqueFile errorStream;
@@ -51,12 +136,27 @@ void RunSandboxProcess(const char *programPath, char *const *programArgs, const
     if (!SetResourceLimit(RLIMIT_AS, maxMemoryToCrash)
         || !SetResourceLimit(RLIMIT_STACK, static_cast<rlim_t>(resourceConfig.MaxStack))
         || !SetResourceLimit(RLIMIT_CPU, cpuLimit)
-        || (resourceConfig.MaxProcessCount >= 0
+        || (resourceConfig.MaxProcessCount >= 0 && !context.ProcessGate
             && !SetResourceLimit(RLIMIT_NPROC, static_cast<rlim_t>(resourceConfig.MaxProcessCount)))
         || !SetResourceLimit(RLIMIT_FSIZE, static_cast<rlim_t>(resourceConfig.MaxOutputSize)))
     {
         HandleChildError(ErrorContext(InternalError::ResourceLimitFailed, "Failed to apply job limits"));
     }
+    // The process gate counts the live descendants of the program, orphans must stay among them.
+    if (context.ProcessGate && prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0) != 0)
+        HandleChildError(ErrorContext(InternalError::ResourceLimitFailed, "Failed to keep orphans under the program"));
+
+    if (context.PinnedCpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(context.PinnedCpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+            HandleChildError(ErrorContext(InternalError::ResourceLimitFailed, "Failed to pin to CPU core"));
+    }
+
+    if (!ApplyPriority(context.Priority))
+        HandleChildError(ErrorContext(InternalError::ResourceLimitFailed, "Failed to lower scheduling priority"));
 
     if (configuration->InputFile)
     {
@@ -67,7 +167,13 @@ void RunSandboxProcess(const char *programPath, char *const *programArgs, const
             HandleChildError(ErrorContext(InternalError::FileRedirectFailed, "Failed to redirect input file"));
     }
 
-    if (configuration->OutputFile)
+    if (context.OutputPipeFd >= 0)
+    {
+        // The parent opened OutputFile, and counts what reaches it.
+        if (dup2(context.OutputPipeFd, fileno(stdout)) == -1)
+            HandleChildError(ErrorContext(InternalError::FileRedirectFailed, "Failed to redirect output file"));
+    }
+    else if (configuration->OutputFile)
     {
         outputStream.reset(fopen(configuration->OutputFile, "w"));
         if (!outputStream)
@@ -78,11 +184,11 @@ void RunSandboxProcess(const char *programPath, char *const *programArgs, const
 
     if (configuration->ErrorFile)
     {
-        if (outputStream && strcmp(configuration->OutputFile, configuration->ErrorFile) == 0)
+        if (configuration->OutputFile && strcmp(configuration->OutputFile, configuration->ErrorFile) == 0)
         {
             Logger::Info("Same path for output and error file");
-            // Share the same FILE* - no need to open again
-            if (dup2(fileno(outputStream.get()), fileno(stderr)) == -1)
+            // Share the same file - no need to open again
+            if (dup2(fileno(stdout), fileno(stderr)) == -1)
                 HandleChildError(ErrorContext(InternalError::FileRedirectFailed, "Failed to redirect error file"));
         }
         else
@@ -96,20 +202,65 @@ void RunSandboxProcess(const char *programPath, char *const *programArgs, const
         }
     }
 
-    if (!SandboxPolicyEngine::IsDefaultPolicyName(configuration->Policy))
+    // After the redirections, which are written to the real directory.
+    if (context.ScratchSize != 0)
     {
-        Logger::Info("Applying custom rules: {0}", configuration->Policy);
+        std::vector<const char *> keptFiles{configuration->InputFile};
+        for (auto argument = programArgs; *argument != nullptr; ++argument)
+            keptFiles.push_back(*argument);
+        if (!MountScratchDirectory(context.ScratchSize, keptFiles))
+            HandleChildError(ErrorContext(InternalError::ScratchDirectoryFailed, "Failed to mount scratch directory"));
     }
 
-    if (ApplyLinuxSecurePolicy(programPath, configuration))
+    int programFd    = context.ProgramFd;
+    int notifySocket = context.NotifySocket;
+    if (!HideFds({&programFd, &notifySocket}))
+        HandleChildError(ErrorContext(InternalError::ResourceLimitFailed, "Failed to move the filter's descriptors"));
+
+    if (context.Profiling)
     {
-        Logger::Info("Applied policy to {0}, start running the sandboxed process", programPath);
+        Logger::Info("Profiling syscalls of {0}, the policy is not enforced", programPath);
+        if (!ApplyLinuxProfilingPolicy(notifySocket))
+            HandleChildError(ErrorContext(InternalError::PolicyApplicationFailed, "Failed to apply profiling policy"));
     }
     else
     {
-        HandleChildError(ErrorContext(InternalError::PolicyApplicationFailed, "Failed to apply policy"));
+        if (!SandboxPolicyEngine::IsDefaultPolicyName(configuration->Policy))
+        {
+            Logger::Info("Applying custom rules: {0}", configuration->Policy);
+        }
+
+        const bool supervised = context.ProcessGate || context.Supervised;
+        bool pathRulesFailed  = false;
+        if (ApplyLinuxSecurePolicy(programPath, configuration, supervised ? notifySocket : -1,
+                                   programFd, context.PathRulesetFd, &pathRulesFailed))
+        {
+            Logger::Info("Applied policy to {0}, start running the sandboxed process", programPath);
+        }
+        else if (pathRulesFailed)
+        {
+            HandleChildError(ErrorContext(InternalError::PathAccessRulesFailed, "Failed to enforce path access rules"));
+        }
+        else
+        {
+            HandleChildError(ErrorContext(InternalError::PolicyApplicationFailed, "Failed to apply policy"));
+        }
     }
 
-    execve(programPath, programArgs, GetEnvironmentVariables(configuration));
+    if (context.Timestamps != nullptr)
+        context.Timestamps->ExecStart.store(SandboxInternal::MonotonicNowNs(), std::memory_order_relaxed);
+    if (programFd >= 0)
+        fexecve(programFd, programArgs, GetEnvironmentVariables(configuration));
+    else
+        execve(programPath, programArgs, GetEnvironmentVariables(configuration));
+
+    // On success the pipe is closed by execve; any data tells the parent that it failed instead.
+    const int savedErrno = errno;
+    if (context.ExecHandshakeFd >= 0)
+    {
+        // The parent still sees the failure in the exit status if this write fails.
+        [[maybe_unused]] const auto written = write(context.ExecHandshakeFd, &savedErrno, sizeof(savedErrno));
+    }
+    errno = savedErrno;
     HandleChildError(ErrorContext(InternalError::ExecFailed, "Failed to execute the user command"));
 }
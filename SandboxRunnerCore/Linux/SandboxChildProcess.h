@@ -2,8 +2,44 @@
 #ifndef SANDBOX_CHILD_PROCESS_H
 #define SANDBOX_CHILD_PROCESS_H
 
+#include <atomic>
+#include <cstdint>
+
 struct SandboxConfiguration;
+class NamespaceSet;
+
+/**
+ * @brief Phase timestamps written by the child into memory shared with the parent, CLOCK_MONOTONIC ns
+ */
+struct SandboxChildTimestamps
+{
+    std::atomic<uint64_t> SetupStart{0};
+    std::atomic<uint64_t> ExecStart{0};
+};
+
+/**
+ * @brief State prepared by the parent before fork that the child needs besides the configuration
+ */
+struct SandboxChildContext
+{
+    bool Profiling   = false; // Install the profiling filter instead of the configured policy
+    bool ProcessGate = false; // Report new processes to the parent's SeccompSupervisor instead of using RLIMIT_NPROC
+    bool Supervised  = false; // The policy has SupervisorRules, which the parent's SeccompSupervisor checks
+    int NotifySocket = -1;    // Socket to hand the seccomp listener fd to the parent, -1 if unused
+    int ExecHandshakeFd = -1; // Close-on-exec pipe, written to only if execve fails, -1 if unused
+    int PinnedCpu       = -1; // Logical CPU to run on, -1 to leave placement to the kernel
+    int ProgramFd       = -1; // Cached copy of the program to fexecve(), -1 to execve() programPath
+    int PathRulesetFd   = -1; // Landlock ruleset of the policy's PathAccessRules, -1 if it has none
+    int OutputPipeFd    = -1; // The parent's OutputRelay, used as stdout instead of OutputFile, -1 if unused
+    uint64_t ScratchSize = 0; // Size of the tmpfs to cover the working directory with, 0 for none
+    uint32_t Priority    = 0; // SandboxPriority of the run, SANDBOX_PRIORITY_NORMAL keeps the supervisor's
+    SandboxChildTimestamps *Timestamps = nullptr; // Shared with the parent, nullptr if unavailable
+    const NamespaceSet *Namespaces     = nullptr; // Namespaces to join, nullptr to share the supervisor's
+};
 
-void RunSandboxProcess(const char *programPath, char *const *programArgs, const SandboxConfiguration *configuration);
+void RunSandboxProcess(const char *programPath,
+                       char *const *programArgs,
+                       const SandboxConfiguration *configuration,
+                       const SandboxChildContext &context);
 
 #endif //! SANDBOX_CHILD_PROCESS_H
@@ -3,13 +3,34 @@
 
 constexpr int UNLIMITED = 0;
 
+struct TimingCalibrationSnapshot;
+
 class SandboxImpl
 {
 private:
     const SandboxConfiguration *_config;
+    SandboxConfigurationEx _extension;
+    SandboxResultEx _resultEx;
     SandboxResult &_result;
 
+    SandboxResult *_resultOut;
+    SandboxResultEx *_resultExOut;
+
+    SandboxConfiguration _scaledConfig{}; // _config points here when MaxCpuTime is scaled by the calibration
+
+    int RunSandbox();
+    int RunCalibrated();
+    void ApplyCalibration(const TimingCalibrationSnapshot &calibration);
+
 public:
-    SandboxImpl(const SandboxConfiguration *config, SandboxResult &result);
+    /**
+     * @param extension Optional, copied up to its StructSize and zero-extended
+     * @param result Receives SandboxResult when not nullptr
+     * @param resultEx Receives the full SandboxResultEx when not nullptr
+     */
+    SandboxImpl(const SandboxConfiguration *config,
+                const SandboxConfigurationEx *extension,
+                SandboxResult *result,
+                SandboxResultEx *resultEx);
     int Run();
 };
@@ -1,24 +1,42 @@
 #include "SandboxMonitor.h"
 
 #include "../Logger.h"
+#include "../InternalHelpers.h"
+#include "../Sandbox.h"
 
 #include <unistd.h>
 #include <csignal>
+#include <ctime>
 #include <optional>
 
 namespace
 {
+
+uint64_t GetDeadline(const SandboxMonitorConfiguration *config)
+{
+    // The limit counts from execve, like RealTimeUsage; before the child gets there, from StartTime.
+    const uint64_t execStart = config->ExecStart != nullptr ? config->ExecStart->load(std::memory_order_relaxed) : 0;
+    return (execStart != 0 ? execStart : config->StartTime) + config->Timeout * 1000000ULL;
+}
+
 void *MonitorThread(void *arg)
 {
     auto *config = static_cast<SandboxMonitorConfiguration *>(arg);
     auto pid = config->Pid;
-    auto timeout = (config->Timeout + 999) / 1000;
 
-    auto sleepTime = sleep(timeout);
+    // clock_nanosleep is a cancellation point, the thread is cancelled once the program exits.
+    for (uint64_t deadline = GetDeadline(config); SandboxInternal::MonotonicNowNs() < deadline;
+         deadline = GetDeadline(config))
+    {
+        const timespec wakeUp{.tv_sec  = static_cast<time_t>(deadline / 1000000000ULL),
+                              .tv_nsec = static_cast<long>(deadline % 1000000000ULL)};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeUp, nullptr);
+    }
+
     if (kill(pid, 0) == 0)
     {
-        Logger::Info("Program (pid @{}) killed: timeout after {}s", pid, timeout - sleepTime);
-        kill(pid, SIGKILL);
+        Logger::Info("Program (pid @{}) killed: timeout after {}ms", pid, config->Timeout);
+        SandboxInternal::KillWithReason(pid, config->TerminationReason, SANDBOX_TERMINATION_REAL_TIME_LIMIT);
     }
     pthread_exit(nullptr);
 
@@ -30,4 +48,4 @@ void *MonitorThread(void *arg)
 int StartSandboxMonitor(pthread_t *thread, const SandboxMonitorConfiguration *configuration)
 {
     return pthread_create(thread, nullptr, MonitorThread, const_cast<SandboxMonitorConfiguration *>(configuration));
-}
\ No newline at end of file
+}
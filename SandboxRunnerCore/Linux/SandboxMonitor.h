@@ -1,6 +1,7 @@
 #ifndef SANDBOX_MONITOR_H
 #define SANDBOX_MONITOR_H
 
+#include <atomic>
 #include <cstdint>
 #include <optional>
 #include <pthread.h>
@@ -9,6 +10,9 @@ struct SandboxMonitorConfiguration
 {
     uint64_t Timeout; // in milliseconds
     pid_t Pid; // process to monitor
+    uint64_t StartTime; // CLOCK_MONOTONIC ns to count from until the program is executed
+    const std::atomic<uint64_t> *ExecStart = nullptr; // CLOCK_MONOTONIC ns of execve, 0 until then
+    std::atomic<uint32_t> *TerminationReason = nullptr; // Set to SANDBOX_TERMINATION_REAL_TIME_LIMIT on timeout
 };
 
 /**
@@ -0,0 +1,105 @@
+#include "ScratchDirectory.h"
+
+#include "../InternalHelpers.h"
+
+#include <climits>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <sched.h>
+#include <string>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace
+{
+
+struct KeptFile
+{
+    std::filesystem::path Target; // Where the file appears in the scratch directory
+    SandboxInternal::UniqueFd Source;
+};
+
+// A read-only remount must keep the flags the source mount is locked with in a user namespace.
+unsigned long GetLockedMountFlags(int fd)
+{
+    struct statvfs info{};
+    if (fstatvfs(fd, &info) != 0)
+        return 0;
+
+    unsigned long flags = 0;
+    if ((info.f_flag & ST_NOEXEC) != 0)
+        flags |= MS_NOEXEC;
+    if ((info.f_flag & ST_NOATIME) != 0)
+        flags |= MS_NOATIME;
+    if ((info.f_flag & ST_NODIRATIME) != 0)
+        flags |= MS_NODIRATIME;
+    if ((info.f_flag & ST_RELATIME) != 0)
+        flags |= MS_RELATIME;
+    return flags;
+}
+
+bool BindReadOnly(const KeptFile &file)
+{
+    std::error_code error;
+    std::filesystem::create_directories(file.Target.parent_path(), error);
+    const SandboxInternal::UniqueFd mountPoint(open(file.Target.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0444));
+    if (!mountPoint.valid())
+        return false;
+
+    // The source is hidden under the tmpfs by now, it is only reachable through the descriptor.
+    const std::string source = "/proc/self/fd/" + std::to_string(file.Source.get());
+    const unsigned long readOnly =
+        MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NODEV | GetLockedMountFlags(file.Source.get());
+    return mount(source.c_str(), file.Target.c_str(), nullptr, MS_BIND, nullptr) == 0
+           && mount(nullptr, file.Target.c_str(), nullptr, readOnly, nullptr) == 0;
+}
+
+} // namespace
+
+bool MountScratchDirectory(uint64_t size, const std::vector<const char *> &keptFiles)
+{
+    char directory[PATH_MAX];
+    if (getcwd(directory, sizeof(directory)) == nullptr)
+        return false;
+    const std::filesystem::path root(directory);
+
+    // Private, so the tmpfs does not propagate back to the namespace the run was started in.
+    if (unshare(CLONE_NEWNS) != 0 || mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) != 0)
+        return false;
+
+    // Opened in the new namespace, only its mounts can be bound, and before the tmpfs hides them. The
+    // target keeps the path as named, a symbolic link included.
+    std::vector<KeptFile> kept;
+    for (const char *file : keptFiles)
+    {
+        if (file == nullptr || *file == '\0')
+            continue;
+        const auto relative = (root / file).lexically_normal().lexically_relative(root);
+        if (relative.empty() || relative == "." || *relative.begin() == "..")
+            continue;
+
+        SandboxInternal::UniqueFd source(open(file, O_PATH | O_CLOEXEC));
+        struct stat info{};
+        if (source.valid() && fstat(source.get(), &info) == 0 && S_ISREG(info.st_mode))
+            kept.push_back({root / relative, std::move(source)});
+    }
+
+    char options[64];
+    snprintf(options, sizeof(options), "size=%llu,mode=0755", static_cast<unsigned long long>(size));
+    if (mount("tmpfs", directory, "tmpfs", MS_NOSUID | MS_NODEV, options) != 0)
+        return false;
+
+    for (const auto &file : kept)
+    {
+        if (!BindReadOnly(file))
+            return false;
+    }
+
+    // The working directory still refers to the directory under the tmpfs.
+    return chdir(directory) == 0;
+}
@@ -0,0 +1,18 @@
+#ifndef SANDBOX_SCRATCH_DIRECTORY_H
+#define SANDBOX_SCRATCH_DIRECTORY_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Cover the working directory with an empty tmpfs of at most size bytes, in the child before execve
+ * @param keptFiles Paths the program needs from the working directory, such as the program itself, its
+ * script and the input file. Those that name regular files inside it are bind-mounted read-only at the
+ * same place; the others are ignored.
+ * @remarks The tmpfs lives in a mount namespace of its own, which needs CAP_SYS_ADMIN in the caller's
+ * user namespace. It is freed with that namespace when the last process of the run exits, so nothing
+ * has to be cleaned up. Files opened before, like the redirections, still refer to the real directory.
+ */
+bool MountScratchDirectory(uint64_t size, const std::vector<const char *> &keptFiles);
+
+#endif //! SANDBOX_SCRATCH_DIRECTORY_H
@@ -0,0 +1,64 @@
+#include "SeccompNotify.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+bool SendSeccompNotifyFd(int notifySocket, int notifyFd)
+{
+    char payload = 0;
+    iovec iov{.iov_base = &payload, .iov_len = sizeof(payload)};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov        = &iov;
+    message.msg_iovlen     = 1;
+    message.msg_control    = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr *header   = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type  = SCM_RIGHTS;
+    header->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &notifyFd, sizeof(int));
+
+    ssize_t sent;
+    do
+    {
+        sent = sendmsg(notifySocket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    return sent == sizeof(payload);
+}
+
+int ReceiveSeccompNotifyFd(int notifySocket)
+{
+    char payload = 0;
+    iovec iov{.iov_base = &payload, .iov_len = sizeof(payload)};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov        = &iov;
+    message.msg_iovlen     = 1;
+    message.msg_control    = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do
+    {
+        received = recvmsg(notifySocket, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    if (received != sizeof(payload))
+        return -1;
+
+    const cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header == nullptr || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS
+        || header->cmsg_len != CMSG_LEN(sizeof(int)))
+        return -1;
+
+    int notifyFd = -1;
+    memcpy(&notifyFd, CMSG_DATA(header), sizeof(int));
+    return notifyFd;
+}
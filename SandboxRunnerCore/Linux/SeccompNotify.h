@@ -0,0 +1,16 @@
+#ifndef SANDBOX_SECCOMP_NOTIFY_H
+#define SANDBOX_SECCOMP_NOTIFY_H
+
+/**
+ * @brief Hand a seccomp user-notification listener fd to the parent over a unix socket (SCM_RIGHTS)
+ * @remarks Called by the child after seccomp_load(); the filter must allow sendmsg() on notifySocket.
+ */
+bool SendSeccompNotifyFd(int notifySocket, int notifyFd);
+
+/**
+ * @brief Receive the listener fd sent by SendSeccompNotifyFd
+ * @return The listener fd, or -1 if the child exited or failed before sending it
+ */
+int ReceiveSeccompNotifyFd(int notifySocket);
+
+#endif //! SANDBOX_SECCOMP_NOTIFY_H
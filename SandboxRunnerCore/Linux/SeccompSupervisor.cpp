@@ -0,0 +1,706 @@
+#include "SeccompSupervisor.h"
+
+#include "ProcessStats.h"
+#include "../Logger.h"
+#include "../Sandbox.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <limits.h>
+#include <linux/openat2.h>
+#include <optional>
+#include <sched.h>
+#include <seccomp.h>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+
+using SandboxPolicyEngine::PathAccessMode;
+using SandboxPolicyEngine::PathAccessRule;
+
+constexpr int MAX_EVENTS = 16;
+// How long a worker waits for another job before it exits.
+constexpr auto WORKER_IDLE_TIMEOUT = std::chrono::seconds(30);
+
+/**
+ * @brief What to answer a notification with
+ */
+struct Verdict
+{
+    int Error     = 0;     // errno the syscall fails with, 0 if it may proceed
+    int64_t Value = 0;     // Return value when Emulated
+    bool Emulated = false; // The supervisor did the work, the syscall returns Value without running
+    bool Answered = false; // Already answered, through SECCOMP_ADDFD_FLAG_SEND
+    bool Denied   = false; // Refused by the rules, rather than failing as the syscall itself would
+    SandboxInternal::UniqueFd Fd; // Installed in the program as the syscall's result, if valid
+    bool CloseOnExec = false;     // Of Fd
+};
+
+Verdict Fail(int error)
+{
+    return Verdict{.Error = error};
+}
+
+Verdict Deny(int error)
+{
+    return Verdict{.Error = error, .Denied = true};
+}
+
+/**
+ * @brief Copy a NUL-terminated string out of the program's memory
+ * @remarks Reads at most a page at a time, so a string ending right before an unmapped page is still read.
+ */
+bool ReadRemoteString(pid_t pid, uint64_t address, std::string &value)
+{
+    static const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    char chunk[PATH_MAX];
+    value.clear();
+    while (value.size() < PATH_MAX)
+    {
+        const size_t length = std::min<uint64_t>(pageSize - address % pageSize, PATH_MAX - value.size());
+        iovec local{.iov_base = chunk, .iov_len = length};
+        iovec remote{.iov_base = reinterpret_cast<void *>(address), .iov_len = length};
+        const ssize_t read = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        if (read <= 0)
+            return false;
+        if (const auto *end = static_cast<const char *>(memchr(chunk, '\0', read)); end != nullptr)
+        {
+            value.append(chunk, end - chunk);
+            return true;
+        }
+        value.append(chunk, read);
+        address += read;
+    }
+    return false;
+}
+
+/**
+ * @brief A field of /proc/<pid>/status, such as "Threads" or "Umask"
+ */
+std::optional<std::string> ReadStatusField(pid_t pid, std::string_view field)
+{
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.size() > field.size() && line.starts_with(field) && line[field.size()] == ':')
+        {
+            const auto begin = line.find_first_not_of(" \t", field.size() + 1);
+            return begin == std::string::npos ? std::string() : line.substr(begin);
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> ReadFdPath(int fd)
+{
+    char buffer[PATH_MAX];
+    const std::string link = "/proc/self/fd/" + std::to_string(fd);
+    const ssize_t length   = readlink(link.c_str(), buffer, sizeof(buffer));
+    if (length <= 0 || length == sizeof(buffer))
+        return std::nullopt;
+    return std::string(buffer, length);
+}
+
+/**
+ * @brief Open the directory a path given by the program is relative to: its root, cwd or one of its fds
+ * @remarks Through /proc/<pid>, so the directory is the one the program sees in its own mount namespace,
+ * which a scratch directory or SANDBOX_NAMESPACE_MOUNT makes differ from the supervisor's.
+ */
+std::optional<SandboxInternal::UniqueFd> OpenBaseDirectory(pid_t pid, int dirFd, const std::string &path)
+{
+    const auto base = path.front() == '/' ? "/proc/" + std::to_string(pid) + "/root"
+                      : dirFd == AT_FDCWD ? "/proc/" + std::to_string(pid) + "/cwd"
+                                          : "/proc/" + std::to_string(pid) + "/fd/" + std::to_string(dirFd);
+    SandboxInternal::UniqueFd fd(open(base.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC));
+    if (!fd.valid())
+        return std::nullopt;
+    return fd;
+}
+
+/**
+ * @brief openat from the directory OpenBaseDirectory returned for path
+ * @remarks An absolute path is resolved with the program's root as the root, absolute symlinks and ".."
+ * included. Without openat2 (before Linux 5.6) only its leading slashes are, still in the right namespace.
+ */
+int OpenFromBase(int baseFd, const std::string &path, int flags, mode_t mode)
+{
+    if (path.front() != '/')
+        return openat(baseFd, path.c_str(), flags, mode);
+
+    open_how how{};
+    how.flags   = static_cast<uint64_t>(flags);
+    how.mode    = (flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE ? mode : 0;
+    how.resolve = RESOLVE_IN_ROOT;
+    const int fd = static_cast<int>(syscall(SYS_openat2, baseFd, path.c_str(), &how, sizeof(how)));
+    if (fd >= 0 || errno != ENOSYS)
+        return fd;
+    const auto relative = path.find_first_not_of('/');
+    return openat(baseFd, relative == std::string::npos ? "." : path.c_str() + relative, flags, mode);
+}
+
+/**
+ * @brief The access the longest rule prefix covering path grants, std::nullopt if no rule covers it
+ */
+std::optional<PathAccessMode> FindPathAccess(const std::vector<PathAccessRule> &rules, const std::string &path)
+{
+    const PathAccessRule *longest = nullptr;
+    for (const auto &rule : rules)
+    {
+        const auto &prefix = rule.PathPrefix;
+        const bool covers  = prefix == "/" || (path.starts_with(prefix)
+                                              && (path.size() == prefix.size() || path[prefix.size()] == '/'));
+        if (covers && (longest == nullptr || prefix.size() > longest->PathPrefix.size()))
+            longest = &rule;
+    }
+    if (longest == nullptr)
+        return std::nullopt;
+    return longest->Mode;
+}
+
+bool IsOpenAllowed(const std::vector<PathAccessRule> &rules, const std::string &path, bool writes)
+{
+    const auto access = FindPathAccess(rules, path);
+    return access == PathAccessMode::ReadWrite || (access == PathAccessMode::ReadOnly && !writes);
+}
+
+bool IsWriteOpen(int flags)
+{
+    return (flags & O_ACCMODE) != O_RDONLY || (flags & (O_CREAT | O_TRUNC)) != 0
+           || (flags & O_TMPFILE) == O_TMPFILE;
+}
+
+/**
+ * @brief Split a path into the directory that holds it and its last component
+ * @remarks "." stands for the directory itself, when the path has no component of its own ("/", "a/..").
+ */
+std::pair<std::string, std::string> SplitLastComponent(std::string path)
+{
+    while (path.size() > 1 && path.back() == '/')
+        path.pop_back();
+    const auto slash = path.rfind('/');
+    std::string parent = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    std::string name   = slash == std::string::npos ? path : path.substr(slash + 1);
+    if (name.empty() || name == "." || name == "..")
+        return {path, "."};
+    return {parent, name};
+}
+
+std::string JoinPath(const std::string &directory, const std::string &name)
+{
+    if (name == ".")
+        return directory;
+    return directory == "/" ? "/" + name : directory + "/" + name;
+}
+
+/**
+ * @brief Answer a notification with a descriptor installed in the program
+ */
+Verdict InjectFd(int notifyFd, uint64_t id, int fd, bool closeOnExec)
+{
+    seccomp_notif_addfd addfd{};
+    addfd.id          = id;
+    addfd.flags       = SECCOMP_ADDFD_FLAG_SEND;
+    addfd.srcfd       = static_cast<uint32_t>(fd);
+    addfd.newfd_flags = closeOnExec ? O_CLOEXEC : 0;
+    if (ioctl(notifyFd, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd) >= 0)
+        return Verdict{.Answered = true};
+    if (errno != EINVAL)
+        return Verdict{.Error = errno, .Answered = errno == ENOENT};
+
+    // Before Linux 5.14 the descriptor is installed first and its number answered separately.
+    addfd.flags        = 0;
+    const int remoteFd = ioctl(notifyFd, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd);
+    if (remoteFd < 0)
+        return Fail(errno);
+    return Verdict{.Value = remoteFd, .Emulated = true};
+}
+
+/**
+ * @brief open and openat under OpenPathRules, run by the supervisor on behalf of the program
+ * @remarks Letting the call continue after checking the path would race with the program rewriting it,
+ * so the supervisor opens the file itself and installs the descriptor. The rules are checked on the path
+ * as written (under the real path of its directory) and again on where the opened file really is, which
+ * catches symlinks leading out of an allowed prefix.
+ */
+Verdict OpenOnBehalf(const SeccompSupervisorJob &job)
+{
+    const auto &request    = job.Request;
+    const bool isOpenat    = request.data.nr == SCMP_SYS(openat);
+    const int dirFd        = isOpenat ? static_cast<int>(request.data.args[0]) : AT_FDCWD;
+    const uint64_t address = request.data.args[isOpenat ? 1 : 0];
+    const int flags        = static_cast<int>(request.data.args[isOpenat ? 2 : 1]);
+    const auto mode        = static_cast<mode_t>(request.data.args[isOpenat ? 3 : 2]);
+    const auto pid         = static_cast<pid_t>(request.pid);
+
+    std::string path;
+    if (!ReadRemoteString(pid, address, path))
+        return Fail(EFAULT);
+    // The pid could have been reused by now, in which case the path came from another process.
+    if (seccomp_notify_id_valid(job.NotifyFd.get(), request.id) != 0)
+        return Verdict{.Answered = true};
+    if (path.empty())
+        return Fail(ENOENT);
+
+    const auto base = OpenBaseDirectory(pid, dirFd, path);
+    if (!base)
+        return Fail(EBADF);
+    const auto [parent, name] = SplitLastComponent(path);
+    const SandboxInternal::UniqueFd parentFd(OpenFromBase(base->get(), parent, O_PATH | O_DIRECTORY | O_CLOEXEC, 0));
+    if (!parentFd.valid())
+        return Fail(errno);
+    const auto parentPath = ReadFdPath(parentFd.get());
+    if (!parentPath)
+        return Fail(ENOENT);
+
+    const auto &rules = job.Paths->OpenPathRules;
+    const bool writes = IsWriteOpen(flags);
+    const auto target = JoinPath(*parentPath, name);
+    if (!IsOpenAllowed(rules, target, writes))
+    {
+        Logger::Info("Supervisor denied opening {0} (pid @{1})", target, pid);
+        return Deny(EACCES);
+    }
+
+    // A created file must be the one named, not what a symlink planted there points to.
+    int openFlags = flags | O_CLOEXEC;
+    if ((flags & O_CREAT) != 0)
+        openFlags |= O_NOFOLLOW;
+    // The trailing slash SplitLastComponent dropped still means the path must be a directory.
+    if (path.size() > 1 && path.back() == '/')
+        openFlags |= O_DIRECTORY;
+    mode_t umask = 022;
+    if ((flags & (O_CREAT | O_TMPFILE)) != 0)
+    {
+        if (const auto field = ReadStatusField(pid, "Umask"))
+            umask = static_cast<mode_t>(std::strtoul(field->c_str(), nullptr, 8));
+    }
+
+    // A worker must not wait for the writer of a FIFO, which may never come. The program gets the flags it
+    // asked for; only a FIFO opened for writing fails with ENXIO instead of waiting for a reader.
+    // An absolute path is looked up again from the root, a symlink it ends in may point to an absolute path.
+    SandboxInternal::UniqueFd fd(
+        path.front() == '/' ? OpenFromBase(base->get(), JoinPath(parent, name), openFlags | O_NONBLOCK, mode & ~umask)
+                            : openat(parentFd.get(), name.c_str(), openFlags | O_NONBLOCK, mode & ~umask));
+    if (!fd.valid())
+        return Fail(errno);
+    if ((flags & O_NONBLOCK) == 0 && fcntl(fd.get(), F_SETFL, fcntl(fd.get(), F_GETFL) & ~O_NONBLOCK) != 0)
+        return Fail(errno);
+
+    const auto opened = ReadFdPath(fd.get());
+    if ((flags & O_TMPFILE) != O_TMPFILE && (!opened || !IsOpenAllowed(rules, *opened, writes)))
+    {
+        Logger::Info("Supervisor denied opening {0}, which resolves to {1} (pid @{2})", target,
+                     opened.value_or("?"), pid);
+        return Deny(EACCES);
+    }
+
+    return Verdict{.Fd = std::move(fd), .CloseOnExec = (flags & O_CLOEXEC) != 0};
+}
+
+/**
+ * @brief execve under ExecvePaths: only the program and the listed files, identified by device and inode
+ * @remarks The kernel reads the path again after the check. Only a task sharing the caller's memory can
+ * rewrite it in between: vfork and clone sharing memory without a thread are denied, and a process with
+ * more than one thread may not execve at all.
+ */
+Verdict CheckExecve(const SeccompSupervisorJob &job)
+{
+    const auto &request = job.Request;
+    const auto pid      = static_cast<pid_t>(request.pid);
+    std::string path;
+    if (!ReadRemoteString(pid, request.data.args[0], path))
+        return Fail(EFAULT);
+    if (seccomp_notify_id_valid(job.NotifyFd.get(), request.id) != 0)
+        return Verdict{.Answered = true};
+    if (path.empty())
+        return Fail(ENOENT);
+
+    if (const auto threads = ReadStatusField(pid, "Threads"); !threads || *threads != "1")
+    {
+        Logger::Info("Supervisor denied execve of {0} by a multi-threaded process (pid @{1})", path, pid);
+        return Deny(EACCES);
+    }
+
+    const auto base = OpenBaseDirectory(pid, AT_FDCWD, path);
+    if (!base)
+        return Fail(ENOENT);
+    const SandboxInternal::UniqueFd file(OpenFromBase(base->get(), path, O_PATH | O_CLOEXEC, 0));
+    struct stat info{};
+    if (!file.valid() || fstat(file.get(), &info) != 0)
+        return Fail(errno);
+
+    const auto identity = std::make_pair(info.st_dev, info.st_ino);
+    const auto &executables = job.Paths->Executables;
+    if (std::ranges::find(executables, identity) == executables.end())
+    {
+        Logger::Info("Supervisor denied execve of {0} (pid @{1})", path, pid);
+        return Deny(EACCES);
+    }
+    return {};
+}
+
+/**
+ * @brief Whether a task is still in the fork, vfork or clone the gate let continue
+ * @remarks Its new process may not be among its children yet until the syscall returns. A task that
+ * cannot be inspected counts as still creating one, which errs on the side of the limit.
+ */
+bool IsCreatingProcess(pid_t tid)
+{
+    const std::string path = "/proc/" + std::to_string(tid) + "/syscall";
+    const SandboxInternal::UniqueFd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid())
+        return errno != ENOENT && errno != ESRCH;
+    char buffer[32];
+    const ssize_t length = read(fd.get(), buffer, sizeof(buffer));
+    if (length <= 0)
+        return true;
+
+    // "<nr> <args...>" while blocked in a syscall, "running" or "-1 ..." otherwise
+    int syscall = -1;
+    std::from_chars(buffer, buffer + length, syscall);
+    return syscall == SCMP_SYS(fork) || syscall == SCMP_SYS(vfork) || syscall == SCMP_SYS(clone)
+           || syscall == SCMP_SYS(clone3);
+}
+
+/**
+ * @brief The process gate of MaxProcessCount
+ * @remarks A process creation continues while the program has fewer than MaxProcessCount live
+ * descendants; otherwise it fails with EAGAIN and the program is killed with
+ * SANDBOX_TERMINATION_PROCESS_LIMIT. The program is a child subreaper, so orphans are still counted, and
+ * so are creations let through whose process is not visible yet. Unlike RLIMIT_NPROC this counts the
+ * processes of this run only, not every process of the user.
+ */
+Verdict GateProcessCreation(SeccompSupervisorSession &session, const seccomp_notif &request)
+{
+    if (session.MaxProcessCount < 0)
+        return {};
+
+    // A task asking again is done with its last creation.
+    const auto creator = static_cast<pid_t>(request.pid);
+    std::erase_if(session.Creating, [creator](pid_t tid) { return tid == creator || !IsCreatingProcess(tid); });
+    const auto live = ListDescendants(session.Pid).size() + session.Creating.size();
+    if (live < static_cast<size_t>(session.MaxProcessCount))
+    {
+        ++session.CreatedCount;
+        session.Creating.push_back(creator);
+        return {};
+    }
+
+    Logger::Info("Program (pid @{0}) tried to run more than {1} processes at once, killing it", session.Pid,
+                 session.MaxProcessCount);
+    SandboxInternal::KillWithReason(session.Pid, session.TerminationReason, SANDBOX_TERMINATION_PROCESS_LIMIT);
+    // A process created earlier may have asked; it would outlive the program otherwise.
+    if (creator != session.Pid)
+        kill(creator, SIGKILL);
+    return Deny(EAGAIN);
+}
+
+// Under ExecvePaths no process may share memory with another, see CheckExecve.
+bool ForbidsSharedMemory(const SeccompSupervisorSession &session)
+{
+    return session.Rules != nullptr && !session.Rules->ExecvePaths.empty();
+}
+
+/**
+ * @brief clone: refuse flags outside AllowedCloneFlags, then count new processes against the gate
+ * @remarks The flags are a register argument, so unlike a path they cannot change after the check.
+ */
+Verdict CheckClone(SeccompSupervisorSession &session, const seccomp_notif &request)
+{
+    const uint64_t flags = request.data.args[0];
+    const auto &allowed  = session.Rules != nullptr ? session.Rules->AllowedCloneFlags : std::nullopt;
+    if (allowed && (flags & ~static_cast<uint64_t>(CSIGNAL) & ~*allowed) != 0)
+    {
+        Logger::Info("Supervisor denied clone with flags {0:#x} (pid @{1})", flags, request.pid);
+        return Deny(EPERM);
+    }
+    if ((flags & (CLONE_VM | CLONE_THREAD)) == CLONE_VM && ForbidsSharedMemory(session))
+    {
+        Logger::Info("Supervisor denied clone of a process sharing memory (pid @{0})", request.pid);
+        return Deny(EPERM);
+    }
+    if ((flags & CLONE_THREAD) != 0)
+        return {};
+    return GateProcessCreation(session, request);
+}
+
+Verdict Decide(SeccompSupervisorSession &session, const seccomp_notif &request)
+{
+    const int syscall = request.data.nr;
+    if (syscall == SCMP_SYS(clone))
+        return CheckClone(session, request);
+    if (syscall == SCMP_SYS(vfork) && ForbidsSharedMemory(session))
+    {
+        Logger::Info("Supervisor denied vfork (pid @{0})", request.pid);
+        return Deny(EPERM);
+    }
+    if (syscall == SCMP_SYS(fork) || syscall == SCMP_SYS(vfork))
+        return GateProcessCreation(session, request);
+    return Deny(EPERM);
+}
+
+// Checks that walk a path of the program, which Serve leaves to a worker.
+bool WalksPath(const SeccompSupervisorSession &session, const seccomp_notif &request)
+{
+    const int syscall = request.data.nr;
+    return session.Paths != nullptr
+           && (syscall == SCMP_SYS(open) || syscall == SCMP_SYS(openat) || syscall == SCMP_SYS(execve));
+}
+
+Verdict DecideJob(const SeccompSupervisorJob &job)
+{
+    if (job.Request.data.nr == SCMP_SYS(execve))
+        return CheckExecve(job);
+    return OpenOnBehalf(job);
+}
+
+/**
+ * @brief Let the syscall continue, or complete it with the verdict's error, value or descriptor
+ */
+void Answer(int notifyFd, seccomp_notif_resp &response, uint64_t id, const Verdict &verdict)
+{
+    if (verdict.Fd.valid())
+        return Answer(notifyFd, response, id, InjectFd(notifyFd, id, verdict.Fd.get(), verdict.CloseOnExec));
+    if (verdict.Answered)
+        return;
+
+    memset(&response, 0, sizeof(seccomp_notif_resp));
+    response.id = id;
+    if (verdict.Error != 0)
+        response.error = -verdict.Error;
+    else if (verdict.Emulated)
+        response.val = verdict.Value;
+    else
+        response.flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+    seccomp_notify_respond(notifyFd, &response);
+}
+
+void RecordAnswer(SeccompSupervisorSession &session, bool denied, uint64_t wokeAt)
+{
+    const uint64_t latency = SandboxInternal::MonotonicNowNs() - wokeAt;
+    ++session.NotificationCount;
+    if (denied)
+        ++session.DeniedCount;
+    session.TotalLatencyNs += latency;
+    session.MaxLatencyNs = std::max(session.MaxLatencyNs, latency);
+}
+
+bool AddExecutable(SeccompSupervisorPaths &paths, const std::string &path)
+{
+    struct stat info{};
+    if (stat(path.c_str(), &info) != 0)
+        return errno == ENOENT || errno == ENOTDIR;
+    paths.Executables.emplace_back(info.st_dev, info.st_ino);
+    return true;
+}
+
+} // namespace
+
+SeccompSupervisor &SeccompSupervisor::Instance()
+{
+    // Never destroyed: the detached thread may still be waiting when static destructors run.
+    static auto *instance = new SeccompSupervisor();
+    return *instance;
+}
+
+bool SeccompSupervisor::StartLocked()
+{
+    if (_started)
+        return true;
+
+    _epollFd.reset(epoll_create1(EPOLL_CLOEXEC));
+    if (!_epollFd.valid())
+        return false;
+    if (seccomp_notify_alloc(&_request, &_response) != 0)
+        return false;
+    try
+    {
+        std::thread(&SeccompSupervisor::Run, this).detach();
+    }
+    catch (const std::system_error &)
+    {
+        return false;
+    }
+    _started = true;
+    return true;
+}
+
+bool SeccompSupervisor::Attach(SeccompSupervisorSession *session, int notifyFd)
+{
+    session->NotifyFd.reset(notifyFd);
+    session->NotificationCount = 0;
+    session->DeniedCount       = 0;
+    session->TotalLatencyNs    = 0;
+    session->MaxLatencyNs      = 0;
+    session->CreatedCount      = 0;
+    session->Creating.clear();
+
+    session->Paths.reset();
+    if (session->Rules != nullptr)
+    {
+        auto paths           = std::make_shared<SeccompSupervisorPaths>();
+        paths->OpenPathRules = session->Rules->OpenPathRules;
+        if (!session->Rules->ExecvePaths.empty())
+        {
+            if (!AddExecutable(*paths, session->ProgramPath))
+                return false;
+            for (const auto &path : session->Rules->ExecvePaths)
+            {
+                if (!AddExecutable(*paths, path))
+                    return false;
+            }
+        }
+        session->Paths = std::move(paths);
+    }
+
+    std::lock_guard lock(_mutex);
+    if (!StartLocked())
+        return false;
+
+    session->Id = _nextId++;
+    epoll_event event{.events = EPOLLIN, .data = {.u64 = session->Id}};
+    if (epoll_ctl(_epollFd.get(), EPOLL_CTL_ADD, session->NotifyFd.get(), &event) != 0)
+        return false;
+    _sessions.emplace(session->Id, session);
+    return true;
+}
+
+void SeccompSupervisor::Detach(SeccompSupervisorSession *session)
+{
+    std::lock_guard lock(_mutex);
+    if (_sessions.erase(session->Id) != 0)
+        epoll_ctl(_epollFd.get(), EPOLL_CTL_DEL, session->NotifyFd.get(), nullptr);
+    session->NotifyFd.reset();
+}
+
+void SeccompSupervisor::Run()
+{
+    epoll_event events[MAX_EVENTS];
+    while (true)
+    {
+        const int count = epoll_wait(_epollFd.get(), events, MAX_EVENTS, -1);
+        if (count < 0)
+        {
+            if (errno != EINTR)
+                Logger::Error("Seccomp supervisor failed to wait for notifications: {0}", strerror(errno));
+            continue;
+        }
+
+        const uint64_t wokeAt = SandboxInternal::MonotonicNowNs();
+        std::lock_guard lock(_mutex);
+        for (int i = 0; i < count; ++i)
+        {
+            // Sessions are looked up by id, so an event of a session detached meanwhile finds nothing.
+            const auto found = _sessions.find(events[i].data.u64);
+            if (found == _sessions.end())
+                continue;
+            auto *session = found->second;
+            if ((events[i].events & EPOLLIN) != 0)
+                Serve(session, wokeAt);
+            else // EPOLLHUP: every task using the filter has exited
+                epoll_ctl(_epollFd.get(), EPOLL_CTL_DEL, session->NotifyFd.get(), nullptr);
+        }
+    }
+}
+
+void SeccompSupervisor::Serve(SeccompSupervisorSession *session, uint64_t wokeAt)
+{
+    // EPOLLIN means a notification is pending, so this does not block; it fails if the task died since.
+    memset(_request, 0, sizeof(seccomp_notif));
+    if (seccomp_notify_receive(session->NotifyFd.get(), _request) != 0)
+        return;
+
+    if (WalksPath(*session, *_request))
+    {
+        SeccompSupervisorJob job{
+            .SessionId = session->Id,
+            .NotifyFd  = SandboxInternal::UniqueFd(fcntl(session->NotifyFd.get(), F_DUPFD_CLOEXEC, 0)),
+            .Paths     = session->Paths,
+            .Request   = *_request,
+            .WokeAt    = wokeAt,
+        };
+        if (job.NotifyFd.valid() && Enqueue(std::move(job)))
+            return;
+        Answer(session->NotifyFd.get(), *_response, _request->id, Fail(EAGAIN));
+        RecordAnswer(*session, false, wokeAt);
+        return;
+    }
+
+    const auto verdict = Decide(*session, *_request);
+    Answer(session->NotifyFd.get(), *_response, _request->id, verdict);
+    RecordAnswer(*session, verdict.Denied, wokeAt);
+}
+
+bool SeccompSupervisor::Enqueue(SeccompSupervisorJob job)
+{
+    std::lock_guard lock(_jobMutex);
+    _jobs.push_back(std::move(job));
+    if (_jobs.size() <= _idleWorkers)
+    {
+        _jobReady.notify_one();
+        return true;
+    }
+
+    try
+    {
+        std::thread(&SeccompSupervisor::Work, this).detach();
+        ++_workers;
+        return true;
+    }
+    catch (const std::system_error &)
+    {
+        // A busy worker gets to the job eventually, unless the job it is busy with never ends.
+        if (_workers != 0)
+            return true;
+        _jobs.pop_back();
+        return false;
+    }
+}
+
+void SeccompSupervisor::Work()
+{
+    seccomp_notif_resp response{};
+    std::unique_lock lock(_jobMutex);
+    ++_idleWorkers;
+    while (_jobReady.wait_for(lock, WORKER_IDLE_TIMEOUT, [this] { return !_jobs.empty(); }))
+    {
+        auto job = std::move(_jobs.front());
+        _jobs.pop_front();
+        --_idleWorkers;
+        lock.unlock();
+
+        const auto verdict = DecideJob(job);
+        // Before answering: once the syscall returns, the run may end and read the statistics.
+        Record(job.SessionId, verdict.Denied, job.WokeAt);
+        Answer(job.NotifyFd.get(), response, job.Request.id, verdict);
+
+        job = {};
+        lock.lock();
+        ++_idleWorkers;
+    }
+    --_idleWorkers;
+    --_workers;
+}
+
+void SeccompSupervisor::Record(uint64_t sessionId, bool denied, uint64_t wokeAt)
+{
+    std::lock_guard lock(_mutex);
+    if (const auto found = _sessions.find(sessionId); found != _sessions.end())
+        RecordAnswer(*found->second, denied, wokeAt);
+}
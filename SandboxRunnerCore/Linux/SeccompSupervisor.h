@@ -0,0 +1,119 @@
+#ifndef SANDBOX_SECCOMP_SUPERVISOR_H
+#define SANDBOX_SECCOMP_SUPERVISOR_H
+
+#include "../InternalHelpers.h"
+#include "../Policy/SandboxPolicy.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <seccomp.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @brief What paths are checked against, copied from the session's rules by Attach
+ * @remarks Shared with the supervisor's workers, whose checks may still run after the session was detached.
+ */
+struct SeccompSupervisorPaths
+{
+    std::vector<SandboxPolicyEngine::PathAccessRule> OpenPathRules;
+    std::vector<std::pair<dev_t, ino_t>> Executables; // Files the execve check lets run
+};
+
+/**
+ * @brief Supervision state of one sandboxed program
+ * @remarks The settings are filled by the caller. The rest is owned by the supervisor thread while the
+ * session is attached, and may be read by the caller after Detach.
+ */
+struct SeccompSupervisorSession
+{
+    pid_t Pid           = -1;
+    int MaxProcessCount = -1; // Live processes the program may have besides itself, -1 if the process gate is off
+    const SandboxPolicyEngine::SupervisorRules *Rules = nullptr; // Outlives the session, nullptr for the gate only
+    std::string ProgramPath;                                     // Always passes the execve check
+    std::atomic<uint32_t> *TerminationReason = nullptr;
+
+    uint64_t NotificationCount = 0; // Notifications answered
+    uint64_t DeniedCount       = 0; // Of them, the syscalls the rules or the process gate refused
+    uint64_t TotalLatencyNs    = 0; // From the supervisor waking up for a notification to answering it
+    uint64_t MaxLatencyNs      = 0;
+
+    int CreatedCount = 0;                                // Processes the gate let the program create
+    std::vector<pid_t> Creating;                         // Tasks the gate let fork that may not be done yet
+    std::shared_ptr<const SeccompSupervisorPaths> Paths; // nullptr without Rules
+    SandboxInternal::UniqueFd NotifyFd;
+    uint64_t Id = 0;
+};
+
+/**
+ * @brief A notification whose check walks a path, waiting for or running on a worker
+ */
+struct SeccompSupervisorJob
+{
+    uint64_t SessionId = 0;
+    SandboxInternal::UniqueFd NotifyFd; // A duplicate, the session may be detached before the job is done
+    std::shared_ptr<const SeccompSupervisorPaths> Paths;
+    seccomp_notif Request{};
+    uint64_t WokeAt = 0;
+};
+
+/**
+ * @brief A single process-wide thread that answers the seccomp user notifications of every attached sandbox
+ * @remarks Listeners are multiplexed with epoll, so no thread is started per run and a notification costs
+ * one wake-up of this thread. Only the syscalls the BPF filter cannot decide alone get here: process
+ * creation under the process gate (MaxProcessCount) and the policy's SupervisorRules. Checks that walk a
+ * path of the program, open and execve, may block on a hung NFS or FUSE mount; they run on worker threads,
+ * started when none is idle, so they hold up only the task that asked.
+ */
+class SeccompSupervisor
+{
+public:
+    static SeccompSupervisor &Instance();
+
+    /**
+     * @brief Start answering the notifications of a listener, takes ownership of notifyFd
+     * @return false if the listener cannot be watched; the session is not attached then
+     */
+    bool Attach(SeccompSupervisorSession *session, int notifyFd);
+
+    /**
+     * @brief Stop answering the notifications of the session
+     * @remarks Once this returns, the supervisor no longer touches the session. Tasks still waiting for an
+     * answer fail their syscall with ENOSYS, unless a worker is already checking it.
+     */
+    void Detach(SeccompSupervisorSession *session);
+
+private:
+    SeccompSupervisor() = default;
+
+    bool StartLocked();
+    void Run();
+    void Serve(SeccompSupervisorSession *session, uint64_t wokeAt);
+    bool Enqueue(SeccompSupervisorJob job);
+    void Work();
+    void Record(uint64_t sessionId, bool denied, uint64_t wokeAt);
+
+    std::mutex _mutex;
+    SandboxInternal::UniqueFd _epollFd;
+    std::unordered_map<uint64_t, SeccompSupervisorSession *> _sessions;
+    uint64_t _nextId = 1;
+    seccomp_notif *_request       = nullptr;
+    seccomp_notif_resp *_response = nullptr;
+    bool _started = false;
+
+    // May be taken while holding _mutex, never the other way round.
+    std::mutex _jobMutex;
+    std::condition_variable _jobReady;
+    std::deque<SeccompSupervisorJob> _jobs;
+    size_t _idleWorkers = 0;
+    size_t _workers     = 0;
+};
+
+#endif //! SANDBOX_SECCOMP_SUPERVISOR_H
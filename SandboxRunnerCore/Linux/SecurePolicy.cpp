@@ -1,11 +1,16 @@
 #include "SecurePolicy.h"
+#include "SeccompNotify.h"
+#include "PathAccessRuleset.h"
 
 #include "../Logger.h"
 #include "../InternalHelpers.h"
 #include "../Policy/PolicyRegistry.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdint>
 #include <fcntl.h>
+#include <sched.h>
 #include <seccomp.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -13,10 +18,39 @@
 namespace
 {
 
-bool AllowPolicySyscalls(scmp_filter_ctx ctx, const SandboxPolicyEngine::SandboxPolicy &policy)
+bool IsProcessCreationSyscall(int syscall)
+{
+    return syscall == SCMP_SYS(fork) || syscall == SCMP_SYS(vfork) || syscall == SCMP_SYS(clone)
+           || syscall == SCMP_SYS(clone3);
+}
+
+// Syscalls the supervisor decides from their arguments, see SupervisorRules.
+bool IsSupervisedSyscall(const SandboxPolicyEngine::SandboxPolicy &policy, int syscall)
+{
+    const auto &rules = policy.Supervisor;
+    if (!rules.OpenPathRules.empty() && (syscall == SCMP_SYS(open) || syscall == SCMP_SYS(openat)))
+    {
+        return true;
+    }
+    // A process sharing the memory of one calling execve could rewrite the path after the check.
+    if (!rules.ExecvePaths.empty() && (syscall == SCMP_SYS(execve) || syscall == SCMP_SYS(vfork)))
+    {
+        return true;
+    }
+    return (rules.AllowedCloneFlags.has_value() || !rules.ExecvePaths.empty())
+           && (syscall == SCMP_SYS(clone) || syscall == SCMP_SYS(clone3));
+}
+
+bool AllowPolicySyscalls(scmp_filter_ctx ctx, const SandboxPolicyEngine::SandboxPolicy &policy, bool processGate)
 {
     for (const auto syscall : policy.AllowedSyscalls)
     {
+        // The gate and supervisor rules decide these instead.
+        if ((processGate && IsProcessCreationSyscall(syscall)) || IsSupervisedSyscall(policy, syscall))
+        {
+            continue;
+        }
+
         if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, syscall, 0) != 0)
         {
             return false;
@@ -26,8 +60,110 @@ bool AllowPolicySyscalls(scmp_filter_ctx ctx, const SandboxPolicyEngine::Sandbox
     return true;
 }
 
-bool AllowExecveRule(scmp_filter_ctx ctx, const char *programPath, const SandboxPolicyEngine::SandboxPolicy &policy)
+/**
+ * @brief Report every new process to the parent, see SeccompSupervisor
+ * @param policy nullptr for the default policy, where everything else is allowed
+ * @remarks Threads are not processes and pass without a notification. clone3 hides its flags behind a
+ * pointer, so it fails with ENOSYS and libc falls back to clone. A syscall the policy does not allow
+ * stays forbidden, unless the limit is 0: then any new process is over the limit and reported as such.
+ * When the supervisor checks clone flags or execve, every clone is notified already and the gate counts there.
+ */
+bool AddProcessGateRules(scmp_filter_ctx ctx, const SandboxPolicyEngine::SandboxPolicy *policy, int maxProcessCount)
+{
+    const auto allowedByPolicy = [policy](int syscall) {
+        return policy == nullptr
+               || std::find(policy->AllowedSyscalls.begin(), policy->AllowedSyscalls.end(), syscall)
+                      != policy->AllowedSyscalls.end();
+    };
+    const auto gated = [&](int syscall) { return allowedByPolicy(syscall) || maxProcessCount == 0; };
+
+    // The supervisor rules may notify these already, see AddSupervisorRules.
+    const auto supervised = [policy](int syscall) {
+        return policy != nullptr && IsSupervisedSyscall(*policy, syscall);
+    };
+
+    for (const int syscall : {SCMP_SYS(fork), SCMP_SYS(vfork)})
+    {
+        if (gated(syscall) && !supervised(syscall) && seccomp_rule_add(ctx, SCMP_ACT_NOTIFY, syscall, 0) != 0)
+        {
+            return false;
+        }
+    }
+
+    if (supervised(SCMP_SYS(clone)))
+    {
+        return true;
+    }
+
+    const scmp_datum_t cloneThread = CLONE_THREAD;
+    if (gated(SCMP_SYS(clone))
+        && seccomp_rule_add(ctx, SCMP_ACT_NOTIFY, SCMP_SYS(clone), 1, SCMP_A0(SCMP_CMP_MASKED_EQ, cloneThread, 0)) != 0)
+    {
+        return false;
+    }
+    if (allowedByPolicy(SCMP_SYS(clone3)) && seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOSYS), SCMP_SYS(clone3), 0) != 0)
+    {
+        return false;
+    }
+
+    // Under the default policy both are allowed anyway, and libseccomp rejects rules that repeat the default action.
+    if (policy == nullptr)
+    {
+        return true;
+    }
+
+    return !allowedByPolicy(SCMP_SYS(clone))
+           || seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(clone), 1,
+                               SCMP_A0(SCMP_CMP_MASKED_EQ, cloneThread, cloneThread))
+                  == 0;
+}
+
+/**
+ * @brief Turn the supervised syscalls into notifications, see SeccompSupervisor
+ * @remarks clone3 hides its flags behind a pointer, so with clone supervised it fails with ENOSYS and libc
+ * falls back to clone. ExecvePaths supervises clone and vfork too, which may share the memory of the caller.
+ */
+bool AddSupervisorRules(scmp_filter_ctx ctx, const SandboxPolicyEngine::SandboxPolicy &policy)
 {
+    for (const int syscall :
+         {SCMP_SYS(open), SCMP_SYS(openat), SCMP_SYS(execve), SCMP_SYS(vfork), SCMP_SYS(clone)})
+    {
+        if (IsSupervisedSyscall(policy, syscall) && seccomp_rule_add(ctx, SCMP_ACT_NOTIFY, syscall, 0) != 0)
+        {
+            return false;
+        }
+    }
+
+    return !IsSupervisedSyscall(policy, SCMP_SYS(clone3))
+           || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOSYS), SCMP_SYS(clone3), 0) == 0;
+}
+
+/**
+ * @param programFd The cached copy of the program the child will fexecve(), -1 if it uses execve()
+ * @remarks fexecve() is execveat(fd, "", ..., AT_EMPTY_PATH). The rule outlives the descriptor, which is
+ * closed on exec, so it only keeps RestrictExecveToProgramPath because the child moved the descriptor to the
+ * hard RLIMIT_NOFILE: no descriptor the program opens can get that number again.
+ */
+bool AllowExecveRule(scmp_filter_ctx ctx,
+                     const char *programPath,
+                     const SandboxPolicyEngine::SandboxPolicy &policy,
+                     int programFd)
+{
+    if (programFd >= 0
+        && seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(execveat), 2,
+                            SCMP_A0(SCMP_CMP_EQ, static_cast<scmp_datum_t>(programFd)),
+                            SCMP_A4(SCMP_CMP_EQ, static_cast<scmp_datum_t>(AT_EMPTY_PATH)))
+               != 0)
+    {
+        return false;
+    }
+
+    // The supervisor compares the file itself.
+    if (!policy.Supervisor.ExecvePaths.empty())
+    {
+        return true;
+    }
+
     if (policy.RestrictExecveToProgramPath)
     {
         // Keep legacy behavior for stage-1: preserve old seccomp rule shape.
@@ -49,10 +185,13 @@ bool AllowExecveRule(scmp_filter_ctx ctx, const char *programPath, const Sandbox
 
 bool AllowIoRules(scmp_filter_ctx ctx, const SandboxPolicyEngine::SandboxPolicy &policy)
 {
+    // The supervisor checks the paths instead, whatever the access mode.
+    const bool openSupervised = !policy.Supervisor.OpenPathRules.empty();
     if (policy.AllowIO)
     {
-        if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(open), 0) != 0
-            || seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(openat), 0) != 0
+        if ((!openSupervised
+             && (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(open), 0) != 0
+                 || seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(openat), 0) != 0))
             || seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(dup), 0) != 0
             || seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(dup2), 0) != 0
             || seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(dup3), 0) != 0)
@@ -60,7 +199,7 @@ bool AllowIoRules(scmp_filter_ctx ctx, const SandboxPolicyEngine::SandboxPolicy
             return false;
         }
     }
-    else
+    else if (!openSupervised)
     {
         if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(open), 1,
                              SCMP_CMP(1, SCMP_CMP_MASKED_EQ, O_WRONLY | O_RDWR, 0)))
@@ -77,25 +216,92 @@ bool AllowIoRules(scmp_filter_ctx ctx, const SandboxPolicyEngine::SandboxPolicy
     return true;
 }
 
-bool ApplyPolicy(const char *programPath, const SandboxPolicyEngine::SandboxPolicy &policy)
+// Must run after all rules are added: priorities only reorder syscalls that already have rules.
+bool ApplyFilterLayout(scmp_filter_ctx ctx, const SandboxPolicyEngine::SandboxPolicy &policy)
 {
-    SandboxInternal::SeccompContext ctx(SCMP_ACT_KILL);
+    using SandboxPolicyEngine::FilterLayout;
+
+    switch (policy.Layout)
+    {
+    case FilterLayout::Linear:
+        return true;
+
+    case FilterLayout::BinaryTree:
+        // libseccomp < 2.5 or API level < 4 cannot build the tree; a linear filter is still correct.
+        if (seccomp_attr_set(ctx, SCMP_FLTATR_CTL_OPTIMIZE, 2) != 0)
+        {
+            Logger::Warning("Binary tree seccomp filter is not supported, using the linear layout");
+        }
+        return true;
+
+    case FilterLayout::Frequency: {
+        // Higher priority is checked earlier, so the first hint gets the highest one.
+        uint8_t priority = UINT8_MAX;
+        for (const auto syscall : policy.FrequencyHints)
+        {
+            if (seccomp_syscall_priority(ctx, syscall, priority) != 0)
+            {
+                return false;
+            }
+            if (priority > 1)
+            {
+                --priority;
+            }
+        }
+        return true;
+    }
+    }
+
+    return false;
+}
+
+bool AddPolicyRules(scmp_filter_ctx ctx,
+                    const char *programPath,
+                    const SandboxPolicyEngine::SandboxPolicy &policy,
+                    bool processGate = false,
+                    int programFd    = -1)
+{
+    return AllowPolicySyscalls(ctx, policy, processGate) && AllowExecveRule(ctx, programPath, policy, programFd)
+           && AllowIoRules(ctx, policy) && AddSupervisorRules(ctx, policy) && ApplyFilterLayout(ctx, policy);
+}
+
+/**
+ * @param policy nullptr for the default policy, which only installs a filter for the process gate
+ * @param supervisorSocket Socket to hand the listener fd to the parent's SeccompSupervisor, -1 if nothing is
+ * supervised. The process gate is on with a supervisor and a maxProcessCount of 0 or more.
+ * @param programFd The cached copy of the program, -1 if none
+ */
+bool ApplyPolicy(const char *programPath,
+                 const SandboxPolicyEngine::SandboxPolicy *policy,
+                 int maxProcessCount,
+                 int supervisorSocket,
+                 int programFd)
+{
+    const bool supervised  = supervisorSocket >= 0;
+    const bool processGate = supervised && maxProcessCount >= 0;
+    SandboxInternal::SeccompContext ctx(policy != nullptr ? SCMP_ACT_KILL : SCMP_ACT_ALLOW);
     if (!ctx.valid())
     {
         return false;
     }
 
-    if (!AllowPolicySyscalls(ctx.get(), policy))
+    if (policy != nullptr && !AddPolicyRules(ctx.get(), programPath, *policy, processGate, programFd))
     {
         return false;
     }
 
-    if (!AllowExecveRule(ctx.get(), programPath, policy))
+    if (processGate && !AddProcessGateRules(ctx.get(), policy, maxProcessCount))
     {
         return false;
     }
 
-    if (!AllowIoRules(ctx.get(), policy))
+    // The listener fd cannot be handed over through a notification nobody listens to yet. The socket's number
+    // is at or above RLIMIT_NOFILE, so the program cannot reuse it after exec. The default policy allows
+    // sendmsg anyway, and libseccomp rejects rules that repeat the default action.
+    if (supervised && policy != nullptr
+        && seccomp_rule_add(ctx.get(), SCMP_ACT_ALLOW, SCMP_SYS(sendmsg), 1,
+                            SCMP_A0(SCMP_CMP_EQ, static_cast<scmp_datum_t>(supervisorSocket)))
+               != 0)
     {
         return false;
     }
@@ -106,17 +312,29 @@ bool ApplyPolicy(const char *programPath, const SandboxPolicyEngine::SandboxPoli
         return false;
     }
 
+    if (supervised)
+    {
+        const int notifyFd = seccomp_notify_fd(ctx.get());
+        return notifyFd >= 0 && SendSeccompNotifyFd(supervisorSocket, notifyFd);
+    }
+
     // SeccompContext destructor will automatically release the context
     return true;
 }
 
 } // namespace
 
-bool ApplyLinuxSecurePolicy(const char *programPath, const SandboxConfiguration *config)
+bool ApplyLinuxSecurePolicy(const char *programPath,
+                            const SandboxConfiguration *config,
+                            int supervisorSocket,
+                            int programFd,
+                            int pathRulesetFd,
+                            bool *pathRulesFailed)
 {
     if (SandboxPolicyEngine::IsDefaultPolicyName(config->Policy))
     {
-        return true;
+        return supervisorSocket < 0
+               || ApplyPolicy(programPath, nullptr, config->MaxProcessCount, supervisorSocket, programFd);
     }
 
     SandboxPolicyEngine::SandboxPolicy resolvedPolicy;
@@ -126,5 +344,47 @@ bool ApplyLinuxSecurePolicy(const char *programPath, const SandboxConfiguration
         return false;
     }
 
-    return ApplyPolicy(programPath, *policy);
+    // Only now, the policy file itself may lie outside the paths the program is allowed to open.
+    if (pathRulesetFd >= 0 && !RestrictToPathAccessRuleset(pathRulesetFd))
+    {
+        if (pathRulesFailed != nullptr)
+        {
+            *pathRulesFailed = true;
+        }
+        return false;
+    }
+
+    return ApplyPolicy(programPath, policy, config->MaxProcessCount, supervisorSocket, programFd);
+}
+
+bool ExportLinuxSecurePolicy(const char *programPath, const SandboxPolicyEngine::SandboxPolicy &policy, int fd)
+{
+    SandboxInternal::SeccompContext ctx(SCMP_ACT_KILL);
+    return ctx.valid() && AddPolicyRules(ctx.get(), programPath, policy) && seccomp_export_bpf(ctx.get(), fd) == 0;
+}
+
+bool ApplyLinuxProfilingPolicy(int notifySocket)
+{
+    SandboxInternal::SeccompContext ctx(SCMP_ACT_NOTIFY);
+    if (!ctx.valid())
+    {
+        return false;
+    }
+
+    // The listener fd cannot be handed over through a notification nobody listens to yet. As in ApplyPolicy,
+    // the socket's number is out of the program's reach.
+    if (seccomp_rule_add(ctx.get(), SCMP_ACT_ALLOW, SCMP_SYS(sendmsg), 1,
+                         SCMP_A0(SCMP_CMP_EQ, static_cast<scmp_datum_t>(notifySocket))) != 0)
+    {
+        return false;
+    }
+
+    Logger::Info("Loading seccomp profiling filter");
+    if (seccomp_load(ctx.get()) != 0)
+    {
+        return false;
+    }
+
+    const int notifyFd = seccomp_notify_fd(ctx.get());
+    return notifyFd >= 0 && SendSeccompNotifyFd(notifySocket, notifyFd);
 }
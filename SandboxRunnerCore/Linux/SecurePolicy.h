@@ -1,7 +1,35 @@
 #ifndef SANDBOX_SECURE_POLICY_H
 #define SANDBOX_SECURE_POLICY_H
 #include "../Sandbox.h"
+#include "../Policy/SandboxPolicy.h"
 
-bool ApplyLinuxSecurePolicy(const char *programPath, const SandboxConfiguration *config);
+/**
+ * @brief Install the configured policy
+ * @param supervisorSocket Socket to hand the listener fd to the parent's SeccompSupervisor, -1 if nothing is
+ * supervised. It serves the policy's SupervisorRules and, with a MaxProcessCount of 0 or more, the process
+ * gate: then every new process of the program waits for the supervisor, even under the default policy.
+ * Its number must be out of the program's reach once it is closed on exec, as the filter allows sendmsg on it.
+ * @param programFd The cached copy of the program the child will fexecve(), -1 if it uses execve(programPath)
+ * @param pathRulesetFd The Landlock ruleset of the policy's PathAccessRules, -1 if it has none
+ * @param pathRulesFailed Set to true when the failure was enforcing the ruleset, may be nullptr
+ */
+bool ApplyLinuxSecurePolicy(const char *programPath,
+                            const SandboxConfiguration *config,
+                            int supervisorSocket  = -1,
+                            int programFd         = -1,
+                            int pathRulesetFd     = -1,
+                            bool *pathRulesFailed = nullptr);
+
+/**
+ * @brief Compile a policy to raw BPF without loading it, to inspect or measure the generated filter
+ * @param fd Where the BPF program is written
+ */
+bool ExportLinuxSecurePolicy(const char *programPath, const SandboxPolicyEngine::SandboxPolicy &policy, int fd);
+
+/**
+ * @brief Install the profiling filter: every syscall is reported to the parent instead of being checked
+ * @param notifySocket The socket used to hand the listener fd to the parent, out of the program's reach as above
+ */
+bool ApplyLinuxProfilingPolicy(int notifySocket);
 
 #endif // SANDBOX_SECURE_POLICY_H
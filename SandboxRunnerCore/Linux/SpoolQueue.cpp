@@ -0,0 +1,194 @@
+#include "SpoolQueue.h"
+
+#include "../Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+timespec ToTimespec(std::chrono::system_clock::time_point time)
+{
+    const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    return {.tv_sec  = static_cast<time_t>(nanoseconds / 1000000000),
+            .tv_nsec = static_cast<long>(nanoseconds % 1000000000)};
+}
+
+bool IsBefore(const timespec &a, const timespec &b)
+{
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+// Unique among the runners sharing a spool, which may run on several machines and hold several queues.
+std::string MakeOwner()
+{
+    static std::atomic<uint64_t> instances = 0;
+    char host[HOST_NAME_MAX + 1] = {};
+    if (gethostname(host, sizeof(host) - 1) != 0)
+        host[0] = '\0';
+    std::string owner = host;
+    std::replace_if(owner.begin(), owner.end(), [](char c) { return c == '@' || c == '/'; }, '_');
+    return owner + "-" + std::to_string(getpid()) + "-" + std::to_string(instances++);
+}
+
+std::optional<std::string> ReadFile(const std::filesystem::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return std::nullopt;
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+} // namespace
+
+SpoolQueue::SpoolQueue(std::filesystem::path directory, std::chrono::milliseconds lease)
+    : _directory(std::move(directory)), _lease(lease), _owner(MakeOwner())
+{
+    std::error_code error;
+    for (const char *state : {"pending", "running", "done"})
+        std::filesystem::create_directories(_directory / state, error);
+}
+
+bool SpoolQueue::Submit(std::string_view name, std::string_view contents) const
+{
+    // Names starting with a dot are skipped by Claim, so the runners never see the file being written.
+    const auto target    = _directory / "pending" / name;
+    const auto temporary = _directory / "pending" / ("." + std::string(name) + "." + _owner + ".tmp");
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(contents.data(), static_cast<std::streamsize>(contents.size())) || !file.flush())
+            return false;
+    }
+    return rename(temporary.c_str(), target.c_str()) == 0;
+}
+
+std::optional<SpoolJob> SpoolQueue::Claim() const
+{
+    std::vector<std::string> names;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(_directory / "pending", error))
+    {
+        std::string name = entry.path().filename().string();
+        if (!name.empty() && name.front() != '.' && entry.is_regular_file(error))
+            names.push_back(std::move(name));
+    }
+    std::sort(names.begin(), names.end());
+
+    const timespec times[2] = {{.tv_sec = 0, .tv_nsec = UTIME_OMIT},
+                               ToTimespec(std::chrono::system_clock::now() + _lease)};
+    for (const auto &name : names)
+    {
+        const auto pending = _directory / "pending" / name;
+        SpoolJob job{.Name = name, .LeasePath = _directory / "running" / (name + "@" + _owner), .Contents = {}};
+
+        // The lease is set before the rename, so the claimed job is never seen in running/ with the stale
+        // mtime of its submission. Whoever renames first wins, the others find the file gone.
+        if (utimensat(AT_FDCWD, pending.c_str(), times, 0) != 0
+            || rename(pending.c_str(), job.LeasePath.c_str()) != 0)
+            continue;
+
+        auto contents = ReadFile(job.LeasePath);
+        if (!contents.has_value())
+            continue;
+        job.Contents = std::move(*contents);
+        return job;
+    }
+    return std::nullopt;
+}
+
+bool SpoolQueue::Renew(const SpoolJob &job) const
+{
+    const timespec times[2] = {{.tv_sec = 0, .tv_nsec = UTIME_OMIT},
+                               ToTimespec(std::chrono::system_clock::now() + _lease)};
+    return utimensat(AT_FDCWD, job.LeasePath.c_str(), times, 0) == 0;
+}
+
+bool SpoolQueue::Complete(const SpoolJob &job, std::string_view result) const
+{
+    if (!Renew(job))
+        return false;
+
+    const auto done       = _directory / "done";
+    const auto resultPath = done / (std::filesystem::path(job.Name).stem().string() + ".result.json");
+    const auto temporary  = done / ("." + resultPath.filename().string() + "." + _owner + ".tmp");
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(result.data(), static_cast<std::streamsize>(result.size())) || !file.flush())
+            return false;
+    }
+    // The result is in place before the job leaves running/, so a job in done/ always has one.
+    return rename(temporary.c_str(), resultPath.c_str()) == 0
+           && rename(job.LeasePath.c_str(), (done / job.Name).c_str()) == 0;
+}
+
+size_t SpoolQueue::ReclaimExpired() const
+{
+    const timespec now = ToTimespec(std::chrono::system_clock::now());
+    size_t reclaimed   = 0;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(_directory / "running", error))
+    {
+        const std::string lease = entry.path().filename().string();
+        const size_t owner      = lease.rfind('@');
+        struct stat info{};
+        if (owner == std::string::npos || owner == 0 || stat(entry.path().c_str(), &info) != 0
+            || !IsBefore(info.st_mtim, now))
+            continue;
+
+        // Of the runners racing to reclaim it, only one renames it.
+        const auto pending = _directory / "pending" / lease.substr(0, owner);
+        if (rename(entry.path().c_str(), pending.c_str()) == 0)
+        {
+            Logger::Warning("Reclaimed spool job {0} from an expired lease", lease);
+            ++reclaimed;
+        }
+    }
+    return reclaimed;
+}
+
+bool SpoolQueue::Process(const std::function<std::string(const std::string &)> &run) const
+{
+    const auto job = Claim();
+    if (!job.has_value())
+        return false;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false;
+    std::thread renewal([&] {
+        std::unique_lock lock(mutex);
+        while (!finished.wait_for(lock, _lease / 3, [&] { return done; }))
+        {
+            if (!Renew(*job))
+                return;
+        }
+    });
+
+    const std::string result = run(job->Contents);
+    {
+        std::lock_guard lock(mutex);
+        done = true;
+    }
+    finished.notify_all();
+    renewal.join();
+
+    if (!Complete(*job, result))
+        Logger::Warning("Lost the lease of spool job {0}, its result is dropped", job->Name);
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef SANDBOX_SPOOL_QUEUE_H
+#define SANDBOX_SPOOL_QUEUE_H
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief A job claimed from a spool directory
+ */
+struct SpoolJob
+{
+    std::string Name;                // File name of the job in pending/
+    std::filesystem::path LeasePath; // The job in running/, tagged with its owner; its mtime is when the lease expires
+    std::string Contents;
+};
+
+/**
+ * @brief A work queue in a directory, shared by runner processes on one or more machines without a broker
+ * @remarks Jobs are files in pending/, taken in name order. A runner claims one by renaming it into
+ * running/ under a name that carries the runner's identity, so exactly one of the runners racing for
+ * it wins, and pushes the file's mtime ahead while the job runs. A finished job moves to done/, next to
+ * its result. The lease of a runner that crashed stops being renewed, and any runner moves its job back
+ * to pending/. The leases compare wall clocks, so the machines sharing a spool must keep them in sync.
+ */
+class SpoolQueue
+{
+public:
+    SpoolQueue(std::filesystem::path directory, std::chrono::milliseconds lease);
+
+    /**
+     * @brief Queue a job, written aside and renamed into pending/ so no runner sees it half-written
+     */
+    bool Submit(std::string_view name, std::string_view contents) const;
+
+    /**
+     * @brief Take the first pending job that no other runner takes first
+     */
+    std::optional<SpoolJob> Claim() const;
+
+    /**
+     * @brief Extend the lease of a claimed job by the lease duration
+     * @return false if the lease was lost, the job was reclaimed by another runner
+     */
+    bool Renew(const SpoolJob &job) const;
+
+    /**
+     * @brief Write the result to done/<stem>.result.json and move the job next to it
+     * @return false if the lease was lost, the result is then dropped
+     */
+    bool Complete(const SpoolJob &job, std::string_view result) const;
+
+    /**
+     * @brief Move the jobs whose lease expired back to pending/
+     * @return How many jobs were moved
+     */
+    size_t ReclaimExpired() const;
+
+    /**
+     * @brief Claim a job, run it while its lease is renewed in the background, and complete it
+     * @param run Maps the job's contents to its result
+     * @return false if there was no job to claim
+     */
+    bool Process(const std::function<std::string(const std::string &)> &run) const;
+
+private:
+    std::filesystem::path _directory;
+    std::chrono::milliseconds _lease;
+    std::string _owner; // Host, process and instance; tags the leases of this queue object
+};
+
+#endif //! SANDBOX_SPOOL_QUEUE_H
@@ -0,0 +1,356 @@
+#include "SubmissionRing.h"
+
+#include "../InternalHelpers.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint32_t RING_MAGIC          = 0x53425247; // "SBRG"
+constexpr uint32_t RING_LAYOUT_VERSION = 1;
+constexpr uint32_t SUBMISSION_ENTRIES  = 1024;
+// Twice the submissions, so a client that reaps now and then does not hold the runner back.
+constexpr uint32_t COMPLETION_ENTRIES = 2 * SUBMISSION_ENTRIES;
+constexpr size_t RING_SLOT_SIZE       = 4096;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "The ring is shared between processes, its atomics must not need a lock");
+
+/**
+ * @brief Bounded queue for any number of producers and consumers, with a sequence number per cell
+ */
+template <typename T, uint32_t N> struct SharedQueue
+{
+    static_assert((N & (N - 1)) == 0, "The size must be a power of two");
+
+    struct Cell
+    {
+        std::atomic<uint64_t> Sequence; // Position the cell can be written at, or that position + 1 once written
+        T Value;
+    };
+
+    alignas(64) std::atomic<uint64_t> Tail; // Next position to write
+    alignas(64) std::atomic<uint64_t> Head; // Next position to read
+    alignas(64) Cell Cells[N];
+
+    void Initialize()
+    {
+        for (uint32_t i = 0; i < N; ++i)
+            Cells[i].Sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool TryPush(const T &value)
+    {
+        uint64_t position = Tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell              = Cells[position & (N - 1)];
+            const uint64_t sequence = cell.Sequence.load(std::memory_order_acquire);
+            if (sequence == position)
+            {
+                if (Tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.Value = value;
+                    cell.Sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < position)
+                return false;
+            else
+                position = Tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool TryPop(T &value)
+    {
+        uint64_t position = Head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell              = Cells[position & (N - 1)];
+            const uint64_t sequence = cell.Sequence.load(std::memory_order_acquire);
+            if (sequence == position + 1)
+            {
+                if (Head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.Value;
+                    cell.Sequence.store(position + N, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < position + 1)
+                return false;
+            else
+                position = Head.load(std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * @brief A registered configuration or path, written under a sequence lock
+ */
+struct RingSlot
+{
+    std::atomic<uint32_t> Generation; // 0 while empty, odd while being written
+    uint32_t Length;
+    char Data[RING_SLOT_SIZE - 2 * sizeof(uint32_t)];
+};
+
+// Wakes the side that sleeps on Signal. Waiters announce themselves before their last look at the queue,
+// and the other side checks for them after publishing, so one of the two always sees the other.
+void WakeIfWaiting(std::atomic<uint32_t> &signal, const std::atomic<uint32_t> &waiters)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) == 0)
+        return;
+    signal.fetch_add(1, std::memory_order_relaxed);
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&signal), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Not FUTEX_PRIVATE_FLAG, the word is shared with another process.
+void WaitForSignal(std::atomic<uint32_t> &signal, uint32_t seen, const timespec *timeout)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&signal), FUTEX_WAIT, seen, timeout, nullptr, 0);
+}
+
+bool WriteSlot(RingSlot &slot, std::string_view data)
+{
+    if (data.size() >= sizeof(slot.Data))
+        return false;
+    const uint32_t generation = slot.Generation.load(std::memory_order_relaxed) & ~1U;
+    slot.Generation.store(generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(slot.Data, data.data(), data.size());
+    slot.Length = static_cast<uint32_t>(data.size());
+    slot.Generation.store(generation + 2, std::memory_order_release);
+    return true;
+}
+
+std::optional<std::pair<uint32_t, std::string>> ReadSlot(const RingSlot &slot)
+{
+    const uint32_t generation = slot.Generation.load(std::memory_order_acquire);
+    if (generation == 0 || (generation & 1) != 0)
+        return std::nullopt;
+    std::string data(slot.Data, std::min<size_t>(slot.Length, sizeof(slot.Data)));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.Generation.load(std::memory_order_relaxed) != generation)
+        return std::nullopt;
+    return std::pair{generation, std::move(data)};
+}
+
+std::string GetSharedMemoryName(const std::string &name)
+{
+    return "/sandbox-ring-" + name;
+}
+
+} // namespace
+
+/**
+ * @brief The shared memory of a ring
+ */
+struct RingLayout
+{
+    std::atomic<uint32_t> Magic; // Set last by the runner, a client only uses a ring once it is set
+    uint32_t Version;
+
+    alignas(64) std::atomic<uint32_t> RunnerSignal; // Futex the runner threads sleep on
+    std::atomic<uint32_t> RunnersWaitingForWork;
+    std::atomic<uint32_t> RunnersWaitingForRoom;
+    alignas(64) std::atomic<uint32_t> ClientSignal; // Futex the threads in Reap sleep on
+    std::atomic<uint32_t> ClientsWaiting;
+
+    SharedQueue<SandboxRingSubmission, SUBMISSION_ENTRIES> Submissions;
+    SharedQueue<SandboxRingCompletion, COMPLETION_ENTRIES> Completions;
+    RingSlot Configs[SANDBOX_RING_CONFIG_SLOTS];
+    RingSlot Files[SANDBOX_RING_FILE_SLOTS];
+};
+
+std::unique_ptr<SubmissionRing> SubmissionRing::Create(const std::string &name)
+{
+    const std::string path = GetSharedMemoryName(name);
+    shm_unlink(path.c_str());
+    SandboxInternal::UniqueFd fd(shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600));
+    if (!fd.valid())
+        return nullptr;
+
+    // The new pages read as zero, which is what every counter, queue position and slot starts at.
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd.get(), sizeof(RingLayout)) == 0)
+        memory = mmap(nullptr, sizeof(RingLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (memory == MAP_FAILED)
+    {
+        shm_unlink(path.c_str());
+        return nullptr;
+    }
+
+    auto *layout    = static_cast<RingLayout *>(memory);
+    layout->Version = RING_LAYOUT_VERSION;
+    layout->Submissions.Initialize();
+    layout->Completions.Initialize();
+    layout->Magic.store(RING_MAGIC, std::memory_order_release);
+    return std::unique_ptr<SubmissionRing>(new SubmissionRing(name, layout, true));
+}
+
+std::unique_ptr<SubmissionRing> SubmissionRing::Open(const std::string &name)
+{
+    SandboxInternal::UniqueFd fd(shm_open(GetSharedMemoryName(name).c_str(), O_RDWR | O_CLOEXEC, 0));
+    struct stat info{};
+    if (!fd.valid() || fstat(fd.get(), &info) != 0 || static_cast<size_t>(info.st_size) != sizeof(RingLayout))
+        return nullptr;
+
+    void *memory = mmap(nullptr, sizeof(RingLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (memory == MAP_FAILED)
+        return nullptr;
+    auto *layout = static_cast<RingLayout *>(memory);
+    if (layout->Magic.load(std::memory_order_acquire) != RING_MAGIC || layout->Version != RING_LAYOUT_VERSION)
+    {
+        munmap(memory, sizeof(RingLayout));
+        return nullptr;
+    }
+    return std::unique_ptr<SubmissionRing>(new SubmissionRing(name, layout, false));
+}
+
+SubmissionRing::SubmissionRing(std::string name, RingLayout *layout, bool owner)
+    : _name(std::move(name)), _layout(layout), _owner(owner)
+{
+}
+
+SubmissionRing::~SubmissionRing()
+{
+    if (_owner)
+        shm_unlink(GetSharedMemoryName(_name).c_str());
+    munmap(_layout, sizeof(RingLayout));
+}
+
+bool SubmissionRing::RegisterConfig(uint32_t id, std::string_view arguments)
+{
+    return id < SANDBOX_RING_CONFIG_SLOTS && WriteSlot(_layout->Configs[id], arguments);
+}
+
+bool SubmissionRing::RegisterFile(uint32_t id, std::string_view path)
+{
+    return id < SANDBOX_RING_FILE_SLOTS && WriteSlot(_layout->Files[id], path);
+}
+
+uint32_t SubmissionRing::Submit(const SandboxRingSubmission *entries, uint32_t count)
+{
+    uint32_t submitted = 0;
+    while (submitted < count && _layout->Submissions.TryPush(entries[submitted]))
+        ++submitted;
+    if (submitted != 0)
+        WakeIfWaiting(_layout->RunnerSignal, _layout->RunnersWaitingForWork);
+    return submitted;
+}
+
+uint32_t SubmissionRing::Reap(SandboxRingCompletion *entries, uint32_t capacity, std::chrono::milliseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    uint32_t reaped     = 0;
+    while (reaped < capacity)
+    {
+        if (_layout->Completions.TryPop(entries[reaped]))
+        {
+            ++reaped;
+            continue;
+        }
+        const auto remaining = deadline - std::chrono::steady_clock::now();
+        if (reaped != 0 || remaining <= std::chrono::steady_clock::duration::zero())
+            break;
+
+        const uint32_t seen = _layout->ClientSignal.load(std::memory_order_relaxed);
+        _layout->ClientsWaiting.fetch_add(1, std::memory_order_seq_cst);
+        if (!_layout->Completions.TryPop(entries[reaped]))
+        {
+            const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+            const timespec wait{.tv_sec = nanoseconds / 1000000000, .tv_nsec = nanoseconds % 1000000000};
+            WaitForSignal(_layout->ClientSignal, seen, &wait);
+        }
+        else
+            ++reaped;
+        _layout->ClientsWaiting.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    if (reaped != 0)
+        WakeIfWaiting(_layout->RunnerSignal, _layout->RunnersWaitingForRoom);
+    return reaped;
+}
+
+bool SubmissionRing::Take(SandboxRingSubmission &entry)
+{
+    while (!_stopped.load(std::memory_order_relaxed))
+    {
+        if (_layout->Submissions.TryPop(entry))
+            return true;
+
+        const uint32_t seen = _layout->RunnerSignal.load(std::memory_order_relaxed);
+        _layout->RunnersWaitingForWork.fetch_add(1, std::memory_order_seq_cst);
+        const bool taken = _layout->Submissions.TryPop(entry);
+        if (!taken && !_stopped.load(std::memory_order_relaxed))
+            WaitForSignal(_layout->RunnerSignal, seen, nullptr);
+        _layout->RunnersWaitingForWork.fetch_sub(1, std::memory_order_relaxed);
+        if (taken)
+            return true;
+    }
+    return false;
+}
+
+bool SubmissionRing::Complete(const SandboxRingCompletion &entry)
+{
+    while (!_stopped.load(std::memory_order_relaxed))
+    {
+        if (_layout->Completions.TryPush(entry))
+        {
+            WakeIfWaiting(_layout->ClientSignal, _layout->ClientsWaiting);
+            return true;
+        }
+
+        const uint32_t seen = _layout->RunnerSignal.load(std::memory_order_relaxed);
+        _layout->RunnersWaitingForRoom.fetch_add(1, std::memory_order_seq_cst);
+        const bool pushed = _layout->Completions.TryPush(entry);
+        if (!pushed && !_stopped.load(std::memory_order_relaxed))
+            WaitForSignal(_layout->RunnerSignal, seen, nullptr);
+        _layout->RunnersWaitingForRoom.fetch_sub(1, std::memory_order_relaxed);
+        if (pushed)
+        {
+            WakeIfWaiting(_layout->ClientSignal, _layout->ClientsWaiting);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<std::pair<uint32_t, std::string>> SubmissionRing::ReadConfig(uint32_t id) const
+{
+    if (id >= SANDBOX_RING_CONFIG_SLOTS)
+        return std::nullopt;
+    return ReadSlot(_layout->Configs[id]);
+}
+
+std::optional<std::string> SubmissionRing::ReadFile(uint32_t id) const
+{
+    if (id >= SANDBOX_RING_FILE_SLOTS)
+        return std::nullopt;
+    auto slot = ReadSlot(_layout->Files[id]);
+    if (!slot.has_value())
+        return std::nullopt;
+    return std::move(slot->second);
+}
+
+void SubmissionRing::Stop()
+{
+    _stopped.store(true, std::memory_order_relaxed);
+    _layout->RunnerSignal.fetch_add(1, std::memory_order_seq_cst);
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&_layout->RunnerSignal), FUTEX_WAKE, INT_MAX, nullptr, nullptr,
+            0);
+}
@@ -0,0 +1,95 @@
+#ifndef SANDBOX_SUBMISSION_RING_H
+#define SANDBOX_SUBMISSION_RING_H
+
+#include "../Sandbox.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+struct RingLayout;
+
+/**
+ * @brief Shared-memory submission and completion queues between a runner and a client on the same machine
+ * @remarks The runner creates the ring, the client opens it by name. Both queues are bounded and lock-free,
+ * so any number of threads on either side may use them. A side only makes a syscall to wake the other
+ * when it sleeps: the runner when it ran out of submissions or of room for completions, the client when
+ * it waits in Reap. Runs refer to configurations and files the client registered in slots of the ring.
+ */
+class SubmissionRing
+{
+public:
+    /**
+     * @brief Create the ring as the runner, replacing a ring of the same name left by a runner that died
+     */
+    static std::unique_ptr<SubmissionRing> Create(const std::string &name);
+
+    /**
+     * @brief Open the ring of a runner as a client
+     * @return nullptr if no ring of that name exists
+     */
+    static std::unique_ptr<SubmissionRing> Open(const std::string &name);
+
+    ~SubmissionRing();
+
+    SubmissionRing(const SubmissionRing &)            = delete;
+    SubmissionRing &operator=(const SubmissionRing &) = delete;
+
+    // Client side
+
+    bool RegisterConfig(uint32_t id, std::string_view arguments);
+    bool RegisterFile(uint32_t id, std::string_view path);
+
+    /**
+     * @return How many entries were queued, fewer than count if the queue is full
+     */
+    uint32_t Submit(const SandboxRingSubmission *entries, uint32_t count);
+
+    /**
+     * @brief Take up to capacity completions, waiting up to timeout for the first one
+     */
+    uint32_t Reap(SandboxRingCompletion *entries, uint32_t capacity, std::chrono::milliseconds timeout);
+
+    // Runner side
+
+    /**
+     * @brief Block until there is a submission
+     * @return false once Stop was called
+     */
+    bool Take(SandboxRingSubmission &entry);
+
+    /**
+     * @brief Queue a completion, blocking while the client has not made room
+     * @return false once Stop was called
+     */
+    bool Complete(const SandboxRingCompletion &entry);
+
+    /**
+     * @brief A registered configuration and the generation it was registered with, which changes when the
+     * client registers the slot again
+     * @return std::nullopt if the slot is empty or being written
+     */
+    std::optional<std::pair<uint32_t, std::string>> ReadConfig(uint32_t id) const;
+    std::optional<std::string> ReadFile(uint32_t id) const;
+
+    /**
+     * @brief Make Take and Complete return false in every thread
+     * @remarks Async-signal-safe.
+     */
+    void Stop();
+
+private:
+    SubmissionRing(std::string name, RingLayout *layout, bool owner);
+
+    std::string _name;
+    RingLayout *_layout;
+    bool _owner; // The runner unlinks the ring when it is destroyed
+    std::atomic<bool> _stopped = false;
+};
+
+#endif //! SANDBOX_SUBMISSION_RING_H
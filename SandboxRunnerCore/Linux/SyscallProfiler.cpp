@@ -0,0 +1,210 @@
+#include "SyscallProfiler.h"
+
+#include "../Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <optional>
+#include <poll.h>
+#include <sched.h>
+#include <seccomp.h>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace
+{
+
+constexpr int POLL_INTERVAL_MS = 100;
+// Past the first few syscalls a Frequency filter gains nothing over the default order.
+constexpr size_t MAX_FREQUENCY_HINTS = 8;
+
+bool IsWriteOpen(int syscall, const uint64_t *args)
+{
+    if (syscall == SCMP_SYS(open))
+        return (args[1] & (O_WRONLY | O_RDWR)) != 0;
+    if (syscall == SCMP_SYS(openat))
+        return (args[2] & (O_WRONLY | O_RDWR)) != 0;
+    return false;
+}
+
+// A coarse class of the first-seen arguments, for the syscalls where it matters when writing a policy.
+std::optional<std::string> ClassifyArgs(int syscall, const std::array<uint64_t, 6> &args)
+{
+    if (syscall == SCMP_SYS(open) || syscall == SCMP_SYS(openat))
+        return IsWriteOpen(syscall, args.data()) ? "Write" : "ReadOnly";
+    if (syscall == SCMP_SYS(mmap) || syscall == SCMP_SYS(mprotect))
+        return (args[2] & PROT_EXEC) != 0 ? "Exec" : "NoExec";
+    if (syscall == SCMP_SYS(clone))
+        return (args[0] & CLONE_THREAD) != 0 ? "Thread" : "Process";
+    return std::nullopt;
+}
+
+std::string ResolveSyscallName(int syscall)
+{
+    char *name = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, syscall);
+    if (name == nullptr)
+        return {};
+
+    std::string resolved(name);
+    free(name);
+    return resolved;
+}
+
+// Covered by the execve and I/O rules of the policy engine rather than by the whitelist.
+bool IsHandledOutsideWhiteList(int syscall, bool allowIo)
+{
+    if (syscall == SCMP_SYS(execve) || syscall == SCMP_SYS(open) || syscall == SCMP_SYS(openat))
+        return true;
+    return allowIo && (syscall == SCMP_SYS(dup) || syscall == SCMP_SYS(dup2) || syscall == SCMP_SYS(dup3));
+}
+
+} // namespace
+
+SyscallProfiler::~SyscallProfiler()
+{
+    Stop();
+}
+
+bool SyscallProfiler::Start(int notifyFd, pid_t sandboxPid)
+{
+    _notifyFd.reset(notifyFd);
+    _sandboxPid = sandboxPid;
+    try
+    {
+        _thread = std::thread(&SyscallProfiler::Serve, this);
+    }
+    catch (const std::system_error &)
+    {
+        return false;
+    }
+    return true;
+}
+
+void SyscallProfiler::Stop()
+{
+    _stopRequested = true;
+    if (_thread.joinable())
+        _thread.join();
+    _notifyFd.reset();
+}
+
+void SyscallProfiler::Serve()
+{
+    seccomp_notif *request   = nullptr;
+    seccomp_notif_resp *response = nullptr;
+    if (seccomp_notify_alloc(&request, &response) != 0)
+    {
+        Logger::Error("Failed to allocate seccomp notification buffers");
+        return;
+    }
+
+    while (!_stopRequested)
+    {
+        pollfd pfd{.fd = _notifyFd.get(), .events = POLLIN, .revents = 0};
+        const int ready = poll(&pfd, 1, POLL_INTERVAL_MS);
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (ready <= 0)
+            continue;
+        // POLLHUP: every task using the filter has exited
+        if ((pfd.revents & POLLIN) == 0)
+            break;
+
+        memset(request, 0, sizeof(seccomp_notif));
+        if (seccomp_notify_receive(_notifyFd.get(), request) != 0)
+            continue; // The task died before we read the notification
+
+        Record(static_cast<pid_t>(request->pid), request->data.nr,
+               reinterpret_cast<const uint64_t *>(request->data.args));
+
+        memset(response, 0, sizeof(seccomp_notif_resp));
+        response->id    = request->id;
+        response->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+        seccomp_notify_respond(_notifyFd.get(), response);
+    }
+
+    seccomp_notify_free(request, response);
+}
+
+void SyscallProfiler::Record(pid_t pid, int syscall, const uint64_t *args)
+{
+    // Everything up to and including the initial execve is the sandbox's own setup.
+    if (!_execveSeen)
+    {
+        _execveSeen = (pid == _sandboxPid && syscall == SCMP_SYS(execve));
+        return;
+    }
+
+    ++_totalCount;
+    _writeOpenSeen = _writeOpenSeen || IsWriteOpen(syscall, args);
+
+    auto &record = _records[syscall];
+    if (record.Count++ == 0)
+        std::copy(args, args + record.FirstSeenArgs.size(), record.FirstSeenArgs.begin());
+}
+
+bool SyscallProfiler::WritePolicy(const char *path) const
+{
+    using Json = nlohmann::ordered_json;
+
+    std::vector<std::pair<int, const SyscallRecord *>> byFrequency;
+    byFrequency.reserve(_records.size());
+    for (const auto &[syscall, record] : _records)
+        byFrequency.emplace_back(syscall, &record);
+
+    std::stable_sort(byFrequency.begin(), byFrequency.end(),
+                     [](const auto &lhs, const auto &rhs) { return lhs.second->Count > rhs.second->Count; });
+
+    Json whiteList  = Json::array();
+    Json hints      = Json::array();
+    Json statistics = Json::array();
+    for (const auto &[syscall, record] : byFrequency)
+    {
+        const auto name = ResolveSyscallName(syscall);
+        if (!IsHandledOutsideWhiteList(syscall, _writeOpenSeen))
+            whiteList.push_back(name.empty() ? Json(syscall) : Json(name));
+        if (syscall != SCMP_SYS(execve) && hints.size() < MAX_FREQUENCY_HINTS)
+            hints.push_back(name.empty() ? Json(syscall) : Json(name));
+
+        Json entry = {
+            {"Name", name},
+            {"Number", syscall},
+            {"Count", record->Count},
+            {"FirstSeenArgs", record->FirstSeenArgs},
+        };
+        if (const auto argsClass = ClassifyArgs(syscall, record->FirstSeenArgs); argsClass.has_value())
+            entry["ArgsClass"] = *argsClass;
+        statistics.push_back(std::move(entry));
+    }
+
+    const Json root = {
+        {"Version", "1.0"},
+        {"Seccomp",
+         {
+             {"AllowIO", _writeOpenSeen},
+             {"RestrictExecveToProgramPath", true},
+             {"FilterLayout", "Frequency"},
+             {"FrequencyHints", std::move(hints)},
+             {"WhiteList", std::move(whiteList)},
+         }},
+        {"Profile",
+         {
+             {"TotalSyscalls", _totalCount},
+             {"Syscalls", std::move(statistics)},
+         }},
+    };
+
+    std::ofstream output(path);
+    if (!output.is_open())
+        return false;
+
+    output << root.dump(4) << std::endl;
+    return output.good();
+}
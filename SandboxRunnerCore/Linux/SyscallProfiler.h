@@ -0,0 +1,67 @@
+#ifndef SANDBOX_SYSCALL_PROFILER_H
+#define SANDBOX_SYSCALL_PROFILER_H
+
+#include "../InternalHelpers.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <thread>
+#include <sys/types.h>
+
+/**
+ * @brief Supervisor side of the profiling mode
+ *
+ * Serves the seccomp user notifications of a sandboxed process whose filter notifies on every
+ * syscall, counts each syscall made after the initial execve and lets it continue.
+ */
+class SyscallProfiler
+{
+public:
+    struct SyscallRecord
+    {
+        uint64_t Count = 0;
+        std::array<uint64_t, 6> FirstSeenArgs{};
+    };
+
+    SyscallProfiler() = default;
+    ~SyscallProfiler();
+
+    SyscallProfiler(const SyscallProfiler &)            = delete;
+    SyscallProfiler &operator=(const SyscallProfiler &) = delete;
+
+    /**
+     * @brief Start serving notifications on a background thread, takes ownership of notifyFd
+     */
+    bool Start(int notifyFd, pid_t sandboxPid);
+
+    /**
+     * @brief Stop serving and join the thread, the records are stable afterwards
+     */
+    void Stop();
+
+    [[nodiscard]] uint64_t GetTotalCount() const { return _totalCount; }
+    [[nodiscard]] const std::map<int, SyscallRecord> &GetRecords() const { return _records; }
+
+    /**
+     * @brief Write a policy JSON whitelisting the observed syscalls, most frequent first
+     */
+    bool WritePolicy(const char *path) const;
+
+private:
+    void Serve();
+    void Record(pid_t pid, int syscall, const uint64_t *args);
+
+    SandboxInternal::UniqueFd _notifyFd;
+    pid_t _sandboxPid = 0;
+    std::atomic<bool> _stopRequested{false};
+    std::thread _thread;
+
+    bool _execveSeen     = false;
+    bool _writeOpenSeen  = false;
+    uint64_t _totalCount = 0;
+    std::map<int, SyscallRecord> _records;
+};
+
+#endif //! SANDBOX_SYSCALL_PROFILER_H
@@ -0,0 +1,99 @@
+#include "TimingCalibration.h"
+
+#include "../InternalHelpers.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ctime>
+
+namespace
+{
+
+// CPU time of the reference workload on the reference node, a 3 GHz core running a Release build.
+constexpr double REFERENCE_WORKLOAD_NS = 2300000.0;
+constexpr uint32_t REFERENCE_WORKLOAD_ITERATIONS = 1U << 20;
+// The first round warms up caches and frequency and is not counted.
+constexpr size_t CALIBRATION_ROUNDS = 11;
+constexpr uint64_t CALIBRATION_MAX_AGE_NS = 60ULL * 1000000000ULL;
+constexpr double NEAR_LIMIT_NOISE_LEVELS = 3.0;
+
+uint64_t ThreadCpuTimeNs()
+{
+    timespec time{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000ULL + static_cast<uint64_t>(time.tv_nsec);
+}
+
+} // namespace
+
+uint64_t RunReferenceWorkload()
+{
+    const uint64_t start = ThreadCpuTimeNs();
+    // A dependent chain of multiplies and shifts: pure core speed, no memory traffic, nothing to vectorize.
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (uint32_t i = 0; i < REFERENCE_WORKLOAD_ITERATIONS; ++i)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        state ^= state >> 29;
+    }
+    [[maybe_unused]] volatile uint64_t sink = state;
+    return ThreadCpuTimeNs() - start;
+}
+
+SandboxTimingConfidence AssessTimingConfidence(uint64_t cpuTimeMs, uint64_t cpuLimitMs, double noise)
+{
+    if (cpuLimitMs == 0)
+        return SANDBOX_TIMING_CONFIDENCE_HIGH;
+
+    const double distance = std::abs(static_cast<double>(cpuTimeMs) - static_cast<double>(cpuLimitMs));
+    return distance <= static_cast<double>(cpuLimitMs) * noise * NEAR_LIMIT_NOISE_LEVELS
+               ? SANDBOX_TIMING_CONFIDENCE_LOW
+               : SANDBOX_TIMING_CONFIDENCE_HIGH;
+}
+
+TimingCalibrator &TimingCalibrator::Instance()
+{
+    static TimingCalibrator instance;
+    return instance;
+}
+
+TimingCalibrationSnapshot TimingCalibrator::Get()
+{
+    std::lock_guard lock(_mutex);
+    if (_current.Timestamp == 0 || SandboxInternal::MonotonicNowNs() - _current.Timestamp > CALIBRATION_MAX_AGE_NS)
+        return CalibrateLocked();
+    return _current;
+}
+
+TimingCalibrationSnapshot TimingCalibrator::Calibrate()
+{
+    std::lock_guard lock(_mutex);
+    return CalibrateLocked();
+}
+
+TimingCalibrationSnapshot TimingCalibrator::CalibrateLocked()
+{
+    std::array<double, CALIBRATION_ROUNDS - 1> times{};
+    RunReferenceWorkload();
+    for (auto &time : times)
+        time = static_cast<double>(RunReferenceWorkload());
+
+    double mean = 0;
+    for (const double time : times)
+        mean += time;
+    mean /= static_cast<double>(times.size());
+
+    double variance = 0;
+    for (const double time : times)
+        variance += (time - mean) * (time - mean);
+    variance /= static_cast<double>(times.size());
+
+    std::sort(times.begin(), times.end());
+    const double median = times[times.size() / 2];
+
+    _current.SpeedFactor = REFERENCE_WORKLOAD_NS / median;
+    _current.Noise       = std::sqrt(variance) / mean;
+    _current.Timestamp   = SandboxInternal::MonotonicNowNs();
+    return _current;
+}
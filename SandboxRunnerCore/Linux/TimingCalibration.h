@@ -0,0 +1,60 @@
+#ifndef SANDBOX_TIMING_CALIBRATION_H
+#define SANDBOX_TIMING_CALIBRATION_H
+
+#include "../Sandbox.h"
+
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @brief Speed and timing noise of this node, measured with the reference workload
+ */
+struct TimingCalibrationSnapshot
+{
+    double SpeedFactor  = 0; // Reference time / measured time, above 1 on a node faster than the reference
+    double Noise        = 0; // Coefficient of variation of the measured times
+    uint64_t Timestamp  = 0; // When it was measured, CLOCK_MONOTONIC ns
+};
+
+/**
+ * @brief Run the reference workload once
+ * @return The CPU time the calling thread spent on it, ns
+ */
+uint64_t RunReferenceWorkload();
+
+/**
+ * @brief How far a verdict can be trusted given the CPU time, the limit and the node's noise
+ * @remarks A CPU time within three noise levels of the limit could have landed on the other side of it.
+ */
+SandboxTimingConfidence AssessTimingConfidence(uint64_t cpuTimeMs, uint64_t cpuLimitMs, double noise);
+
+/**
+ * @brief Keeps the calibration of this node, measured on first use and again once it is a minute old
+ * @remarks Calibrating runs the reference workload CALIBRATION_ROUNDS times on the calling thread, about
+ * 25 ms on a 3 GHz core. Concurrent callers wait for a single calibration.
+ */
+class TimingCalibrator
+{
+public:
+    static TimingCalibrator &Instance();
+
+    /**
+     * @brief The current calibration, recalibrating first if it is missing or stale
+     */
+    TimingCalibrationSnapshot Get();
+
+    /**
+     * @brief Calibrate now regardless of the age of the current calibration
+     */
+    TimingCalibrationSnapshot Calibrate();
+
+private:
+    TimingCalibrator() = default;
+
+    TimingCalibrationSnapshot CalibrateLocked();
+
+    std::mutex _mutex;
+    TimingCalibrationSnapshot _current;
+};
+
+#endif //! SANDBOX_TIMING_CALIBRATION_H
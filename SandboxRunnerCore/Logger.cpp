@@ -1,12 +1,14 @@
 #include "Logger.h"
 
 #include <new>
+#include <pthread.h>
 
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
 std::unique_ptr<Logger> Logger::_instance = nullptr;
 std::mutex Logger::_instanceMutex;
+std::mutex Logger::_writeMutex;
 
 Logger::Logger(std::shared_ptr<spdlog::logger> logger)
     : _logger(std::move(logger))
@@ -52,6 +54,39 @@ void Logger::FallbackWrite(LoggerLevel level, std::string_view message)
     fmt::print(stderr, "[logger-fallback][{}] {}\n", ToLevelString(level), message);
 }
 
+void Logger::RegisterForkHandlers()
+{
+    // Concurrent sandboxes fork while other threads log; the child must not inherit a locked logger.
+    // Flushing before fork also keeps the child from writing the parent's buffered lines a second
+    // time, after RLIMIT_FSIZE is set, when its own messages fill the inherited buffer.
+    static std::once_flag registered;
+    std::call_once(registered, [] {
+        pthread_atfork(
+            [] {
+                _instanceMutex.lock();
+                _writeMutex.lock();
+                if (_instance != nullptr)
+                {
+                    try
+                    {
+                        _instance->_logger->flush();
+                    }
+                    catch (const std::exception &)
+                    {
+                    }
+                }
+            },
+            [] {
+                _writeMutex.unlock();
+                _instanceMutex.unlock();
+            },
+            [] {
+                _writeMutex.unlock();
+                _instanceMutex.unlock();
+            });
+    });
+}
+
 void Logger::Release()
 {
     std::lock_guard<std::mutex> lock(_instanceMutex);
@@ -61,6 +96,8 @@ void Logger::Release()
 
 bool Logger::Initialize(const char *logName, const char *logFileName, LoggerLevel level)
 {
+    RegisterForkHandlers();
+
     std::lock_guard<std::mutex> lock(_instanceMutex);
     if (_instance != nullptr)
         return true;
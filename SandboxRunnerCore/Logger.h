@@ -58,11 +58,14 @@ private:
     std::shared_ptr<spdlog::logger> _logger;
     static std::unique_ptr<Logger> _instance;
     static std::mutex _instanceMutex;
+    // Held while a message is handed to the sink, so fork() never copies a sink lock held by another thread.
+    static std::mutex _writeMutex;
 
     explicit Logger(std::shared_ptr<spdlog::logger> logger);
     static spdlog::level::level_enum ToSpdlogLevel(LoggerLevel level);
     static const char *ToLevelString(LoggerLevel level);
     static void FallbackWrite(LoggerLevel level, std::string_view message);
+    static void RegisterForkHandlers();
 
 public:
     ~Logger() = default;
@@ -95,6 +98,7 @@ public:
 
         try
         {
+            std::lock_guard<std::mutex> writeLock(_writeMutex);
             logger->log(ToSpdlogLevel(level), logMessage);
         }
         catch (const std::exception &ex)
@@ -0,0 +1,368 @@
+#include "Metrics.h"
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint32_t COUNTER_COUNT   = static_cast<uint32_t>(MetricCounter::Count);
+constexpr uint32_t GAUGE_COUNT     = static_cast<uint32_t>(MetricGauge::Count);
+constexpr uint32_t HISTOGRAM_COUNT = static_cast<uint32_t>(MetricHistogram::Count);
+
+// The verdicts and the kills are counters too, stored after the named ones.
+constexpr uint32_t VERDICT_SLOT  = COUNTER_COUNT;
+constexpr uint32_t KILL_SLOT     = VERDICT_SLOT + SANDBOX_METRICS_VERDICT_COUNT;
+constexpr uint32_t COUNTER_SLOTS = KILL_SLOT + SANDBOX_METRICS_TERMINATION_COUNT;
+
+// Powers of two from about a microsecond to about a minute, the buckets of the Prometheus histograms.
+constexpr uint32_t PROMETHEUS_FIRST_EXPONENT = 10;
+constexpr uint32_t PROMETHEUS_LAST_EXPONENT  = 36;
+
+constexpr const char *VERDICT_LABELS[SANDBOX_METRICS_VERDICT_COUNT] = {
+    "SUCCESS",
+    "MEMORY_LIMIT_EXCEEDED",
+    "RUNTIME_ERROR",
+    "CPU_TIME_LIMIT_EXCEEDED",
+    "REAL_TIME_LIMIT_EXCEEDED",
+    "PROCESS_LIMIT_EXCEEDED",
+    "OUTPUT_LIMIT_EXCEEDED",
+    "ILLEGAL_OPERATION",
+    "INTERNAL_ERROR",
+};
+
+constexpr const char *KILL_LABELS[SANDBOX_METRICS_TERMINATION_COUNT] = {
+    "none", "real_time_limit", "memory_limit", "idle_limit", "process_limit", "output_limit",
+};
+
+// Each block has a single writer, so a load and a store replace the locked read-modify-write.
+template <typename T> void AddRelaxed(std::atomic<T> &value, T delta)
+{
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+} // namespace
+
+/**
+ * @brief What one thread recorded, or the sum of several threads
+ */
+struct MetricsBlock
+{
+    struct Histogram
+    {
+        std::atomic<uint64_t> Buckets[LatencyBuckets::COUNT];
+        std::atomic<uint64_t> SumNs;
+        std::atomic<uint64_t> MaxNs;
+    };
+
+    std::atomic<uint64_t> Counters[COUNTER_SLOTS];
+    std::atomic<int64_t> Gauges[GAUGE_COUNT];
+    Histogram Histograms[HISTOGRAM_COUNT];
+
+    MetricsBlock *Next = nullptr;  // Older block, set before the block is published
+    std::atomic<bool> InUse{true}; // Owned by a live thread
+
+    uint64_t GetCounter(uint32_t slot) const { return Counters[slot].load(std::memory_order_relaxed); }
+    uint64_t GetCounter(MetricCounter counter) const { return GetCounter(static_cast<uint32_t>(counter)); }
+    int64_t GetGauge(MetricGauge gauge) const
+    {
+        return Gauges[static_cast<uint32_t>(gauge)].load(std::memory_order_relaxed);
+    }
+    const Histogram &GetHistogram(MetricHistogram histogram) const
+    {
+        return Histograms[static_cast<uint32_t>(histogram)];
+    }
+
+    void MergeInto(MetricsBlock &total) const
+    {
+        for (uint32_t i = 0; i < COUNTER_SLOTS; ++i)
+            AddRelaxed(total.Counters[i], GetCounter(i));
+        for (uint32_t i = 0; i < GAUGE_COUNT; ++i)
+            AddRelaxed(total.Gauges[i], Gauges[i].load(std::memory_order_relaxed));
+        for (uint32_t i = 0; i < HISTOGRAM_COUNT; ++i)
+        {
+            const Histogram &from = Histograms[i];
+            Histogram &to         = total.Histograms[i];
+            for (uint32_t bucket = 0; bucket < LatencyBuckets::COUNT; ++bucket)
+                AddRelaxed(to.Buckets[bucket], from.Buckets[bucket].load(std::memory_order_relaxed));
+            AddRelaxed(to.SumNs, from.SumNs.load(std::memory_order_relaxed));
+            const uint64_t maxNs = from.MaxNs.load(std::memory_order_relaxed);
+            if (maxNs > to.MaxNs.load(std::memory_order_relaxed))
+                to.MaxNs.store(maxNs, std::memory_order_relaxed);
+        }
+    }
+};
+
+struct MetricsRegistry::ThreadBlockOwner
+{
+    MetricsBlock *Block = nullptr;
+
+    ~ThreadBlockOwner()
+    {
+        // Release, so the thread that takes the block over continues from its last values.
+        if (Block != nullptr)
+            Block->InUse.store(false, std::memory_order_release);
+    }
+};
+
+namespace
+{
+
+SandboxLatencySummary Summarize(const MetricsBlock::Histogram &histogram)
+{
+    SandboxLatencySummary summary{};
+    for (const auto &bucket : histogram.Buckets)
+        summary.Count += bucket.load(std::memory_order_relaxed);
+    summary.SumNs = histogram.SumNs.load(std::memory_order_relaxed);
+    summary.MaxNs = histogram.MaxNs.load(std::memory_order_relaxed);
+    if (summary.Count == 0)
+        return summary;
+
+    // The upper bound of the bucket holding the rank, which overstates by less than a bucket's width.
+    const auto quantile = [&](double q) {
+        const auto rank =
+            std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(summary.Count))));
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < LatencyBuckets::COUNT; ++i)
+        {
+            seen += histogram.Buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return std::min(LatencyBuckets::UpperBound(i), summary.MaxNs);
+        }
+        return summary.MaxNs;
+    };
+    summary.P50Ns  = quantile(0.5);
+    summary.P90Ns  = quantile(0.9);
+    summary.P99Ns  = quantile(0.99);
+    summary.P999Ns = quantile(0.999);
+    return summary;
+}
+
+void AppendHeader(std::string &out, const char *name, const char *type, const char *help)
+{
+    fmt::format_to(std::back_inserter(out), "# HELP {0} {1}\n# TYPE {0} {2}\n", name, help, type);
+}
+
+void AppendCounter(std::string &out, const char *name, const char *help, uint64_t value)
+{
+    AppendHeader(out, name, "counter", help);
+    fmt::format_to(std::back_inserter(out), "{0} {1}\n", name, value);
+}
+
+void AppendGauge(std::string &out, const char *name, const char *help, int64_t value)
+{
+    AppendHeader(out, name, "gauge", help);
+    fmt::format_to(std::back_inserter(out), "{0} {1}\n", name, value);
+}
+
+void AppendHistogram(std::string &out, const char *name, const char *help, const MetricsBlock::Histogram &histogram)
+{
+    AppendHeader(out, name, "histogram", help);
+    uint64_t cumulative = 0;
+    uint32_t bucket     = 0;
+    for (uint32_t exponent = PROMETHEUS_FIRST_EXPONENT; exponent <= PROMETHEUS_LAST_EXPONENT; ++exponent)
+    {
+        const uint64_t bound = uint64_t{1} << exponent;
+        for (; bucket < LatencyBuckets::COUNT && LatencyBuckets::UpperBound(bucket) < bound; ++bucket)
+            cumulative += histogram.Buckets[bucket].load(std::memory_order_relaxed);
+        fmt::format_to(std::back_inserter(out), "{0}_bucket{{le=\"{1}\"}} {2}\n", name,
+                       static_cast<double>(bound) * 1e-9, cumulative);
+    }
+    for (; bucket < LatencyBuckets::COUNT; ++bucket)
+        cumulative += histogram.Buckets[bucket].load(std::memory_order_relaxed);
+    fmt::format_to(std::back_inserter(out), "{0}_bucket{{le=\"+Inf\"}} {1}\n{0}_sum {2}\n{0}_count {1}\n", name,
+                   cumulative, static_cast<double>(histogram.SumNs.load(std::memory_order_relaxed)) * 1e-9);
+}
+
+} // namespace
+
+uint32_t LatencyBuckets::IndexOf(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+        return static_cast<uint32_t>(value);
+    const auto exponent = static_cast<uint32_t>(std::bit_width(value)) - 1;
+    if (exponent >= MAX_EXPONENT)
+        return COUNT - 1;
+    const auto subBucket = static_cast<uint32_t>(value >> (exponent - 4)) & (SUB_BUCKETS - 1);
+    return (exponent - 3) * SUB_BUCKETS + subBucket;
+}
+
+uint64_t LatencyBuckets::UpperBound(uint32_t index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+    const uint32_t exponent = index / SUB_BUCKETS + 3;
+    const uint64_t lower    = static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - 4);
+    return lower + (uint64_t{1} << (exponent - 4)) - 1;
+}
+
+MetricsRegistry &MetricsRegistry::Instance()
+{
+    static MetricsRegistry instance;
+    return instance;
+}
+
+MetricsBlock &MetricsRegistry::GetThreadBlock()
+{
+    thread_local ThreadBlockOwner owner;
+    if (owner.Block != nullptr)
+        return *owner.Block;
+
+    for (MetricsBlock *block = _head.load(std::memory_order_acquire); block != nullptr; block = block->Next)
+    {
+        if (!block->InUse.load(std::memory_order_relaxed) && !block->InUse.exchange(true, std::memory_order_acquire))
+        {
+            owner.Block = block;
+            return *block;
+        }
+    }
+
+    auto *block = new MetricsBlock();
+    block->Next = _head.load(std::memory_order_relaxed);
+    while (!_head.compare_exchange_weak(block->Next, block, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    owner.Block = block;
+    return *block;
+}
+
+std::unique_ptr<MetricsBlock> MetricsRegistry::Sum()
+{
+    auto total = std::make_unique<MetricsBlock>();
+    for (const MetricsBlock *block = _head.load(std::memory_order_acquire); block != nullptr; block = block->Next)
+        block->MergeInto(*total);
+    return total;
+}
+
+void MetricsRegistry::Increment(MetricCounter counter, uint64_t by)
+{
+    AddRelaxed(GetThreadBlock().Counters[static_cast<uint32_t>(counter)], by);
+}
+
+void MetricsRegistry::AddToGauge(MetricGauge gauge, int64_t delta)
+{
+    AddRelaxed(GetThreadBlock().Gauges[static_cast<uint32_t>(gauge)], delta);
+}
+
+void MetricsRegistry::Observe(MetricHistogram histogram, uint64_t ns)
+{
+    auto &cells = GetThreadBlock().Histograms[static_cast<uint32_t>(histogram)];
+    AddRelaxed(cells.Buckets[LatencyBuckets::IndexOf(ns)], uint64_t{1});
+    AddRelaxed(cells.SumNs, ns);
+    if (ns > cells.MaxNs.load(std::memory_order_relaxed))
+        cells.MaxNs.store(ns, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::RecordVerdict(int status)
+{
+    constexpr uint32_t internalError = SANDBOX_METRICS_VERDICT_COUNT - 1;
+    const uint32_t index             = status >= 0 && status < static_cast<int>(internalError)
+                                           ? static_cast<uint32_t>(status)
+                                           : internalError;
+    AddRelaxed(GetThreadBlock().Counters[VERDICT_SLOT + index], uint64_t{1});
+}
+
+void MetricsRegistry::RecordMonitorKill(uint32_t reason)
+{
+    if (reason < SANDBOX_METRICS_TERMINATION_COUNT)
+        AddRelaxed(GetThreadBlock().Counters[KILL_SLOT + reason], uint64_t{1});
+}
+
+void MetricsRegistry::Snapshot(SandboxMetrics &metrics)
+{
+    const auto total = Sum();
+    SandboxMetrics snapshot{};
+    snapshot.StructSize          = sizeof(SandboxMetrics);
+    snapshot.Version             = SANDBOX_METRICS_VERSION;
+    snapshot.Launches            = total->GetCounter(MetricCounter::Launches);
+    snapshot.ForkFailures        = total->GetCounter(MetricCounter::ForkFailures);
+    snapshot.PolicyCacheHits     = total->GetCounter(MetricCounter::PolicyCacheHits);
+    snapshot.PolicyFileLoads     = total->GetCounter(MetricCounter::PolicyFileLoads);
+    snapshot.ResultCacheHits     = total->GetCounter(MetricCounter::ResultCacheHits);
+    snapshot.ExecutableCacheHits = total->GetCounter(MetricCounter::ExecutableCacheHits);
+    snapshot.NamespacePoolHits   = total->GetCounter(MetricCounter::NamespacePoolHits);
+    for (uint32_t i = 0; i < SANDBOX_METRICS_VERDICT_COUNT; ++i)
+        snapshot.Verdicts[i] = total->GetCounter(VERDICT_SLOT + i);
+    for (uint32_t i = 0; i < SANDBOX_METRICS_TERMINATION_COUNT; ++i)
+        snapshot.MonitorKills[i] = total->GetCounter(KILL_SLOT + i);
+    snapshot.ActiveRuns       = total->GetGauge(MetricGauge::ActiveRuns);
+    snapshot.MemoryQueueDepth = total->GetGauge(MetricGauge::MemoryQueueDepth);
+    snapshot.CoreQueueDepth   = total->GetGauge(MetricGauge::CoreQueueDepth);
+    snapshot.LaunchLatency    = Summarize(total->GetHistogram(MetricHistogram::LaunchLatency));
+    snapshot.RunTime          = Summarize(total->GetHistogram(MetricHistogram::RunTime));
+    snapshot.MemoryWait       = Summarize(total->GetHistogram(MetricHistogram::MemoryWait));
+
+    const uint32_t structSize = metrics.StructSize;
+    memcpy(&metrics, &snapshot, std::min<size_t>(structSize, sizeof(SandboxMetrics)));
+    metrics.StructSize = structSize;
+}
+
+std::string MetricsRegistry::FormatPrometheus()
+{
+    const auto total = Sum();
+    std::string out;
+    AppendCounter(out, "sandbox_launches_total", "Programs forked, calibration re-runs included.",
+                  total->GetCounter(MetricCounter::Launches));
+    AppendCounter(out, "sandbox_fork_failures_total", "Forks that failed.",
+                  total->GetCounter(MetricCounter::ForkFailures));
+
+    AppendHeader(out, "sandbox_verdicts_total", "counter", "Results returned, by status.");
+    for (uint32_t i = 0; i < SANDBOX_METRICS_VERDICT_COUNT; ++i)
+        fmt::format_to(std::back_inserter(out), "sandbox_verdicts_total{{status=\"{0}\"}} {1}\n", VERDICT_LABELS[i],
+                       total->GetCounter(VERDICT_SLOT + i));
+    AppendHeader(out, "sandbox_monitor_kills_total", "counter", "Programs the supervisor killed, by reason.");
+    for (uint32_t i = 1; i < SANDBOX_METRICS_TERMINATION_COUNT; ++i)
+        fmt::format_to(std::back_inserter(out), "sandbox_monitor_kills_total{{reason=\"{0}\"}} {1}\n", KILL_LABELS[i],
+                       total->GetCounter(KILL_SLOT + i));
+
+    AppendCounter(out, "sandbox_policy_cache_hits_total", "Policies resolved without reading a JSON file.",
+                  total->GetCounter(MetricCounter::PolicyCacheHits));
+    AppendCounter(out, "sandbox_policy_file_loads_total", "Policies read from a JSON file.",
+                  total->GetCounter(MetricCounter::PolicyFileLoads));
+    AppendCounter(out, "sandbox_result_cache_hits_total", "Results replayed from the result cache.",
+                  total->GetCounter(MetricCounter::ResultCacheHits));
+    AppendCounter(out, "sandbox_executable_cache_hits_total", "Programs executed from the executable cache.",
+                  total->GetCounter(MetricCounter::ExecutableCacheHits));
+    AppendCounter(out, "sandbox_namespace_pool_hits_total", "Runs that joined a warm set of namespaces.",
+                  total->GetCounter(MetricCounter::NamespacePoolHits));
+
+    AppendGauge(out, "sandbox_active_runs", "Programs forked and not reaped yet.",
+                total->GetGauge(MetricGauge::ActiveRuns));
+    AppendGauge(out, "sandbox_memory_queue_depth", "Runs waiting for the memory budget.",
+                total->GetGauge(MetricGauge::MemoryQueueDepth));
+    AppendGauge(out, "sandbox_core_queue_depth", "Runs waiting for a core to pin to.",
+                total->GetGauge(MetricGauge::CoreQueueDepth));
+
+    AppendHistogram(out, "sandbox_launch_latency_seconds", "From the start of a run until the program's execve.",
+                    total->GetHistogram(MetricHistogram::LaunchLatency));
+    AppendHistogram(out, "sandbox_run_duration_seconds", "From the start of a run until the program was reaped.",
+                    total->GetHistogram(MetricHistogram::RunTime));
+    AppendHistogram(out, "sandbox_memory_wait_seconds", "Time runs waited for the memory budget.",
+                    total->GetHistogram(MetricHistogram::MemoryWait));
+    return out;
+}
+
+bool MetricsRegistry::WritePrometheus(const std::string &path)
+{
+    const std::string text      = FormatPrometheus();
+    const std::string temporary = fmt::format("{0}.{1}.tmp", path, getpid());
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(text.data(), static_cast<std::streamsize>(text.size())) || !file.flush())
+            return false;
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
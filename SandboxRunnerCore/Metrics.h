@@ -0,0 +1,127 @@
+#ifndef SANDBOX_METRICS_H
+#define SANDBOX_METRICS_H
+
+#include "Sandbox.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+enum class MetricCounter : uint32_t
+{
+    Launches,
+    ForkFailures,
+    PolicyCacheHits,
+    PolicyFileLoads,
+    ResultCacheHits,
+    ExecutableCacheHits,
+    NamespacePoolHits,
+    Count,
+};
+
+enum class MetricGauge : uint32_t
+{
+    ActiveRuns,
+    MemoryQueueDepth,
+    CoreQueueDepth,
+    Count,
+};
+
+enum class MetricHistogram : uint32_t
+{
+    LaunchLatency,
+    RunTime,
+    MemoryWait,
+    Count,
+};
+
+/**
+ * @brief Log-linear buckets of nanosecond durations, in the style of HdrHistogram
+ * @remarks Values below 16 have a bucket each. Above, every power of two is split into 16 buckets, so a
+ * bucket is at most 1/16 of its lower bound wide. Values from 2^42 ns, over an hour, share the last bucket.
+ */
+struct LatencyBuckets
+{
+    static constexpr uint32_t SUB_BUCKETS  = 16;
+    static constexpr uint32_t MAX_EXPONENT = 42;
+    static constexpr uint32_t COUNT        = (MAX_EXPONENT - 3) * SUB_BUCKETS;
+
+    static uint32_t IndexOf(uint64_t value);
+    static uint64_t UpperBound(uint32_t index); // The largest value counted in the bucket
+};
+
+struct MetricsBlock;
+
+/**
+ * @brief Process-wide counters, gauges and duration histograms of the runs
+ * @remarks Every thread records into a block of its own, with plain loads and stores of relaxed atomics
+ * and no lock, so recording costs a few nanoseconds and threads never contend. The blocks form a list
+ * that only grows; a thread that exits leaves its block, totals included, to the next new thread. Nothing
+ * takes a lock, so a child forked while another thread records may still record. A snapshot sums the
+ * blocks and may see an update of one block before an earlier update of another.
+ */
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry &Instance();
+
+    void Increment(MetricCounter counter, uint64_t by = 1);
+    void AddToGauge(MetricGauge gauge, int64_t delta);
+    void Observe(MetricHistogram histogram, uint64_t ns);
+
+    /**
+     * @brief Count a result returned to the caller
+     * @param status A SandboxStatus
+     */
+    void RecordVerdict(int status);
+
+    /**
+     * @brief Count a program the supervisor killed
+     * @param reason A SandboxTerminationReason other than SANDBOX_TERMINATION_NONE
+     */
+    void RecordMonitorKill(uint32_t reason);
+
+    /**
+     * @brief Sum the blocks into a snapshot, written up to metrics.StructSize
+     */
+    void Snapshot(SandboxMetrics &metrics);
+
+    /**
+     * @brief The snapshot in the Prometheus text exposition format
+     */
+    std::string FormatPrometheus();
+
+    /**
+     * @brief Write FormatPrometheus to a file aside and rename it over path
+     */
+    bool WritePrometheus(const std::string &path);
+
+private:
+    struct ThreadBlockOwner; // Hands the block of its thread back when the thread exits
+
+    MetricsRegistry() = default;
+
+    MetricsBlock &GetThreadBlock();
+    std::unique_ptr<MetricsBlock> Sum();
+
+    std::atomic<MetricsBlock *> _head = nullptr; // Newest block, never freed
+};
+
+/**
+ * @brief Adds one to a gauge for the lifetime of the object
+ */
+class ScopedGauge
+{
+public:
+    explicit ScopedGauge(MetricGauge gauge) : _gauge(gauge) { MetricsRegistry::Instance().AddToGauge(_gauge, 1); }
+    ~ScopedGauge() { MetricsRegistry::Instance().AddToGauge(_gauge, -1); }
+
+    ScopedGauge(const ScopedGauge &)            = delete;
+    ScopedGauge &operator=(const ScopedGauge &) = delete;
+
+private:
+    MetricGauge _gauge;
+};
+
+#endif //! SANDBOX_METRICS_H
@@ -0,0 +1,41 @@
+#include "BuiltinPolicies.h"
+
+#include <algorithm>
+#include <sched.h>
+#include <seccomp.h>
+
+namespace SandboxPolicyEngine
+{
+namespace
+{
+
+#include "BuiltinPolicies.inc"
+
+} // namespace
+
+std::span<const BuiltinPolicy> GetBuiltinPolicies()
+{
+    return kBuiltinPolicies;
+}
+
+std::string_view GetBuiltinPoliciesDigest()
+{
+    return kBuiltinPoliciesDigest;
+}
+
+const BuiltinPolicy *FindBuiltinPolicy(const std::string_view policyName)
+{
+    // The generator emits the table sorted by name.
+    const auto it = std::lower_bound(kBuiltinPolicies.begin(), kBuiltinPolicies.end(), policyName,
+                                     [](const BuiltinPolicy &policy, std::string_view name) {
+                                         return policy.Name < name;
+                                     });
+    if (it == kBuiltinPolicies.end() || it->Name != policyName)
+    {
+        return nullptr;
+    }
+
+    return &*it;
+}
+
+} // namespace SandboxPolicyEngine
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "SandboxPolicy.h"
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace SandboxPolicyEngine
+{
+
+struct BuiltinPathAccessRule
+{
+    std::string_view PathPrefix;
+    PathAccessMode Mode = PathAccessMode::ReadOnly;
+};
+
+/**
+ * @brief A policy compiled into the library from the JSON files under policies/ at build time
+ * @remarks The syscall numbers are resolved by the compiler, so no JSON parsing
+ * or libseccomp name lookup is needed to use it.
+ */
+struct BuiltinPolicy
+{
+    std::string_view Name;
+    std::span<const int> AllowedSyscalls;
+    std::span<const int> FrequencyHints;
+    std::span<const BuiltinPathAccessRule> PathAccessRules;
+    // SupervisorRules, see SandboxPolicy.h
+    std::span<const BuiltinPathAccessRule> SupervisorOpenPathRules;
+    std::span<const std::string_view> SupervisorExecvePaths;
+    uint64_t SupervisorCloneFlags = 0;
+    bool SuperviseClone = false;
+    FilterLayout Layout = FilterLayout::Linear;
+    bool RestrictExecveToProgramPath = false;
+    bool AllowIO = true;
+};
+
+std::span<const BuiltinPolicy> GetBuiltinPolicies();
+
+/**
+ * @brief SHA-256 of the generated table, as a hex string
+ * @remarks Changes whenever a built-in policy or the generator changes.
+ */
+std::string_view GetBuiltinPoliciesDigest();
+
+/**
+ * @brief Find a built-in policy by its exact name
+ * @return nullptr if no policy with that name was compiled into the library
+ */
+const BuiltinPolicy *FindBuiltinPolicy(std::string_view policyName);
+
+} // namespace SandboxPolicyEngine
@@ -1,4 +1,6 @@
 #include "PolicyRegistry.h"
+#include "BuiltinPolicies.h"
+#include "../Metrics.h"
 
 #include <algorithm>
 #include <cassert>
@@ -8,6 +10,7 @@
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <sched.h>
 #include <seccomp.h>
 #include <string>
 #include <unordered_map>
@@ -26,8 +29,36 @@ const SandboxPolicy kDefaultPolicy = {
     .AllowedSyscalls = {},
     .AllowedCapabilities = {},
     .PathAccessRules = {},
+    .FrequencyHints = {},
     .RestrictExecveToProgramPath = false,
     .AllowIO = true,
+    .Supervisor = {},
+};
+
+constexpr std::pair<std::string_view, uint64_t> kCloneFlags[] = {
+    {"CLONE_VM", CLONE_VM},
+    {"CLONE_FS", CLONE_FS},
+    {"CLONE_FILES", CLONE_FILES},
+    {"CLONE_SIGHAND", CLONE_SIGHAND},
+    {"CLONE_PIDFD", CLONE_PIDFD},
+    {"CLONE_PTRACE", CLONE_PTRACE},
+    {"CLONE_VFORK", CLONE_VFORK},
+    {"CLONE_PARENT", CLONE_PARENT},
+    {"CLONE_THREAD", CLONE_THREAD},
+    {"CLONE_NEWNS", CLONE_NEWNS},
+    {"CLONE_SYSVSEM", CLONE_SYSVSEM},
+    {"CLONE_SETTLS", CLONE_SETTLS},
+    {"CLONE_PARENT_SETTID", CLONE_PARENT_SETTID},
+    {"CLONE_CHILD_CLEARTID", CLONE_CHILD_CLEARTID},
+    {"CLONE_UNTRACED", CLONE_UNTRACED},
+    {"CLONE_CHILD_SETTID", CLONE_CHILD_SETTID},
+    {"CLONE_NEWCGROUP", CLONE_NEWCGROUP},
+    {"CLONE_NEWUTS", CLONE_NEWUTS},
+    {"CLONE_NEWIPC", CLONE_NEWIPC},
+    {"CLONE_NEWUSER", CLONE_NEWUSER},
+    {"CLONE_NEWPID", CLONE_NEWPID},
+    {"CLONE_NEWNET", CLONE_NEWNET},
+    {"CLONE_IO", CLONE_IO},
 };
 
 std::mutex gPolicyCacheMutex;
@@ -61,6 +92,14 @@ std::string NormalizePolicyName(std::string_view policyName)
     return normalized;
 }
 
+// Names with a path separator or a .json extension always refer to a policy file, which is how a
+// deployment overrides a built-in policy of the same name.
+bool IsPolicyFileReference(const std::string &policyName)
+{
+    const std::filesystem::path path(policyName);
+    return path.has_parent_path() || path.extension() == ".json";
+}
+
 std::filesystem::path BuildPolicyPath(const std::string &policyName)
 {
     std::filesystem::path path(policyName);
@@ -71,6 +110,12 @@ std::filesystem::path BuildPolicyPath(const std::string &policyName)
     return path;
 }
 
+void NormalizeSyscallList(std::vector<int> &syscalls)
+{
+    std::sort(syscalls.begin(), syscalls.end());
+    syscalls.erase(std::unique(syscalls.begin(), syscalls.end()), syscalls.end());
+}
+
 std::optional<int> TryResolveSyscall(const Json &syscallNode)
 {
     if (syscallNode.is_number_integer())
@@ -105,6 +150,226 @@ std::optional<int> TryResolveSyscall(const Json &syscallNode)
     return syscallId;
 }
 
+std::optional<FilterLayout> TryParseFilterLayout(const Json &layoutNode)
+{
+    if (!layoutNode.is_string())
+    {
+        return std::nullopt;
+    }
+
+    const auto layout = TrimPolicyToken(layoutNode.get<std::string>());
+    if (layout == "Linear")
+    {
+        return FilterLayout::Linear;
+    }
+    if (layout == "BinaryTree")
+    {
+        return FilterLayout::BinaryTree;
+    }
+    if (layout == "Frequency")
+    {
+        return FilterLayout::Frequency;
+    }
+
+    return std::nullopt;
+}
+
+// Hints keep their order, only repeated entries are dropped.
+void RemoveDuplicateHints(std::vector<int> &hints)
+{
+    std::vector<int> unique;
+    for (const auto syscall : hints)
+    {
+        if (std::find(unique.begin(), unique.end(), syscall) == unique.end())
+        {
+            unique.push_back(syscall);
+        }
+    }
+    hints = std::move(unique);
+}
+
+std::optional<PathAccessMode> TryParsePathAccessMode(const Json &modeNode)
+{
+    if (!modeNode.is_string())
+    {
+        return std::nullopt;
+    }
+
+    const auto mode = TrimPolicyToken(modeNode.get<std::string>());
+    if (mode == "ReadOnly")
+    {
+        return PathAccessMode::ReadOnly;
+    }
+    if (mode == "ReadWrite")
+    {
+        return PathAccessMode::ReadWrite;
+    }
+    if (mode == "NoAccess")
+    {
+        return PathAccessMode::NoAccess;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<PathAccessRule> TryParsePathAccessRule(const Json &ruleNode)
+{
+    if (!ruleNode.is_object())
+    {
+        return std::nullopt;
+    }
+
+    const auto prefixIt = ruleNode.find("PathPrefix");
+    const auto modeIt = ruleNode.find("Mode");
+    if (prefixIt == ruleNode.end() || !prefixIt->is_string() || modeIt == ruleNode.end())
+    {
+        return std::nullopt;
+    }
+
+    // Rules are opened by the supervisor, relative prefixes would depend on its working directory.
+    const std::filesystem::path prefix(prefixIt->get<std::string>());
+    const auto mode = TryParsePathAccessMode(*modeIt);
+    if (!prefix.is_absolute() || !mode.has_value())
+    {
+        return std::nullopt;
+    }
+
+    auto normalized = prefix.lexically_normal().string();
+    if (normalized.size() > 1 && normalized.back() == '/')
+    {
+        normalized.pop_back();
+    }
+    return PathAccessRule{.PathPrefix = std::move(normalized), .Mode = *mode};
+}
+
+int GetPathAccessGrant(PathAccessMode mode)
+{
+    switch (mode)
+    {
+    case PathAccessMode::ReadWrite:
+        return 2;
+    case PathAccessMode::ReadOnly:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Whether path is prefix itself or lies below it, comparing whole components.
+bool IsPathBelowPrefix(std::string_view path, std::string_view prefix)
+{
+    if (prefix == "/")
+    {
+        return true;
+    }
+    return path.starts_with(prefix) && (path.size() == prefix.size() || path[prefix.size()] == '/');
+}
+
+// Landlock only adds up what rules grant, so a nested rule can never take back access its parent gives.
+bool ArePathAccessRulesEnforceable(const std::vector<PathAccessRule> &rules)
+{
+    for (const auto &outer : rules)
+    {
+        for (const auto &inner : rules)
+        {
+            if (&outer != &inner && IsPathBelowPrefix(inner.PathPrefix, outer.PathPrefix)
+                && GetPathAccessGrant(inner.Mode) < GetPathAccessGrant(outer.Mode))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::optional<uint64_t> TryResolveCloneFlag(const Json &flagNode)
+{
+    if (flagNode.is_number_unsigned())
+    {
+        return flagNode.get<uint64_t>();
+    }
+    if (!flagNode.is_string())
+    {
+        return std::nullopt;
+    }
+
+    const auto name = TrimPolicyToken(flagNode.get<std::string>());
+    for (const auto &[flagName, flag] : kCloneFlags)
+    {
+        if (name == flagName)
+        {
+            return flag;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<SupervisorRules> TryParseSupervisorRules(const Json &supervisorNode)
+{
+    if (!supervisorNode.is_object())
+    {
+        return std::nullopt;
+    }
+
+    SupervisorRules rules;
+    const auto openIt = supervisorNode.find("OpenPathRules");
+    if (openIt != supervisorNode.end())
+    {
+        if (!openIt->is_array())
+        {
+            return std::nullopt;
+        }
+        for (const auto &ruleNode : *openIt)
+        {
+            auto rule = TryParsePathAccessRule(ruleNode);
+            if (!rule.has_value())
+            {
+                return std::nullopt;
+            }
+            rules.OpenPathRules.push_back(std::move(*rule));
+        }
+    }
+
+    const auto execveIt = supervisorNode.find("ExecvePaths");
+    if (execveIt != supervisorNode.end())
+    {
+        if (!execveIt->is_array())
+        {
+            return std::nullopt;
+        }
+        for (const auto &pathNode : *execveIt)
+        {
+            if (!pathNode.is_string() || !std::filesystem::path(pathNode.get<std::string>()).is_absolute())
+            {
+                return std::nullopt;
+            }
+            rules.ExecvePaths.push_back(pathNode.get<std::string>());
+        }
+    }
+
+    const auto cloneIt = supervisorNode.find("CloneFlags");
+    if (cloneIt != supervisorNode.end())
+    {
+        if (!cloneIt->is_array())
+        {
+            return std::nullopt;
+        }
+        uint64_t allowedFlags = 0;
+        for (const auto &flagNode : *cloneIt)
+        {
+            const auto flag = TryResolveCloneFlag(flagNode);
+            if (!flag.has_value())
+            {
+                return std::nullopt;
+            }
+            allowedFlags |= *flag;
+        }
+        rules.AllowedCloneFlags = allowedFlags;
+    }
+
+    return rules;
+}
+
 std::optional<SandboxPolicy> LoadPolicyFromFile(const std::string &policyName)
 {
     std::ifstream input(BuildPolicyPath(policyName));
@@ -183,13 +448,125 @@ std::optional<SandboxPolicy> LoadPolicyFromFile(const std::string &policyName)
         policy.AllowedSyscalls.push_back(*syscall);
     }
 
-    std::sort(policy.AllowedSyscalls.begin(), policy.AllowedSyscalls.end());
-    policy.AllowedSyscalls.erase(std::unique(policy.AllowedSyscalls.begin(), policy.AllowedSyscalls.end()),
-                                 policy.AllowedSyscalls.end());
+    const auto hintsIt = seccompIt->find("FrequencyHints");
+    if (hintsIt != seccompIt->end())
+    {
+        if (!hintsIt->is_array())
+        {
+            return std::nullopt;
+        }
+
+        for (const auto &syscallNode : *hintsIt)
+        {
+            const auto syscall = TryResolveSyscall(syscallNode);
+            if (!syscall.has_value())
+            {
+                return std::nullopt;
+            }
+            policy.FrequencyHints.push_back(*syscall);
+        }
+    }
+
+    // Hints without an explicit layout imply the layout that uses them.
+    if (!policy.FrequencyHints.empty())
+    {
+        policy.Layout = FilterLayout::Frequency;
+    }
+
+    const auto layoutIt = seccompIt->find("FilterLayout");
+    if (layoutIt != seccompIt->end())
+    {
+        const auto layout = TryParseFilterLayout(*layoutIt);
+        if (!layout.has_value())
+        {
+            return std::nullopt;
+        }
+        policy.Layout = *layout;
+    }
 
+    const auto supervisorIt = seccompIt->find("Supervisor");
+    if (supervisorIt != seccompIt->end())
+    {
+        auto supervisor = TryParseSupervisorRules(*supervisorIt);
+        if (!supervisor.has_value())
+        {
+            return std::nullopt;
+        }
+        policy.Supervisor = std::move(*supervisor);
+    }
+
+    const auto pathRulesIt = root.find("PathAccessRules");
+    if (pathRulesIt != root.end())
+    {
+        if (!pathRulesIt->is_array())
+        {
+            return std::nullopt;
+        }
+
+        for (const auto &ruleNode : *pathRulesIt)
+        {
+            auto rule = TryParsePathAccessRule(ruleNode);
+            if (!rule.has_value())
+            {
+                return std::nullopt;
+            }
+            policy.PathAccessRules.push_back(std::move(*rule));
+        }
+
+        if (!ArePathAccessRulesEnforceable(policy.PathAccessRules))
+        {
+            return std::nullopt;
+        }
+    }
+
+    NormalizeSyscallList(policy.AllowedSyscalls);
+    RemoveDuplicateHints(policy.FrequencyHints);
     return policy;
 }
 
+SandboxPolicy MaterializeBuiltinPolicy(const BuiltinPolicy &builtin)
+{
+    SandboxPolicy policy;
+    policy.Name = std::string(builtin.Name);
+    policy.AllowedSyscalls.assign(builtin.AllowedSyscalls.begin(), builtin.AllowedSyscalls.end());
+    policy.RestrictExecveToProgramPath = builtin.RestrictExecveToProgramPath;
+    policy.AllowIO = builtin.AllowIO;
+    policy.Layout = builtin.Layout;
+    policy.FrequencyHints.assign(builtin.FrequencyHints.begin(), builtin.FrequencyHints.end());
+    for (const auto &rule : builtin.PathAccessRules)
+    {
+        policy.PathAccessRules.push_back({.PathPrefix = std::string(rule.PathPrefix), .Mode = rule.Mode});
+    }
+    for (const auto &rule : builtin.SupervisorOpenPathRules)
+    {
+        policy.Supervisor.OpenPathRules.push_back({.PathPrefix = std::string(rule.PathPrefix), .Mode = rule.Mode});
+    }
+    policy.Supervisor.ExecvePaths.assign(builtin.SupervisorExecvePaths.begin(), builtin.SupervisorExecvePaths.end());
+    if (builtin.SuperviseClone)
+    {
+        policy.Supervisor.AllowedCloneFlags = builtin.SupervisorCloneFlags;
+    }
+
+    NormalizeSyscallList(policy.AllowedSyscalls);
+    RemoveDuplicateHints(policy.FrequencyHints);
+    return policy;
+}
+
+std::optional<SandboxPolicy> LoadPolicy(const std::string &policyName)
+{
+    if (!IsPolicyFileReference(policyName))
+    {
+        if (const auto *builtin = FindBuiltinPolicy(policyName); builtin != nullptr)
+        {
+            MetricsRegistry::Instance().Increment(MetricCounter::PolicyCacheHits);
+            return MaterializeBuiltinPolicy(*builtin);
+        }
+    }
+
+    MetricsRegistry::Instance().Increment(MetricCounter::PolicyFileLoads);
+    return LoadPolicyFromFile(policyName);
+}
+
 } // namespace
 
 bool IsDefaultPolicyName(const std::string_view policyName)
@@ -212,16 +589,18 @@ const SandboxPolicy *TryResolvePolicy(const std::string_view policyName)
     const auto normalizedPolicyName = NormalizePolicyName(policyName);
     if (normalizedPolicyName == DEFAULT_POLICY_NAME)
     {
+        MetricsRegistry::Instance().Increment(MetricCounter::PolicyCacheHits);
         return &kDefaultPolicy;
     }
 
     std::lock_guard lock(gPolicyCacheMutex);
     if (const auto it = gPolicyCache.find(normalizedPolicyName); it != gPolicyCache.end())
     {
+        MetricsRegistry::Instance().Increment(MetricCounter::PolicyCacheHits);
         return it->second.get();
     }
 
-    auto loadedPolicy = LoadPolicyFromFile(normalizedPolicyName);
+    auto loadedPolicy = LoadPolicy(normalizedPolicyName);
     if (!loadedPolicy.has_value())
     {
         return nullptr;
@@ -248,10 +627,11 @@ const SandboxPolicy *TryResolvePolicyNoCache(const std::string_view policyName,
     const auto normalizedPolicyName = NormalizePolicyName(policyName);
     if (normalizedPolicyName == DEFAULT_POLICY_NAME)
     {
+        MetricsRegistry::Instance().Increment(MetricCounter::PolicyCacheHits);
         return &kDefaultPolicy;
     }
 
-    auto loadedPolicy = LoadPolicyFromFile(normalizedPolicyName);
+    auto loadedPolicy = LoadPolicy(normalizedPolicyName);
     if (!loadedPolicy.has_value())
     {
         return nullptr;
@@ -288,4 +668,20 @@ bool IsKnownPolicy(const char *policyName)
     return TryResolvePolicy(policyName) != nullptr;
 }
 
+std::optional<std::filesystem::path> FindPolicyFile(const std::string_view policyName)
+{
+    const auto normalizedPolicyName = NormalizePolicyName(policyName);
+    if (normalizedPolicyName == DEFAULT_POLICY_NAME)
+    {
+        return std::nullopt;
+    }
+
+    if (!IsPolicyFileReference(normalizedPolicyName) && FindBuiltinPolicy(normalizedPolicyName) != nullptr)
+    {
+        return std::nullopt;
+    }
+
+    return BuildPolicyPath(normalizedPolicyName);
+}
+
 } // namespace SandboxPolicyEngine
@@ -2,6 +2,8 @@
 
 #include "SandboxPolicy.h"
 
+#include <filesystem>
+#include <optional>
 #include <string_view>
 
 namespace SandboxPolicyEngine
@@ -19,4 +21,10 @@ const SandboxPolicy &ResolvePolicy(std::string_view policyName);
 bool IsKnownPolicy(std::string_view policyName);
 bool IsKnownPolicy(const char *policyName);
 
+/**
+ * @brief The JSON file a policy name is loaded from, by the same rules as TryResolvePolicy
+ * @return std::nullopt if the name resolves to the default or a built-in policy
+ */
+std::optional<std::filesystem::path> FindPolicyFile(std::string_view policyName);
+
 } // namespace SandboxPolicyEngine
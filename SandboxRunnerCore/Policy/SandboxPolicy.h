@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -13,22 +15,63 @@ enum class PathAccessMode
     NoAccess,
 };
 
+/**
+ * @brief How the seccomp filter orders its syscall checks
+ */
+enum class FilterLayout
+{
+    // libseccomp default: one comparison per allowed syscall, in the order libseccomp picks.
+    Linear,
+    // Binary search over syscall numbers (SCMP_FLTATR_CTL_OPTIMIZE = 2), O(log n) per syscall.
+    BinaryTree,
+    // Linear chain with FrequencyHints checked first, for programs dominated by a few syscalls.
+    Frequency,
+};
+
 struct PathAccessRule
 {
     std::string PathPrefix;
     PathAccessMode Mode = PathAccessMode::ReadOnly;
 };
 
+/**
+ * @brief Syscalls the supervisor decides from their arguments, through seccomp user notifications
+ * @remarks Each part is off while empty. A supervised syscall is allowed whenever its check passes,
+ * whether the WhiteList has it or not. Everything else stays in the BPF filter.
+ */
+struct SupervisorRules
+{
+    // open and openat: the longest matching prefix decides, a path no rule covers is denied.
+    std::vector<PathAccessRule> OpenPathRules;
+    // execve: only these files and the program itself, compared by device and inode. vfork, and clone sharing
+    // memory without being a thread, are denied.
+    std::vector<std::string> ExecvePaths;
+    // clone: the flags a call may use besides the exit signal.
+    std::optional<uint64_t> AllowedCloneFlags;
+
+    bool IsEmpty() const
+    {
+        return OpenPathRules.empty() && ExecvePaths.empty() && !AllowedCloneFlags.has_value();
+    }
+};
+
 struct SandboxPolicy
 {
     std::string Name;
 
     std::vector<int> AllowedSyscalls;
     std::vector<std::string> AllowedCapabilities;
+    // Enforced with Landlock: once a policy has rules, whatever they do not grant is denied.
     std::vector<PathAccessRule> PathAccessRules;
 
+    FilterLayout Layout = FilterLayout::Linear;
+    // Hot syscalls, most frequent first. Only used by FilterLayout::Frequency.
+    std::vector<int> FrequencyHints;
+
     bool RestrictExecveToProgramPath = false;
     bool AllowIO = false;
+
+    SupervisorRules Supervisor;
 };
 
 } // namespace SandboxPolicyEngine
@@ -0,0 +1,63 @@
+#include "RunStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+SandboxRunStatistics ComputeRunStatistics(std::vector<double> values)
+{
+    SandboxRunStatistics statistics{};
+    if (values.empty())
+        return statistics;
+
+    std::sort(values.begin(), values.end());
+    const size_t count = values.size();
+    statistics.Min     = values.front();
+    statistics.Max     = values.back();
+    statistics.Median  = count % 2 == 1 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+    statistics.P95     = values[static_cast<size_t>(std::ceil(0.95 * static_cast<double>(count))) - 1];
+
+    double sum = 0;
+    for (const double value : values)
+        sum += value;
+    statistics.Mean = sum / static_cast<double>(count);
+
+    if (count > 1)
+    {
+        double squares = 0;
+        for (const double value : values)
+            squares += (value - statistics.Mean) * (value - statistics.Mean);
+        statistics.StdDev = std::sqrt(squares / static_cast<double>(count - 1));
+    }
+    return statistics;
+}
+
+void SummarizeRepeatedRuns(const std::vector<SandboxResultEx> &runs, SandboxRepeatResult &result)
+{
+    std::vector<double> cpuTimes;
+    std::vector<double> realTimes;
+    std::vector<double> memoryUsages;
+    std::map<int, uint32_t> statusCounts;
+    for (const auto &run : runs)
+    {
+        cpuTimes.push_back(static_cast<double>(run.UserTimeUs));
+        // RealTimeUsage is in ms, the timeline gives the same span at full resolution.
+        const uint64_t runStart = run.Timeline.ExecStart != 0 ? run.Timeline.ExecStart : run.Timeline.ForkDone;
+        realTimes.push_back(static_cast<double>(run.Timeline.Exit - runStart) / 1000.0);
+        memoryUsages.push_back(static_cast<double>(run.Result.MemoryUsage));
+        ++statusCounts[run.Result.Status];
+    }
+
+    result.RunCount = static_cast<uint32_t>(runs.size());
+    for (const auto &[status, count] : statusCounts)
+    {
+        if (count > result.StatusAgreement)
+        {
+            result.Status          = status;
+            result.StatusAgreement = count;
+        }
+    }
+    result.CpuTimeUs   = ComputeRunStatistics(std::move(cpuTimes));
+    result.RealTimeUs  = ComputeRunStatistics(std::move(realTimes));
+    result.MemoryUsage = ComputeRunStatistics(std::move(memoryUsages));
+}
@@ -0,0 +1,19 @@
+#ifndef SANDBOX_RUN_STATISTICS_H
+#define SANDBOX_RUN_STATISTICS_H
+
+#include "Sandbox.h"
+
+#include <vector>
+
+/**
+ * @brief Summarize the values of one measurement over several runs
+ * @return All zero for an empty input
+ */
+SandboxRunStatistics ComputeRunStatistics(std::vector<double> values);
+
+/**
+ * @brief Aggregate the results of repeated runs of one configuration
+ */
+void SummarizeRepeatedRuns(const std::vector<SandboxResultEx> &runs, SandboxRepeatResult &result);
+
+#endif //! SANDBOX_RUN_STATISTICS_H
@@ -1,12 +1,56 @@
 #include "Linux/SandboxImpl.h"
+#include "Linux/ActivityBoard.h"
+#include "Linux/ExecutableCache.h"
+#include "Linux/MemoryAdmission.h"
+#include "Linux/NamespacePool.h"
+#include "Linux/SubmissionRing.h"
+#include "Linux/TimingCalibration.h"
+#include "Metrics.h"
 #include "Policy/ResourceConfig.h"
+#include "RunStatistics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t MIN_RESULT_EX_SIZE = offsetof(SandboxResultEx, Result) + sizeof(SandboxResult);
+constexpr size_t MIN_REPEAT_RESULT_SIZE = offsetof(SandboxRepeatResult, Version) + sizeof(uint32_t);
+constexpr size_t MIN_METRICS_SIZE = offsetof(SandboxMetrics, Version) + sizeof(uint32_t);
+
+} // namespace
+
+struct SandboxRing
+{
+    std::unique_ptr<SubmissionRing> Ring;
+};
 
 Sandbox::CreateSandboxResult Sandbox::Create(const SandboxConfiguration *config, SandboxResult &result)
 {
     auto sandbox = std::make_unique<Sandbox>();
     if (IsSandboxConfigurationVaild(config) == false)
         return {SANDBOX_STATUS_INTERNAL_ERROR, nullptr};
-    sandbox->_impl = std::make_unique<SandboxImpl>(config, result);
+    sandbox->_impl = std::make_unique<SandboxImpl>(config, nullptr, &result, nullptr);
+    if (sandbox->_impl == nullptr)
+        return {SANDBOX_STATUS_INTERNAL_ERROR, nullptr};
+    return {SANDBOX_STATUS_SUCCESS, std::move(sandbox)};
+}
+
+Sandbox::CreateSandboxResult Sandbox::Create(const SandboxConfiguration *config,
+                                             const SandboxConfigurationEx *extension,
+                                             SandboxResultEx &result)
+{
+    auto sandbox = std::make_unique<Sandbox>();
+    if (IsSandboxConfigurationVaild(config) == false)
+        return {SANDBOX_STATUS_INTERNAL_ERROR, nullptr};
+    sandbox->_impl = std::make_unique<SandboxImpl>(config, extension, nullptr, &result);
     if (sandbox->_impl == nullptr)
         return {SANDBOX_STATUS_INTERNAL_ERROR, nullptr};
     return {SANDBOX_STATUS_SUCCESS, std::move(sandbox)};
@@ -25,6 +69,206 @@ int StartSandbox(const SandboxConfiguration *config, SandboxResult *result)
     return sandbox->Run();
 }
 
+int StartSandboxEx(const SandboxConfiguration *config,
+                   const SandboxConfigurationEx *extension,
+                   SandboxResultEx *result)
+{
+    if (result == nullptr || result->StructSize < MIN_RESULT_EX_SIZE)
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+
+    // Run against a full-size result and copy back only what the caller's struct can hold.
+    SandboxResultEx fullResult{};
+    auto [status, sandbox] = Sandbox::Create(config, extension, fullResult);
+    if (status == SANDBOX_STATUS_SUCCESS)
+        status = sandbox->Run();
+
+    const size_t callerSize = result->StructSize;
+    fullResult.StructSize   = static_cast<uint32_t>(std::min(callerSize, sizeof(SandboxResultEx)));
+    memcpy(result, &fullResult, fullResult.StructSize);
+    return status;
+}
+
+int StartSandboxRepeated(const SandboxConfiguration *config,
+                         const SandboxConfigurationEx *extension,
+                         uint32_t repeatCount,
+                         uint32_t parallelRuns,
+                         SandboxRepeatResult *result)
+{
+    if (result == nullptr || result->StructSize < MIN_REPEAT_RESULT_SIZE || repeatCount == 0)
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+
+    SandboxRepeatResult fullResult{};
+    fullResult.StructSize = sizeof(SandboxRepeatResult);
+    fullResult.Version    = SANDBOX_REPEAT_RESULT_VERSION;
+
+    // Validating once also leaves the resolved policy in the cache, which every forked child inherits.
+    int status = IsSandboxConfigurationVaild(config) ? SANDBOX_STATUS_SUCCESS : SANDBOX_STATUS_INTERNAL_ERROR;
+
+    SandboxConfigurationEx runExtension{};
+    if (extension != nullptr)
+        memcpy(&runExtension, extension, std::min<size_t>(extension->StructSize, sizeof(SandboxConfigurationEx)));
+    runExtension.StructSize      = sizeof(SandboxConfigurationEx);
+    runExtension.ResultCacheFile = nullptr; // Every run is measured, none is replayed
+    parallelRuns                 = std::clamp(parallelRuns, 1U, repeatCount);
+    if (parallelRuns > 1)
+    {
+        runExtension.PinToCore      = 1;
+        runExtension.Samples        = nullptr;
+        runExtension.SampleCapacity = 0;
+    }
+
+    std::vector<SandboxResultEx> runs;
+    runs.reserve(repeatCount);
+    std::mutex runsMutex;
+    std::atomic<uint32_t> nextRun{0};
+    const auto runWorker = [&] {
+        while (nextRun.fetch_add(1) < repeatCount)
+        {
+            SandboxResultEx run{};
+            const int runStatus = SandboxImpl(config, &runExtension, nullptr, &run).Run();
+
+            std::lock_guard lock(runsMutex);
+            if (runStatus != SANDBOX_STATUS_SUCCESS)
+            {
+                // Stop handing out runs, the others finish what they started.
+                nextRun = repeatCount;
+                if (status == SANDBOX_STATUS_SUCCESS)
+                    status = runStatus;
+                continue;
+            }
+            runs.push_back(run);
+        }
+    };
+
+    if (status == SANDBOX_STATUS_SUCCESS)
+    {
+        std::vector<std::thread> workers;
+        try
+        {
+            for (uint32_t i = 1; i < parallelRuns; ++i)
+                workers.emplace_back(runWorker);
+        }
+        catch (const std::system_error &)
+        {
+            // Fewer runs at once, the remaining workers still make all of them.
+        }
+        runWorker();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    SummarizeRepeatedRuns(runs, fullResult);
+    const size_t callerSize = result->StructSize;
+    fullResult.StructSize   = static_cast<uint32_t>(std::min(callerSize, sizeof(SandboxRepeatResult)));
+    memcpy(result, &fullResult, fullResult.StructSize);
+    return status;
+}
+
+int CalibrateSandboxTiming(double *speedFactor, double *timingNoise)
+{
+    const auto calibration = TimingCalibrator::Instance().Calibrate();
+    if (speedFactor != nullptr)
+        *speedFactor = calibration.SpeedFactor;
+    if (timingNoise != nullptr)
+        *timingNoise = calibration.Noise;
+    return SANDBOX_STATUS_SUCCESS;
+}
+
+int SetSandboxExecutableCacheBudget(uint64_t bytes)
+{
+    ExecutableCache::Instance().SetBudget(bytes);
+    return SANDBOX_STATUS_SUCCESS;
+}
+
+int SetSandboxNamespacePoolSize(uint32_t count)
+{
+    NamespacePool::Instance().SetSize(count);
+    return SANDBOX_STATUS_SUCCESS;
+}
+
+int SetSandboxMemoryBudget(uint64_t bytes)
+{
+    MemoryAdmission::Instance().SetBudget(bytes);
+    return SANDBOX_STATUS_SUCCESS;
+}
+
+SandboxRing *OpenSandboxRing(const char *name)
+{
+    if (name == nullptr)
+        return nullptr;
+    auto ring = SubmissionRing::Open(name);
+    if (ring == nullptr)
+        return nullptr;
+    return new SandboxRing{std::move(ring)};
+}
+
+void CloseSandboxRing(SandboxRing *ring)
+{
+    delete ring;
+}
+
+int RegisterSandboxRingConfig(SandboxRing *ring, uint32_t id, const char *arguments)
+{
+    if (ring == nullptr || arguments == nullptr || !ring->Ring->RegisterConfig(id, arguments))
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+    return SANDBOX_STATUS_SUCCESS;
+}
+
+int RegisterSandboxRingFile(SandboxRing *ring, uint32_t id, const char *path)
+{
+    if (ring == nullptr || path == nullptr || !ring->Ring->RegisterFile(id, path))
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+    return SANDBOX_STATUS_SUCCESS;
+}
+
+uint32_t SubmitSandboxRing(SandboxRing *ring, const SandboxRingSubmission *entries, uint32_t count)
+{
+    if (ring == nullptr || entries == nullptr)
+        return 0;
+    return ring->Ring->Submit(entries, count);
+}
+
+uint32_t ReapSandboxRing(SandboxRing *ring, SandboxRingCompletion *entries, uint32_t capacity, uint32_t timeoutMs)
+{
+    if (ring == nullptr || entries == nullptr)
+        return 0;
+    return ring->Ring->Reap(entries, capacity, std::chrono::milliseconds(timeoutMs));
+}
+
+int GetSandboxMetrics(SandboxMetrics *metrics)
+{
+    if (metrics == nullptr || metrics->StructSize < MIN_METRICS_SIZE)
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+    MetricsRegistry::Instance().Snapshot(*metrics);
+    return SANDBOX_STATUS_SUCCESS;
+}
+
+int WriteSandboxMetrics(const char *path)
+{
+    if (path == nullptr || !MetricsRegistry::Instance().WritePrometheus(path))
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+    return SANDBOX_STATUS_SUCCESS;
+}
+
+int PublishSandboxActivity(const char *name)
+{
+    if (!ActivityBoard::Publish(name != nullptr ? name : ""))
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+    return SANDBOX_STATUS_SUCCESS;
+}
+
+int ReadSandboxActivity(const char *name, SandboxActivity *entries, uint32_t capacity, uint32_t *count)
+{
+    if (name == nullptr || (entries == nullptr && capacity != 0) || count == nullptr)
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+    const auto activities = ActivityBoard::Read(name);
+    if (!activities.has_value())
+        return SANDBOX_STATUS_INTERNAL_ERROR;
+    *count = static_cast<uint32_t>(std::min<size_t>(activities->size(), capacity));
+    std::copy_n(activities->begin(), *count, entries);
+    return SANDBOX_STATUS_SUCCESS;
+}
+
 bool IsSandboxConfigurationVaild(const SandboxConfiguration *config)
 {
     return SandboxPolicyEngine::ValidateSandboxConfiguration(config).IsValid;
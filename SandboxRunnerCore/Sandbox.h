@@ -6,8 +6,8 @@
 #include <cstdint>
 #include <memory>
 
-// 1.3.2
-constexpr int SANDBOX_VERSION = 0x010302;
+// 1.4.0
+constexpr int SANDBOX_VERSION = 0x010400;
 
 #define MAJOR_VERSION(v) ((v >> 16) & 0xFF)
 #define MINOR_VERSION(v) ((v >> 8) & 0xFF)
@@ -57,7 +57,7 @@ extern "C"
         uint64_t MaxCpuTime;    // The limit of CPU time, ms, 0 means no limit.
         uint64_t MaxRealTime;   // The limit of real time, ms, 0 means no limit.
         uint64_t MaxOutputSize; // The limit of output size, byte, 0 means no limit.
-        int MaxProcessCount; // The limit of child process count, -1 means no limit.
+        int MaxProcessCount; // The limit of live child processes, -1 means no limit.
         const char *Policy;  // The policy name. "default" is reserved for built-in unrestricted mode.
     };
 
@@ -67,10 +67,419 @@ extern "C"
         int ExitCode;           // The exit code of the sandboxed process
         int Signal;             // The signal of the sandboxed process, if it is terminated by signal
         uint64_t CpuTimeUsage;  // The CPU time of the sandboxed process, ms
-        uint64_t RealTimeUsage; // The real time of the sandboxed process, ms
+        uint64_t RealTimeUsage; // The real time of the sandboxed process from execve to exit, ms
         uint64_t MemoryUsage;   // The memory usage of the sandboxed process, byte
     };
 
+    /**
+     * @brief One point of the live resource time series, see SandboxConfigurationEx::SampleIntervalMs
+     */
+    struct SandboxSample
+    {
+        uint64_t Time;           // CLOCK_MONOTONIC ns, comparable with SandboxTimeline
+        uint64_t ResidentMemory; // Resident set size of the program, byte
+        uint64_t CpuTimeUs;      // User + system CPU time of the program so far, us
+    };
+
+    /**
+     * @brief Receives every sample as it is taken
+     * @remarks Called from the library's sampler thread, which is shared by all running sandboxes.
+     * Keep it short and do not start a sandbox from it.
+     */
+    typedef void (*SandboxSampleCallback)(const SandboxSample *sample, void *userData);
+
+    /**
+     * @brief Optional settings for StartSandboxEx, extending SandboxConfiguration without changing its layout
+     * @remarks The caller sets StructSize to sizeof(SandboxConfigurationEx) and Version to
+     * SANDBOX_CONFIGURATION_EX_VERSION. New fields are only ever appended; fields beyond the
+     * StructSize declared by the caller are treated as zero.
+     */
+    struct SandboxConfigurationEx
+    {
+        uint32_t StructSize;
+        uint32_t Version;
+
+        /**
+         * @brief Profiling mode, NULL disables it
+         *
+         * Instead of enforcing Policy, every syscall made by the sandboxed program is reported to the
+         * supervisor and allowed. When the program exits, a policy JSON whitelisting exactly the
+         * observed syscalls, ordered by frequency, is written to this path.
+         */
+        const char *ProfileOutputFile;
+
+        const char *TraceFile; // Write the phase timeline as a Chrome trace-event JSON file, NULL disables it
+
+        /**
+         * @brief Live resource sampling, 0 disables it (since version 3)
+         *
+         * While the program runs, its resident memory and CPU time are sampled every SampleIntervalMs
+         * and passed to SampleCallback. Up to SampleCapacity samples are also kept in Samples; when the
+         * buffer is full, every other sample is dropped and the spacing doubles, so the buffer always
+         * covers the whole run. SandboxResultEx reports how many were kept.
+         */
+        uint32_t SampleIntervalMs;
+        uint32_t SampleCapacity;              // Entries available in Samples
+        SandboxSample *Samples;               // Caller-owned buffer, may be NULL
+        SandboxSampleCallback SampleCallback; // May be NULL
+        void *SampleUserData;                 // Passed to SampleCallback
+
+        /**
+         * @brief Kill the program once it has used no CPU time for this long, ms. 0 disables it (since version 4)
+         *
+         * Ends programs that block forever, e.g. waiting for input that never comes, before MaxRealTime.
+         * Sleeping counts as idle too. Unless MaxProcessCount is 0, the CPU time of the program's descendants
+         * counts as well, so a parent waiting for a busy child is not idle.
+         */
+        uint64_t MaxIdleTime;
+
+        /**
+         * @brief 1 runs the program on a physical core of its own, 0 leaves placement to the kernel (since version 5)
+         *
+         * No other pinned sandbox of this process shares the core or its SMT siblings. When every core
+         * is taken, the run waits for one to be freed before it starts; the wait is not real time.
+         */
+        uint32_t PinToCore;
+
+        /**
+         * @brief Relate CPU time to this node's speed, see SandboxTimingCalibrationMode (since version 6)
+         *
+         * The node is calibrated with a fixed CPU-bound reference workload on first use and again once
+         * the calibration is a minute old. SandboxResultEx then reports the speed factor, the noise, the
+         * CPU time normalized to the reference node and how far the verdict can be trusted.
+         */
+        uint32_t TimingCalibration;
+        uint32_t MaxNearLimitReruns; // Re-run up to this many times while the confidence is LOW, 0 disables it
+
+        /**
+         * @brief Index file of the result cache, NULL disables it (since version 7)
+         *
+         * Runs are keyed by the SHA-256 of the program binary, the input file, the command line, the
+         * environment, every limit and the policy. When the same key was run before, the stored verdict,
+         * counters and output are replayed instead of starting the program. Output files are kept next
+         * to the index in "<ResultCacheFile>.blobs". Only runs whose OutputFile is a regular file are
+         * cached, and real-time or idle verdicts and low-confidence timings are never stored.
+         */
+        const char *ResultCacheFile;
+        uint32_t ResultCacheMode; // See SandboxResultCacheMode
+
+        /**
+         * @brief 1 executes the program from an in-memory copy, 0 executes it from its path (since version 8)
+         *
+         * The binary is read once into a sealed memfd, keyed by the SHA-256 of its content, and every later
+         * run of the same content is started with fexecve() without reading it again. The copies are shared
+         * by all sandboxes of this process and the least recently used are dropped beyond the budget set
+         * with SetSandboxExecutableCacheBudget. Scripts starting with "#!" always run from their path.
+         */
+        uint32_t CacheExecutable;
+
+        /**
+         * @brief Namespaces to isolate the program in, SandboxNamespaceFlags ORed together (since version 9)
+         *
+         * 0 shares the supervisor's. Sets of namespaces are created ahead of time by a background thread
+         * and kept warm (see SetSandboxNamespacePoolSize), so a run only joins them. A PID namespace needs a
+         * supervisor with CAP_SYS_ADMIN; without it, the others need SANDBOX_NAMESPACE_USER as well.
+         */
+        uint32_t Namespaces;
+
+        /**
+         * @brief Size limit in bytes of a tmpfs mounted over the working directory for the run (since version 10)
+         *
+         * 0 disables it. The program starts in an empty directory that only holds the program, the arguments
+         * naming files and the input file from the real one, bind-mounted read-only, and whatever it writes
+         * there is gone with the run. The redirected files are opened in the real directory. Needs a
+         * supervisor with CAP_SYS_ADMIN or SANDBOX_NAMESPACE_USER.
+         */
+        uint64_t ScratchSize;
+
+        /**
+         * @brief Scheduling class of the run, a SandboxPriority (since version 11)
+         *
+         * Lower classes wait behind higher ones for a core with PinToCore, and are overtaken by runs of a
+         * higher class that arrive while they wait. The program runs at a higher nice value, or under
+         * SCHED_IDLE, so it only takes CPU time that runs of higher classes leave. Unknown values count as
+         * SANDBOX_PRIORITY_IDLE.
+         */
+        uint32_t Priority;
+    };
+
+    /**
+     * @brief CLOCK_MONOTONIC timestamps of the phases of one run, ns. 0 means the phase was not reached.
+     */
+    struct SandboxTimeline
+    {
+        uint64_t PrepareStart;    // The run started, the configuration is being prepared
+        uint64_t ForkStart;       // The supervisor calls fork()
+        uint64_t ForkDone;        // fork() returned in the supervisor
+        uint64_t ChildSetupStart; // The child starts applying limits, redirections and the policy
+        uint64_t ExecStart;       // The child calls execve(), RealTimeUsage counts from here
+        uint64_t ExecDone;        // The supervisor saw execve() succeed (exec handshake)
+        uint64_t Exit;            // The program exited or was killed
+        uint64_t Reaped;          // The supervisor collected the exit status and resource usage
+    };
+
+    /**
+     * @brief Result of StartSandboxEx, extending SandboxResult without changing its layout
+     * @remarks The caller sets StructSize to sizeof(SandboxResultEx). The library never writes beyond
+     * StructSize, and sets Version to the SANDBOX_RESULT_EX_VERSION it was built with.
+     */
+    struct SandboxResultEx
+    {
+        uint32_t StructSize;
+        uint32_t Version;
+        SandboxResult Result;
+
+        uint64_t ProfiledSyscallCount;         // Syscalls observed in profiling mode
+        uint32_t ProfiledDistinctSyscallCount; // Distinct syscalls observed in profiling mode
+
+        SandboxTimeline Timeline; // Since version 2
+
+        // Since version 3: resource counters of the program, from wait4() and /proc/<pid>/io
+        uint64_t UserTimeUs;                 // User CPU time, us
+        uint64_t SystemTimeUs;               // System CPU time, us
+        uint64_t MinorPageFaults;            // Page faults served without I/O
+        uint64_t MajorPageFaults;            // Page faults that required I/O
+        uint64_t VoluntaryContextSwitches;   // The program blocked, e.g. waiting for I/O
+        uint64_t InvoluntaryContextSwitches; // The program was preempted
+        uint64_t BlockInputOperations;       // Filesystem block reads
+        uint64_t BlockOutputOperations;      // Filesystem block writes
+        uint64_t ReadBytes;                  // Bytes passed to read()-like syscalls, including pipes and cache hits
+        uint64_t WriteBytes;                 // Bytes passed to write()-like syscalls
+        uint64_t StorageReadBytes;           // Bytes actually fetched from storage
+        uint64_t StorageWriteBytes;          // Bytes actually sent to storage
+        uint64_t PeakMemoryUsage;            // Peak memory, byte, see PeakMemorySource
+        uint32_t PeakMemorySource;           // Where PeakMemoryUsage comes from, see SandboxPeakMemorySource
+        uint32_t HasIoCounters;              // 1 if the four *Bytes counters were read, 0 if unavailable
+
+        // Since version 4
+        uint32_t SampleCount;  // Samples written to SandboxConfigurationEx::Samples
+        uint32_t SampleStride; // The kept samples are SampleStride * SampleIntervalMs apart
+
+        uint32_t TerminationReason; // Why the supervisor killed the program, see SandboxTerminationReason (since version 5)
+        int32_t CpuCore;            // Logical CPU the program was pinned to, -1 if not pinned (since version 6)
+
+        // Since version 7, with SandboxConfigurationEx::TimingCalibration
+        double SpeedFactor;           // Speed of this node relative to the reference node, 0 if not calibrated
+        double TimingNoise;           // Relative run-to-run variation of CPU time on this node
+        uint64_t NormalizedCpuTimeUs; // UserTimeUs scaled to the reference node
+        uint32_t TimingConfidence;    // See SandboxTimingConfidence
+        uint32_t RunCount;            // Runs behind this result, above 1 after near-limit reruns
+
+        uint32_t FromResultCache; // 1 if the result was replayed from the result cache (since version 8)
+
+        uint32_t FromExecutableCache; // 1 if the program was executed from the executable cache (since version 9)
+
+        // Syscalls answered by the seccomp supervisor and how many it refused (since version 10)
+        uint32_t SupervisedSyscallDenials;
+        uint64_t SupervisedSyscallCount;
+        uint64_t SupervisorTimeNs;    // Total time from the supervisor waking up for a notification to answering it
+        uint64_t SupervisorMaxTimeNs; // Longest of those
+
+        uint32_t FromNamespacePool; // 1 if the namespaces were taken warm from the pool (since version 11)
+
+        // Since version 12, see SetSandboxMemoryBudget
+        uint32_t MemoryQueueDepth;      // Runs already waiting for memory when this one arrived
+        uint64_t MemoryAdmissionWaitNs; // Time spent waiting for the memory budget before the fork
+    };
+
+    enum SandboxResultCacheMode
+    {
+        SANDBOX_RESULT_CACHE_USE = 0, // Replay a cached result if there is one, otherwise run and store it
+        SANDBOX_RESULT_CACHE_REFRESH, // Always run, and overwrite the cached result
+    };
+
+    enum SandboxTimingCalibrationMode
+    {
+        SANDBOX_TIMING_CALIBRATION_OFF = 0,
+        SANDBOX_TIMING_CALIBRATION_REPORT,          // Report the calibration, limits stay as configured
+        SANDBOX_TIMING_CALIBRATION_SCALE_CPU_LIMIT, // Also divide MaxCpuTime by the speed factor
+    };
+
+    enum SandboxTimingConfidence
+    {
+        SANDBOX_TIMING_CONFIDENCE_UNKNOWN = 0, // Not calibrated
+        SANDBOX_TIMING_CONFIDENCE_HIGH,        // The CPU time is clear of MaxCpuTime, or the reruns agreed
+        SANDBOX_TIMING_CONFIDENCE_LOW,         // Noise could have put the CPU time on the other side of MaxCpuTime
+    };
+
+    enum SandboxTerminationReason
+    {
+        SANDBOX_TERMINATION_NONE = 0,        // The supervisor did not kill the program
+        SANDBOX_TERMINATION_REAL_TIME_LIMIT, // MaxRealTime passed
+        SANDBOX_TERMINATION_MEMORY_LIMIT,    // The resident memory passed MaxMemory while the program ran
+        SANDBOX_TERMINATION_IDLE_LIMIT,      // The program used no CPU time for MaxIdleTime
+        SANDBOX_TERMINATION_PROCESS_LIMIT,   // The program tried to run more than MaxProcessCount processes
+        SANDBOX_TERMINATION_OUTPUT_LIMIT,    // The program wrote more than MaxOutputSize bytes to a pipe or device
+    };
+
+    enum SandboxNamespaceFlags
+    {
+        SANDBOX_NAMESPACE_USER  = 1 << 0, // Own user namespace, the caller's user and group are root inside
+        SANDBOX_NAMESPACE_MOUNT = 1 << 1, // Own mount namespace, nothing mounted inside reaches the host
+        SANDBOX_NAMESPACE_PID   = 1 << 2, // Own PID namespace, with MOUNT /proc only lists the program's processes
+        SANDBOX_NAMESPACE_NET   = 1 << 3, // Own network namespace with only a loopback interface
+        SANDBOX_NAMESPACE_IPC   = 1 << 4, // Own System V and POSIX message queue IPC objects
+    };
+
+    enum SandboxPriority
+    {
+        SANDBOX_PRIORITY_NORMAL = 0, // Latency-sensitive runs, such as live submissions
+        SANDBOX_PRIORITY_LOW,        // Background work such as rejudges, at 10 nice levels below the supervisor
+        SANDBOX_PRIORITY_IDLE,       // SCHED_IDLE, only runs on otherwise idle CPUs
+    };
+
+    enum SandboxPeakMemorySource
+    {
+        SANDBOX_PEAK_MEMORY_SOURCE_NONE = 0,
+        SANDBOX_PEAK_MEMORY_SOURCE_RUSAGE, // ru_maxrss: peak RSS of the program or its largest waited child
+    };
+
+    /**
+     * @brief Distribution of one measurement over the runs of StartSandboxRepeated
+     */
+    struct SandboxRunStatistics
+    {
+        double Min;
+        double Median;
+        double P95; // Nearest-rank 95th percentile
+        double Max;
+        double Mean;
+        double StdDev; // Sample standard deviation, 0 for a single run
+    };
+
+    /**
+     * @brief Result of StartSandboxRepeated
+     * @remarks The caller sets StructSize to sizeof(SandboxRepeatResult), like SandboxResultEx.
+     */
+    struct SandboxRepeatResult
+    {
+        uint32_t StructSize;
+        uint32_t Version;
+
+        uint32_t RunCount;        // Runs that completed
+        int Status;               // The most frequent SandboxStatus of the runs
+        uint32_t StatusAgreement; // Runs that reached Status
+
+        SandboxRunStatistics CpuTimeUs;   // User CPU time, us
+        SandboxRunStatistics RealTimeUs;  // Real time from execve to exit, us
+        SandboxRunStatistics MemoryUsage; // Peak memory, byte
+    };
+
+    constexpr uint32_t SANDBOX_RING_CONFIG_SLOTS = 256;  // Ids accepted by RegisterSandboxRingConfig
+    constexpr uint32_t SANDBOX_RING_FILE_SLOTS   = 1024; // Ids accepted by RegisterSandboxRingFile
+    constexpr uint32_t SANDBOX_RING_NO_FILE      = 0xFFFFFFFF;
+
+    /**
+     * @brief A run queued on a shared-memory ring, see OpenSandboxRing
+     */
+    struct SandboxRingSubmission
+    {
+        uint64_t UserData; // Returned as is in the completion
+        uint32_t ConfigId; // The arguments of the run, see RegisterSandboxRingConfig
+        uint32_t InputId;  // Replaces the InputFile of the configuration, SANDBOX_RING_NO_FILE keeps it
+        uint32_t OutputId; // Replaces the OutputFile of the configuration, SANDBOX_RING_NO_FILE keeps it
+        uint32_t Reserved;
+    };
+
+    /**
+     * @brief A finished run of a shared-memory ring
+     */
+    struct SandboxRingCompletion
+    {
+        uint64_t UserData;
+        int InfraStatus; // SANDBOX_STATUS_SUCCESS, or SANDBOX_STATUS_INTERNAL_ERROR if the run could not start
+        uint32_t Reserved;
+        SandboxResult Result;
+    };
+
+    /**
+     * @brief A shared-memory ring opened by OpenSandboxRing
+     */
+    struct SandboxRing;
+
+    constexpr uint32_t SANDBOX_METRICS_VERDICT_COUNT     = 9; // The SandboxStatus values, SANDBOX_STATUS_INTERNAL_ERROR last
+    constexpr uint32_t SANDBOX_METRICS_TERMINATION_COUNT = 6; // The SandboxTerminationReason values
+
+    /**
+     * @brief Distribution of a duration over the runs of the process
+     * @remarks The percentiles come from a log-linear histogram and are at most 1/16 above the true value.
+     */
+    struct SandboxLatencySummary
+    {
+        uint64_t Count;
+        uint64_t SumNs;
+        uint64_t P50Ns;
+        uint64_t P90Ns;
+        uint64_t P99Ns;
+        uint64_t P999Ns;
+        uint64_t MaxNs;
+    };
+
+    /**
+     * @brief Counters of every run the process made, see GetSandboxMetrics
+     * @remarks The caller sets StructSize to sizeof(SandboxMetrics), like SandboxResultEx.
+     */
+    struct SandboxMetrics
+    {
+        uint32_t StructSize;
+        uint32_t Version;
+
+        uint64_t Launches;     // Programs forked, each calibration re-run included
+        uint64_t ForkFailures; // Forks that failed, the run ended with SANDBOX_STATUS_INTERNAL_ERROR
+        uint64_t Verdicts[SANDBOX_METRICS_VERDICT_COUNT];         // Results returned, by SandboxStatus
+        uint64_t MonitorKills[SANDBOX_METRICS_TERMINATION_COUNT]; // Programs the supervisor killed, by reason
+        uint64_t PolicyCacheHits;     // Policies resolved without reading a JSON file
+        uint64_t PolicyFileLoads;     // Policies read from a JSON file
+        uint64_t ResultCacheHits;     // Results replayed from the result cache
+        uint64_t ExecutableCacheHits; // Programs executed from the executable cache
+        uint64_t NamespacePoolHits;   // Runs that joined a warm set of namespaces
+
+        int64_t ActiveRuns;       // Programs forked and not reaped yet
+        int64_t MemoryQueueDepth; // Runs waiting for the memory budget
+        int64_t CoreQueueDepth;   // Runs waiting for a core to pin to
+
+        SandboxLatencySummary LaunchLatency; // From the start of a run until the program's execve succeeded
+        SandboxLatencySummary RunTime;       // From the start of a run until the program was reaped
+        SandboxLatencySummary MemoryWait;    // Time runs waited for the memory budget, runs without a budget excluded
+    };
+
+    constexpr uint32_t SANDBOX_ACTIVITY_SLOTS       = 256; // Runs a published board lists at once
+    constexpr uint32_t SANDBOX_ACTIVITY_NAME_LENGTH = 64;  // Task and policy names are cut to fit, NUL included
+
+    enum SandboxActivityPhase
+    {
+        SANDBOX_ACTIVITY_PREPARING = 0,      // Parsing the command and resolving the policy
+        SANDBOX_ACTIVITY_WAITING_FOR_MEMORY, // Waiting for the memory budget
+        SANDBOX_ACTIVITY_WAITING_FOR_CORE,   // Waiting for a core to pin to
+        SANDBOX_ACTIVITY_STARTING,           // Forked, the child sets up until execve
+        SANDBOX_ACTIVITY_RUNNING,            // The program runs
+        SANDBOX_ACTIVITY_FINISHING,          // The program exited and is being reaped and judged
+    };
+
+    /**
+     * @brief A run in progress, as published by PublishSandboxActivity
+     */
+    struct SandboxActivity
+    {
+        char TaskName[SANDBOX_ACTIVITY_NAME_LENGTH];
+        char Policy[SANDBOX_ACTIVITY_NAME_LENGTH];
+        int Pid;           // 0 until the program is forked
+        int32_t CpuCore;   // Logical CPU the program is pinned to, -1 if not pinned
+        uint32_t Phase;    // SandboxActivityPhase
+        uint32_t Priority; // SandboxPriority
+        uint64_t ElapsedNs;   // Since the run started
+        uint64_t CpuTimeUs;   // CPU time of the program at the supervisor's last sample, 0 before the first
+        uint64_t MemoryUsage; // Resident memory of the program at the supervisor's last sample, byte
+        uint64_t MaxCpuTime;  // The limits of the configuration, 0 = unlimited
+        uint64_t MaxRealTime;
+        uint64_t MaxMemory;
+    };
+
+    constexpr uint32_t SANDBOX_CONFIGURATION_EX_VERSION = 11;
+    constexpr uint32_t SANDBOX_RESULT_EX_VERSION        = 12;
+    constexpr uint32_t SANDBOX_REPEAT_RESULT_VERSION    = 1;
+    constexpr uint32_t SANDBOX_METRICS_VERSION          = 1;
+
     enum SandboxStatus
     {
         SANDBOX_STATUS_SUCCESS = 0,
@@ -92,6 +501,141 @@ extern "C"
      */
     int StartSandbox(const SandboxConfiguration *config, SandboxResult *result);
 
+    /**
+     * @brief Create and start a sandbox with extended configuration and result
+     * @param extension Optional, NULL behaves like StartSandbox
+     * @param result Cannot be NULL, result->StructSize must cover at least SandboxResultEx::Result
+     * @return SandboxStatus If the function succeeds, it returns SANDBOX_STATUS_SUCCESS
+     */
+    int StartSandboxEx(const SandboxConfiguration *config,
+                       const SandboxConfigurationEx *extension,
+                       SandboxResultEx *result);
+
+    /**
+     * @brief Run the same configuration repeatedly and report the distribution of its timings
+     * @param extension Optional, applied to every run
+     * @param repeatCount Runs to make, at least 1
+     * @param parallelRuns Runs to make at once, each on a core of its own (see PinToCore); 1 runs them one by one
+     * @param result Cannot be NULL, result->StructSize must cover at least SandboxRepeatResult::Version
+     * @remarks The configuration is validated and its policy resolved once for all runs. Every run writes the
+     * same output files. With parallelRuns above 1 the samples buffer of extension is not used, since the
+     * runs would share it. The result cache is not used.
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS, or the status of the first run that failed to start
+     */
+    int StartSandboxRepeated(const SandboxConfiguration *config,
+                             const SandboxConfigurationEx *extension,
+                             uint32_t repeatCount,
+                             uint32_t parallelRuns,
+                             SandboxRepeatResult *result);
+
+    /**
+     * @brief Calibrate this node now with the reference workload
+     * @param speedFactor Receives the speed relative to the reference node, may be NULL
+     * @param timingNoise Receives the relative run-to-run variation, may be NULL
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS
+     */
+    int CalibrateSandboxTiming(double *speedFactor, double *timingNoise);
+
+    /**
+     * @brief Set the memory the executable cache may take, see SandboxConfigurationEx::CacheExecutable
+     * @param bytes 256 MiB by default. Lowering it drops the least recently used copies at once, 0 disables
+     * the cache. Runs still executing a dropped copy are not affected.
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS
+     */
+    int SetSandboxExecutableCacheBudget(uint64_t bytes);
+
+    /**
+     * @brief Set how many warm namespace sets are kept, see SandboxConfigurationEx::Namespaces
+     * @param count Sets per combination of SandboxNamespaceFlags in use, 2 by default. 0 creates the
+     * namespaces of each run at launch.
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS
+     */
+    int SetSandboxNamespacePoolSize(uint32_t count);
+
+    /**
+     * @brief Set the memory concurrent runs of this process may commit together
+     * @param bytes 0 by default, which admits every run at once. A run commits its effective memory limit,
+     * MaxMemoryToCrash or twice MaxMemory, plus its ScratchSize, and waits before the fork until that fits.
+     * A run without a memory limit, or above the budget, commits the whole budget and so runs alone.
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS
+     */
+    int SetSandboxMemoryBudget(uint64_t bytes);
+
+    /**
+     * @brief Attach to the shared-memory ring of a "SandboxRunner --ring name" on this machine
+     * @remarks Submitting and reaping only touch shared memory. A syscall is only made to wake a side that
+     * sleeps: the runner after it ran out of work, or a caller waiting in ReapSandboxRing. The ring and its
+     * slots belong to one client process; its threads may share them.
+     * @return NULL if no ring of that name is served
+     */
+    SandboxRing *OpenSandboxRing(const char *name);
+
+    void CloseSandboxRing(SandboxRing *ring);
+
+    /**
+     * @brief Register the run that submissions with ConfigId id make
+     * @param arguments A JSON array of SandboxRunner arguments, like a spool job, at most 4 KiB. Registering
+     * an id again changes the runs that have not started yet.
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS, SANDBOX_STATUS_INTERNAL_ERROR if the id or the size is
+     * out of range
+     */
+    int RegisterSandboxRingConfig(SandboxRing *ring, uint32_t id, const char *arguments);
+
+    /**
+     * @brief Register a path that submissions refer to as InputId or OutputId
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS, SANDBOX_STATUS_INTERNAL_ERROR if the id or the size is
+     * out of range
+     */
+    int RegisterSandboxRingFile(SandboxRing *ring, uint32_t id, const char *path);
+
+    /**
+     * @brief Queue runs without waiting for them
+     * @return How many entries were queued, fewer than count while the ring is full
+     */
+    uint32_t SubmitSandboxRing(SandboxRing *ring, const SandboxRingSubmission *entries, uint32_t count);
+
+    /**
+     * @brief Take finished runs, in the order they finished
+     * @param timeoutMs How long to wait for the first one, 0 returns at once
+     * @return How many completions were written to entries
+     */
+    uint32_t ReapSandboxRing(SandboxRing *ring, SandboxRingCompletion *entries, uint32_t capacity,
+                             uint32_t timeoutMs);
+
+    /**
+     * @brief Snapshot the metrics of every run the process made
+     * @param metrics StructSize must be set, fields beyond it are not written
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS, SANDBOX_STATUS_INTERNAL_ERROR if StructSize does not cover
+     * Version
+     */
+    int GetSandboxMetrics(SandboxMetrics *metrics);
+
+    /**
+     * @brief Write the metrics in the Prometheus text exposition format
+     * @remarks The file is written aside and renamed over path, so a collector never reads it half-written.
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS, SANDBOX_STATUS_INTERNAL_ERROR if the file cannot be written
+     */
+    int WriteSandboxMetrics(const char *path);
+
+    /**
+     * @brief List the runs of this process in shared memory under a name, for "SandboxRunner --top name"
+     * @param name NULL stops publishing. A board of the same name left by a process that died is replaced.
+     * @remarks Runs write their phase, pid and core when they change, and the supervisor's sampler thread
+     * writes the CPU time and resident memory of the program as it samples it; a run is sampled at least
+     * twice a second while a board is published. Reading the board touches shared memory only.
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS, SANDBOX_STATUS_INTERNAL_ERROR if the board cannot be
+     * created
+     */
+    int PublishSandboxActivity(const char *name);
+
+    /**
+     * @brief Copy the runs in progress from the board a process on this machine published under name
+     * @param count Set to the number of entries written, at most capacity, in the order of the board's slots
+     * @return SandboxStatus SANDBOX_STATUS_SUCCESS, SANDBOX_STATUS_INTERNAL_ERROR if no live process
+     * publishes that name
+     */
+    int ReadSandboxActivity(const char *name, SandboxActivity *entries, uint32_t capacity, uint32_t *count);
+
     /**
      * @brief Check if the configuration is valid
      */
@@ -131,6 +675,15 @@ public:
      */
     static CreateSandboxResult Create(const SandboxConfiguration *config, SandboxResult &result);
 
+    /**
+     * @brief Create a sandbox with the given configuration and extension
+     * @param extension The extended configuration, can be nullptr
+     * @param result The extended result, filled completely regardless of result.StructSize
+     */
+    static CreateSandboxResult Create(const SandboxConfiguration *config,
+                                      const SandboxConfigurationEx *extension,
+                                      SandboxResultEx &result);
+
     /**
      * @brief Get the version of the sandbox library
      * @return The version of the sandbox library
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #include <filesystem>
 #include <type_traits>
 #include <vector>
@@ -48,10 +49,73 @@ struct SandboxResultAbiBaseline
 
 using StartSandboxSignature           = int (*)(const SandboxConfiguration *, SandboxResult *);
 using IsConfigurationValidSignature  = bool (*)(const SandboxConfiguration *);
+using StartSandboxExSignature         = int (*)(const SandboxConfiguration *, const SandboxConfigurationEx *,
+                                              SandboxResultEx *);
 
 static_assert(std::is_same_v<decltype(&StartSandbox), StartSandboxSignature>, "StartSandbox signature changed");
 static_assert(std::is_same_v<decltype(&IsSandboxConfigurationVaild), IsConfigurationValidSignature>,
               "IsSandboxConfigurationVaild signature changed");
+static_assert(std::is_same_v<decltype(&StartSandboxEx), StartSandboxExSignature>, "StartSandboxEx signature changed");
+
+// Extension structs may grow at the end only, the size/version header must stay in front.
+static_assert(offsetof(SandboxConfigurationEx, StructSize) == 0, "SandboxConfigurationEx::StructSize must come first");
+static_assert(offsetof(SandboxConfigurationEx, Version) == 4, "SandboxConfigurationEx::Version offset changed");
+static_assert(offsetof(SandboxResultEx, StructSize) == 0, "SandboxResultEx::StructSize must come first");
+static_assert(offsetof(SandboxResultEx, Version) == 4, "SandboxResultEx::Version offset changed");
+static_assert(offsetof(SandboxResultEx, Result) == 8, "SandboxResultEx::Result offset changed");
+static_assert(offsetof(SandboxResultEx, Timeline) > offsetof(SandboxResultEx, ProfiledDistinctSyscallCount),
+              "SandboxResultEx::Timeline must be appended after the version 1 fields");
+static_assert(offsetof(SandboxResultEx, UserTimeUs) > offsetof(SandboxResultEx, Timeline),
+              "SandboxResultEx resource counters must be appended after the version 2 fields");
+static_assert(offsetof(SandboxResultEx, HasIoCounters) > offsetof(SandboxResultEx, PeakMemorySource),
+              "SandboxResultEx version 3 field order changed");
+static_assert(offsetof(SandboxResultEx, SampleCount) > offsetof(SandboxResultEx, HasIoCounters),
+              "SandboxResultEx::SampleCount must be appended after the version 3 fields");
+static_assert(offsetof(SandboxConfigurationEx, SampleIntervalMs) > offsetof(SandboxConfigurationEx, TraceFile),
+              "SandboxConfigurationEx sampling fields must be appended after the version 2 fields");
+static_assert(offsetof(SandboxResultEx, TerminationReason) > offsetof(SandboxResultEx, SampleStride),
+              "SandboxResultEx::TerminationReason must be appended after the version 4 fields");
+static_assert(offsetof(SandboxConfigurationEx, MaxIdleTime) > offsetof(SandboxConfigurationEx, SampleUserData),
+              "SandboxConfigurationEx::MaxIdleTime must be appended after the version 3 fields");
+static_assert(offsetof(SandboxConfigurationEx, PinToCore) > offsetof(SandboxConfigurationEx, MaxIdleTime),
+              "SandboxConfigurationEx::PinToCore must be appended after the version 4 fields");
+static_assert(offsetof(SandboxResultEx, CpuCore) > offsetof(SandboxResultEx, TerminationReason),
+              "SandboxResultEx::CpuCore must be appended after the version 5 fields");
+static_assert(offsetof(SandboxConfigurationEx, TimingCalibration) > offsetof(SandboxConfigurationEx, PinToCore),
+              "SandboxConfigurationEx::TimingCalibration must be appended after the version 5 fields");
+static_assert(offsetof(SandboxResultEx, SpeedFactor) > offsetof(SandboxResultEx, CpuCore),
+              "SandboxResultEx::SpeedFactor must be appended after the version 6 fields");
+static_assert(offsetof(SandboxConfigurationEx, ResultCacheFile) > offsetof(SandboxConfigurationEx, MaxNearLimitReruns),
+              "SandboxConfigurationEx::ResultCacheFile must be appended after the version 6 fields");
+static_assert(offsetof(SandboxResultEx, FromResultCache) > offsetof(SandboxResultEx, RunCount),
+              "SandboxResultEx::FromResultCache must be appended after the version 7 fields");
+static_assert(offsetof(SandboxConfigurationEx, CacheExecutable) > offsetof(SandboxConfigurationEx, ResultCacheMode),
+              "SandboxConfigurationEx::CacheExecutable must be appended after the version 7 fields");
+static_assert(offsetof(SandboxResultEx, FromExecutableCache) > offsetof(SandboxResultEx, FromResultCache),
+              "SandboxResultEx::FromExecutableCache must be appended after the version 8 fields");
+static_assert(offsetof(SandboxResultEx, SupervisedSyscallDenials) > offsetof(SandboxResultEx, FromExecutableCache),
+              "SandboxResultEx::SupervisedSyscallDenials must be appended after the version 9 fields");
+static_assert(offsetof(SandboxConfigurationEx, Namespaces) > offsetof(SandboxConfigurationEx, CacheExecutable),
+              "SandboxConfigurationEx::Namespaces must be appended after the version 8 fields");
+static_assert(offsetof(SandboxConfigurationEx, ScratchSize) > offsetof(SandboxConfigurationEx, Namespaces),
+              "SandboxConfigurationEx::ScratchSize must be appended after the version 9 fields");
+static_assert(offsetof(SandboxConfigurationEx, Priority) > offsetof(SandboxConfigurationEx, ScratchSize),
+              "SandboxConfigurationEx::Priority must be appended after the version 10 fields");
+static_assert(offsetof(SandboxResultEx, FromNamespacePool) > offsetof(SandboxResultEx, SupervisorMaxTimeNs),
+              "SandboxResultEx::FromNamespacePool must be appended after the version 10 fields");
+static_assert(offsetof(SandboxResultEx, MemoryAdmissionWaitNs) > offsetof(SandboxResultEx, FromNamespacePool),
+              "SandboxResultEx::MemoryAdmissionWaitNs must be appended after the version 11 fields");
+static_assert(sizeof(SandboxRingSubmission) == 24, "SandboxRingSubmission layout changed");
+static_assert(sizeof(SandboxRingCompletion) == 56, "SandboxRingCompletion layout changed");
+static_assert(offsetof(SandboxRingCompletion, Result) == 16, "SandboxRingCompletion::Result offset changed");
+static_assert(offsetof(SandboxMetrics, StructSize) == 0, "SandboxMetrics::StructSize must come first");
+static_assert(offsetof(SandboxMetrics, Version) == 4, "SandboxMetrics::Version offset changed");
+static_assert(sizeof(SandboxLatencySummary) == 56, "SandboxLatencySummary layout changed");
+static_assert(sizeof(SandboxActivity) == 192, "SandboxActivity layout changed");
+static_assert(offsetof(SandboxActivity, Pid) == 128, "SandboxActivity::Pid offset changed");
+static_assert(sizeof(SandboxSample) == 24, "SandboxSample layout changed");
+static_assert(offsetof(SandboxConfigurationEx, TraceFile) > offsetof(SandboxConfigurationEx, ProfileOutputFile),
+              "SandboxConfigurationEx::TraceFile must be appended after the version 1 fields");
 
 static_assert(SANDBOX_STATUS_SUCCESS == 0, "SANDBOX_STATUS_SUCCESS numeric value changed");
 static_assert(SANDBOX_STATUS_MEMORY_LIMIT_EXCEEDED == 1, "SANDBOX_STATUS_MEMORY_LIMIT_EXCEEDED numeric value changed");
@@ -171,9 +235,39 @@ TEST(AbiCompatibility, ExportedSymbolsPresent)
 
     const auto startSandboxFn = GetProcAddress(module, "StartSandbox");
     const auto validateFn     = GetProcAddress(module, "IsSandboxConfigurationVaild");
+    const auto startSandboxExFn = GetProcAddress(module, "StartSandboxEx");
+    const auto calibrateFn      = GetProcAddress(module, "CalibrateSandboxTiming");
+    const auto cacheBudgetFn    = GetProcAddress(module, "SetSandboxExecutableCacheBudget");
+    const auto poolSizeFn       = GetProcAddress(module, "SetSandboxNamespacePoolSize");
+    const auto memoryBudgetFn   = GetProcAddress(module, "SetSandboxMemoryBudget");
+    const auto openRingFn       = GetProcAddress(module, "OpenSandboxRing");
+    const auto closeRingFn      = GetProcAddress(module, "CloseSandboxRing");
+    const auto ringConfigFn     = GetProcAddress(module, "RegisterSandboxRingConfig");
+    const auto ringFileFn       = GetProcAddress(module, "RegisterSandboxRingFile");
+    const auto submitRingFn     = GetProcAddress(module, "SubmitSandboxRing");
+    const auto reapRingFn       = GetProcAddress(module, "ReapSandboxRing");
+    const auto metricsFn        = GetProcAddress(module, "GetSandboxMetrics");
+    const auto writeMetricsFn   = GetProcAddress(module, "WriteSandboxMetrics");
+    const auto publishFn        = GetProcAddress(module, "PublishSandboxActivity");
+    const auto readActivityFn   = GetProcAddress(module, "ReadSandboxActivity");
 
     EXPECT_NE(startSandboxFn, nullptr);
     EXPECT_NE(validateFn, nullptr);
+    EXPECT_NE(startSandboxExFn, nullptr);
+    EXPECT_NE(calibrateFn, nullptr);
+    EXPECT_NE(cacheBudgetFn, nullptr);
+    EXPECT_NE(poolSizeFn, nullptr);
+    EXPECT_NE(memoryBudgetFn, nullptr);
+    EXPECT_NE(openRingFn, nullptr);
+    EXPECT_NE(closeRingFn, nullptr);
+    EXPECT_NE(ringConfigFn, nullptr);
+    EXPECT_NE(ringFileFn, nullptr);
+    EXPECT_NE(submitRingFn, nullptr);
+    EXPECT_NE(reapRingFn, nullptr);
+    EXPECT_NE(metricsFn, nullptr);
+    EXPECT_NE(writeMetricsFn, nullptr);
+    EXPECT_NE(publishFn, nullptr);
+    EXPECT_NE(readActivityFn, nullptr);
 
     FreeLibrary(module);
 #else
@@ -182,10 +276,70 @@ TEST(AbiCompatibility, ExportedSymbolsPresent)
 
     void *startSandboxFn = dlsym(handle, "StartSandbox");
     void *validateFn     = dlsym(handle, "IsSandboxConfigurationVaild");
+    void *startSandboxExFn = dlsym(handle, "StartSandboxEx");
+    void *calibrateFn      = dlsym(handle, "CalibrateSandboxTiming");
+    void *cacheBudgetFn    = dlsym(handle, "SetSandboxExecutableCacheBudget");
+    void *poolSizeFn       = dlsym(handle, "SetSandboxNamespacePoolSize");
+    void *memoryBudgetFn   = dlsym(handle, "SetSandboxMemoryBudget");
+    void *openRingFn       = dlsym(handle, "OpenSandboxRing");
+    void *closeRingFn      = dlsym(handle, "CloseSandboxRing");
+    void *ringConfigFn     = dlsym(handle, "RegisterSandboxRingConfig");
+    void *ringFileFn       = dlsym(handle, "RegisterSandboxRingFile");
+    void *submitRingFn     = dlsym(handle, "SubmitSandboxRing");
+    void *reapRingFn       = dlsym(handle, "ReapSandboxRing");
+    void *metricsFn        = dlsym(handle, "GetSandboxMetrics");
+    void *writeMetricsFn   = dlsym(handle, "WriteSandboxMetrics");
+    void *publishFn        = dlsym(handle, "PublishSandboxActivity");
+    void *readActivityFn   = dlsym(handle, "ReadSandboxActivity");
 
     EXPECT_NE(startSandboxFn, nullptr);
     EXPECT_NE(validateFn, nullptr);
+    EXPECT_NE(startSandboxExFn, nullptr);
+    EXPECT_NE(calibrateFn, nullptr);
+    EXPECT_NE(cacheBudgetFn, nullptr);
+    EXPECT_NE(poolSizeFn, nullptr);
+    EXPECT_NE(memoryBudgetFn, nullptr);
+    EXPECT_NE(openRingFn, nullptr);
+    EXPECT_NE(closeRingFn, nullptr);
+    EXPECT_NE(ringConfigFn, nullptr);
+    EXPECT_NE(ringFileFn, nullptr);
+    EXPECT_NE(submitRingFn, nullptr);
+    EXPECT_NE(reapRingFn, nullptr);
+    EXPECT_NE(metricsFn, nullptr);
+    EXPECT_NE(writeMetricsFn, nullptr);
+    EXPECT_NE(publishFn, nullptr);
+    EXPECT_NE(readActivityFn, nullptr);
 
     dlclose(handle);
 #endif
 }
+
+TEST(AbiCompatibility, StartSandboxExRespectsCallerStructSize)
+{
+    SandboxConfiguration configuration{};
+    configuration.TaskName    = "abi-result-ex";
+    configuration.UserCommand = "/bin/true";
+    configuration.Policy      = "default";
+    configuration.MaxProcessCount = -1;
+
+    // A caller built against the first revision only knows the header and the embedded SandboxResult.
+    constexpr size_t legacySize = offsetof(SandboxResultEx, Result) + sizeof(SandboxResult);
+    SandboxResultEx result;
+    memset(&result, 0xCD, sizeof(result));
+    result.StructSize = legacySize;
+
+    ASSERT_EQ(StartSandboxEx(&configuration, nullptr, &result), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(result.StructSize, legacySize);
+    EXPECT_EQ(result.Version, SANDBOX_RESULT_EX_VERSION);
+    EXPECT_EQ(result.Result.Status, SANDBOX_STATUS_SUCCESS);
+
+    const auto *tail = reinterpret_cast<const unsigned char *>(&result) + legacySize;
+    for (size_t i = 0; i < sizeof(SandboxResultEx) - legacySize; ++i)
+    {
+        ASSERT_EQ(tail[i], 0xCD) << "StartSandboxEx wrote beyond StructSize at offset " << legacySize + i;
+    }
+
+    SandboxResultEx tooSmall{};
+    tooSmall.StructSize = sizeof(uint32_t) * 2;
+    EXPECT_EQ(StartSandboxEx(&configuration, nullptr, &tooSmall), SANDBOX_STATUS_INTERNAL_ERROR);
+}
@@ -0,0 +1,80 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/Linux/ActivityBoard.h"
+
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+std::string MakeBoardName(const std::string &name)
+{
+    return name + "-" + std::to_string(getpid());
+}
+
+} // namespace
+
+TEST(ActivityBoardTest, ClaimFailsWhileEverySlotIsTaken)
+{
+    ASSERT_TRUE(ActivityBoard::Publish(MakeBoardName("board-full-test")));
+    const auto board = ActivityBoard::GetPublished();
+    ASSERT_NE(board, nullptr);
+
+    SandboxActivity activity{};
+    activity.MaxMemory = 1234;
+    std::vector<BoardSlot *> slots;
+    for (uint32_t i = 0; i < SANDBOX_ACTIVITY_SLOTS; ++i)
+    {
+        slots.push_back(board->Claim(activity, 1));
+        ASSERT_NE(slots.back(), nullptr);
+    }
+    EXPECT_EQ(board->Claim(activity, 1), nullptr);
+
+    const auto listed = ActivityBoard::Read(MakeBoardName("board-full-test"));
+    ASSERT_TRUE(listed.has_value());
+    ASSERT_EQ(listed->size(), SANDBOX_ACTIVITY_SLOTS);
+    EXPECT_EQ(listed->front().MaxMemory, 1234U);
+    EXPECT_EQ(listed->front().CpuCore, -1);
+
+    board->Release(slots[7]);
+    EXPECT_EQ(ActivityBoard::Read(MakeBoardName("board-full-test"))->size(), SANDBOX_ACTIVITY_SLOTS - 1);
+    slots[7] = board->Claim(activity, 1);
+    EXPECT_NE(slots[7], nullptr);
+    for (auto *slot : slots)
+        board->Release(slot);
+    EXPECT_TRUE(ActivityBoard::Read(MakeBoardName("board-full-test"))->empty());
+    ASSERT_TRUE(ActivityBoard::Publish(""));
+}
+
+TEST(ActivityBoardTest, ReplacedBoardIsRemovedWithItsLastRun)
+{
+    EXPECT_FALSE(ActivityBoard::Read(MakeBoardName("board-missing-test")).has_value());
+
+    ASSERT_TRUE(ActivityBoard::Publish(MakeBoardName("board-old-test")));
+    const SandboxConfiguration configuration{};
+    {
+        ActivityEntry entry(configuration, SANDBOX_PRIORITY_LOW, 1);
+        ASSERT_TRUE(entry.IsListed());
+        entry.SetPhase(SANDBOX_ACTIVITY_RUNNING);
+        entry.SetUsage(2000, 4096);
+
+        // The run keeps its slot on the board it started on.
+        ASSERT_TRUE(ActivityBoard::Publish(MakeBoardName("board-new-test")));
+        const auto listed = ActivityBoard::Read(MakeBoardName("board-old-test"));
+        ASSERT_TRUE(listed.has_value());
+        ASSERT_EQ(listed->size(), 1U);
+        EXPECT_STREQ(listed->front().Policy, "default");
+        EXPECT_EQ(listed->front().Priority, SANDBOX_PRIORITY_LOW);
+        EXPECT_EQ(listed->front().Phase, SANDBOX_ACTIVITY_RUNNING);
+        EXPECT_EQ(listed->front().CpuTimeUs, 2000U);
+        EXPECT_EQ(listed->front().MemoryUsage, 4096U);
+        EXPECT_TRUE(ActivityBoard::Read(MakeBoardName("board-new-test"))->empty());
+    }
+    EXPECT_FALSE(ActivityBoard::Read(MakeBoardName("board-old-test")).has_value());
+
+    ASSERT_TRUE(ActivityBoard::Publish(""));
+    EXPECT_FALSE(ActivityBoard::Read(MakeBoardName("board-new-test")).has_value());
+    EXPECT_FALSE(ActivityEntry(configuration, SANDBOX_PRIORITY_NORMAL, 1).IsListed());
+}
@@ -0,0 +1,94 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/Linux/CoreAllocator.h"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+TEST(CoreAllocatorTest, ParseCpuList)
+{
+    EXPECT_EQ(ParseCpuList("0-3,8,10-11\n"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(ParseCpuList("5"), (std::vector<int>{5}));
+    EXPECT_EQ(ParseCpuList("4,0"), (std::vector<int>{0, 4}));
+    EXPECT_TRUE(ParseCpuList("3-1").empty());
+    EXPECT_TRUE(ParseCpuList("a").empty());
+}
+
+TEST(CoreAllocatorTest, GroupsSmtSiblingsIntoOneCore)
+{
+    // Two cores with two threads each, numbered like most x86 machines: cpu N and N+2 are siblings.
+    const auto cpuRoot = std::filesystem::temp_directory_path() / "sandboxrunner-topology";
+    for (const auto &[cpu, siblings] : {std::pair{0, "0,2"}, {1, "1,3"}, {2, "0,2"}, {3, "1,3"}})
+    {
+        const auto topology = cpuRoot / ("cpu" + std::to_string(cpu)) / "topology";
+        std::filesystem::create_directories(topology);
+        std::ofstream(topology / "thread_siblings_list") << siblings << "\n";
+    }
+
+    const auto cores = ReadCoreTopology(cpuRoot, {0, 1, 2, 3});
+    ASSERT_EQ(cores.size(), 2U);
+    EXPECT_EQ(cores[0].Cpu, 0);
+    EXPECT_EQ(cores[0].Siblings, (std::vector<int>{0, 2}));
+    EXPECT_EQ(cores[1].Cpu, 1);
+    EXPECT_EQ(cores[1].Siblings, (std::vector<int>{1, 3}));
+
+    // Siblings outside the usable set are ignored, CPUs without topology are cores of their own.
+    const auto restricted = ReadCoreTopology(cpuRoot, {2, 3, 7});
+    ASSERT_EQ(restricted.size(), 3U);
+    EXPECT_EQ(restricted[0].Siblings, (std::vector<int>{2}));
+    EXPECT_EQ(restricted[2].Cpu, 7);
+
+    std::error_code errorCode;
+    std::filesystem::remove_all(cpuRoot, errorCode);
+}
+
+TEST(CoreAllocatorTest, QueuesWhenEveryCoreIsTaken)
+{
+    CoreAllocator allocator({PhysicalCore{.Cpu = 0, .Siblings = {0, 2}}, PhysicalCore{.Cpu = 1, .Siblings = {1, 3}}});
+    const int first  = allocator.Acquire();
+    const int second = allocator.Acquire();
+    EXPECT_NE(first, second);
+
+    std::atomic<int> third{-1};
+    std::thread waiter([&] { third = allocator.Acquire(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(third.load(), -1);
+
+    allocator.Release(second);
+    waiter.join();
+    EXPECT_EQ(third.load(), second);
+
+    allocator.Release(first);
+    allocator.Release(third);
+    EXPECT_EQ(CoreAllocator({}).Acquire(), -1);
+}
+
+TEST(CoreAllocatorTest, ServesHigherPrioritiesFirst)
+{
+    CoreAllocator allocator({PhysicalCore{.Cpu = 0, .Siblings = {0}}});
+    const int held = allocator.Acquire();
+
+    // The low-priority caller queues first, the normal one overtakes it.
+    std::vector<uint32_t> order;
+    std::mutex orderMutex;
+    const auto take = [&](uint32_t priority) {
+        const int cpu = allocator.Acquire(priority);
+        {
+            std::lock_guard lock(orderMutex);
+            order.push_back(priority);
+        }
+        allocator.Release(cpu);
+    };
+    std::thread low(take, SANDBOX_PRIORITY_LOW);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread normal(take, SANDBOX_PRIORITY_NORMAL);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    allocator.Release(held);
+    low.join();
+    normal.join();
+    EXPECT_EQ(order, (std::vector<uint32_t>{SANDBOX_PRIORITY_NORMAL, SANDBOX_PRIORITY_LOW}));
+}
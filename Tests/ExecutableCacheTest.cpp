@@ -0,0 +1,78 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/Linux/ExecutableCache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+namespace
+{
+
+class ExecutableCacheTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        _directory = std::filesystem::temp_directory_path() / ("executable-cache-test-" + std::to_string(getpid()));
+        std::filesystem::create_directories(_directory);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(_directory); }
+
+    std::string WriteFile(const std::string &name, const std::string &content) const
+    {
+        const auto path = _directory / name;
+        std::ofstream(path, std::ios::binary) << content;
+        return path.string();
+    }
+
+    std::filesystem::path _directory;
+};
+
+} // namespace
+
+TEST_F(ExecutableCacheTest, CopiesAreSharedByContent)
+{
+    ExecutableCache cache;
+    const auto first  = cache.Acquire(WriteFile("first", std::string(1000, 'a')));
+    const auto second = cache.Acquire(WriteFile("second", std::string(1000, 'a')));
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(cache.GetCount(), 1U);
+    EXPECT_EQ(cache.GetSize(), 1000U);
+
+    // Sealed: the program cannot change the copy other runs execute.
+    EXPECT_LT(write(first->GetFd(), "b", 1), 0);
+    EXPECT_EQ(cache.Acquire(WriteFile("missing/file", "")), nullptr);
+}
+
+TEST_F(ExecutableCacheTest, LeastRecentlyUsedCopiesAreEvicted)
+{
+    ExecutableCache cache(2500);
+    const auto a = WriteFile("a", std::string(1000, 'a'));
+    const auto b = WriteFile("b", std::string(1000, 'b'));
+    const auto c = WriteFile("c", std::string(1000, 'c'));
+    const auto held = cache.Acquire(a);
+    ASSERT_NE(cache.Acquire(b), nullptr);
+    ASSERT_NE(cache.Acquire(a), nullptr); // b is now the least recently used
+    ASSERT_NE(cache.Acquire(c), nullptr);
+    EXPECT_EQ(cache.GetCount(), 2U);
+    EXPECT_EQ(cache.GetSize(), 2000U);
+    EXPECT_EQ(cache.Acquire(a), held);
+
+    // An evicted copy stays usable by whoever holds it.
+    cache.SetBudget(0);
+    EXPECT_EQ(cache.GetCount(), 0U);
+    EXPECT_EQ(cache.Acquire(a), nullptr);
+    char byte = 0;
+    EXPECT_EQ(pread(held->GetFd(), &byte, 1, 0), 1);
+    EXPECT_EQ(byte, 'a');
+}
+
+TEST_F(ExecutableCacheTest, ScriptsAreNotCached)
+{
+    ExecutableCache cache;
+    EXPECT_EQ(cache.Acquire(WriteFile("script.sh", "#!/bin/sh\nexit 0\n")), nullptr);
+    EXPECT_EQ(cache.GetCount(), 0U);
+}
@@ -0,0 +1,80 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/Linux/MemoryAdmission.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+TEST(MemoryAdmissionTest, AdmitsEverythingWithoutBudget)
+{
+    MemoryAdmission admission;
+    uint32_t queueDepth = 1;
+    EXPECT_EQ(admission.Admit(1ULL << 40, SANDBOX_PRIORITY_NORMAL, queueDepth), 0U);
+    EXPECT_EQ(queueDepth, 0U);
+    EXPECT_EQ(admission.GetCommitted(), 0U);
+}
+
+TEST(MemoryAdmissionTest, WaitsUntilTheRunFits)
+{
+    MemoryAdmission admission(100);
+    uint32_t queueDepth = 0;
+    const uint64_t held = admission.Admit(60, SANDBOX_PRIORITY_NORMAL, queueDepth);
+    EXPECT_EQ(held, 60U);
+
+    std::atomic<bool> admitted = false;
+    std::thread waiter([&] {
+        uint32_t depth = 0;
+        admission.Release(admission.Admit(50, SANDBOX_PRIORITY_NORMAL, depth));
+        admitted = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(admitted);
+
+    admission.Release(held);
+    waiter.join();
+    EXPECT_TRUE(admitted);
+    EXPECT_EQ(admission.GetCommitted(), 0U);
+}
+
+TEST(MemoryAdmissionTest, RunsAboveTheBudgetRunAlone)
+{
+    MemoryAdmission admission(100);
+    uint32_t queueDepth = 0;
+    EXPECT_EQ(admission.Admit(500, SANDBOX_PRIORITY_NORMAL, queueDepth), 100U);
+    admission.Release(100);
+    EXPECT_EQ(admission.Admit(0, SANDBOX_PRIORITY_NORMAL, queueDepth), 100U);
+    admission.Release(100);
+}
+
+TEST(MemoryAdmissionTest, AdmitsHigherPrioritiesFirst)
+{
+    MemoryAdmission admission(100);
+    uint32_t queueDepth = 0;
+    const uint64_t held = admission.Admit(100, SANDBOX_PRIORITY_NORMAL, queueDepth);
+
+    // The low-priority run queues first, the normal one overtakes it and sees it waiting.
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> depths;
+    std::mutex orderMutex;
+    const auto run = [&](uint32_t priority) {
+        uint32_t depth           = 0;
+        const uint64_t committed = admission.Admit(80, priority, depth);
+        {
+            std::lock_guard lock(orderMutex);
+            order.push_back(priority);
+            depths.push_back(depth);
+        }
+        admission.Release(committed);
+    };
+    std::thread low(run, SANDBOX_PRIORITY_LOW);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread normal(run, SANDBOX_PRIORITY_NORMAL);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    admission.Release(held);
+    low.join();
+    normal.join();
+    EXPECT_EQ(order, (std::vector<uint32_t>{SANDBOX_PRIORITY_NORMAL, SANDBOX_PRIORITY_LOW}));
+    EXPECT_EQ(depths, (std::vector<uint32_t>{1, 0}));
+}
@@ -0,0 +1,123 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/Metrics.h"
+
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+SandboxMetrics TakeSnapshot()
+{
+    SandboxMetrics metrics{};
+    metrics.StructSize = sizeof(SandboxMetrics);
+    MetricsRegistry::Instance().Snapshot(metrics);
+    return metrics;
+}
+
+// The value of a series in the Prometheus text, std::nullopt if it is not listed.
+std::optional<uint64_t> FindSample(const std::string &text, const std::string &series)
+{
+    const auto position = text.find("\n" + series + " ");
+    if (position == std::string::npos)
+        return std::nullopt;
+    return std::stoull(text.substr(position + series.size() + 2));
+}
+
+} // namespace
+
+TEST(MetricsTest, BucketsBoundTheirValuesWithinASixteenth)
+{
+    uint32_t previous = 0;
+    for (uint64_t value = 0; value < (1ULL << 41); value = value < 64 ? value + 1 : value + value / 7)
+    {
+        const uint32_t index = LatencyBuckets::IndexOf(value);
+        ASSERT_LT(index, LatencyBuckets::COUNT);
+        EXPECT_GE(index, previous) << value;
+        EXPECT_GE(LatencyBuckets::UpperBound(index), value) << value;
+        EXPECT_LE(LatencyBuckets::UpperBound(index) - value, value / 16) << value;
+        if (index > 0)
+        {
+            EXPECT_LT(LatencyBuckets::UpperBound(index - 1), value) << value;
+        }
+        previous = index;
+    }
+    EXPECT_EQ(LatencyBuckets::IndexOf(~0ULL), LatencyBuckets::COUNT - 1);
+}
+
+TEST(MetricsTest, CountsOfExitedThreadsAreKept)
+{
+    const SandboxMetrics before = TakeSnapshot();
+    constexpr int threadCount    = 4;
+    constexpr uint64_t perThread = 10000;
+    for (int round = 0; round < 2; ++round)
+    {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back([] {
+                const ScopedGauge active(MetricGauge::ActiveRuns);
+                for (uint64_t n = 1; n <= perThread; ++n)
+                {
+                    MetricsRegistry::Instance().Increment(MetricCounter::Launches);
+                    MetricsRegistry::Instance().Observe(MetricHistogram::RunTime, n * 1000);
+                }
+                MetricsRegistry::Instance().RecordVerdict(SANDBOX_STATUS_INTERNAL_ERROR);
+                MetricsRegistry::Instance().RecordMonitorKill(SANDBOX_TERMINATION_IDLE_LIMIT);
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    const SandboxMetrics after = TakeSnapshot();
+    EXPECT_EQ(after.Launches - before.Launches, 2 * threadCount * perThread);
+    EXPECT_EQ(after.RunTime.Count - before.RunTime.Count, 2 * threadCount * perThread);
+    EXPECT_EQ(after.Verdicts[SANDBOX_METRICS_VERDICT_COUNT - 1] - before.Verdicts[SANDBOX_METRICS_VERDICT_COUNT - 1],
+              2U * threadCount);
+    EXPECT_EQ(after.MonitorKills[SANDBOX_TERMINATION_IDLE_LIMIT] - before.MonitorKills[SANDBOX_TERMINATION_IDLE_LIMIT],
+              2U * threadCount);
+    EXPECT_EQ(after.ActiveRuns, before.ActiveRuns);
+
+    // Each thread observed 1..10000 us, so the percentiles are close to those of that sequence.
+    EXPECT_GE(after.RunTime.MaxNs, perThread * 1000);
+    EXPECT_NEAR(static_cast<double>(after.RunTime.P50Ns), 5000e3, 5000e3 / 16);
+    EXPECT_NEAR(static_cast<double>(after.RunTime.P99Ns), 9900e3, 9900e3 / 16);
+}
+
+TEST(MetricsTest, SnapshotRespectsStructSize)
+{
+    SandboxMetrics metrics{};
+    metrics.StructSize = offsetof(SandboxMetrics, ForkFailures);
+    metrics.ForkFailures = 12345;
+    ASSERT_EQ(GetSandboxMetrics(&metrics), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(metrics.Version, SANDBOX_METRICS_VERSION);
+    EXPECT_EQ(metrics.ForkFailures, 12345U);
+
+    metrics.StructSize = sizeof(uint32_t);
+    EXPECT_EQ(GetSandboxMetrics(&metrics), SANDBOX_STATUS_INTERNAL_ERROR);
+}
+
+TEST(MetricsTest, PrometheusTextListsEveryFamily)
+{
+    // Runs of other tests in this process are observed too, only the difference is this one's.
+    const std::string below  = "sandbox_launch_latency_seconds_bucket{le=\"0.002097152\"}";
+    const std::string above  = "sandbox_launch_latency_seconds_bucket{le=\"0.004194304\"}";
+    const std::string before = MetricsRegistry::Instance().FormatPrometheus();
+    MetricsRegistry::Instance().Observe(MetricHistogram::LaunchLatency, 3'000'000);
+    const std::string text = MetricsRegistry::Instance().FormatPrometheus();
+    for (const char *line : {"# TYPE sandbox_launches_total counter\n", "sandbox_verdicts_total{status=\"SUCCESS\"} ",
+                             "sandbox_monitor_kills_total{reason=\"memory_limit\"} ",
+                             "# TYPE sandbox_active_runs gauge\n", "# TYPE sandbox_launch_latency_seconds histogram\n",
+                             "sandbox_launch_latency_seconds_bucket{le=\"+Inf\"} ", "sandbox_memory_wait_seconds_count "})
+        EXPECT_NE(text.find(line), std::string::npos) << line;
+
+    // 3 ms falls in the bucket of 2^22 ns, not in the one of 2^21 ns.
+    ASSERT_TRUE(FindSample(text, below).has_value());
+    ASSERT_TRUE(FindSample(text, above).has_value());
+    EXPECT_EQ(*FindSample(text, below), FindSample(before, below).value_or(0));
+    EXPECT_EQ(*FindSample(text, above), FindSample(before, above).value_or(0) + 1);
+}
@@ -1,8 +1,12 @@
 #include "SandboxTest.h"
 
 #include "../SandboxRunnerCore/Policy/PolicyRegistry.h"
+#include "../SandboxRunnerCore/Policy/BuiltinPolicies.h"
 
 #include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sched.h>
 #include <seccomp.h>
 
 namespace
@@ -141,3 +145,167 @@ TEST(PolicyRegistryTest, UnknownPolicyReturnsNull)
     EXPECT_EQ(SandboxPolicyEngine::TryResolvePolicy("NOT_EXISTS"), nullptr);
     EXPECT_FALSE(SandboxPolicyEngine::IsKnownPolicy("NOT_EXISTS"));
 }
+
+TEST(PolicyRegistryTest, CxxProgramPolicyIsBuiltIn)
+{
+    const auto *builtin = SandboxPolicyEngine::FindBuiltinPolicy("CXX_PROGRAM");
+    ASSERT_NE(builtin, nullptr);
+    EXPECT_TRUE(builtin->RestrictExecveToProgramPath);
+    EXPECT_TRUE(builtin->AllowIO);
+
+    SandboxPolicyEngine::SandboxPolicy storage;
+    const auto *policy = SandboxPolicyEngine::TryResolvePolicyNoCache("CXX_PROGRAM", storage);
+    ASSERT_NE(policy, nullptr);
+    EXPECT_EQ(policy->AllowedSyscalls.size(), builtin->AllowedSyscalls.size());
+    EXPECT_TRUE(std::is_sorted(policy->AllowedSyscalls.begin(), policy->AllowedSyscalls.end()));
+}
+
+TEST(PolicyRegistryTest, PolicyFileOverridesBuiltInPolicy)
+{
+    const auto policyPath = std::filesystem::temp_directory_path() / "sandboxrunner-override" / "CXX_PROGRAM.json";
+    std::filesystem::create_directories(policyPath.parent_path());
+    {
+        std::ofstream output(policyPath);
+        output << R"({"Version": "1.0", "Seccomp": {"AllowIO": false, "WhiteList": ["read", "write", "exit_group"]}})";
+    }
+
+    SandboxPolicyEngine::SandboxPolicy storage;
+    const auto *policy = SandboxPolicyEngine::TryResolvePolicyNoCache(policyPath.string(), storage);
+    ASSERT_NE(policy, nullptr);
+    EXPECT_FALSE(policy->AllowIO);
+    EXPECT_FALSE(policy->RestrictExecveToProgramPath);
+    EXPECT_EQ(policy->AllowedSyscalls.size(), 3U);
+
+    std::error_code errorCode;
+    std::filesystem::remove_all(policyPath.parent_path(), errorCode);
+}
+
+TEST(PolicyRegistryTest, CxxProgramPolicyChecksHotSyscallsFirst)
+{
+    const auto *policy = SandboxPolicyEngine::TryResolvePolicy("CXX_PROGRAM");
+    ASSERT_NE(policy, nullptr);
+
+    EXPECT_EQ(policy->Layout, SandboxPolicyEngine::FilterLayout::Frequency);
+    ASSERT_FALSE(policy->FrequencyHints.empty());
+    EXPECT_EQ(policy->FrequencyHints.front(), SCMP_SYS(read));
+}
+
+TEST(PolicyRegistryTest, ParseFilterLayoutAndFrequencyHints)
+{
+    const auto policyDirectory = std::filesystem::temp_directory_path() / "sandboxrunner-layout";
+    std::filesystem::create_directories(policyDirectory);
+    const auto writePolicy = [&](const std::string &name, const std::string &seccomp) {
+        std::ofstream(policyDirectory / name) << R"({"Version": "1.0", "Seccomp": {"WhiteList": ["read", "write", "brk"], )"
+                                              << seccomp << "}}";
+        return (policyDirectory / name).string();
+    };
+
+    SandboxPolicyEngine::SandboxPolicy storage;
+    const auto *policy = SandboxPolicyEngine::TryResolvePolicyNoCache(
+        writePolicy("hints.json", R"("FrequencyHints": ["write", "read", "write"])"), storage);
+    ASSERT_NE(policy, nullptr);
+    EXPECT_EQ(policy->Layout, SandboxPolicyEngine::FilterLayout::Frequency);
+    EXPECT_EQ(policy->FrequencyHints, (std::vector<int>{SCMP_SYS(write), SCMP_SYS(read)}));
+
+    policy = SandboxPolicyEngine::TryResolvePolicyNoCache(writePolicy("tree.json", R"("FilterLayout": "BinaryTree")"),
+                                                          storage);
+    ASSERT_NE(policy, nullptr);
+    EXPECT_EQ(policy->Layout, SandboxPolicyEngine::FilterLayout::BinaryTree);
+
+    EXPECT_EQ(SandboxPolicyEngine::TryResolvePolicyNoCache(writePolicy("bad.json", R"("FilterLayout": "Random")"),
+                                                           storage),
+              nullptr);
+    EXPECT_EQ(SandboxPolicyEngine::TryResolvePolicyNoCache(
+                  writePolicy("bad_hint.json", R"("FrequencyHints": ["not_a_syscall"])"), storage),
+              nullptr);
+
+    std::error_code errorCode;
+    std::filesystem::remove_all(policyDirectory, errorCode);
+}
+
+TEST(PolicyRegistryTest, ParsePathAccessRules)
+{
+    const auto policyDirectory = std::filesystem::temp_directory_path() / "sandboxrunner-paths";
+    std::filesystem::create_directories(policyDirectory);
+    const auto writePolicy = [&](const std::string &name, const std::string &rules) {
+        std::ofstream(policyDirectory / name) << R"({"Version": "1.0", "Seccomp": {"WhiteList": ["read"]}, )"
+                                              << R"("PathAccessRules": [)" << rules << "]}";
+        return (policyDirectory / name).string();
+    };
+
+    SandboxPolicyEngine::SandboxPolicy storage;
+    const auto *policy = SandboxPolicyEngine::TryResolvePolicyNoCache(
+        writePolicy("rules.json", R"({"PathPrefix": "/usr/", "Mode": "ReadOnly"},
+                                     {"PathPrefix": "/tmp/work", "Mode": "ReadWrite"},
+                                     {"PathPrefix": "/tmp/work/data", "Mode": "ReadWrite"},
+                                     {"PathPrefix": "/home", "Mode": "NoAccess"})"),
+        storage);
+    ASSERT_NE(policy, nullptr);
+    ASSERT_EQ(policy->PathAccessRules.size(), 4U);
+    EXPECT_EQ(policy->PathAccessRules[0].PathPrefix, "/usr");
+    EXPECT_EQ(policy->PathAccessRules[0].Mode, SandboxPolicyEngine::PathAccessMode::ReadOnly);
+    EXPECT_EQ(policy->PathAccessRules[1].Mode, SandboxPolicyEngine::PathAccessMode::ReadWrite);
+    EXPECT_EQ(policy->PathAccessRules[3].Mode, SandboxPolicyEngine::PathAccessMode::NoAccess);
+
+    EXPECT_EQ(SandboxPolicyEngine::TryResolvePolicyNoCache(
+                  writePolicy("relative.json", R"({"PathPrefix": "usr", "Mode": "ReadOnly"})"), storage),
+              nullptr);
+    EXPECT_EQ(SandboxPolicyEngine::TryResolvePolicyNoCache(
+                  writePolicy("mode.json", R"({"PathPrefix": "/usr", "Mode": "Execute"})"), storage),
+              nullptr);
+    // Landlock cannot take back what a parent prefix grants.
+    EXPECT_EQ(SandboxPolicyEngine::TryResolvePolicyNoCache(
+                  writePolicy("nested.json", R"({"PathPrefix": "/tmp", "Mode": "ReadWrite"},
+                                                {"PathPrefix": "/tmp/secret", "Mode": "NoAccess"})"),
+                  storage),
+              nullptr);
+    EXPECT_EQ(SandboxPolicyEngine::TryResolvePolicyNoCache(
+                  writePolicy("narrowed.json", R"({"PathPrefix": "/", "Mode": "ReadWrite"},
+                                                  {"PathPrefix": "/usr", "Mode": "ReadOnly"})"),
+                  storage),
+              nullptr);
+
+    std::error_code errorCode;
+    std::filesystem::remove_all(policyDirectory, errorCode);
+}
+
+TEST(PolicyRegistryTest, ParseSupervisorRules)
+{
+    const auto policyDirectory = std::filesystem::temp_directory_path() / "sandboxrunner-supervisor";
+    std::filesystem::create_directories(policyDirectory);
+    const auto writePolicy = [&](const std::string &name, const std::string &supervisor) {
+        std::ofstream(policyDirectory / name) << R"({"Version": "1.0", "Seccomp": {"WhiteList": ["read"], )"
+                                              << R"("Supervisor": )" << supervisor << "}}";
+        return (policyDirectory / name).string();
+    };
+
+    SandboxPolicyEngine::SandboxPolicy storage;
+    const auto *policy = SandboxPolicyEngine::TryResolvePolicyNoCache(
+        writePolicy("rules.json", R"({"OpenPathRules": [{"PathPrefix": "/tmp", "Mode": "ReadWrite"},
+                                                        {"PathPrefix": "/tmp/secret", "Mode": "NoAccess"}],
+                                      "ExecvePaths": ["/bin/sh"],
+                                      "CloneFlags": ["CLONE_VM", "CLONE_THREAD", 256]})"),
+        storage);
+    ASSERT_NE(policy, nullptr);
+    // Unlike Landlock, the supervisor can narrow a parent prefix.
+    ASSERT_EQ(policy->Supervisor.OpenPathRules.size(), 2U);
+    EXPECT_EQ(policy->Supervisor.OpenPathRules[1].Mode, SandboxPolicyEngine::PathAccessMode::NoAccess);
+    ASSERT_EQ(policy->Supervisor.ExecvePaths.size(), 1U);
+    EXPECT_EQ(policy->Supervisor.ExecvePaths[0], "/bin/sh");
+    EXPECT_EQ(policy->Supervisor.AllowedCloneFlags, static_cast<uint64_t>(CLONE_VM | CLONE_THREAD | 256));
+    EXPECT_FALSE(policy->Supervisor.IsEmpty());
+
+    policy = SandboxPolicyEngine::TryResolvePolicyNoCache(writePolicy("empty.json", "{}"), storage);
+    ASSERT_NE(policy, nullptr);
+    EXPECT_TRUE(policy->Supervisor.IsEmpty());
+
+    EXPECT_EQ(SandboxPolicyEngine::TryResolvePolicyNoCache(writePolicy("relative.json", R"({"ExecvePaths": ["sh"]})"),
+                                                           storage),
+              nullptr);
+    EXPECT_EQ(SandboxPolicyEngine::TryResolvePolicyNoCache(
+                  writePolicy("flag.json", R"({"CloneFlags": ["CLONE_EVERYTHING"]})"), storage),
+              nullptr);
+
+    std::error_code errorCode;
+    std::filesystem::remove_all(policyDirectory, errorCode);
+}
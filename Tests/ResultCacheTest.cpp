@@ -0,0 +1,91 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/ContentHash.h"
+#include "../SandboxRunnerCore/Linux/ResultCache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+namespace
+{
+
+ContentDigest DigestWithHomeSlot(uint8_t home, uint8_t tag)
+{
+    ContentDigest digest{};
+    digest[0]  = home;
+    digest[31] = tag;
+    return digest;
+}
+
+} // namespace
+
+TEST(ResultCacheTest, Sha256MatchesKnownDigests)
+{
+    EXPECT_EQ(DigestToHex(Sha256().Finish()), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    Sha256 abc;
+    abc.Update("abc");
+    EXPECT_EQ(DigestToHex(abc.Finish()), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    // Crosses the block boundary in uneven pieces.
+    Sha256 longMessage;
+    longMessage.Update("abcdbcdecdefdefgefghfghighijhijkijkljklmklmn");
+    longMessage.Update("lmnomnopnopq");
+    EXPECT_EQ(DigestToHex(longMessage.Finish()), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+TEST(ResultCacheTest, StoredEntriesAreFoundAfterCollisions)
+{
+    const auto indexPath = std::filesystem::temp_directory_path() / ("result-cache-test-" + std::to_string(getpid()));
+    std::filesystem::remove(indexPath);
+    const ResultCache cache(indexPath.string(), 8);
+
+    EXPECT_FALSE(cache.Lookup(DigestWithHomeSlot(3, 1)).has_value());
+
+    // Same home slot, the second entry is placed in the next one.
+    for (uint8_t tag = 1; tag <= 2; ++tag)
+    {
+        ResultCacheEntry entry{};
+        entry.Key             = DigestWithHomeSlot(3, tag);
+        entry.Result.Status   = SANDBOX_STATUS_CPU_TIME_LIMIT_EXCEEDED;
+        entry.PeakMemoryUsage = tag * 1024;
+        ASSERT_TRUE(cache.Store(entry));
+    }
+
+    const auto second = cache.Lookup(DigestWithHomeSlot(3, 2));
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(second->Result.Status, SANDBOX_STATUS_CPU_TIME_LIMIT_EXCEEDED);
+    EXPECT_EQ(second->PeakMemoryUsage, 2048U);
+    EXPECT_EQ(cache.Lookup(DigestWithHomeSlot(3, 1))->PeakMemoryUsage, 1024U);
+    EXPECT_FALSE(cache.Lookup(DigestWithHomeSlot(3, 3)).has_value());
+
+    // A foreign file is replaced, not misread.
+    std::ofstream(indexPath) << "not an index";
+    EXPECT_FALSE(cache.Lookup(DigestWithHomeSlot(3, 1)).has_value());
+    ResultCacheEntry entry{};
+    entry.Key = DigestWithHomeSlot(3, 1);
+    EXPECT_TRUE(cache.Store(entry));
+    EXPECT_TRUE(cache.Lookup(entry.Key).has_value());
+
+    std::filesystem::remove(indexPath);
+}
+
+TEST(ResultCacheTest, OnlyLoadIndependentResultsAreCacheable)
+{
+    SandboxResultEx result{};
+    result.Result.Status = SANDBOX_STATUS_CPU_TIME_LIMIT_EXCEEDED;
+    EXPECT_TRUE(IsResultCacheable(result));
+
+    result.TimingConfidence = SANDBOX_TIMING_CONFIDENCE_LOW;
+    EXPECT_FALSE(IsResultCacheable(result));
+
+    result                   = {};
+    result.Result.Status     = SANDBOX_STATUS_RUNTIME_ERROR;
+    result.TerminationReason = SANDBOX_TERMINATION_IDLE_LIMIT;
+    EXPECT_FALSE(IsResultCacheable(result));
+
+    result               = {};
+    result.Result.Status = SANDBOX_STATUS_REAL_TIME_LIMIT_EXCEEDED;
+    EXPECT_FALSE(IsResultCacheable(result));
+}
@@ -0,0 +1,45 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/RunStatistics.h"
+
+TEST(RunStatisticsTest, SummarizesTheDistribution)
+{
+    std::vector<double> values;
+    for (int i = 20; i >= 1; --i)
+        values.push_back(i);
+
+    const auto statistics = ComputeRunStatistics(values);
+    EXPECT_DOUBLE_EQ(statistics.Min, 1);
+    EXPECT_DOUBLE_EQ(statistics.Max, 20);
+    EXPECT_DOUBLE_EQ(statistics.Median, 10.5);
+    EXPECT_DOUBLE_EQ(statistics.P95, 19);
+    EXPECT_DOUBLE_EQ(statistics.Mean, 10.5);
+    EXPECT_NEAR(statistics.StdDev, 5.916, 0.001);
+
+    const auto single = ComputeRunStatistics({7});
+    EXPECT_DOUBLE_EQ(single.Median, 7);
+    EXPECT_DOUBLE_EQ(single.P95, 7);
+    EXPECT_DOUBLE_EQ(single.StdDev, 0);
+
+    EXPECT_DOUBLE_EQ(ComputeRunStatistics({}).Max, 0);
+}
+
+TEST(RunStatisticsTest, ReportsTheMostFrequentStatus)
+{
+    std::vector<SandboxResultEx> runs(3);
+    runs[0].Result.Status = SANDBOX_STATUS_CPU_TIME_LIMIT_EXCEEDED;
+    runs[1].Result.Status = SANDBOX_STATUS_SUCCESS;
+    runs[2].Result.Status = SANDBOX_STATUS_CPU_TIME_LIMIT_EXCEEDED;
+    for (auto &run : runs)
+    {
+        run.Timeline.ExecStart = 1000000;
+        run.Timeline.Exit      = 3000000;
+    }
+
+    SandboxRepeatResult result{};
+    SummarizeRepeatedRuns(runs, result);
+    EXPECT_EQ(result.RunCount, 3U);
+    EXPECT_EQ(result.Status, SANDBOX_STATUS_CPU_TIME_LIMIT_EXCEEDED);
+    EXPECT_EQ(result.StatusAgreement, 2U);
+    EXPECT_DOUBLE_EQ(result.RealTimeUs.Median, 2000);
+}
@@ -0,0 +1,12 @@
+#include <bits/stdc++.h>
+using namespace std;
+
+int main() {
+    // 40M ints ~= 160MB resident: over the soft limit (128MB), under the hard fallback (256MB).
+    vector overflow(40 * 1024 * 1024, 1);
+    cout << accumulate(overflow.begin(), overflow.end(), 0LL) << endl;
+
+    // Would run into the real time limit if the supervisor waited for the exit.
+    this_thread::sleep_for(chrono::seconds(5));
+    return 0;
+}
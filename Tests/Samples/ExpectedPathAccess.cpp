@@ -0,0 +1,21 @@
+#include <bits/stdc++.h>
+using namespace std;
+
+// Prints the first line of the file named by the first argument, fails if it cannot be opened.
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        return 2;
+
+    ifstream input(argv[1]);
+    if (!input.is_open())
+    {
+        cerr << "cannot open " << argv[1] << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    string line;
+    getline(input, line);
+    cout << line << endl;
+    return 0;
+}
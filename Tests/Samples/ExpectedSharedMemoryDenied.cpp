@@ -0,0 +1,31 @@
+#include <bits/stdc++.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+static char childStack[64 * 1024];
+
+static int RunChild(void *)
+{
+    return 0;
+}
+
+// Creates processes that share its memory, succeeds only if both vfork and clone(CLONE_VM) fail with EPERM.
+int main()
+{
+    const pid_t forked = vfork();
+    if (forked == 0)
+        _exit(0);
+    const int vforkError = forked < 0 ? errno : 0;
+    if (forked > 0)
+        waitpid(forked, nullptr, 0);
+
+    const pid_t cloned = clone(RunChild, childStack + sizeof(childStack), CLONE_VM | SIGCHLD, nullptr);
+    const int cloneError = cloned < 0 ? errno : 0;
+    if (cloned > 0)
+        waitpid(cloned, nullptr, 0);
+
+    cout << "vfork: " << strerror(vforkError) << endl << "clone: " << strerror(cloneError) << endl;
+    return vforkError == EPERM && cloneError == EPERM ? 0 : 1;
+}
@@ -7,12 +7,17 @@
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 #include <nlohmann/json.hpp>
 
 #ifndef _WIN32
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
 #include <sys/wait.h>
+#include <unistd.h>
 #endif
 
 namespace
@@ -167,6 +172,65 @@ TEST(SandboxRunnerCliTest, OutputsJsonResult)
     EXPECT_TRUE(json.contains("CpuTimeUsage"));
     EXPECT_TRUE(json.contains("RealTimeUsage"));
     EXPECT_TRUE(json.contains("MemoryUsage"));
+    EXPECT_EQ(json.at("TerminationReason"), "NONE");
+    EXPECT_TRUE(json.at("PhaseTimeUsage").contains("Run"));
+    EXPECT_TRUE(json.at("ResourceCounters").contains("MinorPageFaults"));
+    EXPECT_EQ(json.at("ResourceCounters").at("PeakMemorySource"), "rusage");
+#else
+    GTEST_SKIP() << "CLI sandbox execution test is only supported on Linux.";
+#endif
+}
+
+TEST(SandboxRunnerCliTest, OutputsResourceSamples)
+{
+#ifdef __linux__
+    const auto result = RunSandboxRunner({"--format", "json", "--sample-interval", "10", "/bin/sleep 0.1"});
+    ASSERT_EQ(result.ExitCode, 0) << result.StdErr;
+
+    const auto samples = nlohmann::json::parse(result.StdOut).at("Samples");
+    EXPECT_EQ(samples.at("IntervalMs"), 10);
+    EXPECT_GE(samples.at("TimeUs").size(), 5U);
+    EXPECT_EQ(samples.at("ResidentMemory").size(), samples.at("TimeUs").size());
+    EXPECT_EQ(samples.at("CpuTimeUs").size(), samples.at("TimeUs").size());
+#else
+    GTEST_SKIP() << "CLI sandbox execution test is only supported on Linux.";
+#endif
+}
+
+TEST(SandboxRunnerCliTest, OutputsRepeatStatistics)
+{
+#ifdef __linux__
+    const auto result = RunSandboxRunner({"--format", "json", "--repeat", "3", "/bin/true"});
+    ASSERT_EQ(result.ExitCode, 0) << result.StdErr;
+
+    const auto json = nlohmann::json::parse(result.StdOut);
+    EXPECT_EQ(json.at("RunCount"), 3);
+    EXPECT_EQ(json.at("StatusName"), "SUCCESS");
+    EXPECT_EQ(json.at("StatusAgreement"), 3);
+    for (const char *measurement : {"CpuTimeUs", "RealTimeUs", "MemoryUsage"})
+    {
+        for (const char *statistic : {"Min", "Median", "P95", "Max", "Mean", "StdDev"})
+            EXPECT_TRUE(json.at(measurement).contains(statistic)) << measurement << "." << statistic;
+    }
+#else
+    GTEST_SKIP() << "CLI sandbox execution test is only supported on Linux.";
+#endif
+}
+
+TEST(SandboxRunnerCliTest, WritesPrometheusMetricsOnExit)
+{
+#ifdef __linux__
+    const auto metricsPath = MakeTemporaryPath("metrics.prom");
+    const auto result      = RunSandboxRunner({"--metrics", metricsPath.string(), "--repeat", "3", "/bin/true"});
+    ASSERT_EQ(result.ExitCode, 0) << result.StdErr;
+
+    const std::string metrics = ReadTextFile(metricsPath);
+    EXPECT_NE(metrics.find("sandbox_launches_total 3\n"), std::string::npos) << metrics;
+    EXPECT_NE(metrics.find("sandbox_verdicts_total{status=\"SUCCESS\"} 3\n"), std::string::npos) << metrics;
+    EXPECT_NE(metrics.find("sandbox_run_duration_seconds_count 3\n"), std::string::npos) << metrics;
+
+    std::error_code errorCode;
+    std::filesystem::remove(metricsPath, errorCode);
 #else
     GTEST_SKIP() << "CLI sandbox execution test is only supported on Linux.";
 #endif
@@ -189,3 +253,174 @@ TEST(SandboxRunnerCliTest, OutputsTextResultAndRejectsInvalidFormat)
     GTEST_SKIP() << "CLI sandbox execution test is only supported on Linux.";
 #endif
 }
+
+TEST(SandboxRunnerCliTest, SpoolRunnersShareJobs)
+{
+#ifdef __linux__
+    const auto spool = MakeTemporaryPath("spool");
+    std::filesystem::create_directories(spool / "pending");
+    std::filesystem::create_directories(spool / "running");
+    for (int i = 0; i < 6; ++i)
+        std::ofstream(spool / "pending" / ("job" + std::to_string(i) + ".json")) << R"(["/bin/echo )" << i << R"("])";
+    std::ofstream(spool / "pending" / "invalid.json") << R"(["--format", "xml", "/bin/true"])";
+
+    // Left behind by a runner that crashed long ago.
+    const auto stale = spool / "running" / "stale.json@crashed-1-0";
+    std::ofstream(stale) << R"(["/bin/true"])";
+    std::filesystem::last_write_time(stale, std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+
+    std::vector<std::thread> runners;
+    for (int runner = 0; runner < 2; ++runner)
+    {
+        runners.emplace_back([&spool] {
+            const auto result = RunSandboxRunner({"--spool", spool.string()});
+            EXPECT_EQ(result.ExitCode, 0) << result.StdErr;
+        });
+    }
+    for (auto &runner : runners)
+        runner.join();
+
+    EXPECT_TRUE(std::filesystem::is_empty(spool / "pending"));
+    EXPECT_TRUE(std::filesystem::is_empty(spool / "running"));
+    for (const std::string stem : {"job0", "job1", "job2", "job3", "job4", "job5", "stale"})
+    {
+        EXPECT_TRUE(std::filesystem::exists(spool / "done" / (stem + ".json"))) << stem;
+        const auto result = nlohmann::json::parse(ReadTextFile(spool / "done" / (stem + ".result.json")));
+        EXPECT_EQ(result.at("StatusName"), "SUCCESS") << stem;
+    }
+    const auto invalid = nlohmann::json::parse(ReadTextFile(spool / "done" / "invalid.result.json"));
+    EXPECT_NE(invalid.at("Error").get<std::string>().find("Invalid output format: xml"), std::string::npos);
+
+    std::error_code errorCode;
+    std::filesystem::remove_all(spool, errorCode);
+#else
+    GTEST_SKIP() << "CLI sandbox execution test is only supported on Linux.";
+#endif
+}
+
+TEST(SandboxRunnerCliTest, RingRunsSubmissionsWithRegisteredFiles)
+{
+#ifdef __linux__
+    const auto runnerPath = ResolveSandboxRunnerPath();
+    ASSERT_FALSE(runnerPath.empty());
+    const std::string name = MakeTemporaryPath("ring").filename().string();
+    std::vector<std::string> args = {runnerPath.string(), "--ring", name, "--parallel", "2"};
+    std::vector<char *> argv;
+    for (auto &argument : args)
+        argv.push_back(argument.data());
+    argv.push_back(nullptr);
+    pid_t runner = -1;
+    ASSERT_EQ(posix_spawn(&runner, argv[0], nullptr, nullptr, argv.data(), environ), 0);
+
+    SandboxRing *ring = nullptr;
+    for (int attempt = 0; attempt < 500 && ring == nullptr; ++attempt)
+    {
+        ring = OpenSandboxRing(name.c_str());
+        if (ring == nullptr)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_NE(ring, nullptr);
+
+    constexpr uint32_t runCount = 4;
+    std::vector<std::filesystem::path> files;
+    ASSERT_EQ(RegisterSandboxRingConfig(ring, 0, R"(["/bin/cat"])"), SANDBOX_STATUS_SUCCESS);
+    ASSERT_EQ(RegisterSandboxRingConfig(ring, 1, R"(["--format", "xml", "/bin/true"])"), SANDBOX_STATUS_SUCCESS);
+    std::vector<SandboxRingSubmission> submissions;
+    for (uint32_t i = 0; i < runCount; ++i)
+    {
+        files.push_back(MakeTemporaryPath("ring-input-" + std::to_string(i)));
+        files.push_back(MakeTemporaryPath("ring-output-" + std::to_string(i)));
+        std::ofstream(files[2 * i]) << "run " << i;
+        ASSERT_EQ(RegisterSandboxRingFile(ring, 2 * i, files[2 * i].c_str()), SANDBOX_STATUS_SUCCESS);
+        ASSERT_EQ(RegisterSandboxRingFile(ring, 2 * i + 1, files[2 * i + 1].c_str()), SANDBOX_STATUS_SUCCESS);
+        submissions.push_back({.UserData = i, .ConfigId = 0, .InputId = 2 * i, .OutputId = 2 * i + 1, .Reserved = 0});
+    }
+    submissions.push_back({.UserData = runCount, .ConfigId = 1, .InputId = SANDBOX_RING_NO_FILE,
+                           .OutputId = SANDBOX_RING_NO_FILE, .Reserved = 0});
+    ASSERT_EQ(SubmitSandboxRing(ring, submissions.data(), runCount + 1), runCount + 1);
+
+    SandboxRingCompletion completions[runCount + 1];
+    uint32_t reaped = 0;
+    while (reaped < runCount + 1)
+    {
+        const uint32_t count = ReapSandboxRing(ring, completions + reaped, runCount + 1 - reaped, 10000);
+        ASSERT_NE(count, 0U);
+        reaped += count;
+    }
+    for (const auto &completion : completions)
+    {
+        if (completion.UserData == runCount)
+        {
+            EXPECT_EQ(completion.InfraStatus, SANDBOX_STATUS_INTERNAL_ERROR);
+            continue;
+        }
+        EXPECT_EQ(completion.InfraStatus, SANDBOX_STATUS_SUCCESS);
+        EXPECT_EQ(completion.Result.Status, SANDBOX_STATUS_SUCCESS);
+        EXPECT_EQ(ReadTextFile(files[2 * completion.UserData + 1]), "run " + std::to_string(completion.UserData));
+    }
+    CloseSandboxRing(ring);
+
+    kill(runner, SIGTERM);
+    int status = 0;
+    ASSERT_EQ(waitpid(runner, &status, 0), runner);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_EQ(OpenSandboxRing(name.c_str()), nullptr);
+
+    std::error_code errorCode;
+    for (const auto &file : files)
+        std::filesystem::remove(file, errorCode);
+#else
+    GTEST_SKIP() << "CLI sandbox execution test is only supported on Linux.";
+#endif
+}
+
+TEST(SandboxRunnerCliTest, TopShowsRunsOfAnotherRunner)
+{
+#ifdef __linux__
+    const auto runnerPath = ResolveSandboxRunnerPath();
+    ASSERT_FALSE(runnerPath.empty());
+    const std::string name = MakeTemporaryPath("top").filename().string();
+    std::vector<std::string> args = {runnerPath.string(), "--activity", name, "--name", "top-test", "--memory",
+                                     "268435456", "/bin/sleep 2"};
+    std::vector<char *> argv;
+    for (auto &argument : args)
+        argv.push_back(argument.data());
+    argv.push_back(nullptr);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t runner = -1;
+    ASSERT_EQ(posix_spawn(&runner, argv[0], &actions, nullptr, argv.data(), environ), 0);
+    posix_spawn_file_actions_destroy(&actions);
+
+    nlohmann::json runs;
+    for (int attempt = 0; attempt < 100 && (runs.empty() || runs[0]["Phase"] != "RUNNING"); ++attempt)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const auto result = RunSandboxRunner({"--top", name, "--top-interval", "0", "--format", "json"});
+        if (result.ExitCode == 0)
+            runs = nlohmann::json::parse(result.StdOut);
+    }
+    ASSERT_EQ(runs.size(), 1U);
+    EXPECT_EQ(runs[0]["TaskName"], "top-test");
+    EXPECT_EQ(runs[0]["Policy"], "default");
+    EXPECT_EQ(runs[0]["Phase"], "RUNNING");
+    EXPECT_GT(runs[0]["Pid"].get<int>(), 0);
+    EXPECT_EQ(runs[0]["MaxMemory"], 268435456U);
+
+    const auto table = RunSandboxRunner({"--top", name, "--top-interval", "0"});
+    EXPECT_EQ(table.ExitCode, 0);
+    EXPECT_NE(table.StdOut.find("1 run(s) in progress on " + name), std::string::npos) << table.StdOut;
+    EXPECT_NE(table.StdOut.find("top-test"), std::string::npos) << table.StdOut;
+    EXPECT_NE(table.StdOut.find("/256.0"), std::string::npos) << table.StdOut;
+
+    int status = 0;
+    ASSERT_EQ(waitpid(runner, &status, 0), runner);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    const auto gone = RunSandboxRunner({"--top", name, "--top-interval", "0"});
+    EXPECT_EQ(gone.ExitCode, 1);
+#else
+    GTEST_SKIP() << "CLI sandbox execution test is only supported on Linux.";
+#endif
+}
@@ -6,9 +6,23 @@
  */
 
 #include "SandboxTest.h"
+#include "../SandboxRunnerCore/Linux/PathAccessRuleset.h"
+#include "../SandboxRunnerCore/Policy/PolicyRegistry.h"
+#include <atomic>
+#include <cmath>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sched.h>
+#include <seccomp.h>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <string_view>
+#include <thread>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
 
 #define INIT_SANDBOX_TESTCASE(TestName)                                                                                \
     SandboxResult result{};                                                                                            \
@@ -162,6 +176,24 @@ TEST(SandboxTest, ExpectedRealTimeout)
     ASSERT_EQ(result.Status, SANDBOX_STATUS_REAL_TIME_LIMIT_EXCEEDED);
 }
 
+TEST(SandboxTest, RealTimeLimitCountsFromExec)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedTimeout);
+    configuration.MaxRealTime = 1500;
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, nullptr, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_REAL_TIME_LIMIT_EXCEEDED);
+
+    // Killed at the limit measured from execve instead of rounded up to whole seconds.
+    EXPECT_GE(result.RealTimeUsage, 1500U);
+    EXPECT_LT(result.RealTimeUsage, 1900U);
+    EXPECT_EQ(resultEx.TerminationReason, SANDBOX_TERMINATION_REAL_TIME_LIMIT);
+}
+
 TEST(SandboxTest, ExpectedCpuTimeout)
 {
     INIT_SANDBOX_TESTCASE(ExpectedCpuTimeout);
@@ -180,6 +212,97 @@ TEST(SandboxTest, ExpectedMemoryLimitExceeded)
     ASSERT_EQ(result.Status, SANDBOX_STATUS_MEMORY_LIMIT_EXCEEDED);
 }
 
+TEST(SandboxTest, MemoryLimitKillsWhileRunning)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedMemoryLimitExceededEarly);
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, nullptr, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_MEMORY_LIMIT_EXCEEDED);
+    EXPECT_EQ(resultEx.TerminationReason, SANDBOX_TERMINATION_MEMORY_LIMIT);
+    EXPECT_EQ(result.Signal, SIGKILL);
+
+    // Killed right after the allocation, not after the five second sleep or at MaxRealTime.
+    EXPECT_LT(result.RealTimeUsage, 1500U);
+}
+
+TEST(SandboxTest, IdleLimitEndsHangsEarly)
+{
+    // Sleeps for five seconds without using any CPU time.
+    INIT_SANDBOX_TESTCASE(ExpectedTimeout);
+    configuration.MaxRealTime = 10000;
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize  = sizeof(SandboxConfigurationEx);
+    extension.Version     = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.MaxIdleTime = 300;
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_REAL_TIME_LIMIT_EXCEEDED);
+    EXPECT_EQ(resultEx.TerminationReason, SANDBOX_TERMINATION_IDLE_LIMIT);
+    // Well before the sleep ends, with room for a loaded machine.
+    EXPECT_GE(result.RealTimeUsage, 300U);
+    EXPECT_LT(result.RealTimeUsage, 4000U);
+}
+
+TEST(SandboxTest, IdleLimitSparesBusyPrograms)
+{
+    // Spins until MaxCpuTime. On a machine busy with other tests the program may wait for a CPU for a
+    // while, so it would only be idle if it got no CPU time at all for three seconds. The real time limit
+    // leaves room to use up the CPU time at a small share of a core.
+    INIT_SANDBOX_TESTCASE(ExpectedCpuTimeout);
+    configuration.MaxCpuTime  = 300;
+    configuration.MaxRealTime = 30000;
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize  = sizeof(SandboxConfigurationEx);
+    extension.Version     = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.MaxIdleTime = 3000;
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_CPU_TIME_LIMIT_EXCEEDED);
+    EXPECT_EQ(resultEx.TerminationReason, SANDBOX_TERMINATION_NONE);
+}
+
+TEST(SandboxTest, IdleLimitCountsBusyChildren)
+{
+    // The shell only waits, its child spins for three seconds, three times the idle limit.
+    const auto script = std::filesystem::current_path() / "TestData" / "idle-children.sh";
+    std::filesystem::create_directories(script.parent_path());
+    std::ofstream(script) << "/bin/sh -c 'while :; do :; done' &\nsleep 3\nkill $!\n";
+    const std::string command = "/bin/sh " + script.string();
+
+    SandboxConfiguration configuration{};
+    configuration.TaskName        = "IdleChildren";
+    configuration.UserCommand     = command.c_str();
+    configuration.MaxRealTime     = 10000;
+    configuration.MaxProcessCount = -1;
+    configuration.Policy          = "default";
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize  = sizeof(SandboxConfigurationEx);
+    extension.Version     = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.MaxIdleTime = 1000;
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    PrintResult(resultEx.Result);
+    ASSERT_EQ(resultEx.Result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(resultEx.TerminationReason, SANDBOX_TERMINATION_NONE);
+}
+
 TEST(SandboxTest, ExpectedRuntimeError)
 {
     INIT_SANDBOX_TESTCASE(ExpectedRuntimeError);
@@ -194,16 +317,575 @@ TEST(SandboxTest, ExpectedOutputLimitExceeded)
     ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
     PrintResult(result);
     ASSERT_EQ(result.Signal, SIGXFSZ);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_OUTPUT_LIMIT_EXCEEDED);
+}
+
+TEST(SandboxTest, OutputLimitCoversDevices)
+{
+    // RLIMIT_FSIZE does not apply to /dev/null, the write counter has to catch it.
+    INIT_SANDBOX_TESTCASE(ExpectedOutputLimitExceeded);
+    configuration.OutputFile = "/dev/null";
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_OUTPUT_LIMIT_EXCEEDED);
+
+    // A relative OutputFile is the device in the working directory, not a file of the caller's.
+    configuration.WorkingDirectory = "/dev";
+    configuration.OutputFile       = "null";
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_OUTPUT_LIMIT_EXCEEDED);
+}
+
+// Runs script under the default policy with a 10 KiB output limit.
+SandboxResult RunOutputLimitScript(const std::string &name, const std::string &script, const char *outputFile,
+                                   const char *errorFile)
+{
+    const auto path = std::filesystem::current_path() / "TestData" / name;
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream(path) << script;
+    const std::string command = "/bin/sh " + path.string();
+
+    SandboxConfiguration configuration{};
+    configuration.TaskName        = name.c_str();
+    configuration.UserCommand     = command.c_str();
+    configuration.OutputFile      = outputFile;
+    configuration.ErrorFile       = errorFile;
+    configuration.MaxRealTime     = 3000;
+    configuration.MaxOutputSize   = 10 * 1024;
+    configuration.MaxProcessCount = -1;
+    configuration.Policy          = "default";
+
+    SandboxResult result{};
+    EXPECT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    return result;
+}
+
+TEST(SandboxTest, OutputLimitCountsOnlyTheOutputFile)
+{
+    // Writes to another file do not count, the limit is for what reaches OutputFile.
+    const auto elsewhere = RunOutputLimitScript("other-output.sh", "head -c 100000 /dev/zero >/dev/null\necho done\n",
+                                                "/dev/null", nullptr);
+    EXPECT_EQ(elsewhere.Status, SANDBOX_STATUS_SUCCESS);
+
+    // A descendant's output reaches OutputFile as well.
+    const auto fromChild =
+        RunOutputLimitScript("child-output.sh", "/bin/sh -c 'head -c 100000 /dev/zero'\n", "/dev/null", nullptr);
+    EXPECT_EQ(fromChild.Status, SANDBOX_STATUS_OUTPUT_LIMIT_EXCEEDED);
+
+    // And so does stderr, when it is the same file.
+    const auto merged =
+        RunOutputLimitScript("merged-output.sh", "head -c 100000 /dev/zero >&2\n", "/dev/null", "/dev/null");
+    EXPECT_EQ(merged.Status, SANDBOX_STATUS_OUTPUT_LIMIT_EXCEEDED);
+}
+
+TEST(SandboxTest, OutputLimitPassesOutputThrough)
+{
+    const auto fifo = std::filesystem::current_path() / "TestData" / "relay.fifo";
+    std::filesystem::remove(fifo);
+    ASSERT_EQ(mkfifo(fifo.c_str(), 0600), 0);
+
+    // Read from before the run starts to after it ends, as a consumer of a pipe would.
+    std::string received;
+    std::thread reader([&] {
+        std::ifstream stream(fifo);
+        received.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    });
+    const auto result = RunOutputLimitScript("fifo-output.sh", "echo hello\n", fifo.c_str(), nullptr);
+    reader.join();
+    std::filesystem::remove(fifo);
+
+    EXPECT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(received, "hello\n");
 }
 
 TEST(SandboxTest, ExpectedProcessLimitExceeded)
 {
     INIT_SANDBOX_TESTCASE(ExpectedProcessLimitExceeded);
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, nullptr, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    // The policy forbids fork, but with a limit of 0 the process limit is the better verdict.
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_PROCESS_LIMIT_EXCEEDED);
+    EXPECT_EQ(resultEx.TerminationReason, SANDBOX_TERMINATION_PROCESS_LIMIT);
+}
+
+TEST(SandboxTest, ProcessLimitAllowsForksUpToTheLimit)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedProcessLimitExceeded);
+    configuration.Policy          = "default";
+    configuration.MaxProcessCount = 1;
     ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
     PrintResult(result);
-    // Killed by seccomp policy (try to call fork) rather than the ulimit
-    // so SANDBOX_STATUS_PROCESS_LIMIT_EXCEEDED may never be used in some policies
-    ASSERT_EQ(result.Status, SANDBOX_STATUS_ILLEGAL_OPERATION);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+}
+
+// Runs script under the default policy with the given process limit.
+SandboxResult RunProcessLimitScript(const std::string &name, const std::string &script, int maxProcessCount)
+{
+    const auto path = std::filesystem::current_path() / "TestData" / name;
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream(path) << script;
+    const std::string command = "/bin/sh " + path.string();
+
+    SandboxConfiguration configuration{};
+    configuration.TaskName        = name.c_str();
+    configuration.UserCommand     = command.c_str();
+    configuration.MaxRealTime     = 5000;
+    configuration.MaxProcessCount = maxProcessCount;
+    configuration.Policy          = "default";
+
+    SandboxResult result{};
+    EXPECT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    return result;
+}
+
+TEST(SandboxTest, ProcessLimitCountsLiveProcesses)
+{
+    // One process at a time, each reaped before the next starts.
+    const auto result = RunProcessLimitScript("sequential-forks.sh", "/bin/true\n/bin/true\n/bin/true\n/bin/true\n", 1);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+}
+
+TEST(SandboxTest, ProcessLimitCountsOrphans)
+{
+    // Each inner shell exits at once, leaving its sleep orphaned; the second one makes three processes.
+    const auto result =
+        RunProcessLimitScript("orphan-forks.sh", "/bin/sh -c 'sleep 3 &'\n/bin/sh -c 'sleep 3 &'\n/bin/true\n", 2);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_PROCESS_LIMIT_EXCEEDED);
+}
+
+TEST(SandboxTest, PinnedRunReportsItsCore)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    SandboxConfigurationEx extension{};
+    extension.StructSize = sizeof(SandboxConfigurationEx);
+    extension.Version    = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.PinToCore  = 1;
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+
+    cpu_set_t allowed;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    ASSERT_GE(resultEx.CpuCore, 0);
+    EXPECT_TRUE(CPU_ISSET(resultEx.CpuCore, &allowed));
+
+    // Unpinned runs report no core.
+    ASSERT_EQ(StartSandboxEx(&configuration, nullptr, &resultEx), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(resultEx.CpuCore, -1);
+}
+
+TEST(SandboxTest, CalibratedRunReportsNormalizedCpuTime)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    SandboxConfigurationEx extension{};
+    extension.StructSize         = sizeof(SandboxConfigurationEx);
+    extension.Version            = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.TimingCalibration  = SANDBOX_TIMING_CALIBRATION_REPORT;
+    extension.MaxNearLimitReruns = 2;
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+
+    ASSERT_GT(resultEx.SpeedFactor, 0.0);
+    EXPECT_EQ(resultEx.NormalizedCpuTimeUs,
+              static_cast<uint64_t>(std::llround(static_cast<double>(resultEx.UserTimeUs) * resultEx.SpeedFactor)));
+    // Far below the 1000 ms limit, no reason to re-run.
+    EXPECT_EQ(resultEx.TimingConfidence, SANDBOX_TIMING_CONFIDENCE_HIGH);
+    EXPECT_EQ(resultEx.RunCount, 1U);
+}
+
+TEST(SandboxTest, CachedRunIsReplayed)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    const auto cacheFile = std::filesystem::temp_directory_path() / ("sandbox-result-cache-" + std::to_string(getpid()));
+    const std::string cacheFileName = cacheFile.string();
+    SandboxConfigurationEx extension{};
+    extension.StructSize      = sizeof(SandboxConfigurationEx);
+    extension.Version         = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.ResultCacheFile = cacheFileName.c_str();
+
+    SandboxResultEx executed{};
+    executed.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &executed), SANDBOX_STATUS_SUCCESS);
+    ASSERT_EQ(executed.Result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(executed.FromResultCache, 0U);
+
+    const auto readOutput = [&outputFile] {
+        std::ifstream stream(outputFile);
+        return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    };
+    const std::string expectedOutput = readOutput();
+    std::filesystem::remove(outputFile);
+
+    SandboxResultEx replayed{};
+    replayed.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &replayed), SANDBOX_STATUS_SUCCESS);
+    result = replayed.Result;
+    PrintResult(result);
+    EXPECT_EQ(replayed.FromResultCache, 1U);
+    EXPECT_EQ(result.Status, executed.Result.Status);
+    EXPECT_EQ(result.CpuTimeUsage, executed.Result.CpuTimeUsage);
+    EXPECT_EQ(replayed.PeakMemoryUsage, executed.PeakMemoryUsage);
+    EXPECT_EQ(replayed.Timeline.ExecStart, 0U);
+    EXPECT_EQ(readOutput(), expectedOutput);
+
+    // A different limit is a different key.
+    configuration.MaxCpuTime = 2000;
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &replayed), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(replayed.FromResultCache, 0U);
+
+    extension.ResultCacheMode = SANDBOX_RESULT_CACHE_REFRESH;
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &replayed), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(replayed.FromResultCache, 0U);
+    EXPECT_GT(replayed.Timeline.ExecStart, 0U);
+
+    std::filesystem::remove(cacheFile);
+    std::filesystem::remove_all(cacheFileName + ".blobs");
+}
+
+TEST(SandboxTest, CachedExecutableRunsUnderRestrictedExecve)
+{
+    // CXX_PROGRAM sets RestrictExecveToProgramPath.
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    SandboxConfigurationEx extension{};
+    extension.StructSize      = sizeof(SandboxConfigurationEx);
+    extension.Version         = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.CacheExecutable = 1;
+
+    for (int run = 0; run < 2; ++run)
+    {
+        SandboxResultEx resultEx{};
+        resultEx.StructSize = sizeof(SandboxResultEx);
+        ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+        result = resultEx.Result;
+        PrintResult(result);
+        EXPECT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+        EXPECT_EQ(result.ExitCode, 0);
+        EXPECT_EQ(resultEx.FromExecutableCache, 1U);
+    }
+}
+
+TEST(SandboxTest, CachedExecutableFdIsOutOfReach)
+{
+    // The execveat rule names the descriptor's number, the program must never be able to open it again.
+    const auto directory = std::filesystem::current_path() / "TestData";
+    const auto script    = directory / "nofile.sh";
+    const auto output    = directory / "nofile.out";
+    std::ofstream(script) << "ulimit -Sn\nulimit -Hn\n";
+    const std::string command    = "/bin/sh " + script.string();
+    const std::string outputFile = output.string();
+
+    SandboxConfiguration configuration{};
+    configuration.TaskName        = "CachedFd";
+    configuration.UserCommand     = command.c_str();
+    configuration.OutputFile      = outputFile.c_str();
+    configuration.MaxRealTime     = 3000;
+    configuration.MaxProcessCount = -1;
+    configuration.Policy          = "default";
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize      = sizeof(SandboxConfigurationEx);
+    extension.Version         = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.CacheExecutable = 1;
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    PrintResult(resultEx.Result);
+    ASSERT_EQ(resultEx.Result.Status, SANDBOX_STATUS_SUCCESS);
+    ASSERT_EQ(resultEx.FromExecutableCache, 1U);
+
+    rlimit supervisorLimit{};
+    ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &supervisorLimit), 0);
+    uint64_t soft = 0;
+    uint64_t hard = 0;
+    std::ifstream(output) >> soft >> hard;
+    EXPECT_EQ(soft, hard);
+    EXPECT_GT(hard, 0U);
+    EXPECT_LT(hard, supervisorLimit.rlim_cur);
+}
+
+TEST(SandboxTest, NotifySocketIsOutOfReach)
+{
+    // The process gate's filter allows sendmsg() on the socket's number, the program must never get it again.
+    const auto directory = std::filesystem::current_path() / "TestData";
+    const auto script    = directory / "notify-nofile.sh";
+    const auto output    = directory / "notify-nofile.out";
+    std::ofstream(script) << "ulimit -Sn\nulimit -Hn\n";
+    const std::string command    = "/bin/sh " + script.string();
+    const std::string outputFile = output.string();
+
+    SandboxConfiguration configuration{};
+    configuration.TaskName        = "NotifySocket";
+    configuration.UserCommand     = command.c_str();
+    configuration.OutputFile      = outputFile.c_str();
+    configuration.MaxRealTime     = 3000;
+    configuration.MaxProcessCount = 4;
+    configuration.Policy          = "default";
+
+    SandboxResult result{};
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+
+    rlimit supervisorLimit{};
+    ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &supervisorLimit), 0);
+    uint64_t soft = 0;
+    uint64_t hard = 0;
+    std::ifstream(output) >> soft >> hard;
+    EXPECT_EQ(soft, hard);
+    EXPECT_GT(hard, 0U);
+    EXPECT_LT(hard, supervisorLimit.rlim_cur);
+}
+
+TEST(SandboxTest, NamespacedRunsReuseWarmSets)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    SandboxConfigurationEx extension{};
+    extension.StructSize = sizeof(SandboxConfigurationEx);
+    extension.Version    = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.Namespaces = SANDBOX_NAMESPACE_USER | SANDBOX_NAMESPACE_MOUNT | SANDBOX_NAMESPACE_PID
+                           | SANDBOX_NAMESPACE_NET | SANDBOX_NAMESPACE_IPC;
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    if (StartSandboxEx(&configuration, &extension, &resultEx) != SANDBOX_STATUS_SUCCESS)
+        GTEST_SKIP() << "namespaces cannot be created here";
+    EXPECT_EQ(resultEx.Result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(resultEx.FromNamespacePool, 0U);
+
+    // The pool fills in the background after the first request for the combination.
+    bool pooled = false;
+    for (int run = 0; run < 20 && !pooled; ++run)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        resultEx            = {};
+        resultEx.StructSize = sizeof(SandboxResultEx);
+        ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+        result = resultEx.Result;
+        EXPECT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+        EXPECT_EQ(result.ExitCode, 0);
+        pooled = resultEx.FromNamespacePool != 0;
+    }
+    PrintResult(result);
+    EXPECT_TRUE(pooled);
+
+    extension.Namespaces = 1U << 31;
+    EXPECT_NE(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+}
+
+TEST(SandboxTest, ScratchDirectoryKeepsWritesOffTheDisk)
+{
+    const auto directory = std::filesystem::current_path() / "TestData" / "scratch";
+    std::filesystem::create_directories(directory);
+    std::filesystem::remove(directory / "note.txt");
+    std::ofstream(directory / "run.sh") << "echo scratch > note.txt\ncat note.txt\nls\n"
+                                           "head -c 2000000 /dev/zero > big || echo full\n";
+    const std::string workingDirectory = directory.string();
+
+    SandboxConfiguration configuration{};
+    configuration.TaskName         = "ScratchDirectory";
+    configuration.UserCommand      = "/bin/sh run.sh";
+    configuration.WorkingDirectory = workingDirectory.c_str();
+    configuration.OutputFile       = "output.txt";
+    configuration.MaxRealTime      = 3000;
+    configuration.MaxProcessCount  = -1;
+    configuration.Policy           = "default";
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize  = sizeof(SandboxConfigurationEx);
+    extension.Version     = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.ScratchSize = 1024 * 1024;
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    if (StartSandboxEx(&configuration, &extension, &resultEx) != SANDBOX_STATUS_SUCCESS)
+        GTEST_SKIP() << "a tmpfs cannot be mounted here";
+    PrintResult(resultEx.Result);
+    ASSERT_EQ(resultEx.Result.Status, SANDBOX_STATUS_SUCCESS);
+
+    // Only the script is kept from the real directory, the redirected output is written there.
+    std::stringstream output;
+    output << std::ifstream(directory / "output.txt").rdbuf();
+    EXPECT_EQ(output.str(), "scratch\nnote.txt\nrun.sh\nfull\n");
+    EXPECT_FALSE(std::filesystem::exists(directory / "note.txt"));
+    EXPECT_FALSE(std::filesystem::exists(directory / "big"));
+}
+
+TEST(SandboxTest, LowerPrioritiesAreScheduledBehind)
+{
+    const auto directory = std::filesystem::current_path() / "TestData";
+    const auto script    = directory / "priority.sh";
+    const auto output    = directory / "priority.out";
+    // Fields 19 and 41 of /proc/<pid>/stat are the nice value and the scheduling policy.
+    std::ofstream(script) << "cut -d' ' -f19,41 /proc/self/stat\n";
+    const std::string command    = "/bin/sh " + script.string();
+    const std::string outputFile = output.string();
+
+    SandboxConfiguration configuration{};
+    configuration.TaskName        = "Priority";
+    configuration.UserCommand     = command.c_str();
+    configuration.OutputFile      = outputFile.c_str();
+    configuration.MaxRealTime     = 3000;
+    configuration.MaxProcessCount = -1;
+    configuration.Policy          = "default";
+
+    const auto runAt = [&](uint32_t priority) {
+        SandboxConfigurationEx extension{};
+        extension.StructSize = sizeof(SandboxConfigurationEx);
+        extension.Version    = SANDBOX_CONFIGURATION_EX_VERSION;
+        extension.Priority   = priority;
+        SandboxResultEx resultEx{};
+        resultEx.StructSize = sizeof(SandboxResultEx);
+        EXPECT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+        EXPECT_EQ(resultEx.Result.Status, SANDBOX_STATUS_SUCCESS);
+        int nice   = 0;
+        int policy = -1;
+        std::ifstream(output) >> nice >> policy;
+        return std::pair{nice, policy};
+    };
+
+    const int supervisorNice = getpriority(PRIO_PROCESS, 0);
+    EXPECT_EQ(runAt(SANDBOX_PRIORITY_NORMAL), std::pair(supervisorNice, SCHED_OTHER));
+    EXPECT_EQ(runAt(SANDBOX_PRIORITY_LOW), std::pair(std::min(supervisorNice + 10, 19), SCHED_OTHER));
+    EXPECT_EQ(runAt(SANDBOX_PRIORITY_IDLE).second, SCHED_IDLE);
+}
+
+TEST(SandboxTest, MemoryBudgetQueuesRunsThatDoNotFit)
+{
+    SandboxConfiguration configuration{};
+    configuration.TaskName        = "MemoryBudget";
+    configuration.UserCommand     = "/bin/sleep 0.3";
+    configuration.MaxMemory       = 64 * 1024 * 1024;
+    configuration.MaxRealTime     = 3000;
+    configuration.MaxProcessCount = -1;
+    configuration.Policy          = "default";
+
+    // Each run commits twice MaxMemory, the budget leaves room for one of them at a time.
+    ASSERT_EQ(SetSandboxMemoryBudget(3 * configuration.MaxMemory), SANDBOX_STATUS_SUCCESS);
+    SandboxResultEx first{};
+    SandboxResultEx second{};
+    const auto run = [&configuration](SandboxResultEx *resultEx) {
+        SandboxConfigurationEx extension{};
+        extension.StructSize = sizeof(SandboxConfigurationEx);
+        extension.Version    = SANDBOX_CONFIGURATION_EX_VERSION;
+        resultEx->StructSize = sizeof(SandboxResultEx);
+        EXPECT_EQ(StartSandboxEx(&configuration, &extension, resultEx), SANDBOX_STATUS_SUCCESS);
+        EXPECT_EQ(resultEx->Result.Status, SANDBOX_STATUS_SUCCESS);
+    };
+    std::thread early(run, &first);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::thread late(run, &second);
+    early.join();
+    late.join();
+    SetSandboxMemoryBudget(0);
+
+    EXPECT_LT(first.MemoryAdmissionWaitNs, 100'000'000U);
+    EXPECT_GT(second.MemoryAdmissionWaitNs, 100'000'000U);
+    EXPECT_EQ(second.MemoryQueueDepth, 0U);
+}
+
+TEST(SandboxTest, MetricsCountRunsAndVerdicts)
+{
+    SandboxMetrics before{};
+    before.StructSize = sizeof(SandboxMetrics);
+    ASSERT_EQ(GetSandboxMetrics(&before), SANDBOX_STATUS_SUCCESS);
+
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+
+    SandboxMetrics after{};
+    after.StructSize = sizeof(SandboxMetrics);
+    ASSERT_EQ(GetSandboxMetrics(&after), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(after.Launches - before.Launches, 1U);
+    EXPECT_EQ(after.Verdicts[SANDBOX_STATUS_SUCCESS] - before.Verdicts[SANDBOX_STATUS_SUCCESS], 1U);
+    EXPECT_EQ(after.LaunchLatency.Count - before.LaunchLatency.Count, 1U);
+    EXPECT_EQ(after.RunTime.Count - before.RunTime.Count, 1U);
+    EXPECT_GE(after.PolicyCacheHits + after.PolicyFileLoads, before.PolicyCacheHits + before.PolicyFileLoads + 1);
+    EXPECT_EQ(after.ActiveRuns, 0);
+    EXPECT_LE(after.LaunchLatency.P50Ns, after.RunTime.MaxNs);
+}
+
+TEST(SandboxTest, ActivityBoardListsRunsInProgress)
+{
+    const std::string name = "sandbox-test-" + std::to_string(getpid());
+    ASSERT_EQ(PublishSandboxActivity(name.c_str()), SANDBOX_STATUS_SUCCESS);
+
+    SandboxConfiguration configuration{};
+    configuration.TaskName        = "ActivityBoard";
+    configuration.UserCommand     = "/bin/sleep 1";
+    configuration.MaxRealTime     = 3000;
+    configuration.MaxProcessCount = -1;
+    configuration.Policy          = "default";
+    std::thread run([&configuration] {
+        SandboxResult result{};
+        EXPECT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    });
+
+    // Without a memory limit the program is only sampled for the board, the first sample is taken at once.
+    SandboxActivity activity{};
+    uint32_t count = 0;
+    for (int attempt = 0; attempt < 100 && (count == 0 || activity.MemoryUsage == 0); ++attempt)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ASSERT_EQ(ReadSandboxActivity(name.c_str(), &activity, 1, &count), SANDBOX_STATUS_SUCCESS);
+    }
+    ASSERT_EQ(count, 1U);
+    EXPECT_STREQ(activity.TaskName, "ActivityBoard");
+    EXPECT_STREQ(activity.Policy, "default");
+    EXPECT_EQ(activity.Phase, SANDBOX_ACTIVITY_RUNNING);
+    EXPECT_GT(activity.Pid, 0);
+    EXPECT_EQ(activity.CpuCore, -1);
+    EXPECT_EQ(activity.MaxRealTime, 3000U);
+    EXPECT_GT(activity.ElapsedNs, 0U);
+    EXPECT_GT(activity.MemoryUsage, 0U);
+
+    run.join();
+    ASSERT_EQ(ReadSandboxActivity(name.c_str(), &activity, 1, &count), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(count, 0U);
+    ASSERT_EQ(PublishSandboxActivity(nullptr), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(ReadSandboxActivity(name.c_str(), &activity, 1, &count), SANDBOX_STATUS_INTERNAL_ERROR);
+}
+
+TEST(SandboxTest, RepeatedRunsReportStatistics)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    SandboxRepeatResult repeatResult{};
+    repeatResult.StructSize = sizeof(SandboxRepeatResult);
+    ASSERT_EQ(StartSandboxRepeated(&configuration, nullptr, 5, 1, &repeatResult), SANDBOX_STATUS_SUCCESS);
+
+    EXPECT_EQ(repeatResult.Version, SANDBOX_REPEAT_RESULT_VERSION);
+    EXPECT_EQ(repeatResult.RunCount, 5U);
+    EXPECT_EQ(repeatResult.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(repeatResult.StatusAgreement, 5U);
+    for (const auto &statistics : {repeatResult.CpuTimeUs, repeatResult.RealTimeUs, repeatResult.MemoryUsage})
+    {
+        EXPECT_LE(statistics.Min, statistics.Median);
+        EXPECT_LE(statistics.Median, statistics.P95);
+        EXPECT_LE(statistics.P95, statistics.Max);
+    }
+    EXPECT_GT(repeatResult.RealTimeUs.Min, 0.0);
+    EXPECT_GT(repeatResult.MemoryUsage.Min, 0.0);
+
+    // Interleaved over the cores, the runs still all count.
+    ASSERT_EQ(StartSandboxRepeated(&configuration, nullptr, 4, 2, &repeatResult), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(repeatResult.RunCount, 4U);
+
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(result.Status, repeatResult.Status);
 }
 
 TEST(SandboxTest, ExpectedKilledBySecomp)
@@ -223,6 +905,446 @@ TEST(SandboxTest, ExpectedStackOverflow)
     ASSERT_EQ(result.Signal, SIGSEGV);
 }
 
+TEST(SandboxTest, ProfilingGeneratesUsablePolicy)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    const std::string profileFile = (currentDirectory / "TestData" / "ExpectedAccepted.profile.json").string();
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize        = sizeof(SandboxConfigurationEx);
+    extension.Version           = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.ProfileOutputFile = profileFile.c_str();
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    PrintResult(resultEx.Result);
+    ASSERT_EQ(resultEx.Result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_GT(resultEx.ProfiledSyscallCount, 0U);
+    EXPECT_GT(resultEx.ProfiledDistinctSyscallCount, 0U);
+
+    std::ifstream input(profileFile);
+    const auto profile = nlohmann::json::parse(input);
+    const auto &whiteList = profile.at("Seccomp").at("WhiteList");
+    EXPECT_FALSE(whiteList.empty());
+    EXPECT_NE(std::find(whiteList.begin(), whiteList.end(), "exit_group"), whiteList.end());
+    EXPECT_EQ(std::find(whiteList.begin(), whiteList.end(), "execve"), whiteList.end());
+
+    EXPECT_EQ(profile.at("Seccomp").at("FilterLayout"), "Frequency");
+    EXPECT_FALSE(profile.at("Seccomp").at("FrequencyHints").empty());
+
+    uint64_t previousCount = UINT64_MAX;
+    for (const auto &entry : profile.at("Profile").at("Syscalls"))
+    {
+        EXPECT_LE(entry.at("Count").get<uint64_t>(), previousCount);
+        previousCount = entry.at("Count").get<uint64_t>();
+    }
+
+    // The generated policy must be enough to run the same program under enforcement.
+    configuration.Policy = profileFile.c_str();
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+}
+
+TEST(SandboxTest, PhaseTimelineIsOrderedAndTraced)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    const std::string traceFile = (currentDirectory / "TestData" / "ExpectedAccepted.trace.json").string();
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize = sizeof(SandboxConfigurationEx);
+    extension.Version    = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.TraceFile  = traceFile.c_str();
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+
+    const auto &timeline = resultEx.Timeline;
+    const std::vector<uint64_t> phases = {timeline.PrepareStart, timeline.ForkStart, timeline.ChildSetupStart,
+                                          timeline.ExecStart,    timeline.ExecDone,  timeline.Exit,
+                                          timeline.Reaped};
+    for (size_t i = 0; i < phases.size(); ++i)
+    {
+        EXPECT_NE(phases[i], 0U) << "phase " << i;
+        if (i > 0)
+        {
+            EXPECT_LE(phases[i - 1], phases[i]) << "phase " << i;
+        }
+    }
+    EXPECT_LE(timeline.ForkStart, timeline.ForkDone);
+    EXPECT_LE(timeline.ForkDone, timeline.Exit);
+    EXPECT_EQ(result.RealTimeUsage, (timeline.Exit - timeline.ExecStart) / 1000000);
+
+    std::ifstream input(traceFile);
+    const auto trace = nlohmann::json::parse(input);
+    std::vector<std::string> names;
+    for (const auto &event : trace.at("traceEvents"))
+    {
+        if (event.at("ph") == "X")
+            names.push_back(event.at("name").get<std::string>());
+    }
+    EXPECT_EQ(names, (std::vector<std::string>{"Prepare", "Fork", "Reap", "ChildSetup", "Exec", "Run"}));
+}
+
+TEST(SandboxTest, ResourceCountersAreReported)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, nullptr, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+
+    EXPECT_EQ(resultEx.Version, SANDBOX_RESULT_EX_VERSION);
+    EXPECT_EQ(result.CpuTimeUsage, resultEx.UserTimeUs / 1000);
+    EXPECT_GT(resultEx.MinorPageFaults, 0U);
+    EXPECT_EQ(resultEx.PeakMemorySource, SANDBOX_PEAK_MEMORY_SOURCE_RUSAGE);
+    EXPECT_EQ(resultEx.PeakMemoryUsage, result.MemoryUsage);
+
+    // The answer goes to the redirected output file.
+    ASSERT_EQ(resultEx.HasIoCounters, 1U);
+    EXPECT_GT(resultEx.WriteBytes, 0U);
+    EXPECT_GT(resultEx.ReadBytes, 0U);
+}
+
+TEST(SandboxTest, ResourceSamplesCoverTheWholeRun)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedCpuTimeout);
+
+    // Far fewer entries than ticks, so the buffer has to be decimated.
+    std::vector<SandboxSample> samples(16);
+    std::atomic<uint64_t> callbackCount{0};
+    SandboxConfigurationEx extension{};
+    extension.StructSize       = sizeof(SandboxConfigurationEx);
+    extension.Version          = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.SampleIntervalMs = 10;
+    extension.SampleCapacity   = static_cast<uint32_t>(samples.size());
+    extension.Samples          = samples.data();
+    extension.SampleUserData   = &callbackCount;
+    extension.SampleCallback   = [](const SandboxSample *, void *userData) {
+        static_cast<std::atomic<uint64_t> *>(userData)->fetch_add(1);
+    };
+
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_CPU_TIME_LIMIT_EXCEEDED);
+
+    ASSERT_GT(resultEx.SampleCount, 1U);
+    EXPECT_LE(resultEx.SampleCount, samples.size());
+    EXPECT_GT(resultEx.SampleStride, 1U);
+    EXPECT_GE(callbackCount.load(), static_cast<uint64_t>(resultEx.SampleCount - 1) * resultEx.SampleStride);
+
+    for (uint32_t i = 1; i < resultEx.SampleCount; ++i)
+    {
+        EXPECT_LT(samples[i - 1].Time, samples[i].Time) << "sample " << i;
+        EXPECT_LE(samples[i - 1].CpuTimeUs, samples[i].CpuTimeUs) << "sample " << i;
+    }
+    EXPECT_GE(samples[0].Time, resultEx.Timeline.ExecDone);
+    EXPECT_LE(samples[resultEx.SampleCount - 1].Time, resultEx.Timeline.Exit);
+    EXPECT_GT(samples[resultEx.SampleCount - 1].ResidentMemory, 0U);
+    // The program spins, so the last kept sample is well into the one second CPU limit.
+    EXPECT_GT(samples[resultEx.SampleCount - 1].CpuTimeUs, 300000U);
+}
+
+// CXX_PROGRAM with only the filter layout changed, written next to the test data.
+std::string WriteCxxProgramLayoutVariant(const std::filesystem::path &directory, std::string_view layout)
+{
+    const auto *builtin = SandboxPolicyEngine::TryResolvePolicy("CXX_PROGRAM");
+    const nlohmann::json policy = {
+        {"Version", "1.0"},
+        {"Seccomp",
+         {
+             {"WhiteList", builtin->AllowedSyscalls},
+             {"RestrictExecveToProgramPath", builtin->RestrictExecveToProgramPath},
+             {"AllowIO", builtin->AllowIO},
+             {"FilterLayout", layout},
+         }},
+    };
+
+    const auto path = directory / "TestData" / ("CXX_PROGRAM_" + std::string(layout) + ".json");
+    std::ofstream(path) << policy.dump(4);
+    return path.string();
+}
+
+TEST(SandboxTest, BinaryTreeFilterLayoutAllowsWhiteList)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    const auto policyFile = WriteCxxProgramLayoutVariant(currentDirectory, "BinaryTree");
+    configuration.Policy  = policyFile.c_str();
+
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+}
+
+TEST(SandboxTest, BinaryTreeFilterLayoutKillsOtherSyscalls)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedKilledBySecomp);
+    const auto policyFile = WriteCxxProgramLayoutVariant(currentDirectory, "BinaryTree");
+    configuration.Policy  = policyFile.c_str();
+
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_ILLEGAL_OPERATION);
+}
+
+TEST(SandboxTest, CachedRunMissesAfterPolicyFileChanges)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedAccepted);
+    const auto cacheFile = std::filesystem::temp_directory_path() / ("sandbox-policy-cache-" + std::to_string(getpid()));
+    const std::string cacheFileName = cacheFile.string();
+    SandboxConfigurationEx extension{};
+    extension.StructSize      = sizeof(SandboxConfigurationEx);
+    extension.Version         = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.ResultCacheFile = cacheFileName.c_str();
+
+    // A bare name that is not built in loads "<name>.json" from the current directory.
+    const auto policyFile = std::filesystem::current_path() / "CACHED_POLICY.json";
+    std::filesystem::copy_file(WriteCxxProgramLayoutVariant(currentDirectory, "Linear"), policyFile,
+                               std::filesystem::copy_options::overwrite_existing);
+    configuration.Policy = "CACHED_POLICY";
+
+    SandboxResultEx run{};
+    run.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &run), SANDBOX_STATUS_SUCCESS);
+    ASSERT_EQ(run.Result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(run.FromResultCache, 0U);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &run), SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(run.FromResultCache, 1U);
+
+    std::filesystem::copy_file(WriteCxxProgramLayoutVariant(currentDirectory, "BinaryTree"), policyFile,
+                               std::filesystem::copy_options::overwrite_existing);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &run), SANDBOX_STATUS_SUCCESS);
+    result = run.Result;
+    PrintResult(result);
+    EXPECT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(run.FromResultCache, 0U);
+
+    std::filesystem::remove(policyFile);
+    std::filesystem::remove(cacheFile);
+    std::filesystem::remove_all(cacheFileName + ".blobs");
+}
+
+// CXX_PROGRAM allowed to open files, confined to the system directories and the given rules.
+std::string WritePathAccessPolicy(const std::filesystem::path &directory, nlohmann::json rules)
+{
+    const auto *builtin = SandboxPolicyEngine::TryResolvePolicy("CXX_PROGRAM");
+    auto syscalls       = builtin->AllowedSyscalls;
+    syscalls.push_back(SCMP_SYS(openat));
+    for (const auto *systemPath : {"/usr", "/lib", "/lib64", "/etc"})
+        rules.push_back({{"PathPrefix", systemPath}, {"Mode", "ReadOnly"}});
+
+    const nlohmann::json policy = {
+        {"Version", "1.0"},
+        {"Seccomp", {{"WhiteList", syscalls}, {"RestrictExecveToProgramPath", true}}},
+        {"PathAccessRules", rules},
+    };
+    const auto path = directory / "TestData" / ("CXX_PROGRAM_paths_" + std::to_string(rules.size()) + ".json");
+    std::ofstream(path) << policy.dump(4);
+    return path.string();
+}
+
+TEST(SandboxTest, PathAccessRulesDenyOtherPaths)
+{
+    if (GetLandlockAbiVersion() == 0)
+        GTEST_SKIP() << "Landlock is not available";
+
+    INIT_SANDBOX_TESTCASE(ExpectedPathAccess);
+    const std::string command = executable + " " + inputFile;
+    const auto policyFile     = WritePathAccessPolicy(currentDirectory, nlohmann::json::array());
+    configuration.UserCommand = command.c_str();
+    configuration.Policy      = policyFile.c_str();
+
+    // The input file itself is opened before the rules apply, only opening it again is denied.
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_RUNTIME_ERROR);
+    EXPECT_EQ(result.ExitCode, 1);
+}
+
+TEST(SandboxTest, PathAccessRulesAllowGrantedPaths)
+{
+    if (GetLandlockAbiVersion() == 0)
+        GTEST_SKIP() << "Landlock is not available";
+
+    INIT_SANDBOX_TESTCASE(ExpectedPathAccess);
+    const std::string command = executable + " " + inputFile;
+    const auto policyFile     = WritePathAccessPolicy(
+        currentDirectory, {{{"PathPrefix", (currentDirectory / "TestData").string()}, {"Mode", "ReadOnly"}}});
+    configuration.UserCommand = command.c_str();
+    configuration.Policy      = policyFile.c_str();
+
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+}
+
+std::string WriteSupervisedPolicy(const std::filesystem::path &directory, nlohmann::json openRules,
+                                  const nlohmann::json &execvePaths, const std::vector<int> &extraSyscalls = {})
+{
+    const auto *builtin = SandboxPolicyEngine::TryResolvePolicy("CXX_PROGRAM");
+    for (const auto *systemPath : {"/usr", "/lib", "/lib64", "/etc"})
+        openRules.push_back({{"PathPrefix", systemPath}, {"Mode", "ReadOnly"}});
+    auto syscalls = builtin->AllowedSyscalls;
+    syscalls.insert(syscalls.end(), extraSyscalls.begin(), extraSyscalls.end());
+
+    const nlohmann::json policy = {
+        {"Version", "1.0"},
+        {"Seccomp",
+         {{"WhiteList", syscalls},
+          {"RestrictExecveToProgramPath", true},
+          {"Supervisor", {{"OpenPathRules", openRules}, {"ExecvePaths", execvePaths}}}}},
+    };
+    const auto path = directory / "TestData"
+                      / ("CXX_PROGRAM_supervised_" + std::to_string(openRules.size()) + "_"
+                         + std::to_string(extraSyscalls.size()) + ".json");
+    std::ofstream(path) << policy.dump(4);
+    return path.string();
+}
+
+TEST(SandboxTest, SupervisorDeniesUncoveredOpen)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedPathAccess);
+    const std::string command = executable + " " + inputFile;
+    const auto policyFile     = WriteSupervisedPolicy(currentDirectory, nlohmann::json::array(), nlohmann::json::array());
+    configuration.UserCommand = command.c_str();
+    configuration.Policy      = policyFile.c_str();
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize = sizeof(SandboxConfigurationEx);
+    extension.Version    = SANDBOX_CONFIGURATION_EX_VERSION;
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_RUNTIME_ERROR);
+    EXPECT_EQ(result.ExitCode, 1);
+    // The loader opens its libraries through the supervisor as well.
+    EXPECT_GT(resultEx.SupervisedSyscallCount, 1U);
+    EXPECT_EQ(resultEx.SupervisedSyscallDenials, 1U);
+    EXPECT_GE(resultEx.SupervisorTimeNs, resultEx.SupervisorMaxTimeNs);
+    EXPECT_GT(resultEx.SupervisorMaxTimeNs, 0U);
+}
+
+TEST(SandboxTest, SupervisorAllowsCoveredOpenAndProgramExecve)
+{
+    INIT_SANDBOX_TESTCASE(ExpectedPathAccess);
+    const std::string command = executable + " " + inputFile;
+    const auto policyFile     = WriteSupervisedPolicy(
+        currentDirectory, {{{"PathPrefix", (currentDirectory / "TestData").string()}, {"Mode", "ReadOnly"}}},
+        nlohmann::json::array({"/bin/true"}));
+    configuration.UserCommand = command.c_str();
+    configuration.Policy      = policyFile.c_str();
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize = sizeof(SandboxConfigurationEx);
+    extension.Version    = SANDBOX_CONFIGURATION_EX_VERSION;
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_GT(resultEx.SupervisedSyscallCount, 1U);
+    EXPECT_EQ(resultEx.SupervisedSyscallDenials, 0U);
+}
+
+TEST(SandboxTest, SupervisorOpensFifosWithoutWaiting)
+{
+    // The supervisor thread opens files for every sandbox, a FIFO without a writer must not stall it.
+    INIT_SANDBOX_TESTCASE(ExpectedPathAccess);
+    const auto fifo = currentDirectory / "TestData" / "supervised.fifo";
+    std::filesystem::remove(fifo);
+    ASSERT_EQ(mkfifo(fifo.c_str(), 0600), 0);
+    const std::string command = executable + " " + fifo.string();
+    const auto policyFile     = WriteSupervisedPolicy(
+        currentDirectory, {{{"PathPrefix", (currentDirectory / "TestData").string()}, {"Mode", "ReadOnly"}}},
+        nlohmann::json::array());
+    configuration.UserCommand = command.c_str();
+    configuration.Policy      = policyFile.c_str();
+
+    ASSERT_EQ(StartSandbox(&configuration, &result), SANDBOX_STATUS_SUCCESS);
+    PrintResult(result);
+    std::filesystem::remove(fifo);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_LT(result.RealTimeUsage, 1000U);
+}
+
+TEST(SandboxTest, SupervisorResolvesPathsInTheProgramsMountNamespace)
+{
+    // The file is on the disk, but hidden from the program by the scratch directory. The path reaches it
+    // through a symlink outside the working directory, so it is not one of the files kept there.
+    INIT_SANDBOX_TESTCASE(ExpectedPathAccess);
+    const auto directory = currentDirectory / "TestData" / "scratch-supervised";
+    const auto link      = currentDirectory / "TestData" / "scratch-supervised-link";
+    std::filesystem::create_directories(directory);
+    std::ofstream(directory / "hidden.txt") << "disk\n";
+    std::filesystem::remove(link);
+    std::filesystem::create_directory_symlink("scratch-supervised", link);
+    const std::string command          = executable + " " + (link / "hidden.txt").string();
+    const std::string workingDirectory = directory.string();
+    const auto policyFile              = WriteSupervisedPolicy(
+        currentDirectory, {{{"PathPrefix", (currentDirectory / "TestData").string()}, {"Mode", "ReadOnly"}}},
+        nlohmann::json::array());
+    configuration.UserCommand      = command.c_str();
+    configuration.WorkingDirectory = workingDirectory.c_str();
+    configuration.Policy           = policyFile.c_str();
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize  = sizeof(SandboxConfigurationEx);
+    extension.Version     = SANDBOX_CONFIGURATION_EX_VERSION;
+    extension.ScratchSize = 1024 * 1024;
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    if (StartSandboxEx(&configuration, &extension, &resultEx) != SANDBOX_STATUS_SUCCESS)
+        GTEST_SKIP() << "a tmpfs cannot be mounted here";
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_RUNTIME_ERROR);
+    EXPECT_EQ(result.ExitCode, 1);
+    EXPECT_EQ(resultEx.SupervisedSyscallDenials, 0U);
+
+    // Without the scratch directory the same path reaches the file.
+    extension.ScratchSize = 0;
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    PrintResult(resultEx.Result);
+    EXPECT_EQ(resultEx.Result.Status, SANDBOX_STATUS_SUCCESS);
+}
+
+TEST(SandboxTest, SupervisorDeniesSharedMemoryUnderExecvePaths)
+{
+    // Another process sharing its memory could rewrite the path of an execve after the check.
+    INIT_SANDBOX_TESTCASE(ExpectedSharedMemoryDenied);
+    const auto policyFile = WriteSupervisedPolicy(
+        currentDirectory, nlohmann::json::array(), nlohmann::json::array({"/bin/true"}),
+        {SCMP_SYS(vfork), SCMP_SYS(clone), SCMP_SYS(wait4), SCMP_SYS(exit)});
+    configuration.Policy          = policyFile.c_str();
+    configuration.MaxProcessCount = -1;
+
+    SandboxConfigurationEx extension{};
+    extension.StructSize = sizeof(SandboxConfigurationEx);
+    extension.Version    = SANDBOX_CONFIGURATION_EX_VERSION;
+    SandboxResultEx resultEx{};
+    resultEx.StructSize = sizeof(SandboxResultEx);
+    ASSERT_EQ(StartSandboxEx(&configuration, &extension, &resultEx), SANDBOX_STATUS_SUCCESS);
+    result = resultEx.Result;
+    PrintResult(result);
+    ASSERT_EQ(result.Status, SANDBOX_STATUS_SUCCESS);
+    EXPECT_EQ(result.ExitCode, 0);
+    EXPECT_EQ(resultEx.SupervisedSyscallDenials, 2U);
+}
+
 int main(int argc, char **argv)
 {
     const char *const argv0 = (argc > 0 && argv != nullptr) ? argv[0] : nullptr;
@@ -0,0 +1,88 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/Linux/SpoolQueue.h"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+
+std::filesystem::path MakeSpoolDirectory(const std::string &name)
+{
+    const auto directory = std::filesystem::temp_directory_path() / (name + "-" + std::to_string(getpid()));
+    std::filesystem::remove_all(directory);
+    return directory;
+}
+
+} // namespace
+
+TEST(SpoolQueueTest, RunnersClaimEachJobOnce)
+{
+    const auto directory = MakeSpoolDirectory("spool-queue-test");
+    const SpoolQueue submitter(directory, std::chrono::seconds(10));
+    constexpr int jobCount = 40;
+    for (int i = 0; i < jobCount; ++i)
+        ASSERT_TRUE(submitter.Submit("job" + std::to_string(100 + i) + ".json", std::to_string(i)));
+
+    // Each runner has a queue of its own, as separate processes would.
+    std::atomic<int> processed = 0;
+    std::vector<std::thread> runners;
+    for (int runner = 0; runner < 4; ++runner)
+    {
+        runners.emplace_back([&] {
+            const SpoolQueue queue(directory, std::chrono::seconds(10));
+            while (queue.Process([](const std::string &contents) { return "result " + contents; }))
+                ++processed;
+        });
+    }
+    for (auto &runner : runners)
+        runner.join();
+
+    EXPECT_EQ(processed, jobCount);
+    EXPECT_TRUE(std::filesystem::is_empty(directory / "pending"));
+    EXPECT_TRUE(std::filesystem::is_empty(directory / "running"));
+    for (int i = 0; i < jobCount; ++i)
+    {
+        const std::string stem = "job" + std::to_string(100 + i);
+        EXPECT_TRUE(std::filesystem::exists(directory / "done" / (stem + ".json")));
+        std::string result;
+        std::getline(std::ifstream(directory / "done" / (stem + ".result.json")), result);
+        EXPECT_EQ(result, "result " + std::to_string(i));
+    }
+    std::filesystem::remove_all(directory);
+}
+
+TEST(SpoolQueueTest, ExpiredLeasesAreReclaimed)
+{
+    const auto directory = MakeSpoolDirectory("spool-queue-reclaim-test");
+    const SpoolQueue crashed(directory, std::chrono::milliseconds(50));
+    const SpoolQueue survivor(directory, std::chrono::seconds(10));
+    ASSERT_TRUE(crashed.Submit("job.json", "payload"));
+
+    // The first runner claims the job and stops renewing its lease, as if it had crashed.
+    const auto lost = crashed.Claim();
+    ASSERT_TRUE(lost.has_value());
+    EXPECT_EQ(lost->Contents, "payload");
+    EXPECT_EQ(survivor.ReclaimExpired(), 0U);
+    EXPECT_FALSE(survivor.Claim().has_value());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(survivor.ReclaimExpired(), 1U);
+    const auto reclaimed = survivor.Claim();
+    ASSERT_TRUE(reclaimed.has_value());
+    EXPECT_EQ(reclaimed->Name, "job.json");
+
+    // The late runner finds its lease gone and does not overwrite the result.
+    EXPECT_FALSE(crashed.Complete(*lost, "stale"));
+    EXPECT_TRUE(survivor.Complete(*reclaimed, "fresh"));
+    std::string result;
+    std::getline(std::ifstream(directory / "done" / "job.result.json"), result);
+    EXPECT_EQ(result, "fresh");
+    std::filesystem::remove_all(directory);
+}
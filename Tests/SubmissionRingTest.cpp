@@ -0,0 +1,104 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/Linux/SubmissionRing.h"
+
+#include <set>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+std::string MakeRingName(const std::string &name)
+{
+    return name + "-" + std::to_string(getpid());
+}
+
+// Completes every submission with its ConfigId as the exit code, as the runner would after a run.
+std::thread StartEchoRunner(SubmissionRing &runner)
+{
+    return std::thread([&runner] {
+        SandboxRingSubmission submission{};
+        while (runner.Take(submission))
+        {
+            SandboxRingCompletion completion{};
+            completion.UserData        = submission.UserData;
+            completion.Result.ExitCode = static_cast<int>(submission.ConfigId);
+            if (!runner.Complete(completion))
+                return;
+        }
+    });
+}
+
+} // namespace
+
+TEST(SubmissionRingTest, CompletesEverySubmissionOnce)
+{
+    const auto runner = SubmissionRing::Create(MakeRingName("ring-test"));
+    ASSERT_NE(runner, nullptr);
+    const auto client = SubmissionRing::Open(MakeRingName("ring-test"));
+    ASSERT_NE(client, nullptr);
+    std::thread echo = StartEchoRunner(*runner);
+
+    // Several times what either queue holds, so both the client and the runner run into a full queue.
+    constexpr uint32_t runCount = 10000;
+    std::vector<SandboxRingSubmission> submissions(runCount);
+    for (uint32_t i = 0; i < runCount; ++i)
+        submissions[i] = {.UserData = i, .ConfigId = i % 7, .InputId = SANDBOX_RING_NO_FILE,
+                          .OutputId = SANDBOX_RING_NO_FILE, .Reserved = 0};
+
+    std::set<uint64_t> completed;
+    uint32_t submitted = 0;
+    SandboxRingCompletion completions[64];
+    while (completed.size() < runCount)
+    {
+        submitted += client->Submit(submissions.data() + submitted, runCount - submitted);
+        const uint32_t reaped = client->Reap(completions, 64, std::chrono::milliseconds(1000));
+        ASSERT_NE(reaped, 0U);
+        for (uint32_t i = 0; i < reaped; ++i)
+        {
+            EXPECT_TRUE(completed.insert(completions[i].UserData).second);
+            EXPECT_EQ(completions[i].Result.ExitCode, static_cast<int>(completions[i].UserData % 7));
+        }
+    }
+    EXPECT_EQ(client->Reap(completions, 64, std::chrono::milliseconds(0)), 0U);
+
+    runner->Stop();
+    echo.join();
+}
+
+TEST(SubmissionRingTest, RegisteringASlotAgainChangesItsGeneration)
+{
+    const auto runner = SubmissionRing::Create(MakeRingName("ring-slot-test"));
+    ASSERT_NE(runner, nullptr);
+    const auto client = SubmissionRing::Open(MakeRingName("ring-slot-test"));
+    ASSERT_NE(client, nullptr);
+
+    EXPECT_FALSE(runner->ReadConfig(3).has_value());
+    ASSERT_TRUE(client->RegisterConfig(3, R"(["/bin/true"])"));
+    const auto first = runner->ReadConfig(3);
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->second, R"(["/bin/true"])");
+
+    ASSERT_TRUE(client->RegisterConfig(3, R"(["/bin/false"])"));
+    const auto second = runner->ReadConfig(3);
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(second->second, R"(["/bin/false"])");
+    EXPECT_NE(second->first, first->first);
+
+    ASSERT_TRUE(client->RegisterFile(0, "/tmp/input.txt"));
+    EXPECT_EQ(runner->ReadFile(0), "/tmp/input.txt");
+    EXPECT_FALSE(client->RegisterConfig(SANDBOX_RING_CONFIG_SLOTS, "[]"));
+    EXPECT_FALSE(client->RegisterFile(1, std::string(8192, 'a')));
+}
+
+TEST(SubmissionRingTest, OpenFailsWithoutARunner)
+{
+    EXPECT_EQ(SubmissionRing::Open(MakeRingName("ring-missing-test")), nullptr);
+
+    // The runner removes its ring when it goes away.
+    SubmissionRing::Create(MakeRingName("ring-closed-test"));
+    EXPECT_EQ(SubmissionRing::Open(MakeRingName("ring-closed-test")), nullptr);
+}
@@ -0,0 +1,26 @@
+#include "SandboxTest.h"
+
+#include "../SandboxRunnerCore/Linux/TimingCalibration.h"
+
+#include <iostream>
+
+TEST(TimingCalibrationTest, CalibrationMeasuresThisNode)
+{
+    double speedFactor = 0;
+    double timingNoise = -1;
+    ASSERT_EQ(CalibrateSandboxTiming(&speedFactor, &timingNoise), SANDBOX_STATUS_SUCCESS);
+    std::cout << "Speed factor " << speedFactor << ", noise " << timingNoise << std::endl;
+    EXPECT_GT(speedFactor, 0.0);
+    EXPECT_GE(timingNoise, 0.0);
+    EXPECT_GT(RunReferenceWorkload(), 0U);
+}
+
+TEST(TimingCalibrationTest, OnlyNearLimitVerdictsAreUncertain)
+{
+    // 2% noise: anything within 6% of the limit could have gone either way.
+    EXPECT_EQ(AssessTimingConfidence(960, 1000, 0.02), SANDBOX_TIMING_CONFIDENCE_LOW);
+    EXPECT_EQ(AssessTimingConfidence(1040, 1000, 0.02), SANDBOX_TIMING_CONFIDENCE_LOW);
+    EXPECT_EQ(AssessTimingConfidence(900, 1000, 0.02), SANDBOX_TIMING_CONFIDENCE_HIGH);
+    EXPECT_EQ(AssessTimingConfidence(960, 1000, 0.001), SANDBOX_TIMING_CONFIDENCE_HIGH);
+    EXPECT_EQ(AssessTimingConfidence(960, 0, 0.02), SANDBOX_TIMING_CONFIDENCE_HIGH);
+}
@@ -0,0 +1,251 @@
+# -*- coding: utf-8 -*-
+
+# File: generate_builtin_policies.py
+# Usage: generate_builtin_policies.py OutputFile PolicyFile [PolicyFile...]
+# Translate the JSON policies under policies/ into constexpr syscall tables that are compiled
+# into libsandbox. Syscall names are emitted as SCMP_SYS(name) so the compiler resolves them
+# against the libseccomp headers of the target, and unknown names fail the build instead of
+# failing at runtime.
+# This script is used in SandboxRunnerCore/CMakeLists.txt.
+
+import hashlib
+import json
+import os
+import posixpath
+import re
+import sys
+
+SCMP_MACRO = re.compile(r"^SCMP_SYS\((\w+)\)$")
+SYSCALL_NAME = re.compile(r"^\w+$")
+CLONE_FLAG = re.compile(r"^CLONE_[A-Z_]+$")
+FILTER_LAYOUTS = ("Linear", "BinaryTree", "Frequency")
+# Ordered by what they grant, as the runtime loader compares them.
+PATH_ACCESS_MODES = ("NoAccess", "ReadOnly", "ReadWrite")
+
+
+def fail(policy_file, message):
+    print(f"{policy_file}: {message}", file=sys.stderr)
+    sys.exit(1)
+
+
+def read_bool(policy_file, seccomp, key, default):
+    value = seccomp.get(key, default)
+    if not isinstance(value, bool):
+        fail(policy_file, f"Seccomp.{key} must be a boolean")
+    return value
+
+
+def translate_syscall(policy_file, node):
+    # bool is a subclass of int in Python, reject it explicitly.
+    if isinstance(node, int) and not isinstance(node, bool):
+        return str(node)
+    if not isinstance(node, str):
+        fail(policy_file, f"invalid WhiteList entry: {node!r}")
+
+    name = node.strip()
+    macro = SCMP_MACRO.match(name)
+    if macro:
+        name = macro.group(1)
+    if not SYSCALL_NAME.match(name):
+        fail(policy_file, f"invalid syscall name: {node!r}")
+    return f"SCMP_SYS({name})"
+
+
+def read_layout(policy_file, seccomp, hints):
+    # Frequency hints without an explicit layout imply the Frequency layout, like the runtime loader.
+    layout = seccomp.get("FilterLayout", "Frequency" if hints else "Linear")
+    if layout not in FILTER_LAYOUTS:
+        fail(policy_file, f"Seccomp.FilterLayout must be one of {', '.join(FILTER_LAYOUTS)}")
+    return layout
+
+
+def read_hints(policy_file, seccomp):
+    hints = seccomp.get("FrequencyHints", [])
+    if not isinstance(hints, list):
+        fail(policy_file, "Seccomp.FrequencyHints must be an array")
+    return [translate_syscall(policy_file, node) for node in hints]
+
+
+def is_below_prefix(path, prefix):
+    return prefix == "/" or path == prefix or path.startswith(prefix + "/")
+
+
+def parse_path_rules(policy_file, key, rules):
+    if not isinstance(rules, list):
+        fail(policy_file, f"{key} must be an array")
+
+    result = []
+    for rule in rules:
+        if not isinstance(rule, dict):
+            fail(policy_file, f"invalid {key} entry: {rule!r}")
+        prefix = rule.get("PathPrefix")
+        mode = rule.get("Mode")
+        mode = mode.strip() if isinstance(mode, str) else mode
+        if not isinstance(prefix, str) or not posixpath.isabs(prefix):
+            fail(policy_file, f"PathPrefix must be an absolute path: {rule!r}")
+        if mode not in PATH_ACCESS_MODES:
+            fail(policy_file, f"Mode must be one of {', '.join(PATH_ACCESS_MODES)}: {rule!r}")
+        # normpath keeps a leading "//", the runtime loader does not.
+        result.append({"prefix": "/" + posixpath.normpath(prefix).lstrip("/"), "mode": mode})
+    return result
+
+
+def read_path_rules(policy_file, root):
+    result = parse_path_rules(policy_file, "PathAccessRules", root.get("PathAccessRules", []))
+
+    # Landlock only adds up what rules grant, a nested rule cannot take back access its parent gives.
+    for outer in result:
+        for inner in result:
+            if (inner is not outer and is_below_prefix(inner["prefix"], outer["prefix"])
+                    and PATH_ACCESS_MODES.index(inner["mode"]) < PATH_ACCESS_MODES.index(outer["mode"])):
+                fail(policy_file, f"{inner['prefix']} cannot be narrowed below {outer['prefix']}")
+    return result
+
+
+def read_supervisor(policy_file, seccomp):
+    supervisor = seccomp.get("Supervisor", {})
+    if not isinstance(supervisor, dict):
+        fail(policy_file, "Seccomp.Supervisor must be an object")
+
+    # The supervisor picks the longest matching prefix, so nested rules need no check here.
+    open_rules = parse_path_rules(policy_file, "Seccomp.Supervisor.OpenPathRules",
+                                  supervisor.get("OpenPathRules", []))
+
+    execve_paths = supervisor.get("ExecvePaths", [])
+    if not isinstance(execve_paths, list) or not all(
+            isinstance(path, str) and posixpath.isabs(path) for path in execve_paths):
+        fail(policy_file, "Seccomp.Supervisor.ExecvePaths must be an array of absolute paths")
+
+    clone_flags = supervisor.get("CloneFlags")
+    if clone_flags is not None:
+        if not isinstance(clone_flags, list):
+            fail(policy_file, "Seccomp.Supervisor.CloneFlags must be an array")
+        for flag in clone_flags:
+            valid_number = isinstance(flag, int) and not isinstance(flag, bool) and flag >= 0
+            if not valid_number and not (isinstance(flag, str) and CLONE_FLAG.match(flag.strip())):
+                fail(policy_file, f"invalid clone flag: {flag!r}")
+        # Names stay macros, so the compiler checks them against <sched.h>.
+        clone_flags = " | ".join(str(flag).strip() for flag in clone_flags) or "0"
+
+    return {"open_rules": open_rules, "execve_paths": execve_paths, "clone_flags": clone_flags}
+
+
+def load_policy(policy_file):
+    with open(policy_file, "r", encoding="utf-8-sig") as f:
+        root = json.load(f)
+
+    if not isinstance(root, dict) or root.get("Version") != "1.0":
+        fail(policy_file, "Version must be \"1.0\"")
+
+    seccomp = root.get("Seccomp")
+    if not isinstance(seccomp, dict) or not isinstance(seccomp.get("WhiteList"), list):
+        fail(policy_file, "Seccomp.WhiteList must be an array")
+
+    hints = read_hints(policy_file, seccomp)
+    return {
+        "name": os.path.splitext(os.path.basename(policy_file))[0],
+        "hints": hints,
+        "layout": read_layout(policy_file, seccomp, hints),
+        "syscalls": [translate_syscall(policy_file, node) for node in seccomp["WhiteList"]],
+        "restrict_execve": read_bool(policy_file, seccomp, "RestrictExecveToProgramPath", False),
+        "allow_io": read_bool(policy_file, seccomp, "AllowIO", True),
+        "path_rules": read_path_rules(policy_file, root),
+        "supervisor": read_supervisor(policy_file, seccomp),
+    }
+
+
+def to_identifier(name):
+    return re.sub(r"\W", "_", name)
+
+
+def render_path_rules(lines, table, rules):
+    if not rules:
+        return
+    lines.append(f"constexpr BuiltinPathAccessRule {table}[] = {{")
+    lines.extend(f"    {{{json.dumps(rule['prefix'])}, PathAccessMode::{rule['mode']}}}," for rule in rules)
+    lines.append("};")
+    lines.append("")
+
+
+def render(policies):
+    lines = [
+        "// Generated by scripts/generate_builtin_policies.py from policies/*.json -- do not edit.",
+        "",
+    ]
+
+    for policy in policies:
+        lines.append(f"constexpr int kBuiltinPolicy_{to_identifier(policy['name'])}_Syscalls[] = {{")
+        lines.extend(f"    {syscall}," for syscall in policy["syscalls"])
+        lines.append("};")
+        lines.append("")
+        if policy["hints"]:
+            lines.append(f"constexpr int kBuiltinPolicy_{to_identifier(policy['name'])}_Hints[] = {{")
+            lines.extend(f"    {syscall}," for syscall in policy["hints"])
+            lines.append("};")
+            lines.append("")
+        identifier = to_identifier(policy["name"])
+        render_path_rules(lines, f"kBuiltinPolicy_{identifier}_PathRules", policy["path_rules"])
+        render_path_rules(lines, f"kBuiltinPolicy_{identifier}_OpenPathRules", policy["supervisor"]["open_rules"])
+        if policy["supervisor"]["execve_paths"]:
+            lines.append(f"constexpr std::string_view kBuiltinPolicy_{identifier}_ExecvePaths[] = {{")
+            lines.extend(f"    {json.dumps(path)}," for path in policy["supervisor"]["execve_paths"])
+            lines.append("};")
+            lines.append("")
+
+    if not policies:
+        lines.append("constexpr std::span<const BuiltinPolicy> kBuiltinPolicies{};")
+        return "\n".join(lines) + "\n"
+
+    lines.append("constexpr BuiltinPolicy kBuiltinPolicyTable[] = {")
+    for policy in policies:
+        hints = f"kBuiltinPolicy_{to_identifier(policy['name'])}_Hints" if policy["hints"] else "{}"
+        path_rules = f"kBuiltinPolicy_{to_identifier(policy['name'])}_PathRules" if policy["path_rules"] else "{}"
+        supervisor = policy["supervisor"]
+        open_rules = f"kBuiltinPolicy_{to_identifier(policy['name'])}_OpenPathRules" if supervisor["open_rules"] else "{}"
+        execve_paths = f"kBuiltinPolicy_{to_identifier(policy['name'])}_ExecvePaths" if supervisor["execve_paths"] else "{}"
+        lines.extend([
+            "    {",
+            f"        .Name = \"{policy['name']}\",",
+            f"        .AllowedSyscalls = kBuiltinPolicy_{to_identifier(policy['name'])}_Syscalls,",
+            f"        .FrequencyHints = {hints},",
+            f"        .PathAccessRules = {path_rules},",
+            f"        .SupervisorOpenPathRules = {open_rules},",
+            f"        .SupervisorExecvePaths = {execve_paths},",
+            f"        .SupervisorCloneFlags = {supervisor['clone_flags'] or '0'},",
+            f"        .SuperviseClone = {str(supervisor['clone_flags'] is not None).lower()},",
+            f"        .Layout = FilterLayout::{policy['layout']},",
+            f"        .RestrictExecveToProgramPath = {str(policy['restrict_execve']).lower()},",
+            f"        .AllowIO = {str(policy['allow_io']).lower()},",
+            "    },",
+        ])
+    lines.append("};")
+    lines.append("")
+    lines.append("constexpr std::span<const BuiltinPolicy> kBuiltinPolicies{kBuiltinPolicyTable};")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: generate_builtin_policies.py OutputFile PolicyFile [PolicyFile...]")
+        sys.exit(1)
+
+    output_file = sys.argv[1]
+    policies = sorted((load_policy(f) for f in sys.argv[2:]), key=lambda p: p["name"])
+
+    names = [policy["name"] for policy in policies]
+    if len(names) != len(set(names)):
+        print("Duplicate built-in policy names", file=sys.stderr)
+        sys.exit(1)
+
+    content = render(policies)
+    # Lets the result cache tell apart runs under different builds of the same policy names.
+    digest = hashlib.sha256(content.encode("utf-8")).hexdigest()
+    content += f"\nconstexpr std::string_view kBuiltinPoliciesDigest = \"{digest}\";\n"
+    os.makedirs(os.path.dirname(os.path.abspath(output_file)), exist_ok=True)
+
+    with open(output_file, "w", encoding="utf-8") as f:
+        f.write(content)
+
+
+if __name__ == "__main__":
+    main()